@@ -29,6 +29,8 @@
  *  pradeep.subedi@rutgers.edu
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include "vector.h"
 
 typedef void WrapperMap;
@@ -37,14 +39,22 @@ typedef void WrapperMap;
 extern "C" {
 #endif
 	WrapperMap * map_new();
-	void map_subscribe( const WrapperMap *t, const char *names, const char *topic, const char *subscriber_addr);
-	vector map_get_value(const WrapperMap *t, const char *names, const char *topic);
+	void map_subscribe( const WrapperMap *t, const char *names, const char *topic, uint32_t subscriber_id);
+	size_t map_get_value(const WrapperMap *t, const char *names, const char *topic, uint32_t *ids, size_t max);
+	size_t map_get_value_seq(const WrapperMap *t, const char *names, const char *topic, uint32_t *ids, size_t max, uint64_t *seq);
 	vector map_get_topics(const WrapperMap *t);
-	void map_unsubscribe(const WrapperMap *t, const char *names, const char *topic, const char *subscriber_addr);
-	void map_remove(const WrapperMap *t, const char *subscriber_addr);
+	void map_unsubscribe(const WrapperMap *t, const char *names, const char *topic, uint32_t subscriber_id);
+	void map_remove(const WrapperMap *t, uint32_t subscriber_id);
+	uint32_t map_register(WrapperMap *t, const char *subscriber_addr);
+	int map_find_subscriber(const WrapperMap *t, const char *subscriber_addr, uint32_t *subscriber_id);
+	const char *map_subscriber_addr(const WrapperMap *t, uint32_t subscriber_id);
+	void map_unregister(WrapperMap *t, uint32_t subscriber_id);
+	size_t map_membership_bytes(const WrapperMap *t);
+	void map_table_sizes(const WrapperMap *t, size_t *topics, size_t *subscribers);
 	void map_delete(WrapperMap *t);
 	void insert_handler(WrapperMap *test, const char *names, const char *topic, void *func_ptr,  void *func_args);
 	void delete_handler(WrapperMap *test, const char *names, const char *topic);
+	int get_handler(WrapperMap *test, const char *names, const char *topic, void **func_ptr, void **func_args);
 
 #ifdef __cplusplus
 }
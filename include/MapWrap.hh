@@ -31,22 +31,70 @@
 
 #include <iostream>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <algorithm>
+#include <stdint.h>
 #include "vector.h"
+
+// Set of subscriber ids. Kept as a sorted array while sparse and as a bitmap
+// once the bitmap is the smaller of the two, which is the usual case since
+// ids are handed out densely.
+class IdSet {
+        public:
+                IdSet() : dense(false), count(0), seq(0) {}
+                bool insert(uint32_t id);
+                bool erase(uint32_t id);
+                bool contains(uint32_t id) const;
+                size_t size() const { return count; }
+                bool empty() const { return count == 0; }
+                size_t copy_to(uint32_t *out, size_t max) const;
+                size_t bytes() const;
+                // next number of the topic's sequence, 1 first; safe under a shared lock
+                uint64_t next_seq() { return __atomic_add_fetch(&seq, 1, __ATOMIC_RELAXED); }
+
+        private:
+                void to_bitmap(uint32_t max_id);
+                void to_array();
+
+                bool dense;
+                size_t count;
+                std::vector<uint32_t> ids;      // sorted, when !dense
+                std::vector<uint64_t> bits;     // when dense
+                uint64_t seq;                   // last number handed out
+};
+
 class MapWrap {
         public:
-                void mp_insert(const char *names, const char *topic, const char *subscriber_addr);
-                vector get_value(const char *names, const char *topic);
+                void mp_insert(const char *names, const char *topic, uint32_t id);
+                size_t get_value(const char *names, const char *topic, uint32_t *ids, size_t max, uint64_t *seq = NULL);
                 vector get_topics();
-                void mp_delete(const char *names, const char *topic, const char *subscriber_addr);
-                void mp_remove(const char *subscriber_addr);
+                void mp_delete(const char *names, const char *topic, uint32_t id);
+                void mp_remove(uint32_t id);
                 MapWrap();
                 void delete_all();
 
+                uint32_t register_subscriber(const char *subscriber_addr);
+                bool find_subscriber(const char *subscriber_addr, uint32_t *id);
+                const char *subscriber_addr(uint32_t id);
+                void unregister_subscriber(uint32_t id);
+                size_t membership_bytes();
+                void table_sizes(size_t *topics, size_t *subscribers);
+
                 void insert_pointers(const char *names, const char *topic, void *func_ptr, void *func_args);
+                bool get_pointers(const char *names, const char *topic, void **func_ptr, void **func_args);
                 void delete_topic(const char *names, const char *topic);
 
         private:
+                bool erase_subscriber(const std::string &names, const std::string &topic, uint32_t id);
+
                  std::map <std::string, std::map<std::string, vector> > cMap;
+                 std::map <std::string, std::map<std::string, IdSet> > sMap;
+                 // subscriber id -> the (namespace, topic) pairs it is subscribed to
+                 std::vector <std::set<std::pair<std::string, std::string> > > subsIndex;
+                 // subscriber id <-> address, freed ids are reused to keep them dense
+                 std::vector <std::string> addrOf;
+                 std::map <std::string, uint32_t> idOf;
+                 std::vector <uint32_t> freeIds;
 };
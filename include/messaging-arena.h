@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_ARENA_H
+#define __MESSAGING_ARENA_H
+
+#include <margo.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Registered-memory arena for message payloads.
+ *
+ * One region is registered with Mercury when the client or server starts and
+ * is carved into fixed size slabs.  Payloads larger than the eager size are
+ * placed in slabs (a run of contiguous slabs for large messages) and moved
+ * with margo_bulk_transfer() using the arena's bulk handle and the slab
+ * offset, so no memory is registered per message.
+ *
+ * The arena is configured from the environment:
+ *   MESSAGING_ARENA_SIZE       bytes to register, 0 disables the arena (default 64M)
+ *   MESSAGING_ARENA_SLAB       slab size in bytes (default 64K)
+ *   MESSAGING_ARENA_HUGEPAGES  1 to back the arena with hugepages (default 0)
+ *   MESSAGING_EAGER_SIZE       largest payload sent inline with the RPC (default 4K)
+ * Sizes accept a k, m or g suffix.
+ */
+
+#define MESSAGING_EAGER_SIZE        4096
+#define MESSAGING_ARENA_DEFAULT_SIZE (64UL << 20)
+#define MESSAGING_ARENA_DEFAULT_SLAB (64UL << 10)
+
+typedef struct messaging_arena* messaging_arena_t;
+#define MESSAGING_ARENA_NULL ((messaging_arena_t)NULL)
+
+struct messaging_arena_config {
+    size_t size;
+    size_t slab_size;
+    size_t eager_size;
+    int hugepages;
+};
+
+/* a payload buffer in the arena or registered on its own */
+struct messaging_arena_buf {
+    void *ptr;
+    size_t len;
+    hg_bulk_t bulk;      /* handle covering ptr */
+    size_t offset;       /* offset of ptr within bulk */
+    int registered;      /* 1 if bulk was created for this buffer only */
+};
+
+/**
+ * @brief Fills 'cfg' with the defaults, overridden by the environment.
+ */
+void messaging_arena_config_init(struct messaging_arena_config *cfg);
+
+/**
+ * @brief Allocates and registers an arena.
+ *
+ * @param[in] mid Margo instance
+ * @param[in] cfg arena configuration
+ * @param[out] arena the arena, MESSAGING_ARENA_NULL if cfg->size is 0
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_arena_create(margo_instance_id mid,
+        const struct messaging_arena_config *cfg,
+        messaging_arena_t *arena);
+
+/**
+ * @brief Deregisters and frees an arena. All buffers must have been released.
+ */
+void messaging_arena_destroy(messaging_arena_t arena);
+
+/**
+ * @brief Reserves 'len' bytes in the arena.
+ *
+ * @return MESSAGING_SUCCESS, or MESSAGING_ERR_ALLOCATION if the arena is
+ * NULL or has no run of free slabs large enough
+ */
+int messaging_arena_alloc(messaging_arena_t arena, size_t len,
+        struct messaging_arena_buf *buf);
+
+/**
+ * @brief Gets a registered buffer of 'len' bytes: from the arena when it has
+ * room, otherwise a pool buffer registered for this buffer only.
+ */
+int messaging_arena_get(messaging_arena_t arena, margo_instance_id mid,
+        size_t len, hg_uint8_t access, struct messaging_arena_buf *buf);
+
+/**
+ * @brief Pulls 'len' bytes at 'remote_offset' of 'remote' on 'origin' into a
+ * buffer obtained with messaging_arena_get().
+ */
+int messaging_arena_pull(messaging_arena_t arena, margo_instance_id mid,
+        hg_addr_t origin, hg_bulk_t remote, size_t remote_offset,
+        size_t len, struct messaging_arena_buf *buf);
+
+/**
+ * @brief Releases a buffer obtained from this arena.
+ */
+void messaging_arena_release(messaging_arena_t arena, struct messaging_arena_buf *buf);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
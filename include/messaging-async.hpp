@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+#ifndef __MESSAGING_ASYNC_HPP
+#define __MESSAGING_ASYNC_HPP
+
+/*
+ * Asynchronous C++ layer over the client API, header only.
+ *
+ * Operations are started with the non-blocking C calls (publish_async(),
+ * subscribe_many_async(), ...), which send the RPC with margo_iforward()
+ * and return at once.  A ULT on the client's handler pool then waits for
+ * the response and completes a future backed by an Argobots eventual, so
+ * thousands of operations can be in flight from a handful of threads: a
+ * waiting ULT costs a stack, not an OS thread.
+ *
+ *   messaging::async_client ac(client);
+ *   std::vector<messaging::future> ops;
+ *   for(auto &m : batch)
+ *       ops.push_back(ac.publish("sim", "particles", &m, sizeof(m)));
+ *   int ret = messaging::when_all(std::move(ops)).get();
+ *
+ * With C++20 coroutines a future can also be awaited, and a coroutine
+ * returning messaging::future runs until its first co_await on the calling
+ * thread and resumes on the ULT that completed what it awaited:
+ *
+ *   messaging::future flow(messaging::async_client &ac, const particle &p)
+ *   {
+ *       int ret = co_await ac.publish(particles, p);
+ *       if(ret == MESSAGING_SUCCESS)
+ *           ret = co_await ac.subscribe("sim", "replies", on_reply, NULL);
+ *       co_return ret;
+ *   }
+ *
+ * Results are the status codes of messaging-common.h; nothing throws.
+ */
+
+#include <stddef.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <abt.h>
+#include <margo.h>
+#include <messaging.hpp>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define MESSAGING_HAVE_COROUTINES 1
+#endif
+#endif
+
+namespace messaging {
+
+namespace detail {
+
+/* the result of one operation, set once; waiters block on the eventual,
+ * a single continuation may be attached instead */
+class state {
+public:
+    state() : ret_(MESSAGING_SUCCESS), done_(false), ev_(ABT_EVENTUAL_NULL)
+    {
+        ABT_eventual_create(0, &ev_);
+    }
+    ~state()
+    {
+        if(ev_ != ABT_EVENTUAL_NULL)
+            ABT_eventual_free(&ev_);
+    }
+    state(const state&) = delete;
+    state &operator=(const state&) = delete;
+
+    void complete(int ret)
+    {
+        std::function<void()> next;
+
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            ret_ = ret;
+            done_ = true;
+            next.swap(then_);
+        }
+        ABT_eventual_set(ev_, NULL, 0);
+        if(next)
+            next();
+    }
+
+    /* false, and f is not kept, if the result is already there */
+    bool on_complete(std::function<void()> f)
+    {
+        std::lock_guard<std::mutex> l(lock_);
+
+        if(done_)
+            return false;
+        then_ = std::move(f);
+        return true;
+    }
+
+    bool ready()
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        return done_;
+    }
+
+    int wait()
+    {
+        ABT_eventual_wait(ev_, NULL);
+        return result();
+    }
+
+    int result()
+    {
+        std::lock_guard<std::mutex> l(lock_);
+        return ret_;
+    }
+
+private:
+    std::mutex lock_;
+    int ret_;
+    bool done_;
+    ABT_eventual ev_;
+    std::function<void()> then_;
+};
+
+} // namespace detail
+
+/* the status of an operation that may not have completed yet */
+class future {
+public:
+    future() {}
+    explicit future(std::shared_ptr<detail::state> st) : st_(std::move(st)) {}
+
+    /* a future that is already complete with ret */
+    static future ready_with(int ret)
+    {
+        std::shared_ptr<detail::state> st = std::make_shared<detail::state>();
+        st->complete(ret);
+        return future(st);
+    }
+
+    bool valid() const { return st_ != NULL; }
+    bool ready() const { return st_ && st_->ready(); }
+
+    /* blocks the calling ULT or thread until the operation completes */
+    int get() const { return st_ ? st_->wait() : MESSAGING_ERR_INVALID_ARG; }
+
+    const std::shared_ptr<detail::state> &shared_state() const { return st_; }
+
+#ifdef MESSAGING_HAVE_COROUTINES
+    struct promise_type {
+        std::shared_ptr<detail::state> st = std::make_shared<detail::state>();
+
+        future get_return_object() { return future(st); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_value(int ret) { st->complete(ret); }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    struct awaiter {
+        std::shared_ptr<detail::state> st;
+
+        bool await_ready() const { return st->ready(); }
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            return st->on_complete([h]() { h.resume(); });
+        }
+        int await_resume() const { return st->result(); }
+    };
+
+    awaiter operator co_await() const
+    {
+        return awaiter{ st_ ? st_ : ready_with(MESSAGING_ERR_INVALID_ARG).st_ };
+    }
+#endif
+
+private:
+    std::shared_ptr<detail::state> st_;
+};
+
+/**
+ * @brief Completes once every future in fs has.
+ *
+ * @return a future with MESSAGING_SUCCESS, or the first error one of fs
+ *         completed with
+ */
+inline future when_all(std::vector<future> fs)
+{
+    struct join {
+        std::atomic<size_t> left;
+        std::atomic<int> ret;
+        std::shared_ptr<detail::state> all;
+    };
+    std::shared_ptr<join> j = std::make_shared<join>();
+
+    /* one extra count so nothing completes while we are still attaching */
+    j->left = fs.size() + 1;
+    j->ret = MESSAGING_SUCCESS;
+    j->all = std::make_shared<detail::state>();
+    for(auto &f : fs){
+        std::shared_ptr<detail::state> st = f.valid() ? f.shared_state() :
+            future::ready_with(MESSAGING_ERR_INVALID_ARG).shared_state();
+        std::function<void()> done = [j, st]() {
+            int r = st->result(), ok = MESSAGING_SUCCESS;
+
+            if(r != MESSAGING_SUCCESS)
+                j->ret.compare_exchange_strong(ok, r);
+            if(j->left.fetch_sub(1) == 1)
+                j->all->complete(j->ret.load());
+        };
+        if(!st->on_complete(done))
+            done();
+    }
+    if(j->left.fetch_sub(1) == 1)
+        j->all->complete(j->ret.load());
+    return future(j->all);
+}
+
+template <typename... F>
+future when_all(future first, F... rest)
+{
+    std::vector<future> fs;
+
+    fs.reserve(1 + sizeof...(rest));
+    fs.push_back(std::move(first));
+    int expand[] = { 0, (fs.push_back(std::move(rest)), 0)... };
+    (void)expand;
+    return when_all(std::move(fs));
+}
+
+/* runs work as ULTs on an Argobots pool, by default the client's handler pool */
+class executor {
+public:
+    explicit executor(ABT_pool pool) : pool_(pool) {}
+    explicit executor(margo_instance_id mid) : pool_(ABT_POOL_NULL)
+    {
+        margo_get_handler_pool(mid, &pool_);
+    }
+
+    ABT_pool pool() const { return pool_; }
+
+    /* @return MESSAGING_SUCCESS or MESSAGING_ERR_ARGOBOTS if no ULT could be created */
+    template <typename F>
+    int post(F &&f) const
+    {
+        std::function<void()> *fn = new std::function<void()>(std::forward<F>(f));
+
+        if(ABT_thread_create(pool_, &run, fn, ABT_THREAD_ATTR_NULL, NULL) != ABT_SUCCESS){
+            delete fn;
+            return MESSAGING_ERR_ARGOBOTS;
+        }
+        return MESSAGING_SUCCESS;
+    }
+
+#ifdef MESSAGING_HAVE_COROUTINES
+    /* co_await ex.schedule() moves the coroutine onto a ULT of the pool */
+    struct schedule_awaiter {
+        const executor *ex;
+
+        bool await_ready() const { return false; }
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            return ex->post([h]() { h.resume(); }) == MESSAGING_SUCCESS;
+        }
+        void await_resume() const {}
+    };
+
+    schedule_awaiter schedule() const { return schedule_awaiter{ this }; }
+#endif
+
+private:
+    static void run(void *arg)
+    {
+        std::function<void()> *fn = static_cast<std::function<void()>*>(arg);
+
+        (*fn)();
+        delete fn;
+    }
+
+    ABT_pool pool_;
+};
+
+/*
+ * Starts client operations without blocking.  Strings and buffers passed
+ * in may be reused as soon as a call returns; callbacks behave as for the
+ * blocking calls.  The first subscription to a server still registers with
+ * it synchronously.
+ */
+class async_client {
+public:
+    explicit async_client(messaging_client_t client)
+        : client_(client), ex_(messaging_client_mid(client)) {}
+    async_client(messaging_client_t client, const executor &ex)
+        : client_(client), ex_(ex) {}
+
+    messaging_client_t client() const { return client_; }
+    const executor &get_executor() const { return ex_; }
+
+    future publish(const char *namesp, const char *topic, const void *msg, size_t len)
+    {
+        messaging_request_t req = MESSAGING_REQUEST_NULL;
+        int ret = publish_async(client_, const_cast<char*>(namesp), const_cast<char*>(topic),
+                const_cast<void*>(msg), (int)len, &req);
+
+        return track(ret, req);
+    }
+
+    template <typename T>
+    future publish(const Topic<T> &topic, const T &value)
+    {
+        return publish(topic.namesp(), topic.name(), &value, sizeof(T));
+    }
+
+    future subscribe(const char *namesp, const char *topic, void (*callback)(void*, void*),
+            void *callback_args)
+    {
+        struct messaging_subscription sub = { const_cast<char*>(namesp),
+            const_cast<char*>(topic), callback, callback_args };
+
+        return subscribe_many(&sub, 1);
+    }
+
+    future unsubscribe(const char *namesp, const char *topic)
+    {
+        struct messaging_subscription sub = { const_cast<char*>(namesp),
+            const_cast<char*>(topic), NULL, NULL };
+
+        return unsubscribe_many(&sub, 1);
+    }
+
+    future subscribe_many(const struct messaging_subscription *subs, size_t count)
+    {
+        messaging_request_t req = MESSAGING_REQUEST_NULL;
+        int ret = subscribe_many_async(client_, subs, count, &req);
+
+        return track(ret, req);
+    }
+
+    future unsubscribe_many(const struct messaging_subscription *subs, size_t count)
+    {
+        messaging_request_t req = MESSAGING_REQUEST_NULL;
+        int ret = unsubscribe_many_async(client_, subs, count, &req);
+
+        return track(ret, req);
+    }
+
+private:
+    /* hands req to a ULT that completes the future once the response is in */
+    future track(int ret, messaging_request_t req)
+    {
+        std::shared_ptr<detail::state> st;
+
+        if(ret != MESSAGING_SUCCESS)
+            return future::ready_with(ret);
+        st = std::make_shared<detail::state>();
+        if(ex_.post([st, req]() { st->complete(messaging_wait(req)); }) != MESSAGING_SUCCESS)
+            st->complete(messaging_wait(req));
+        return future(st);
+    }
+
+    messaging_client_t client_;
+    executor ex_;
+};
+
+} // namespace messaging
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_BOOTSTRAP_H
+#define __MESSAGING_BOOTSTRAP_H
+
+#include <margo.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Discovery of the server address list.
+ *
+ * A bootstrap spec is "provider[:arg]".  The built-in providers are
+ *   file[:path]      addresses written by the servers, whitespace separated
+ *                    (path defaults to MESSAGING_SERVER_FILE or servids.0)
+ *   env[:list]       a comma or whitespace separated connection string
+ *                    (list defaults to MESSAGING_SERVERS)
+ *   group[:addr]     asks the server at addr for the group view
+ *                    (addr defaults to the first entry of MESSAGING_SERVERS)
+ *
+ * The spec comes from MESSAGING_BOOTSTRAP and defaults to "file".  A provider
+ * that finds no servers yet is retried with exponential backoff for up to
+ * MESSAGING_BOOTSTRAP_TIMEOUT seconds (default 30), so clients may start
+ * before the servers do.
+ *
+ * A server process running several providers (MESSAGING_PROVIDERS) lists
+ * one entry per provider, "address#n" for provider n; a bare address is
+ * provider 0.  Clients treat every entry as a server of its own.
+ */
+
+#define MESSAGING_BOOTSTRAP_DEFAULT       "file"
+#define MESSAGING_BOOTSTRAP_DEFAULT_FILE  "servids.0"
+#define MESSAGING_BOOTSTRAP_TIMEOUT       30
+
+/* the server address list, addrs holds num_addrs NUL terminated strings back to back */
+struct messaging_server_list {
+    char *addrs;
+    int addrs_len;
+    int num_addrs;
+};
+
+struct messaging_bootstrap_provider {
+    const char *name;
+    /* fills in list (addrs is malloc'ed); MESSAGING_ERR_UNKNOWN_PR means try again later */
+    int (*load)(margo_instance_id mid, const char *arg, struct messaging_server_list *list);
+};
+
+/**
+ * @brief Adds a bootstrap provider, replacing any provider with the same name.
+ *
+ * @param[in] provider provider to add, must stay valid while in use
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_bootstrap_register(const struct messaging_bootstrap_provider *provider);
+
+/**
+ * @brief Loads the server address list, waiting for the servers to come up.
+ *
+ * @param[in] mid Margo instance
+ * @param[in] spec bootstrap spec, or NULL to use MESSAGING_BOOTSTRAP
+ * @param[out] list server addresses, free list->addrs when done
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_bootstrap_load(margo_instance_id mid, const char *spec,
+        struct messaging_server_list *list);
+
+/**
+ * @brief Splits a server list entry into its address and provider.
+ *
+ * @param[in] entry entry, "address" or "address#provider"
+ * @param[in] len length of entry
+ * @param[out] addr_len length of the address part
+ *
+ * @return the provider, MARGO_DEFAULT_PROVIDER_ID if the entry names none
+ */
+uint16_t messaging_bootstrap_endpoint(const char *entry, size_t len, size_t *addr_len);
+
+/**
+ * @brief Path of the address file written by servers, NULL if disabled.
+ */
+const char *messaging_bootstrap_file(void);
+
+/**
+ * @brief Serves the group view RPC so clients can bootstrap from any server.
+ *
+ * @param[in] mid Margo instance
+ * @param[in] list server addresses, must stay valid until the RPC is deregistered
+ *
+ * @return the RPC id
+ */
+hg_id_t messaging_bootstrap_serve(margo_instance_id mid, const struct messaging_server_list *list);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_CAPTURE_H
+#define __MESSAGING_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Server side recording of the traffic, for replaying it later
+ * (tests/replay.c).
+ *
+ *   MESSAGING_CAPTURE          file to record into, with ".<rank>" appended
+ *                              when there is more than one server; empty
+ *                              disables (default)
+ *   MESSAGING_CAPTURE_PAYLOAD  1 records publish payloads too, otherwise
+ *                              only their size (default 0)
+ *
+ * A capture file is a header followed by records, in host byte order:
+ *   op            1 byte, MESSAGING_CAPTURE_PUBLISH/SUBSCRIBE/UNSUBSCRIBE
+ *   dt            varint, ns since the previous record (or the start)
+ *   who           varint, publisher (a hash of its address) or subscriber id
+ *   size          varint, payload bytes; 0 for (un)subscribes
+ *   namesp        varint length including the NUL, then the bytes
+ *   topic         varint length including the NUL, then the bytes
+ *   data          varint length, then the payload if it was recorded
+ * Subscriptions made before the capture started are not in the file, so
+ * start capturing with the servers.  Subscriptions dropped because their
+ * client finalized are not recorded either.
+ */
+
+#define MESSAGING_CAPTURE_MAGIC     "MSGCAPT"
+#define MESSAGING_CAPTURE_VERSION   1
+
+#define MESSAGING_CAPTURE_PUBLISH      1
+#define MESSAGING_CAPTURE_SUBSCRIBE    2
+#define MESSAGING_CAPTURE_UNSUBSCRIBE  3
+
+#define MESSAGING_CAPTURE_FLAG_PAYLOAD 0x1   /* publish payloads are recorded */
+
+struct messaging_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t start_ns;          /* CLOCK_REALTIME when the capture started */
+    uint32_t rank;              /* of the server that wrote it */
+    uint32_t reserved;
+};
+
+struct messaging_capture_config {
+    char path[256];             /* empty: no capture */
+    int payloads;
+};
+
+/* one decoded record; the pointers are into the buffer being read */
+struct messaging_capture_event {
+    uint64_t ts;                /* ns, CLOCK_REALTIME */
+    uint32_t op;
+    uint32_t who;
+    uint64_t size;
+    const char *namesp;
+    const char *topic;
+    const void *payload;        /* NULL unless recorded */
+};
+
+struct messaging_capture_reader {
+    struct messaging_capture_header header;
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t ts;
+};
+
+typedef struct messaging_capture* messaging_capture_t;
+
+void messaging_capture_config_init(struct messaging_capture_config *cfg);
+
+/**
+ * @brief Starts a capture file.
+ *
+ * @param[in] cfg configuration, cfg->path must be set
+ * @param[in] rank recorded in the header
+ * @param[out] cap the capture
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_capture_open(const struct messaging_capture_config *cfg, uint32_t rank,
+        messaging_capture_t *cap);
+
+/* writes out what is buffered and closes the file */
+void messaging_capture_close(messaging_capture_t cap);
+
+/* appends a record; payload may be NULL, it is only kept if the capture records payloads */
+void messaging_capture_record(messaging_capture_t cap, uint32_t op, uint32_t who,
+        const char *namesp, const char *topic, const void *payload, uint64_t size);
+
+/**
+ * @brief Starts reading the capture in buf, which must stay valid while reading.
+ *
+ * @return MESSAGING_SUCCESS or MESSAGING_ERR_PROTOCOL if it is not a capture
+ */
+int messaging_capture_reader_init(struct messaging_capture_reader *r, const void *buf, size_t len);
+
+/**
+ * @brief Decodes the next record.
+ *
+ * @return 1 for a record, 0 at the end, MESSAGING_ERR_PROTOCOL if the rest
+ *         is damaged (a capture cut short ends that way)
+ */
+int messaging_capture_next(struct messaging_capture_reader *r, struct messaging_capture_event *ev);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -36,6 +36,7 @@
 
 #include <margo.h>
 #include <messaging-common.h>
+#include <messaging-stats.h>
 #include <ss_data.h>
 #include <mpi.h>
 
@@ -46,6 +47,17 @@ extern "C" {
 typedef struct messaging_client* messaging_client_t;
 #define MESSAGING_CLIENT_NULL ((messaging_client_t)NULL)
 
+typedef struct messaging_request* messaging_request_t;
+#define MESSAGING_REQUEST_NULL ((messaging_request_t)NULL)
+
+/* One entry of a batched subscribe or unsubscribe; callback fields are unused by unsubscribe */
+struct messaging_subscription {
+    char *namesp;
+    char *topic;
+    void (*callback)(void*, void*);
+    void *callback_args;
+};
+
 /**
  * @brief Creates a MESSAGING client.
  *
@@ -57,6 +69,20 @@ typedef struct messaging_client* messaging_client_t;
 int client_init( margo_instance_id mid,
         messaging_client_t* client); 
 
+/**
+ * @brief Creates a MESSAGING client that finds the servers through spec.
+ *
+ * @param[in] mid Margo instance
+ * @param[in] spec bootstrap spec (see messaging-bootstrap.h), e.g.
+ *            "env:na+sm://1234-0", or NULL for MESSAGING_BOOTSTRAP
+ * @param[out] client MESSAGING client
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int client_init_with_bootstrap( margo_instance_id mid,
+        const char *spec,
+        messaging_client_t* client); 
+
 /**
  * @brief Creates a MESSAGING client.
  *
@@ -97,13 +123,54 @@ int publish(messaging_client_t client,
         void *messg, 
         int msg_len);
 
+/**
+ * @brief Non-blocking version of publish().
+ *
+ * The message is copied before this returns, so messg may be reused right
+ * away; local subscribers have already been served.  The request must be
+ * completed with messaging_wait().
+ *
+ * @param[out] req request to wait on
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int publish_async(messaging_client_t client,
+        char *namesp,
+        char *topic,
+        void *messg,
+        int msg_len,
+        messaging_request_t *req);
+
+
+/**
+ * @brief Publishes to a topic without waiting for the server's answer.
+ *
+ * With oneway set, publish() and publish_async() to namesp/topic return, or
+ * complete, as soon as the message is sent; the server answers nothing, so
+ * only failures to send are reported and a message it drops goes unnoticed.
+ * Payloads larger than the eager size, which the server pulls from our
+ * memory, and publishes sent straight to the subscribers (MESSAGING_DIRECT)
+ * still wait.
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] namesp Namespace of the topic
+ * @param[in] topic the topic
+ * @param[in] oneway 1 to stop waiting, 0 to wait again
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int publish_set_oneway(messaging_client_t client,
+        const char *namesp,
+        const char *topic,
+        int oneway);
 
 /**
  * @brief Subscribes to a 'topic' topic in 'namesp' Namespace.
  * 
  * When client receives notification 'callback' handler will be triggered
  * with arguments (void* callback_args, void* msg), where msg is the
- * published message
+ * published message. msg points into the received buffer and is only
+ * valid until the callback returns; copy it to keep it.
  *
  * @param[in] client MESSAGING client that is subscribing to a namespace and topic
  * @param[in] namesp Subscribes to Namespace: 'namesp'
@@ -134,6 +201,146 @@ int unsubscribe(messaging_client_t client,
         char *namesp, 
         char *topic);
 
+/**
+ * @brief Subscribes to 'count' topics at once.
+ *
+ * Sends a single message to each server that owns at least one of the
+ * topics instead of one round trip per topic. Callbacks behave as for
+ * subscribe().
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] subs array of namespace/topic/callback entries
+ * @param[in] count number of entries in subs
+ *
+ * @return MESSAGING_SUCCESS or the first error code reported
+ */
+int subscribe_many(messaging_client_t client,
+        const struct messaging_subscription *subs,
+        size_t count);
+
+/**
+ * @brief Unsubscribes from 'count' topics at once.
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] subs array of namespace/topic entries
+ * @param[in] count number of entries in subs
+ *
+ * @return MESSAGING_SUCCESS or the first error code reported
+ */
+int unsubscribe_many(messaging_client_t client,
+        const struct messaging_subscription *subs,
+        size_t count);
+
+/**
+ * @brief Non-blocking version of subscribe_many().
+ *
+ * subs may be reused as soon as this returns. The request must be
+ * completed with messaging_wait().
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] subs array of namespace/topic/callback entries
+ * @param[in] count number of entries in subs
+ * @param[out] req request to wait on
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int subscribe_many_async(messaging_client_t client,
+        const struct messaging_subscription *subs,
+        size_t count,
+        messaging_request_t *req);
+
+/**
+ * @brief Non-blocking version of unsubscribe_many().
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] subs array of namespace/topic entries
+ * @param[in] count number of entries in subs
+ * @param[out] req request to wait on
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int unsubscribe_many_async(messaging_client_t client,
+        const struct messaging_subscription *subs,
+        size_t count,
+        messaging_request_t *req);
+
+/**
+ * @brief Checks whether a request has completed without blocking.
+ *
+ * @param[in] req request returned by an _async call
+ * @param[out] flag set to 1 if the request completed, 0 otherwise
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_test(messaging_request_t req, int *flag);
+
+/**
+ * @brief Number of notifications this client received from servers.
+ *
+ * Messages delivered through shared memory or dispatched in place by
+ * publish() are not counted, which makes this the server fan-out seen
+ * by the client.
+ *
+ * @param[in] client MESSAGING client
+ *
+ * @return the number of notify RPCs handled so far
+ */
+uint64_t messaging_notify_count(messaging_client_t client);
+
+/**
+ * @brief Number of servers the client talks to.
+ *
+ * @param[in] client MESSAGING client
+ *
+ * @return servers are numbered 0 to this minus one
+ */
+int messaging_num_servers(messaging_client_t client);
+
+/* the Margo instance the client was created on */
+margo_instance_id messaging_client_mid(messaging_client_t client);
+
+/**
+ * @brief Fetches a snapshot of a server's statistics.
+ *
+ * The snapshot is large (see messaging-stats.h); allocate it on the heap.
+ *
+ * @param[in] client MESSAGING client
+ * @param[in] server server number, below messaging_num_servers()
+ * @param[out] stats the snapshot
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_get_server_stats(messaging_client_t client, int server,
+        struct messaging_server_stats *stats);
+
+/**
+ * @brief Takes a snapshot of this client's statistics.
+ *
+ * Covers publish and subscribe round trips per server, messages received
+ * per topic, callback times and the delay before callbacks start.  The
+ * snapshot is large (see messaging-stats.h); allocate it on the heap.
+ *
+ * With MESSAGING_CLIENT_STATS_FILE set the client also dumps it every
+ * MESSAGING_CLIENT_STATS_INTERVAL seconds (default 10) to that file with
+ * .<pid> appended.  Callbacks that run longer than MESSAGING_CALLBACK_WARN_MS
+ * (default 1000, 0 disables) are reported on stderr.
+ *
+ * @param[in] client MESSAGING client
+ * @param[out] stats the snapshot
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int client_get_stats(messaging_client_t client, struct messaging_client_stats *stats);
+
+/**
+ * @brief Waits for a request to complete and frees it.
+ *
+ * @param[in] req request returned by an _async call
+ *
+ * @return MESSAGING_SUCCESS or the first error code reported by a server
+ */
+int messaging_wait(messaging_request_t req);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -40,6 +40,7 @@ extern "C" {
 #define MESSAGING_ERR_ALLOCATION  -1 /* Error allocating something */
 #define MESSAGING_ERR_INVALID_ARG -2 /* An argument is invalid */
 #define MESSAGING_ERR_MERCURY     -3 /* An error happened calling a Mercury function */
+#define MESSAGING_ERR_PROTOCOL    -4 /* Malformed or unsupported wire message */
 #define MESSAGING_ERR_SIZE        -5 /* Client did not allocate enough for the requested data */
 #define MESSAGING_ERR_ARGOBOTS    -6 /* Argobots related error */
 #define MESSAGING_ERR_UNKNOWN_PR    -7 /* Could not find server */
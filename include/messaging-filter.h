@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+#ifndef __MESSAGING_FILTER_H
+#define __MESSAGING_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Summary of the topics a server has subscribers for, so publishers can
+ * skip the round trip for topics nobody listens to.
+ *
+ * A server keeps a counting Bloom filter: each topic with at least one
+ * subscriber adds one to MESSAGING_FILTER_HASHES counters picked from its
+ * wire_topic_hash(), and publishers get the bits of the counters that are
+ * non-zero.  A topic whose bits are all set may still have no subscribers
+ * (a false positive, which only costs the usual RPC); a topic with any bit
+ * clear has none.  Counters stick at their maximum rather than wrap, which
+ * keeps the answer conservative.
+ *
+ * Every change bumps the version.  Servers push the bits to the publishers
+ * that asked for them right after acknowledging a subscription that set a
+ * bit, so a publish racing subscribe() may still be skipped; bits that clear
+ * reach publishers when they next refresh.  A publisher that does not take
+ * a push within MESSAGING_PUSH_TIMEOUT gets no more until it refreshes.
+ *
+ *   MESSAGING_FILTER_BITS   counters per server, rounded up to a power of
+ *                           two (default 32768, 4 KB of bits on the wire)
+ */
+
+#define MESSAGING_FILTER_BITS     32768
+#define MESSAGING_FILTER_HASHES   3
+#define MESSAGING_FILTER_FORMAT   1
+
+typedef struct messaging_filter* messaging_filter_t;
+#define MESSAGING_FILTER_NULL ((messaging_filter_t)NULL)
+
+/* nbits 0 reads MESSAGING_FILTER_BITS from the environment */
+int messaging_filter_create(uint32_t nbits, messaging_filter_t *filter);
+void messaging_filter_destroy(messaging_filter_t filter);
+
+/* a topic gained its first subscriber; returns 1 if a bit was set */
+int messaging_filter_add(messaging_filter_t filter, uint64_t topic_hash);
+
+/* a topic lost its last subscriber; returns 1 if a bit was cleared */
+int messaging_filter_remove(messaging_filter_t filter, uint64_t topic_hash);
+
+/* 0 if the topic certainly has no subscribers; safe against a concurrent
+ * messaging_filter_apply() */
+int messaging_filter_test(messaging_filter_t filter, uint64_t topic_hash);
+
+uint64_t messaging_filter_version(messaging_filter_t filter);
+
+/**
+ * @brief Serializes the bits for publishers.
+ *
+ * @param[out] buf messaging_pool_alloc()'ed buffer, owned by the caller
+ * @param[out] len its length
+ *
+ * @return MESSAGING_SUCCESS or MESSAGING_ERR_ALLOCATION
+ */
+int messaging_filter_encode(messaging_filter_t filter, void **buf, size_t *len);
+
+/**
+ * @brief Creates a publisher's copy from an encoded filter.
+ *
+ * The copy has no counters, only messaging_filter_test() and
+ * messaging_filter_apply() may be used on it.
+ *
+ * @return MESSAGING_SUCCESS, MESSAGING_ERR_PROTOCOL or MESSAGING_ERR_ALLOCATION
+ */
+int messaging_filter_decode(const void *buf, size_t len, messaging_filter_t *filter);
+
+/**
+ * @brief Updates a publisher's copy in place if buf is newer.
+ *
+ * Callers serialize updates; tests may run concurrently and see every bit
+ * either before or after the update.
+ *
+ * @return MESSAGING_SUCCESS, or MESSAGING_ERR_PROTOCOL if buf is malformed
+ *         or of another size
+ */
+int messaging_filter_apply(messaging_filter_t filter, const void *buf, size_t len);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
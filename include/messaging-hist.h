@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_HIST_H
+#define __MESSAGING_HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Log-linear histogram of non-negative integer samples (latencies in ns,
+ * sizes in bytes, fan-out widths).  Values below 2^MESSAGING_HIST_SUB_BITS
+ * are counted exactly; above that every power of two is split in
+ * 2^(MESSAGING_HIST_SUB_BITS-1) equal buckets, so a reported value is within
+ * 1/64 of the true one.  Recording is a handful of instructions and never
+ * allocates; a histogram has one writer, readers merge copies.
+ */
+
+#define MESSAGING_HIST_SUB_BITS  7
+#define MESSAGING_HIST_SUB       (1 << MESSAGING_HIST_SUB_BITS)
+#define MESSAGING_HIST_HALF      (MESSAGING_HIST_SUB / 2)
+#define MESSAGING_HIST_BUCKETS   ((64 - MESSAGING_HIST_SUB_BITS + 2) * MESSAGING_HIST_HALF)
+
+struct messaging_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[MESSAGING_HIST_BUCKETS];
+};
+
+void messaging_hist_init(struct messaging_hist *h);
+
+static inline int messaging_hist_bucket(uint64_t v)
+{
+    int shift;
+
+    if (v < MESSAGING_HIST_SUB)
+        return (int)v;
+    shift = 63 - __builtin_clzll(v) - (MESSAGING_HIST_SUB_BITS - 1);
+    return (shift + 1) * MESSAGING_HIST_HALF + (int)(v >> shift) - MESSAGING_HIST_HALF;
+}
+
+static inline void messaging_hist_record(struct messaging_hist *h, uint64_t v)
+{
+    h->counts[messaging_hist_bucket(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* adds the samples of src to dst */
+void messaging_hist_merge(struct messaging_hist *dst, const struct messaging_hist *src);
+
+/* largest value counted in a bucket */
+uint64_t messaging_hist_bucket_top(int bucket);
+
+/**
+ * @brief Value below which a fraction q of the samples fall.
+ *
+ * @param[in] h histogram
+ * @param[in] q quantile between 0 and 1, e.g. 0.99
+ *
+ * @return the value, never above the largest sample; 0 if h is empty
+ */
+uint64_t messaging_hist_quantile(const struct messaging_hist *h, double q);
+
+double messaging_hist_mean(const struct messaging_hist *h);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
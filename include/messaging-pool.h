@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_POOL_H
+#define __MESSAGING_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Size-class buffer pool used for message buffers on the publish, decode
+ * and notify paths.  Blocks are rounded up to a power of two between
+ * MESSAGING_POOL_MIN_SIZE and MESSAGING_POOL_MAX_SIZE and cached per
+ * thread, so a thread that keeps sending and receiving messages of similar
+ * sizes stops touching the heap once warmed up.  Larger requests go
+ * straight to the heap.  Every block is MESSAGING_POOL_ALIGN aligned.
+ */
+
+#define MESSAGING_POOL_ALIGN     64
+#define MESSAGING_POOL_MIN_SHIFT 6   /* 64 bytes */
+#define MESSAGING_POOL_MAX_SHIFT 20  /* 1 MB */
+#define MESSAGING_POOL_MIN_SIZE  (1UL << MESSAGING_POOL_MIN_SHIFT)
+#define MESSAGING_POOL_MAX_SIZE  (1UL << MESSAGING_POOL_MAX_SHIFT)
+
+struct messaging_pool_stats {
+    uint64_t allocs;        /* messaging_pool_alloc() calls */
+    uint64_t frees;         /* messaging_pool_free() calls */
+    uint64_t heap_allocs;   /* allocations that had to go to the heap */
+    uint64_t heap_frees;    /* blocks given back to the heap */
+    uint64_t cached_bytes;  /* bytes held in thread caches and the shared depot */
+};
+
+/**
+ * @brief Allocates a MESSAGING_POOL_ALIGN aligned buffer of at least 'size' bytes.
+ *
+ * @return the buffer, or NULL if the heap is exhausted
+ */
+void *messaging_pool_alloc(size_t size);
+
+/**
+ * @brief Returns a buffer obtained from messaging_pool_alloc(). NULL is ignored.
+ */
+void messaging_pool_free(void *ptr);
+
+/**
+ * @brief Reads the pool counters summed over all threads.
+ */
+void messaging_pool_get_stats(struct messaging_pool_stats *stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
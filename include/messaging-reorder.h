@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+
+#ifndef __MESSAGING_REORDER_H
+#define __MESSAGING_REORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Per topic reorder buffers for subscribers.
+ *
+ * The server owning a topic stamps every message it fans out with the next
+ * number of the topic's sequence, so notifications may go out in parallel
+ * and still be handed to the callbacks in order.  A message whose turn has
+ * come is delivered in place; one that arrived early is copied and held
+ * until the messages before it have been delivered.  A gap still open after
+ * the timeout, or one wider than the window, is given up on and counted.
+ *
+ * The first message of a topic waits out the timeout as well, since the
+ * ones stamped just before it may still be on their way.  Messages behind
+ * the point already delivered are dropped as duplicates.  Messages without
+ * a sequence number (shared memory, local dispatch, direct publishes) are
+ * not ordered.  The server still numbers a publish that some subscribers
+ * got from the publisher itself, and tells those subscribers the number
+ * it took; messaging_reorder_skip() moves past it without a delivery.
+ *
+ *   MESSAGING_REORDER_WINDOW   messages held per topic (default 64)
+ *   MESSAGING_REORDER_TIMEOUT  milliseconds before a gap is given up on
+ *                              (default 10)
+ */
+
+#define MESSAGING_REORDER_WINDOW   64
+#define MESSAGING_REORDER_TIMEOUT  10
+
+typedef struct messaging_reorder* messaging_reorder_t;
+#define MESSAGING_REORDER_NULL ((messaging_reorder_t)NULL)
+
+/* hands a message to the application; payload is only valid during the call,
+ * trace_id is what the message was pushed with */
+typedef void (*messaging_reorder_deliver_t)(void *arg, const char *namesp, const char *topic,
+        void *payload, uint64_t recv_ns, uint64_t trace_id);
+
+struct messaging_reorder_counters {
+    uint64_t held;               /* messages that arrived early and waited */
+    uint64_t gaps;               /* sequence numbers given up on */
+    uint64_t duplicates;         /* messages behind the point already delivered */
+};
+
+/* window and timeout_ns 0 read the environment */
+int messaging_reorder_create(size_t window, uint64_t timeout_ns, messaging_reorder_deliver_t deliver,
+        void *arg, messaging_reorder_t *reorder);
+void messaging_reorder_destroy(messaging_reorder_t reorder);
+
+/**
+ * @brief Takes message seq of namesp/topic.
+ *
+ * Delivers it, and whatever it unblocks, before returning if its turn has
+ * come, copies it otherwise.  Deliveries of a topic never overlap, so a
+ * call may wait for another one to finish.  trace_id, 0 for none, is kept
+ * with the message and handed to the deliver callback.
+ */
+int messaging_reorder_push(messaging_reorder_t reorder, const char *namesp, const char *topic,
+        uint64_t seq, void *payload, size_t len, uint64_t recv_ns, uint64_t trace_id);
+
+/* seq of namesp/topic went to a message delivered some other way; it is
+ * passed over in turn like a delivered one */
+int messaging_reorder_skip(messaging_reorder_t reorder, const char *namesp, const char *topic,
+        uint64_t seq);
+
+/* gives up on the gaps that have been open for longer than the timeout */
+void messaging_reorder_expire(messaging_reorder_t reorder, uint64_t now_ns);
+
+/* forgets what namesp/topic has seen, for a new subscription */
+void messaging_reorder_forget(messaging_reorder_t reorder, const char *namesp, const char *topic);
+
+void messaging_reorder_counters(messaging_reorder_t reorder, struct messaging_reorder_counters *c);
+
+/* the timeout, how often messaging_reorder_expire() should run */
+uint64_t messaging_reorder_timeout(messaging_reorder_t reorder);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+#ifndef __MESSAGING_ROUTE_H
+#define __MESSAGING_ROUTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <messaging-transport.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Subscriber lists publishers cache to notify subscribers themselves.
+ *
+ * A publisher counts its publishes per topic; once a topic has seen
+ * MESSAGING_DIRECT_THRESHOLD of them it asks the owning server for the
+ * topic's subscribers, and from then on sends notifications straight to
+ * them while the server only handles (un)subscriptions.
+ *
+ * The server remembers the topics it handed out and, once it has
+ * acknowledged a change to their subscribers (or a subscriber leaving),
+ * pushes an invalidation to the publishers that hold routes; those that do
+ * not answer within MESSAGING_PUSH_TIMEOUT get no more until they fetch a
+ * route again.  Each invalidation carries a new epoch from the server; a
+ * route that was answered with an older epoch than the last invalidation
+ * seen from its server may already be stale and is not cached.  A dropped topic starts counting again, so
+ * topics whose subscribers keep changing stay with the server.
+ *
+ *   MESSAGING_DIRECT_THRESHOLD  publishes before a topic goes direct
+ *                               (default 16)
+ *   MESSAGING_DIRECT_TOPICS     topics followed per client (default 1024),
+ *                               others always go through the server
+ */
+
+#define MESSAGING_DIRECT_THRESHOLD  16
+#define MESSAGING_DIRECT_TOPICS     1024
+#define MESSAGING_ROUTE_FORMAT      1
+
+/* a topic's subscribers at its server */
+struct messaging_route {
+    int refs;
+    uint64_t epoch;
+    uint32_t count;
+    uint32_t *ids;               /* subscriber ids at the server */
+    hg_addr_t *addrs;
+    void *entry;                 /* the cache entry it belongs to */
+};
+
+typedef struct messaging_routes* messaging_routes_t;
+#define MESSAGING_ROUTES_NULL ((messaging_routes_t)NULL)
+
+/* threshold and max_topics 0 read the environment */
+int messaging_routes_create(const struct messaging_transport *xport, int num_servers,
+        uint32_t threshold, size_t max_topics, messaging_routes_t *routes);
+void messaging_routes_destroy(messaging_routes_t routes);
+
+/**
+ * @brief Counts a publish to namesp/topic on server.
+ *
+ * @return the route to send it on, with a reference for
+ *         messaging_routes_put(), or NULL to go through the server; then
+ *         *fetch is 1 if the caller should fetch the route and install it
+ */
+struct messaging_route *messaging_routes_get(messaging_routes_t routes, int server,
+        const char *namesp, const char *topic, int *fetch);
+void messaging_routes_put(messaging_routes_t routes, struct messaging_route *route);
+
+/* installs a route fetched from server; on error the topic goes back to counting */
+int messaging_routes_install(messaging_routes_t routes, int server, const char *namesp,
+        const char *topic, const void *buf, size_t len);
+
+/* drops namesp/topic, or every topic of server if topic is NULL, and
+ * remembers epoch as the newest invalidation from server */
+void messaging_routes_invalidate(messaging_routes_t routes, int server, const char *namesp,
+        const char *topic, uint64_t epoch);
+
+/* drops route if it is still cached, after a subscriber could not be reached */
+void messaging_routes_drop(messaging_routes_t routes, struct messaging_route *route);
+
+/* encodes a route for the server: ids[i] listens at addrs[i]; buf comes from
+ * messaging_pool_alloc() */
+int messaging_route_encode(uint64_t epoch, const uint32_t *ids, const char **addrs,
+        uint32_t count, void **buf, size_t *len);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
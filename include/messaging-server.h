@@ -35,6 +35,7 @@
 
 #include <margo.h>
 #include <messaging-common.h>
+#include <messaging-transport.h>
 #include <ss_data.h>
 #include <mpi.h>
 
@@ -46,6 +47,33 @@ extern "C" {
 typedef struct messaging_server* messaging_server_t;
 #define MESSAGING_SERVER_NULL ((messaging_server_t)NULL)
 
+/*
+ * A server process may run several Margo providers (MESSAGING_PROVIDERS,
+ * default 1).  Each owns the topics that hash to it, with a subscription
+ * table, lock and statistics of its own, and is listed to the clients as a
+ * server of its own ("address#provider", see messaging-bootstrap.h).  With
+ * more than one, every provider serves its RPCs from an xstream of its own,
+ * provider n pinned to core MESSAGING_PROVIDER_CPU + n (default 0, modulo
+ * the cores online; negative leaves them unpinned).
+ */
+#define MESSAGING_PROVIDERS_MAX 256
+
+/*
+ * Every message a server fans out carries the next number of its topic's
+ * sequence, which subscribers use to deliver in order (MESSAGING_REORDER,
+ * see messaging-reorder.h).  The notifications of different publishes go out
+ * in parallel; MESSAGING_SERIAL_FANOUT=1 instead finishes one publish's
+ * before starting the next, which keeps each provider's notifications in
+ * order for subscribers running their callbacks one at a time, at the cost
+ * of its throughput.
+ *
+ * With MESSAGING_NOTIFY_ONEWAY=1 notifications go out as one-way RPCs the
+ * subscribers do not answer, and only the ones that cannot be sent count as
+ * failures.  Every MESSAGING_NOTIFY_ACK_EVERY-th fan-out (default 64, 0 for
+ * none) and every one whose payload the subscribers pull is still
+ * acknowledged, so subscribers that stopped answering show up in the
+ * statistics.
+ */
 
 
 /**
@@ -57,10 +85,66 @@ typedef struct messaging_server* messaging_server_t;
   * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
  */
 int server_init(margo_instance_id mid, MPI_Comm comm, messaging_server_t* server);
+
+/**
+ * @brief Creates a MESSAGING server that is alone in its group, without MPI.
+ *
+ * No address file is written; clients find the server through a bootstrap
+ * spec naming its address (see client_init_with_bootstrap()).
+ *
+ * @param[in] mid Margo instance
+ * @param[out] server MESSAGING server
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int server_init_standalone(margo_instance_id mid, messaging_server_t* server);
+
+/**
+ * @brief Address of a server, as clients should look it up.
+ *
+ * @param[in] server MESSAGING server
+ *
+ * @return the address, valid until server_destroy()
+ */
+const char *server_address(messaging_server_t server);
+
+/**
+ * @brief Number of providers the server runs.
+ *
+ * @param[in] server MESSAGING server
+ *
+ * @return the number of providers, at least 1
+ */
+int server_num_providers(messaging_server_t server);
+
+/**
+ * @brief Server list entry of one of the server's providers.
+ *
+ * Provider 0 is listed under server_address().
+ *
+ * @param[in] server MESSAGING server
+ * @param[in] provider provider number, below server_num_providers()
+ *
+ * @return the entry, valid until server_destroy(); NULL if there is no such provider
+ */
+const char *server_provider_address(messaging_server_t server, int provider);
+
+/**
+ * @brief Sends the server's RPCs through another transport.
+ *
+ * Used to run the server against a simulated network (see
+ * messaging-sim.h).  Only allowed before any subscriber has registered.
+ *
+ * @param[in] server MESSAGING server
+ * @param[in] xport transport, copied
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int server_set_transport(messaging_server_t server, const struct messaging_transport *xport);
 	
 
 /**
- * @brief Destroys the Messaging server and deregisters its RPC.
+ * @brief Destroys the Messaging server, all its providers, and deregisters their RPCs.
  *
  * @param[in] server Messaging server
  *
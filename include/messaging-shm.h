@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_SHM_H
+#define __MESSAGING_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Intra-node delivery through shared memory.
+ *
+ * Processes on a node attach to one POSIX shared memory segment holding a
+ * fixed directory of per-topic broadcast rings.  A subscriber claims a reader
+ * slot in the ring of each topic it subscribes to and polls it; a publisher
+ * copies the payload into the next ring slot and learns which subscribers
+ * the slot reaches, so the server can leave them out of its fan-out.
+ *
+ * Rings are written without locks: publishers reserve a position with a
+ * compare-and-swap on the ring head, only when every reader has consumed the
+ * slot that position reuses, and publish it by storing its sequence number.
+ * A full ring, a payload larger than a slot or a topic without a ring simply
+ * reach nobody locally, and the message takes the Margo path instead.
+ *
+ * The segment is configured from the environment by whoever creates it:
+ *   MESSAGING_SHM            1 to enable intra-node delivery (default 0)
+ *   MESSAGING_SHM_NAME       segment name (default /messaging-<uid>)
+ *   MESSAGING_SHM_RINGS      number of topic rings (default 64)
+ *   MESSAGING_SHM_SLOTS      slots per ring (default 128)
+ *   MESSAGING_SHM_SLOT_SIZE  bytes per slot including its header (default 4K)
+ * Sizes accept a k, m or g suffix.
+ */
+
+#define MESSAGING_SHM_DEFAULT_RINGS      64
+#define MESSAGING_SHM_DEFAULT_SLOTS      128
+#define MESSAGING_SHM_DEFAULT_SLOT_SIZE  4096
+#define MESSAGING_SHM_MAX_READERS        64   /* per ring */
+#define MESSAGING_SHM_NAME_MAX           256  /* namespace and topic, with their NULs */
+
+typedef struct messaging_shm* messaging_shm_t;
+#define MESSAGING_SHM_NULL ((messaging_shm_t)NULL)
+
+typedef struct messaging_shm_reader* messaging_shm_reader_t;
+
+struct messaging_shm_config {
+    int enabled;
+    char name[64];
+    uint32_t num_rings;
+    uint32_t num_slots;
+    uint32_t slot_size;
+};
+
+/* called for every message read from a ring, data is only valid during the call */
+typedef void (*messaging_shm_deliver_fn)(void *arg, const char *namesp, const char *topic,
+        const void *data, size_t len);
+
+void messaging_shm_config_init(struct messaging_shm_config *cfg);
+
+/**
+ * @brief Attaches to the node's segment, creating it if needed.
+ *
+ * @param[in] cfg configuration, used only if the segment is created
+ * @param[out] shm segment, MESSAGING_SHM_NULL if cfg->enabled is 0
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_shm_attach(const struct messaging_shm_config *cfg, messaging_shm_t *shm);
+
+/* detaches, removing the segment when the last process leaves */
+void messaging_shm_detach(messaging_shm_t shm);
+
+/* largest payload a ring slot holds */
+size_t messaging_shm_max_payload(messaging_shm_t shm);
+
+/**
+ * @brief Starts reading namesp/topic from its ring, creating the ring if needed.
+ *
+ * @param[in] shm segment
+ * @param[in] namesp namespace
+ * @param[in] topic topic
+ * @param[in] sub_id our subscriber id at the server owning the topic
+ * @param[out] reader reader to poll
+ *
+ * @return MESSAGING_SUCCESS, or an error if the topic cannot use a ring
+ */
+int messaging_shm_subscribe(messaging_shm_t shm, const char *namesp, const char *topic,
+        uint32_t sub_id, messaging_shm_reader_t *reader);
+
+/* gives up the reader slot */
+void messaging_shm_unsubscribe(messaging_shm_reader_t reader);
+
+/* namespace and topic a reader is attached to */
+const char *messaging_shm_reader_namesp(messaging_shm_reader_t reader);
+const char *messaging_shm_reader_topic(messaging_shm_reader_t reader);
+
+/**
+ * @brief Delivers up to max messages waiting for a reader.
+ *
+ * @return the number of messages delivered
+ */
+int messaging_shm_poll(messaging_shm_reader_t reader, messaging_shm_deliver_fn fn, void *arg, int max);
+
+/**
+ * @brief Broadcasts a payload to the local subscribers of namesp/topic.
+ *
+ * @param[in] shm segment
+ * @param[in] namesp namespace
+ * @param[in] topic topic
+ * @param[in] data payload
+ * @param[in] len payload length
+ * @param[in] skip_self 1 to leave out readers of the calling process, which
+ *            the caller delivers to itself
+ * @param[out] ids subscriber ids the message will reach, room for
+ *             MESSAGING_SHM_MAX_READERS entries
+ *
+ * @return the number of ids, 0 if nobody local was reached
+ */
+int messaging_shm_publish(messaging_shm_t shm, const char *namesp, const char *topic,
+        const void *data, size_t len, int skip_self, uint32_t *ids);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
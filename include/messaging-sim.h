@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_SIM_H
+#define __MESSAGING_SIM_H
+
+#include <stdint.h>
+#include <messaging-transport.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * A simulated network of virtual subscribers, for running a real server at
+ * a scale no allocation would give us.
+ *
+ * The simulation is a transport (see messaging-transport.h) layered over
+ * another one.  Addresses "sim://<n>", n below max_endpoints, name virtual
+ * endpoints that cost a counter each; everything else is passed to the
+ * inner transport untouched, so the server keeps serving real clients.
+ * A virtual endpoint accepts notifications (message_t in, response_t out)
+ * and answers them after a modelled delay:
+ *
+ *   sender link   one at a time at 'bandwidth' bytes/s (0: unlimited),
+ *                 counting the inline message and any bulk payload
+ *   network       'latency' each way plus up to 'jitter' more
+ *   subscriber    'handler' to process the message
+ *
+ * A fraction 'failure_rate' of notifications is answered with an error.
+ * Waiting for a reply yields until its modelled completion time.
+ */
+
+#define MESSAGING_SIM_PREFIX "sim://"
+
+struct messaging_sim_config {
+    uint64_t latency_ns;        /* one way, default 1 us */
+    uint64_t jitter_ns;         /* 0 */
+    double bandwidth;           /* bytes/s, 0 */
+    uint64_t handler_ns;        /* 0 */
+    double failure_rate;        /* 0 */
+    uint32_t max_endpoints;     /* 100000 */
+    uint64_t seed;              /* 1 */
+};
+
+struct messaging_sim_stats {
+    uint64_t notifications;     /* sent to virtual endpoints */
+    uint64_t bytes;
+    uint64_t failures;          /* answered with an error */
+    uint64_t link_busy_ns;      /* time the sender link spent transmitting */
+    uint64_t max_completion_ns; /* longest modelled time from send to reply */
+};
+
+typedef struct messaging_sim *messaging_sim_t;
+
+void messaging_sim_config_init(struct messaging_sim_config *cfg);
+
+/**
+ * @brief Creates a simulated network over 'inner'.
+ *
+ * @param[in] inner transport for addresses that are not virtual, copied
+ * @param[in] cfg configuration
+ * @param[out] sim the simulation
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_sim_create(const struct messaging_transport *inner,
+        const struct messaging_sim_config *cfg, messaging_sim_t *sim);
+
+/* the users of the transport must be gone */
+void messaging_sim_destroy(messaging_sim_t sim);
+
+/* the transport to hand to server_set_transport(), valid until messaging_sim_destroy() */
+const struct messaging_transport *messaging_sim_transport(messaging_sim_t sim);
+
+/* notifications virtual endpoint n has received */
+uint64_t messaging_sim_delivered(messaging_sim_t sim, uint32_t n);
+
+void messaging_sim_get_stats(messaging_sim_t sim, struct messaging_sim_stats *stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_STATS_H
+#define __MESSAGING_STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <messaging-hist.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Server statistics.
+ *
+ * The server keeps its counters and histograms per Argobots execution
+ * stream, so the publish path only writes memory no other stream writes,
+ * and a snapshot sums them.  Hot topics are tracked per stream with the
+ * space-saving algorithm over MESSAGING_STATS_HOT_SLOTS entries; once more
+ * topics than that are active, their publish counts are upper bounds.
+ *
+ * Snapshots are returned to clients by messaging_get_server_stats() and can
+ * be dumped periodically in the Prometheus text format:
+ *   MESSAGING_STATS_FILE      file to write, empty disables (default)
+ *   MESSAGING_STATS_INTERVAL  seconds between dumps (default 10)
+ */
+
+#define MESSAGING_STATS_TOP_N         16
+#define MESSAGING_STATS_NAME_MAX      64   /* longer names are truncated */
+#define MESSAGING_STATS_HOT_SLOTS     64
+#define MESSAGING_STATS_MAX_XSTREAMS  64   /* streams beyond this share slots */
+
+/* space-saving counters over the hottest topics, one writer */
+struct messaging_hot_topics {
+    uint64_t hash[MESSAGING_STATS_HOT_SLOTS];
+    uint64_t count[MESSAGING_STATS_HOT_SLOTS];
+    char namesp[MESSAGING_STATS_HOT_SLOTS][MESSAGING_STATS_NAME_MAX];
+    char topic[MESSAGING_STATS_HOT_SLOTS][MESSAGING_STATS_NAME_MAX];
+};
+
+struct messaging_topic_stats {
+    char namesp[MESSAGING_STATS_NAME_MAX];
+    char topic[MESSAGING_STATS_NAME_MAX];
+    uint64_t publishes;
+    uint64_t subscribers;
+};
+
+/* a snapshot; about 120 KB because of the histograms, keep it off the stack */
+struct messaging_server_stats {
+    uint64_t uptime_ns;
+    uint64_t publishes;
+    uint64_t publish_bytes;
+    uint64_t publish_errors;     /* malformed publishes, or payloads we could not pull */
+    uint64_t notifies;
+    uint64_t notify_failures;
+    uint64_t notifies_oneway;    /* notifications sent without waiting for an answer */
+    uint64_t publishes_oneway;   /* publishes the publisher did not wait for */
+    uint64_t subscribes;
+    uint64_t unsubscribes;
+    uint64_t registrations;
+    uint64_t in_flight;          /* publishes being handled when the snapshot was taken */
+    uint64_t topics;             /* topics with subscribers */
+    uint64_t subscribers;        /* registered subscribers */
+    uint64_t membership_bytes;
+    uint32_t num_top;
+    struct messaging_topic_stats top[MESSAGING_STATS_TOP_N];   /* by publishes */
+    struct messaging_hist msg_size;       /* payload bytes */
+    struct messaging_hist fanout;         /* subscribers notified per publish */
+    struct messaging_hist handler_ns;     /* publish handler, start to finish */
+    struct messaging_hist notify_rtt_ns;  /* notify round trip */
+};
+
+/* what one execution stream records */
+struct messaging_stats_xs {
+    uint64_t publishes;
+    uint64_t publish_bytes;
+    uint64_t publish_errors;
+    uint64_t notifies;
+    uint64_t notify_failures;
+    uint64_t notifies_oneway;
+    uint64_t publishes_oneway;
+    uint64_t subscribes;
+    uint64_t unsubscribes;
+    uint64_t registrations;
+    struct messaging_hist msg_size;
+    struct messaging_hist fanout;
+    struct messaging_hist handler_ns;
+    struct messaging_hist notify_rtt_ns;
+    struct messaging_hot_topics hot;
+};
+
+typedef struct messaging_stats* messaging_stats_t;
+#define MESSAGING_STATS_NULL ((messaging_stats_t)NULL)
+
+int messaging_stats_create(messaging_stats_t *stats);
+void messaging_stats_destroy(messaging_stats_t stats);
+
+/**
+ * @brief Counters of the calling execution stream.
+ *
+ * Update them right away: a ULT that yields may resume on another stream.
+ */
+struct messaging_stats_xs *messaging_stats_local(messaging_stats_t stats);
+
+/* counts a message for namesp/topic towards the hot topics */
+void messaging_stats_hot(struct messaging_hot_topics *hot, uint64_t topic_hash,
+        const char *namesp, const char *topic);
+
+/* publishes being handled, shared by all streams */
+void messaging_stats_in_flight(messaging_stats_t stats, int delta);
+
+/* sums the streams into out; table sizes and per-topic subscribers are left 0 */
+void messaging_stats_snapshot(messaging_stats_t stats, struct messaging_server_stats *out);
+
+/**
+ * @brief Serializes a snapshot for the stats RPC.
+ *
+ * @param[out] buf messaging_pool_alloc()'ed buffer, owned by the caller
+ * @param[out] len its length
+ *
+ * @return MESSAGING_SUCCESS or MESSAGING_ERR_ALLOCATION
+ */
+int messaging_stats_encode(const struct messaging_server_stats *stats, void **buf, size_t *len);
+
+/* @return MESSAGING_SUCCESS or MESSAGING_ERR_PROTOCOL */
+int messaging_stats_decode(const void *buf, size_t len, struct messaging_server_stats *stats);
+
+/* writes a snapshot in the Prometheus text exposition format */
+void messaging_stats_write_prometheus(FILE *f, const struct messaging_server_stats *stats,
+        const char *instance);
+
+/*
+ * Client statistics.
+ *
+ * Clients publish from application threads and run callbacks on Argobots
+ * streams, so their counters and histograms are kept per thread instead of
+ * per stream; threads beyond MESSAGING_CSTATS_MAX_THREADS share slots and
+ * may lose updates.  Round trips to each server are also summed in shared
+ * atomics, so a slow server stands out from the others.
+ *
+ * Callbacks are followed by a watchdog: one that runs longer than the
+ * limit is reported while it is still running and counted when it returns.
+ */
+
+#define MESSAGING_CSTATS_MAX_THREADS  64
+#define MESSAGING_CSTATS_MAX_SERVERS  64    /* servers beyond this share slots */
+#define MESSAGING_CSTATS_WATCH_SLOTS  256   /* callbacks followed at once, more run unwatched */
+
+struct messaging_client_server_stats {
+    uint64_t publishes;
+    uint64_t updates;            /* subscribes and unsubscribes */
+    uint64_t errors;
+    uint64_t rtt_sum_ns;
+    uint64_t rtt_max_ns;
+};
+
+/* a snapshot; about 150 KB because of the histograms, keep it off the stack */
+struct messaging_client_stats {
+    uint64_t uptime_ns;
+    uint64_t publishes;
+    uint64_t publish_errors;
+    uint64_t publishes_filtered; /* publishes not sent, the topic had no subscribers */
+    uint64_t publishes_direct;   /* publishes sent straight to the subscribers */
+    uint64_t direct_failures;    /* subscribers those could not reach */
+    uint64_t publishes_oneway;   /* publishes not waiting for the server, see publish_set_oneway() */
+    uint64_t bytes_out;          /* payload bytes published */
+    uint64_t subscribes;
+    uint64_t unsubscribes;
+    uint64_t notifications;      /* messages received, from servers, shared memory or ourselves */
+    uint64_t bytes_in;
+    uint64_t slow_callbacks;     /* callbacks that ran longer than the watchdog limit */
+    uint64_t pending;            /* notifications received whose callback has not returned */
+    uint64_t max_pending;
+    uint64_t reorder_held;       /* MESSAGING_REORDER: notifications that waited for earlier ones */
+    uint64_t reorder_gaps;       /* sequence numbers given up on */
+    uint64_t reorder_duplicates; /* notifications dropped, their turn had passed */
+    uint32_t num_servers;
+    struct messaging_client_server_stats servers[MESSAGING_CSTATS_MAX_SERVERS];
+    uint32_t num_top;
+    struct messaging_topic_stats top[MESSAGING_STATS_TOP_N];   /* by notifications, in publishes */
+    struct messaging_hist publish_rtt_ns;
+    struct messaging_hist subscribe_rtt_ns;  /* subscribes and unsubscribes, one at a time */
+    struct messaging_hist callback_ns;       /* callback start to return */
+    struct messaging_hist dispatch_ns;       /* notification received to callback start */
+    struct messaging_hist handler_queue;     /* handler pool size, sampled by the watchdog */
+};
+
+typedef struct messaging_cstats* messaging_cstats_t;
+#define MESSAGING_CSTATS_NULL ((messaging_cstats_t)NULL)
+
+/* a callback being timed */
+struct messaging_cstats_cb {
+    uint64_t start_ns;
+    int slot;                    /* in the watchdog table, -1 if unwatched */
+    const char *namesp;
+    const char *topic;
+};
+
+/**
+ * @brief Creates client statistics.
+ *
+ * @param[in] num_servers servers the client talks to
+ * @param[in] warn_ns callbacks running longer than this are reported, 0 disables
+ */
+int messaging_cstats_create(int num_servers, uint64_t warn_ns, messaging_cstats_t *stats);
+void messaging_cstats_destroy(messaging_cstats_t stats);
+
+/* a publish to server answered after rtt_ns; ok is 0 if it failed */
+void messaging_cstats_publish(messaging_cstats_t stats, int server, size_t len,
+        uint64_t rtt_ns, int ok);
+
+/* a publish the subscription filter kept from going to the server */
+void messaging_cstats_filtered(messaging_cstats_t stats, size_t len);
+
+/* a publish sent straight to the subscribers, failed of which could not be reached */
+void messaging_cstats_direct(messaging_cstats_t stats, int failed);
+
+/* a publish to server that nobody answers; ok is 0 if it could not be sent */
+void messaging_cstats_oneway(messaging_cstats_t stats, int server, size_t len, int ok);
+
+/* subscriptions (subscribe != 0) or unsubscriptions requested by the application */
+void messaging_cstats_updates(messaging_cstats_t stats, int subscribe, size_t count);
+
+/* a single (un)subscribe round trip to server */
+void messaging_cstats_update_rtt(messaging_cstats_t stats, int server, uint64_t rtt_ns, int ok);
+
+/* a message for namesp/topic arrived, whether or not a callback takes it */
+void messaging_cstats_received(messaging_cstats_t stats, const char *namesp, const char *topic,
+        size_t len);
+
+/* notifications between receipt and the end of their callback */
+void messaging_cstats_pending(messaging_cstats_t stats, int delta);
+
+/**
+ * @brief Times a callback.
+ *
+ * namesp and topic must stay valid until messaging_cstats_callback_end().
+ *
+ * @param[in] recv_ns when the message was received, the dispatch delay is
+ *            measured from there; 0 records none
+ */
+void messaging_cstats_callback_begin(messaging_cstats_t stats, struct messaging_cstats_cb *cb,
+        const char *namesp, const char *topic, uint64_t recv_ns);
+void messaging_cstats_callback_end(messaging_cstats_t stats, struct messaging_cstats_cb *cb);
+
+/**
+ * @brief One pass of the watchdog.
+ *
+ * Reports callbacks that have run past the limit and were not reported yet,
+ * and records queue_size, the handler pool size, if it is not negative.
+ * Call it from a single thread.
+ */
+void messaging_cstats_watch(messaging_cstats_t stats, long queue_size);
+
+void messaging_cstats_snapshot(messaging_cstats_t stats, struct messaging_client_stats *out);
+
+/* writes a client snapshot in the Prometheus text exposition format */
+void messaging_client_stats_write_prometheus(FILE *f, const struct messaging_client_stats *stats,
+        const char *instance);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
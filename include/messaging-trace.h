@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_TRACE_H
+#define __MESSAGING_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <margo.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Sampled end-to-end message tracing.
+ *
+ * A publisher picks one message in MESSAGING_TRACE and tags it with a trace
+ * id (extension WIRE_EXT_TRACE).  Every process that handles a tagged message
+ * and has tracing enabled records a span per hop: an event, its wall clock
+ * time and, for the fan-out, the subscriber id.  Spans go into a lock-free
+ * ring that a ULT drains into one binary file per process; tests/trace_merge
+ * joins the files by trace id, estimates the clock offset between processes
+ * from the publish and notify round trips and prints a per-hop breakdown.
+ *
+ *   MESSAGING_TRACE        trace one publish in N, and record spans for
+ *                          traced messages from other processes (default 0, off)
+ *   MESSAGING_TRACE_DIR    where trace files go (default .)
+ *   MESSAGING_TRACE_SPANS  ring capacity, rounded up to a power of two;
+ *                          spans recorded while it is full are dropped
+ *                          (default 64K)
+ *
+ * Messages delivered through shared memory rings or dispatched in place by
+ * the publisher do not go through the server and are not traced.
+ */
+
+/* span events, in the order a message meets them */
+#define MESSAGING_TRACE_PUBLISH         1  /* publish() called */
+#define MESSAGING_TRACE_PUBLISH_DONE    2  /* the server answered the publisher */
+#define MESSAGING_TRACE_SERVER_RECV     3  /* publish handler started */
+#define MESSAGING_TRACE_ROUTE_DONE      4  /* subscribers looked up, publisher answered */
+#define MESSAGING_TRACE_NOTIFY_SENT     5  /* arg: subscriber id */
+#define MESSAGING_TRACE_NOTIFY_DONE     6  /* arg: subscriber id */
+#define MESSAGING_TRACE_SUB_RECV        7  /* notify handler started, arg: our subscriber id */
+#define MESSAGING_TRACE_SUB_RESPOND     8  /* notify answered, arg: our subscriber id */
+#define MESSAGING_TRACE_CALLBACK_START  9  /* arg: our subscriber id */
+#define MESSAGING_TRACE_CALLBACK_END    10 /* arg: our subscriber id */
+#define MESSAGING_TRACE_NUM_EVENTS      11
+
+#define MESSAGING_TRACE_DEFAULT_SPANS   65536
+#define MESSAGING_TRACE_MAGIC           "MSGTRACE"
+#define MESSAGING_TRACE_VERSION         1
+
+/* a trace file is a header followed by spans, both in host byte order */
+struct messaging_trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;
+    char host[64];              /* processes on one host share a clock */
+    char addr[128];             /* Margo address of the process */
+};
+
+struct messaging_trace_span {
+    uint64_t trace_id;
+    uint64_t ts;                /* ns, CLOCK_REALTIME of the recording process */
+    uint32_t event;
+    uint32_t arg;
+};
+
+struct messaging_trace_config {
+    uint32_t rate;              /* 0 disables tracing */
+    char dir[256];
+    uint32_t num_spans;
+};
+
+void messaging_trace_config_init(struct messaging_trace_config *cfg);
+
+/**
+ * @brief Starts tracing for this process.
+ *
+ * Clients and servers in one process share the tracer; it is set up by the
+ * first caller with cfg->rate set and stops with the last
+ * messaging_trace_stop().
+ *
+ * @param[in] mid Margo instance running the ULT that writes the file
+ * @param[in] cfg configuration
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+int messaging_trace_start(margo_instance_id mid, const struct messaging_trace_config *cfg);
+
+/* writes the remaining spans and closes the file with the last user */
+void messaging_trace_stop(void);
+
+/* nonzero while this process records spans */
+int messaging_trace_enabled(void);
+
+/* a fresh trace id if this publish is sampled, 0 otherwise */
+uint64_t messaging_trace_sample(void);
+
+/* records a span; a no-op if tracing is off or trace_id is 0 */
+void messaging_trace_record(uint64_t trace_id, uint32_t event, uint32_t arg, uint64_t ts);
+
+/* spans dropped because the ring was full */
+uint64_t messaging_trace_dropped(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
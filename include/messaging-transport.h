@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#ifndef __MESSAGING_TRANSPORT_H
+#define __MESSAGING_TRANSPORT_H
+
+#include <margo.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * The RPC calls clients and servers make, behind a table of functions.
+ *
+ * messaging_transport_margo() gives the plain Margo calls, which is what
+ * clients and servers use unless told otherwise.  Other transports may hand
+ * out addresses, handles and requests of their own; callers only ever pass
+ * them back to the transport they came from.  Argument decoding
+ * (margo_get_input), bulk transfers and RPC registration stay with Margo.
+ * Forwards name the provider that should handle the RPC at the target;
+ * xport_forward() and xport_iforward() go to MARGO_DEFAULT_PROVIDER_ID.
+ * A timed forward fails its wait with HG_TIMEOUT once timeout_ms pass
+ * without an answer.
+ */
+
+struct messaging_transport_ops {
+    const char *name;
+    hg_return_t (*lookup)(void *ctx, const char *name, hg_addr_t *addr);
+    hg_return_t (*addr_dup)(void *ctx, hg_addr_t addr, hg_addr_t *copy);
+    hg_return_t (*addr_free)(void *ctx, hg_addr_t addr);
+    hg_return_t (*create)(void *ctx, hg_addr_t addr, hg_id_t id, hg_handle_t *h);
+    hg_return_t (*forward)(void *ctx, hg_handle_t h, uint16_t provider, void *in);
+    hg_return_t (*iforward)(void *ctx, hg_handle_t h, uint16_t provider, void *in, margo_request *req);
+    hg_return_t (*iforward_timed)(void *ctx, hg_handle_t h, uint16_t provider, void *in,
+            double timeout_ms, margo_request *req);
+    hg_return_t (*wait)(void *ctx, margo_request req);
+    hg_return_t (*test)(void *ctx, margo_request req, int *flag);
+    hg_return_t (*get_output)(void *ctx, hg_handle_t h, void *out);
+    hg_return_t (*free_output)(void *ctx, hg_handle_t h, void *out);
+    hg_return_t (*respond)(void *ctx, hg_handle_t h, void *out);
+    hg_return_t (*destroy)(void *ctx, hg_handle_t h);
+};
+
+struct messaging_transport {
+    const struct messaging_transport_ops *ops;
+    void *ctx;
+};
+
+/* fills t with the Margo calls on instance mid */
+void messaging_transport_margo(margo_instance_id mid, struct messaging_transport *t);
+
+static inline hg_return_t xport_lookup(const struct messaging_transport *t, const char *name, hg_addr_t *addr)
+{
+    return t->ops->lookup(t->ctx, name, addr);
+}
+
+static inline hg_return_t xport_addr_dup(const struct messaging_transport *t, hg_addr_t addr, hg_addr_t *copy)
+{
+    return t->ops->addr_dup(t->ctx, addr, copy);
+}
+
+static inline hg_return_t xport_addr_free(const struct messaging_transport *t, hg_addr_t addr)
+{
+    return t->ops->addr_free(t->ctx, addr);
+}
+
+static inline hg_return_t xport_create(const struct messaging_transport *t, hg_addr_t addr, hg_id_t id, hg_handle_t *h)
+{
+    return t->ops->create(t->ctx, addr, id, h);
+}
+
+static inline hg_return_t xport_forward(const struct messaging_transport *t, hg_handle_t h, void *in)
+{
+    return t->ops->forward(t->ctx, h, MARGO_DEFAULT_PROVIDER_ID, in);
+}
+
+static inline hg_return_t xport_iforward(const struct messaging_transport *t, hg_handle_t h, void *in, margo_request *req)
+{
+    return t->ops->iforward(t->ctx, h, MARGO_DEFAULT_PROVIDER_ID, in, req);
+}
+
+static inline hg_return_t xport_iforward_timed(const struct messaging_transport *t, hg_handle_t h, void *in,
+        double timeout_ms, margo_request *req)
+{
+    return t->ops->iforward_timed(t->ctx, h, MARGO_DEFAULT_PROVIDER_ID, in, timeout_ms, req);
+}
+
+static inline hg_return_t xport_provider_forward(const struct messaging_transport *t, hg_handle_t h,
+        uint16_t provider, void *in)
+{
+    return t->ops->forward(t->ctx, h, provider, in);
+}
+
+static inline hg_return_t xport_provider_iforward(const struct messaging_transport *t, hg_handle_t h,
+        uint16_t provider, void *in, margo_request *req)
+{
+    return t->ops->iforward(t->ctx, h, provider, in, req);
+}
+
+static inline hg_return_t xport_provider_iforward_timed(const struct messaging_transport *t, hg_handle_t h,
+        uint16_t provider, void *in, double timeout_ms, margo_request *req)
+{
+    return t->ops->iforward_timed(t->ctx, h, provider, in, timeout_ms, req);
+}
+
+static inline hg_return_t xport_wait(const struct messaging_transport *t, margo_request req)
+{
+    return t->ops->wait(t->ctx, req);
+}
+
+/* sets *flag when req has completed, without waiting for it */
+static inline hg_return_t xport_test(const struct messaging_transport *t, margo_request req, int *flag)
+{
+    return t->ops->test(t->ctx, req, flag);
+}
+
+static inline hg_return_t xport_get_output(const struct messaging_transport *t, hg_handle_t h, void *out)
+{
+    return t->ops->get_output(t->ctx, h, out);
+}
+
+static inline hg_return_t xport_free_output(const struct messaging_transport *t, hg_handle_t h, void *out)
+{
+    return t->ops->free_output(t->ctx, h, out);
+}
+
+static inline hg_return_t xport_respond(const struct messaging_transport *t, hg_handle_t h, void *out)
+{
+    return t->ops->respond(t->ctx, h, out);
+}
+
+static inline hg_return_t xport_destroy(const struct messaging_transport *t, hg_handle_t h)
+{
+    return t->ops->destroy(t->ctx, h);
+}
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Wire format shared by every messaging RPC.
+ *
+ * A message is laid out as
+ *
+ *   offset  0  u16 magic
+ *   offset  2  u8  version
+ *   offset  3  u8  flags
+ *   offset  4  u32 reserved (sent as 0, ignored on receive)
+ *   offset  8  u64 topic hash
+ *   offset 16  u64 sequence number
+ *   offset 24  u64 timestamp (ns)
+ *   offset 32  varint namespace length, varint topic length,
+ *              varint extension length, varint payload length
+ *              namespace (NUL terminated), topic (NUL terminated),
+ *              extension records, zero padding up to a multiple of WIRE_ALIGN
+ *              payload
+ *
+ * All integers are little endian, varints are unsigned LEB128.  The payload
+ * starts on a WIRE_ALIGN boundary relative to the start of the message, so a
+ * message received into a WIRE_ALIGN aligned buffer can be reinterpreted in
+ * place.  With WIRE_FLAG_BULK the message ends at the padding and the payload
+ * length describes data that travels by bulk transfer.  With WIRE_FLAG_BATCH
+ * the payload is a list of topic records, each a varint namespace length, a
+ * varint topic length and the two NUL terminated strings.  The extension
+ * area is a list of (u8 type, varint length, bytes) records; unknown record
+ * types are skipped by readers.
+ */
+
+#ifndef __MESSAGING_WIRE_H
+#define __MESSAGING_WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <messaging-common.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define WIRE_MAGIC        0x4d50  /* "PM" on the wire */
+#define WIRE_VERSION      1
+#define WIRE_ALIGN        64
+#define WIRE_FIXED_SIZE   32
+#define WIRE_VARINT_MAX   10
+
+/* header flags */
+#define WIRE_FLAG_NONE    0x00
+#define WIRE_FLAG_BULK    0x01  /* payload is not inline, it is pulled with a bulk transfer */
+#define WIRE_FLAG_BATCH   0x02  /* payload is a list of topic records */
+#define WIRE_FLAG_SKIP    0x04  /* no payload, the sequence number went to a message
+                                   the subscriber got from the publisher itself */
+
+/* extension record types */
+#define WIRE_EXT_ADDR     1  /* subscriber address, NUL terminated */
+#define WIRE_EXT_SUBID    2  /* subscriber id assigned by the server, u32 */
+#define WIRE_EXT_EXCLUDE  3  /* subscriber ids the publisher reached itself, u32 each */
+#define WIRE_EXT_TRACE    4  /* trace id of a sampled message, u64 */
+
+struct wire_msg {
+    uint8_t version;
+    uint8_t flags;
+    uint64_t topic_hash;
+    uint64_t seq;
+    uint64_t timestamp;
+    const char *namesp;     /* NUL terminated */
+    size_t namesp_len;      /* including the NUL */
+    const char *topic;      /* NUL terminated */
+    size_t topic_len;       /* including the NUL */
+    const void *ext;
+    size_t ext_len;
+    void *payload;
+    size_t payload_len;
+};
+
+static inline void wire_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void wire_put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline void wire_put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint16_t wire_get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t wire_get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t wire_get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline size_t wire_varint_size(uint64_t v)
+{
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static inline size_t wire_put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/* returns the number of bytes consumed, or 0 if the varint is truncated or overlong */
+static inline size_t wire_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t res = 0;
+    size_t n = 0;
+    while (p + n < end && n < WIRE_VARINT_MAX) {
+        uint8_t b = p[n];
+        if (n == WIRE_VARINT_MAX - 1 && b > 1)
+            return 0;
+        res |= (uint64_t)(b & 0x7f) << (7 * n);
+        n++;
+        if (!(b & 0x80)) {
+            *v = res;
+            return n;
+        }
+    }
+    return 0;
+}
+
+/* FNV-1a over "namespace\0topic" */
+static inline uint64_t wire_topic_hash(const char *namesp, const char *topic)
+{
+    uint64_t h = 14695981039346656037ULL;
+    const unsigned char *s;
+    for (s = (const unsigned char *)namesp; *s; s++)
+        h = (h ^ *s) * 1099511628211ULL;
+    h = (h ^ 0) * 1099511628211ULL;
+    for (s = (const unsigned char *)topic; *s; s++)
+        h = (h ^ *s) * 1099511628211ULL;
+    return h;
+}
+
+static inline uint64_t wire_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline size_t wire_ext_size(size_t len)
+{
+    return 1 + wire_varint_size(len) + len;
+}
+
+/* writes one extension record at p, returns its size */
+static inline size_t wire_ext_put(void *p, uint8_t type, const void *data, size_t len)
+{
+    uint8_t *b = (uint8_t *)p;
+    size_t n = 0;
+    b[n++] = type;
+    n += wire_put_varint(b + n, len);
+    if (len)
+        memcpy(b + n, data, len);
+    return n + len;
+}
+
+/* finds the first extension record of the given type; returns 1 if found */
+static inline int wire_ext_find(const struct wire_msg *m, uint8_t type, const void **data, size_t *len)
+{
+    const uint8_t *p = (const uint8_t *)m->ext;
+    const uint8_t *end = p + m->ext_len;
+    while (p < end) {
+        uint8_t t = *p++;
+        uint64_t l;
+        size_t n = wire_get_varint(p, end, &l);
+        if (n == 0 || l > (uint64_t)(end - p - n))
+            return 0;
+        p += n;
+        if (t == type) {
+            *data = p;
+            *len = (size_t)l;
+            return 1;
+        }
+        p += l;
+    }
+    return 0;
+}
+
+/* finds a NUL terminated string extension record, or returns NULL */
+static inline const char *wire_ext_string(const struct wire_msg *m, uint8_t type)
+{
+    const void *data;
+    size_t len;
+    if (!wire_ext_find(m, type, &data, &len) || len == 0 || ((const char *)data)[len-1] != '\0')
+        return NULL;
+    return (const char *)data;
+}
+
+/* reads a u32 extension, returns 0 if it is missing or the wrong size */
+static inline int wire_ext_u32(const struct wire_msg *m, uint8_t type, uint32_t *v)
+{
+    const void *data;
+    size_t len;
+    if (!wire_ext_find(m, type, &data, &len) || len != 4)
+        return 0;
+    *v = wire_get_u32((const uint8_t *)data);
+    return 1;
+}
+
+/* reads a u64 extension, returns 0 if it is missing or the wrong size */
+static inline int wire_ext_u64(const struct wire_msg *m, uint8_t type, uint64_t *v)
+{
+    const void *data;
+    size_t len;
+    if (!wire_ext_find(m, type, &data, &len) || len != 8)
+        return 0;
+    *v = wire_get_u64((const uint8_t *)data);
+    return 1;
+}
+
+static inline size_t wire_topic_rec_size(size_t namesp_len, size_t topic_len)
+{
+    return wire_varint_size(namesp_len) + wire_varint_size(topic_len) + namesp_len + topic_len;
+}
+
+/* appends a topic record for a batch, lengths include the NUL; returns its size */
+static inline size_t wire_put_topic_rec(void *p, const char *namesp, size_t namesp_len,
+        const char *topic, size_t topic_len)
+{
+    uint8_t *b = (uint8_t *)p;
+    size_t n = wire_put_varint(b, namesp_len);
+    n += wire_put_varint(b + n, topic_len);
+    memcpy(b + n, namesp, namesp_len);
+    n += namesp_len;
+    memcpy(b + n, topic, topic_len);
+    return n + topic_len;
+}
+
+/* reads the topic record at p; returns its size, or 0 if it is malformed */
+static inline size_t wire_get_topic_rec(const void *p, const void *end,
+        const char **namesp, const char **topic)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    const uint8_t *e = (const uint8_t *)end;
+    uint64_t nl, tl;
+    size_t n, c;
+
+    if ((c = wire_get_varint(b, e, &nl)) == 0)
+        return 0;
+    n = c;
+    if ((c = wire_get_varint(b + n, e, &tl)) == 0)
+        return 0;
+    n += c;
+    if (nl == 0 || tl == 0 || nl > (uint64_t)(e - b - n) || tl > (uint64_t)(e - b - n) - nl)
+        return 0;
+    if (b[n + nl - 1] != '\0' || b[n + nl + tl - 1] != '\0')
+        return 0;
+    *namesp = (const char *)(b + n);
+    *topic = (const char *)(b + n + nl);
+    if (strlen(*namesp) + 1 != nl || strlen(*topic) + 1 != tl)
+        return 0;
+    return n + (size_t)(nl + tl);
+}
+
+/**
+ * @brief Fills in a header for namespace 'namesp' and topic 'topic'
+ * with no extension and no payload.
+ */
+static inline void wire_msg_init(struct wire_msg *m, const char *namesp, const char *topic)
+{
+    memset(m, 0, sizeof(*m));
+    m->version = WIRE_VERSION;
+    m->namesp = namesp;
+    m->namesp_len = strlen(namesp) + 1;
+    m->topic = topic;
+    m->topic_len = strlen(topic) + 1;
+    m->topic_hash = wire_topic_hash(namesp, topic);
+    m->timestamp = wire_now_ns();
+}
+
+/* offset of the extension area within an encoded message */
+static inline size_t wire_ext_offset(const struct wire_msg *m)
+{
+    return WIRE_FIXED_SIZE
+        + wire_varint_size(m->namesp_len) + wire_varint_size(m->topic_len)
+        + wire_varint_size(m->ext_len) + wire_varint_size(m->payload_len)
+        + m->namesp_len + m->topic_len;
+}
+
+static inline size_t wire_payload_offset(const struct wire_msg *m)
+{
+    size_t off = wire_ext_offset(m) + m->ext_len;
+    return (off + WIRE_ALIGN - 1) & ~(size_t)(WIRE_ALIGN - 1);
+}
+
+/* bytes of payload carried inline */
+static inline size_t wire_inline_len(const struct wire_msg *m)
+{
+    return (m->flags & WIRE_FLAG_BULK) ? 0 : m->payload_len;
+}
+
+static inline size_t wire_encoded_size(const struct wire_msg *m)
+{
+    return wire_payload_offset(m) + wire_inline_len(m);
+}
+
+/**
+ * @brief Encodes 'm' into 'buf'.
+ *
+ * The extension area is copied from m->ext when it is not NULL, and the
+ * payload from m->payload when it is not NULL and not sent by bulk transfer;
+ * otherwise those regions are left for the caller to fill in place.
+ *
+ * @return number of bytes written, or 0 if 'buf_size' is too small
+ */
+static inline size_t wire_encode(void *buf, size_t buf_size, const struct wire_msg *m)
+{
+    uint8_t *b = (uint8_t *)buf;
+    size_t off = wire_payload_offset(m);
+    size_t n = WIRE_FIXED_SIZE;
+
+    if (buf_size < off + wire_inline_len(m))
+        return 0;
+
+    wire_put_u16(b, WIRE_MAGIC);
+    b[2] = WIRE_VERSION;
+    b[3] = m->flags;
+    wire_put_u32(b + 4, 0);
+    wire_put_u64(b + 8, m->topic_hash);
+    wire_put_u64(b + 16, m->seq);
+    wire_put_u64(b + 24, m->timestamp);
+    n += wire_put_varint(b + n, m->namesp_len);
+    n += wire_put_varint(b + n, m->topic_len);
+    n += wire_put_varint(b + n, m->ext_len);
+    n += wire_put_varint(b + n, m->payload_len);
+    memcpy(b + n, m->namesp, m->namesp_len);
+    n += m->namesp_len;
+    memcpy(b + n, m->topic, m->topic_len);
+    n += m->topic_len;
+    if (m->ext)
+        memcpy(b + n, m->ext, m->ext_len);
+    n += m->ext_len;
+    memset(b + n, 0, off - n);
+    if (m->payload && wire_inline_len(m))
+        memcpy(b + off, m->payload, m->payload_len);
+    return off + wire_inline_len(m);
+}
+
+/* restamps the sequence number of an encoded message in place */
+static inline void wire_set_seq(void *buf, uint64_t seq)
+{
+    wire_put_u64((uint8_t *)buf + 16, seq);
+}
+
+/**
+ * @brief Decodes the message in 'buf' of 'size' bytes into 'm'.
+ *
+ * No data is copied: the string, extension and payload pointers in 'm'
+ * point into 'buf' and stay valid as long as 'buf' does.  For a message
+ * with WIRE_FLAG_BULK the payload pointer is NULL.
+ *
+ * @return MESSAGING_SUCCESS or MESSAGING_ERR_PROTOCOL
+ */
+static inline int wire_decode(void *buf, size_t size, struct wire_msg *m)
+{
+    uint8_t *b = (uint8_t *)buf;
+    const uint8_t *end = b + size;
+    uint64_t lens[4];
+    size_t n = WIRE_FIXED_SIZE, off;
+
+    if (buf == NULL || size < WIRE_FIXED_SIZE)
+        return MESSAGING_ERR_PROTOCOL;
+    if (wire_get_u16(b) != WIRE_MAGIC || b[2] != WIRE_VERSION)
+        return MESSAGING_ERR_PROTOCOL;
+
+    for (int i = 0; i < 4; i++) {
+        size_t c = wire_get_varint(b + n, end, &lens[i]);
+        /* a bulk payload may be larger than the message itself */
+        if (c == 0 || (i < 3 && lens[i] > size) || lens[i] > SIZE_MAX)
+            return MESSAGING_ERR_PROTOCOL;
+        n += c;
+    }
+    /* namespace and topic must at least hold their terminator */
+    if (lens[0] == 0 || lens[1] == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    if (lens[0] + lens[1] + lens[2] > size - n)
+        return MESSAGING_ERR_PROTOCOL;
+
+    m->version = b[2];
+    m->flags = b[3];
+    m->topic_hash = wire_get_u64(b + 8);
+    m->seq = wire_get_u64(b + 16);
+    m->timestamp = wire_get_u64(b + 24);
+    m->namesp = (const char *)(b + n);
+    m->namesp_len = (size_t)lens[0];
+    m->topic = (const char *)(b + n + lens[0]);
+    m->topic_len = (size_t)lens[1];
+    m->ext = b + n + lens[0] + lens[1];
+    m->ext_len = (size_t)lens[2];
+    m->payload_len = (size_t)lens[3];
+
+    if (m->namesp[m->namesp_len-1] != '\0' || strlen(m->namesp) != m->namesp_len - 1)
+        return MESSAGING_ERR_PROTOCOL;
+    if (m->topic[m->topic_len-1] != '\0' || strlen(m->topic) != m->topic_len - 1)
+        return MESSAGING_ERR_PROTOCOL;
+
+    /* extension records must tile the extension area exactly */
+    {
+        const uint8_t *p = (const uint8_t *)m->ext;
+        const uint8_t *ext_end = p + m->ext_len;
+        while (p < ext_end) {
+            uint64_t l;
+            size_t c = wire_get_varint(p + 1, ext_end, &l);
+            if (c == 0 || l > (uint64_t)(ext_end - p - 1 - c))
+                return MESSAGING_ERR_PROTOCOL;
+            p += 1 + c + l;
+        }
+    }
+
+    off = n + (size_t)(lens[0] + lens[1] + lens[2]);
+    off = (off + WIRE_ALIGN - 1) & ~(size_t)(WIRE_ALIGN - 1);
+    if (off > size)
+        return MESSAGING_ERR_PROTOCOL;
+    if (m->flags & WIRE_FLAG_BULK) {
+        if (size != off)
+            return MESSAGING_ERR_PROTOCOL;
+        m->payload = NULL;
+        return MESSAGING_SUCCESS;
+    }
+    if (m->payload_len != size - off)
+        return MESSAGING_ERR_PROTOCOL;
+    m->payload = b + off;
+    return MESSAGING_SUCCESS;
+}
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+#ifndef __MESSAGING_HPP
+#define __MESSAGING_HPP
+
+/*
+ * Typed C++ layer over the client API, header only.
+ *
+ * A Topic<T> names a topic that carries values of one trivially copyable
+ * type T.  publisher<T> hands the bytes of a T straight to publish(), which
+ * encodes them into the wire buffer, and subscribe() runs a callable with a
+ * const T& that points into the received message; nothing is serialized
+ * or copied on either side.
+ *
+ *   struct particle { double x, y, z; uint32_t id; };
+ *   constexpr messaging::Topic<particle> particles("sim", "particles");
+ *
+ *   messaging::publisher<particle> pub(client, particles);
+ *   pub.publish(p);
+ *
+ *   messaging::subscription sub;
+ *   messaging::subscribe(client, particles,
+ *           [&](const particle &p) { ... }, sub);
+ *
+ * All publishers and subscribers of a topic must agree on T; the wire does
+ * not carry the type.  T is checked to fit the default eager size
+ * (MESSAGING_EAGER_SIZE), so it always travels inline with the RPC unless
+ * the eager size is lowered at run time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <sched.h>
+#include <messaging-client.h>
+#include <messaging-arena.h>
+
+namespace messaging {
+
+namespace detail {
+
+/* the hash the client routes topics to servers with */
+constexpr unsigned long topic_hash(const char *s, unsigned long h = 5381)
+{
+    return *s ? topic_hash(s + 1, ((h << 5) + h) + (unsigned long)*s) : h;
+}
+
+struct handler_base {
+    std::atomic<int> running{0};
+    virtual ~handler_base() {}
+};
+
+template <typename T, typename F>
+struct handler : handler_base {
+    F fn;
+
+    template <typename G>
+    explicit handler(G &&g) : fn(std::forward<G>(g)) {}
+
+    static void call(void *args, void *msg)
+    {
+        handler *h = static_cast<handler*>(args);
+
+        h->running.fetch_add(1, std::memory_order_acquire);
+        if(reinterpret_cast<uintptr_t>(msg) % alignof(T) == 0){
+            h->fn(*static_cast<const T*>(msg));
+        }else{
+            /* payloads are WIRE_ALIGN aligned within a message, but not
+             * every transport hands us an aligned message */
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type tmp;
+            memcpy(&tmp, msg, sizeof(T));
+            h->fn(*reinterpret_cast<const T*>(&tmp));
+        }
+        h->running.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+} // namespace detail
+
+/* a topic carrying values of type T; usable as a constexpr constant */
+template <typename T>
+class Topic {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "messaging::Topic<T> needs a trivially copyable T");
+    static_assert(sizeof(T) <= MESSAGING_EAGER_SIZE,
+            "messaging::Topic<T> needs T to fit in the eager size");
+
+public:
+    typedef T value_type;
+
+    constexpr Topic(const char *namesp, const char *name)
+        : namesp_(namesp), name_(name), hash_(detail::topic_hash(name)) {}
+
+    constexpr const char *namesp() const { return namesp_; }
+    constexpr const char *name() const { return name_; }
+    /* the topic lives on server hash() % messaging_num_servers() */
+    constexpr unsigned long hash() const { return hash_; }
+
+private:
+    const char *namesp_;
+    const char *name_;
+    unsigned long hash_;
+};
+
+template <typename T>
+class publisher {
+public:
+    publisher(messaging_client_t client, const Topic<T> &topic)
+        : client_(client), topic_(topic) {}
+
+    /* @return MESSAGING_SUCCESS or error code defined in messaging-common.h */
+    int publish(const T &value) const
+    {
+        return ::publish(client_, const_cast<char*>(topic_.namesp()),
+                const_cast<char*>(topic_.name()),
+                const_cast<void*>(static_cast<const void*>(&value)), (int)sizeof(T));
+    }
+
+private:
+    messaging_client_t client_;
+    Topic<T> topic_;
+};
+
+/*
+ * Owns a typed subscription and unsubscribes when destroyed.  Like
+ * subscribe(), a client holds one callback per topic: subscribing the same
+ * topic again replaces the previous callback.
+ */
+class subscription {
+public:
+    subscription() : client_(NULL), handler_(NULL) {}
+    subscription(const subscription&) = delete;
+    subscription &operator=(const subscription&) = delete;
+    subscription(subscription &&o) : subscription() { swap(o); }
+    subscription &operator=(subscription &&o) { reset(); swap(o); return *this; }
+    ~subscription() { reset(); }
+
+    explicit operator bool() const { return handler_ != NULL; }
+
+    /**
+     * @brief Unsubscribes and frees the callback.
+     *
+     * Waits for callbacks that are already running, so it must not be
+     * called from the subscription's own callback.
+     *
+     * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+     */
+    int reset()
+    {
+        int ret = MESSAGING_SUCCESS;
+
+        if(handler_ == NULL)
+            return ret;
+        ret = ::unsubscribe(client_, &namesp_[0], &name_[0]);
+        while(handler_->running.load(std::memory_order_acquire) > 0)
+            sched_yield();
+        delete handler_;
+        handler_ = NULL;
+        return ret;
+    }
+
+private:
+    template <typename T, typename F>
+    friend int subscribe(messaging_client_t client, const Topic<T> &topic, F &&fn,
+            subscription &sub);
+
+    void swap(subscription &o)
+    {
+        std::swap(client_, o.client_);
+        namesp_.swap(o.namesp_);
+        name_.swap(o.name_);
+        std::swap(handler_, o.handler_);
+    }
+
+    messaging_client_t client_;
+    std::string namesp_;
+    std::string name_;
+    detail::handler_base *handler_;
+};
+
+/**
+ * @brief Subscribes to a typed topic.
+ *
+ * fn is called as fn(const T&) with the value in place in the received
+ * message, valid until fn returns.  Callbacks run on the client's handler
+ * streams, possibly several at once.
+ *
+ * @param[out] sub takes over the subscription; whatever it held is released first
+ *
+ * @return MESSAGING_SUCCESS or error code defined in messaging-common.h
+ */
+template <typename T, typename F>
+int subscribe(messaging_client_t client, const Topic<T> &topic, F &&fn, subscription &sub)
+{
+    typedef detail::handler<T, typename std::decay<F>::type> handler_t;
+    handler_t *h;
+    int ret;
+
+    sub.reset();
+    h = new handler_t(std::forward<F>(fn));
+    ret = ::subscribe(client, const_cast<char*>(topic.namesp()), const_cast<char*>(topic.name()),
+            &handler_t::call, h);
+    /* the callback stays registered even if the server refused, like subscribe() */
+    sub.client_ = client;
+    sub.namesp_ = topic.namesp();
+    sub.name_ = topic.name();
+    sub.handler_ = h;
+    return ret;
+}
+
+} // namespace messaging
+
+#endif
@@ -36,6 +36,9 @@
 #include <mercury.h>
 #include <mercury_macros.h>
 #include <mercury_proc_string.h>
+#include <mercury_proc_bulk.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
 
 
 typedef struct{
@@ -56,12 +59,15 @@ static inline hg_return_t hg_proc_event_meta(hg_proc_t proc, void *arg)
         if(ret != HG_SUCCESS) return ret;
       break;
     case HG_DECODE:
-      in->raw_data = (char*)malloc(in->size);
+      /* pool buffers are aligned so the message payload can be used in place */
+      in->raw_data = messaging_pool_alloc(in->size);
+      if (in->raw_data == NULL)
+        return HG_NOMEM;
       ret = hg_proc_raw(proc, in->raw_data, in->size);
       if(ret != HG_SUCCESS) return ret;
       break;
     case HG_FREE:
-      free(in->raw_data);
+      messaging_pool_free(in->raw_data);
       break;
     default:
       break;
@@ -73,6 +79,25 @@ static inline hg_return_t hg_proc_event_meta(hg_proc_t proc, void *arg)
 MERCURY_GEN_PROC(bulk_data_t,
   ((event_meta)(evnt)))
 MERCURY_GEN_PROC(response_t, ((int32_t)(ret)))
+/* registration: the subscriber id the server assigned to the client */
+MERCURY_GEN_PROC(register_out_t, ((int32_t)(ret))((uint32_t)(id)))
+
+/* publish and notify: the message plus, for WIRE_FLAG_BULK, where its payload lives */
+MERCURY_GEN_PROC(message_t,
+  ((event_meta)(evnt))
+  ((hg_bulk_t)(bulk))
+  ((uint64_t)(offset)))
+
+/* group view: the server address list as NUL terminated strings back to back */
+MERCURY_GEN_PROC(group_view_t,
+  ((int32_t)(ret))
+  ((int32_t)(num_addrs))
+  ((event_meta)(addrs)))
+
+/* server statistics, encoded by messaging_stats_encode() */
+MERCURY_GEN_PROC(stats_out_t,
+  ((int32_t)(ret))
+  ((event_meta)(data)))
 
 
 #endif /* __SS_DATA_H_ */
@@ -39,24 +39,59 @@ extern "C" {
 		return (WrapperMap *)t;
 	}
 
-	void map_subscribe(const WrapperMap *test, const char *names, const char *topic, const char *subscriber_addr) {
+	void map_subscribe(const WrapperMap *test, const char *names, const char *topic, uint32_t subscriber_id) {
 		MapWrap *t = (MapWrap*)test;
-		t->mp_insert(names, topic, subscriber_addr);
+		t->mp_insert(names, topic, subscriber_id);
 	}
 
-	void map_unsubscribe(const WrapperMap *test, const char *names, const char *topic, const char *subscriber_addr) {
+	void map_unsubscribe(const WrapperMap *test, const char *names, const char *topic, uint32_t subscriber_id) {
 		MapWrap *t = (MapWrap*)test;
-		t->mp_delete(names, topic, subscriber_addr);
+		t->mp_delete(names, topic, subscriber_id);
 	}
 
-	void map_remove(const WrapperMap *test, const char *subscriber_addr) {
+	void map_remove(const WrapperMap *test, uint32_t subscriber_id) {
 		MapWrap *t = (MapWrap*)test;
-		t->mp_remove(subscriber_addr);
+		t->mp_remove(subscriber_id);
 	}
 
-	vector map_get_value(const WrapperMap *test, const char *names, const char *topic){
+	size_t map_get_value(const WrapperMap *test, const char *names, const char *topic, uint32_t *ids, size_t max){
 		MapWrap *t = (MapWrap*)test;
-		return t->get_value(names, topic);
+		return t->get_value(names, topic, ids, max);
+	}
+
+	size_t map_get_value_seq(const WrapperMap *test, const char *names, const char *topic, uint32_t *ids, size_t max, uint64_t *seq){
+		MapWrap *t = (MapWrap*)test;
+		return t->get_value(names, topic, ids, max, seq);
+	}
+
+	uint32_t map_register(WrapperMap *test, const char *subscriber_addr){
+		MapWrap *t = (MapWrap*)test;
+		return t->register_subscriber(subscriber_addr);
+	}
+
+	int map_find_subscriber(const WrapperMap *test, const char *subscriber_addr, uint32_t *subscriber_id){
+		MapWrap *t = (MapWrap*)test;
+		return t->find_subscriber(subscriber_addr, subscriber_id) ? 1 : 0;
+	}
+
+	const char *map_subscriber_addr(const WrapperMap *test, uint32_t subscriber_id){
+		MapWrap *t = (MapWrap*)test;
+		return t->subscriber_addr(subscriber_id);
+	}
+
+	void map_unregister(WrapperMap *test, uint32_t subscriber_id){
+		MapWrap *t = (MapWrap*)test;
+		t->unregister_subscriber(subscriber_id);
+	}
+
+	size_t map_membership_bytes(const WrapperMap *test){
+		MapWrap *t = (MapWrap*)test;
+		return t->membership_bytes();
+	}
+
+	void map_table_sizes(const WrapperMap *test, size_t *topics, size_t *subscribers){
+		MapWrap *t = (MapWrap*)test;
+		t->table_sizes(topics, subscribers);
 	}
 
 	vector map_get_topics(const WrapperMap *test){
@@ -79,4 +114,9 @@ extern "C" {
     	t->delete_topic(names, topic);
     }
 
+    int get_handler(WrapperMap *test, const char *names, const char *topic, void **func_ptr, void **func_args){
+    	MapWrap *t = (MapWrap*)test;
+    	return t->get_pointers(names, topic, func_ptr, func_args) ? 1 : 0;
+    }
+
 }
\ No newline at end of file
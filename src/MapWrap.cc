@@ -31,143 +31,291 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <functional>
 #include "vector.h"
 #include "MapWrap.hh"
 
-MapWrap::MapWrap(){
-	std::map <std::string, std::map <std::string, vector> > mymap;
-	this->cMap = mymap;
+#define WORD_BITS 64
+
+/* array and bitmap footprints, the switch between them has some slack so a
+ * set sitting at the boundary does not flip on every insert and erase */
+static size_t array_bytes(size_t n) { return n * sizeof(uint32_t); }
+static size_t bitmap_bytes(uint32_t max_id) { return (max_id / WORD_BITS + 1) * sizeof(uint64_t); }
+
+bool IdSet::contains(uint32_t id) const {
+	if(dense)
+		return id / WORD_BITS < bits.size() && (bits[id / WORD_BITS] >> (id % WORD_BITS)) & 1;
+	return std::binary_search(ids.begin(), ids.end(), id);
 }
 
-void MapWrap::mp_insert(const char *names, const char *topic, const char *subscriber_addr){
+bool IdSet::insert(uint32_t id){
 
-	std::string c_names(names);
-	std::string c_topic(topic);
-	std::map<std::string, vector> inner_map = cMap[c_names];
-	std::map<std::string, vector>::iterator it;
-	it=inner_map.find(c_topic);
-	if(it==inner_map.end()){
-		VECTOR_INIT(v);
-		VECTOR_ADD(v, subscriber_addr);
-		inner_map[c_topic] = v;
-	}else{
-		//
-		vector v;
-		v = it->second;
-		int flg = 0;
-		for (int i = 0; i < VECTOR_TOTAL(v); i++){
-			char *curr_subs = VECTOR_GET(v, char*, i);
-			if(strcmp(curr_subs, subscriber_addr) == 0){
-				flg = 1;
-				break;
-			}
+	if(dense){
+		if(id / WORD_BITS >= bits.size()){
+			if(bitmap_bytes(id) > 2 * array_bytes(count + 1))
+				to_array();
+			else
+				bits.resize(id / WORD_BITS + 1, 0);
 		}
-		if(flg==0){
-			VECTOR_ADD(inner_map[c_topic], subscriber_addr);
+	}
+	if(dense){
+		uint64_t mask = (uint64_t)1 << (id % WORD_BITS);
+		if(bits[id / WORD_BITS] & mask)
+			return false;
+		bits[id / WORD_BITS] |= mask;
+		count++;
+		return true;
+	}
+
+	std::vector<uint32_t>::iterator it = std::lower_bound(ids.begin(), ids.end(), id);
+	if(it != ids.end() && *it == id)
+		return false;
+	ids.insert(it, id);
+	count++;
+	if(array_bytes(count) > bitmap_bytes(ids.back()))
+		to_bitmap(ids.back());
+	return true;
+
+}
+
+bool IdSet::erase(uint32_t id){
+
+	if(dense){
+		uint64_t mask = (uint64_t)1 << (id % WORD_BITS);
+		if(id / WORD_BITS >= bits.size() || !(bits[id / WORD_BITS] & mask))
+			return false;
+		bits[id / WORD_BITS] &= ~mask;
+		count--;
+		while(!bits.empty() && bits.back() == 0)
+			bits.pop_back();
+		if(!bits.empty() && 2 * array_bytes(count) < bits.size() * sizeof(uint64_t))
+			to_array();
+		return true;
+	}
+
+	std::vector<uint32_t>::iterator it = std::lower_bound(ids.begin(), ids.end(), id);
+	if(it == ids.end() || *it != id)
+		return false;
+	ids.erase(it);
+	count--;
+	return true;
+
+}
+
+// copies up to max ids in ascending order, returns how many were copied
+size_t IdSet::copy_to(uint32_t *out, size_t max) const {
+
+	size_t n = 0;
+	if(!dense){
+		n = std::min(max, ids.size());
+		std::copy(ids.begin(), ids.begin() + n, out);
+		return n;
+	}
+	for(size_t w = 0; w < bits.size() && n < max; w++){
+		uint64_t word = bits[w];
+		while(word && n < max){
+			out[n++] = (uint32_t)(w * WORD_BITS + __builtin_ctzll(word));
+			word &= word - 1;
 		}
 	}
-	cMap[c_names] = inner_map;
-	
+	return n;
+
 }
 
+size_t IdSet::bytes() const {
+	return sizeof(*this) + (dense ? bits.capacity() * sizeof(uint64_t) : ids.capacity() * sizeof(uint32_t));
+}
 
-vector MapWrap::get_value(const char *names, const char *topic){
+void IdSet::to_bitmap(uint32_t max_id){
 
-	std::string c_names(names);
-	std::string c_topic(topic);
+	std::vector<uint64_t> b(max_id / WORD_BITS + 1, 0);
+	for(size_t i = 0; i < ids.size(); i++)
+		b[ids[i] / WORD_BITS] |= (uint64_t)1 << (ids[i] % WORD_BITS);
+	bits.swap(b);
+	std::vector<uint32_t>().swap(ids);
+	dense = true;
+
+}
+
+void IdSet::to_array(){
+
+	std::vector<uint32_t> a(count);
+	copy_to(a.data(), count);
+	ids.swap(a);
+	std::vector<uint64_t>().swap(bits);
+	dense = false;
+
+}
+
+MapWrap::MapWrap(){
+	std::map <std::string, std::map <std::string, vector> > mymap;
+	this->cMap = mymap;
+}
+
+void MapWrap::mp_insert(const char *names, const char *topic, uint32_t id){
+
+	if(id >= addrOf.size() || addrOf[id].empty())
+		return;
+	if(sMap[names][topic].insert(id))
+		subsIndex[id].insert(std::make_pair(std::string(names), std::string(topic)));
 	
-	std::map<std::string, vector> inner_map = cMap[c_names];
-	VECTOR_INIT(v);
-	v = inner_map[c_topic];
-	return v;
+}
+
+
+// copies up to max subscriber ids of names/topic into ids and returns the
+// number of subscribers; call with max 0 to size the buffer. With seq, also
+// takes the topic's next sequence number, 0 if nobody is subscribed
+size_t MapWrap::get_value(const char *names, const char *topic, uint32_t *ids, size_t max, uint64_t *seq){
+
+	// lookup only: no copies of the inner map and nothing inserted on a miss
+	if(seq)
+		*seq = 0;
+	std::map<std::string, std::map<std::string, IdSet> >::iterator it_out = sMap.find(names);
+	if(it_out == sMap.end())
+		return 0;
+	std::map<std::string, IdSet>::iterator it_in = it_out->second.find(topic);
+	if(it_in == it_out->second.end())
+		return 0;
+	if(max > 0)
+		it_in->second.copy_to(ids, max);
+	if(seq)
+		*seq = it_in->second.next_seq();
+	return it_in->second.size();
 
 }
 
+// returns namespace, topic pairs; every string is malloc'ed and owned by the caller
 vector MapWrap::get_topics(){
 
 	VECTOR_INIT(v);
-	std::map <std::string, std::map<std::string, vector>>::iterator it_out = cMap.begin();
-	while (it_out != cMap.end()){
-		int i = 0;
-		char *out_str = new char[(it_out->first).length()+1];
-		strcpy(out_str, (it_out->first).c_str());
-		VECTOR_ADD(v, out_str);
-
-		std::map<std::string, vector> inner_map = it_out->second;
-		std::map<std::string, vector>::iterator it_in = inner_map.begin();
-		while(it_in != inner_map.end()){
-			if((i%2) != 0){
-				VECTOR_ADD(v, out_str);
-				i = 0;
-			}
-			char *in_str = new char[(it_in->first).length()+1];
-			strcpy(in_str, (it_in->first).c_str());
-			VECTOR_ADD(v, in_str);
-			i++;
-			it_in++;
-
+	std::map <std::string, std::map<std::string, vector>>::iterator it_out;
+	for (it_out = cMap.begin(); it_out != cMap.end(); it_out++){
+		std::map<std::string, vector>::iterator it_in;
+		for (it_in = it_out->second.begin(); it_in != it_out->second.end(); it_in++){
+			VECTOR_ADD(v, strdup(it_out->first.c_str()));
+			VECTOR_ADD(v, strdup(it_in->first.c_str()));
 		}
-		if(i==0)
-			VECTOR_DELETE(v, VECTOR_TOTAL(v)-1);
-		
-		it_out++;
 	}
 	return v;
 
 }
 
-void MapWrap::mp_delete(const char *names, const char *topic, const char *subscriber_addr){
+// drops id from one topic, and the topic once nobody is subscribed
+bool MapWrap::erase_subscriber(const std::string &names, const std::string &topic, uint32_t id){
 
-	std::string c_names(names);
-	std::string c_topic(topic);
+	std::map <std::string, std::map<std::string, IdSet>>::iterator it_out = sMap.find(names);
+	if(it_out == sMap.end())
+		return false;
+	std::map<std::string, IdSet>::iterator it_in = it_out->second.find(topic);
+	if(it_in == it_out->second.end())
+		return false;
 
-	
-	std::map<std::string, vector> inner_map = cMap[c_names];
-	std::map<std::string, vector>::iterator it;
-	it=inner_map.find(c_topic);
-	vector v;
-	if(it!=inner_map.end()){
-		v = it->second;
-		int del_id =0;
-		for (int i = 0; i < VECTOR_TOTAL(v); i++){
-			char *curr_subs = VECTOR_GET(v, char*, i);
-			if(strcmp(curr_subs, subscriber_addr) == 0){
-				del_id = i;
-				break;
-			}
-		}
-		VECTOR_DELETE(v, del_id);
-		inner_map[c_topic] = v;
-		cMap[c_names] = inner_map;
+	if(!it_in->second.erase(id))
+		return false;
+	if(it_in->second.empty()){
+		it_out->second.erase(it_in);
+		if(it_out->second.empty())
+			sMap.erase(it_out);
 	}
+	return true;
 
-	
 }
 
-void MapWrap::mp_remove(const char *subscriber_addr){
-	std::map <std::string, std::map<std::string, vector>>::iterator it_out = cMap.begin();
-	while (it_out != cMap.end()){
-		std::map<std::string, vector> inner_map = it_out->second;
-		std::map<std::string, vector>::iterator it_in = inner_map.begin();
-		while(it_in != inner_map.end()){
-			vector v;
-			v = it_in->second;
-			int del_id =0;
-			for (int i = 0; i < VECTOR_TOTAL(v); i++){
-				char *curr_subs = VECTOR_GET(v, char*, i);
-				if(strcmp(curr_subs, subscriber_addr) == 0){
-					del_id = i;
-					break;
-				}
-			}
-			VECTOR_DELETE(v, del_id);
-			inner_map[it_in->first] = v;
-			it_in++;
-		}
-		cMap[it_out->first] = inner_map;
-		it_out++;
+void MapWrap::mp_delete(const char *names, const char *topic, uint32_t id){
+
+	if(erase_subscriber(names, topic, id))
+		subsIndex[id].erase(std::make_pair(std::string(names), std::string(topic)));
+
+}
+
+// only touches the topics id is subscribed to
+void MapWrap::mp_remove(uint32_t id){
+
+	if(id >= subsIndex.size())
+		return;
+	std::set<std::pair<std::string, std::string> >::iterator it_sub;
+	for (it_sub = subsIndex[id].begin(); it_sub != subsIndex[id].end(); it_sub++)
+		erase_subscriber(it_sub->first, it_sub->second, id);
+	subsIndex[id].clear();
+
+}
+
+// returns the id of subscriber_addr, assigning the lowest free one if it is new
+uint32_t MapWrap::register_subscriber(const char *subscriber_addr){
+
+	std::map<std::string, uint32_t>::iterator it = idOf.find(subscriber_addr);
+	if(it != idOf.end())
+		return it->second;
+
+	uint32_t id;
+	if(!freeIds.empty()){
+		std::pop_heap(freeIds.begin(), freeIds.end(), std::greater<uint32_t>());
+		id = freeIds.back();
+		freeIds.pop_back();
+		addrOf[id] = subscriber_addr;
+	}else{
+		id = (uint32_t)addrOf.size();
+		addrOf.push_back(subscriber_addr);
+		subsIndex.resize(addrOf.size());
 	}
-	
+	idOf[subscriber_addr] = id;
+	return id;
+
+}
+
+bool MapWrap::find_subscriber(const char *subscriber_addr, uint32_t *id){
+
+	std::map<std::string, uint32_t>::iterator it = idOf.find(subscriber_addr);
+	if(it == idOf.end())
+		return false;
+	*id = it->second;
+	return true;
+
+}
+
+const char *MapWrap::subscriber_addr(uint32_t id){
+	if(id >= addrOf.size() || addrOf[id].empty())
+		return NULL;
+	return addrOf[id].c_str();
+}
+
+// drops every subscription of id and makes the id available again
+void MapWrap::unregister_subscriber(uint32_t id){
+
+	if(id >= addrOf.size() || addrOf[id].empty())
+		return;
+	mp_remove(id);
+	idOf.erase(addrOf[id]);
+	addrOf[id].clear();
+	freeIds.push_back(id);
+	std::push_heap(freeIds.begin(), freeIds.end(), std::greater<uint32_t>());
+
+}
+
+// bytes used by topic membership, not counting the topic names
+size_t MapWrap::membership_bytes(){
+
+	size_t total = 0;
+	std::map <std::string, std::map<std::string, IdSet>>::iterator it_out;
+	for (it_out = sMap.begin(); it_out != sMap.end(); it_out++){
+		std::map<std::string, IdSet>::iterator it_in;
+		for (it_in = it_out->second.begin(); it_in != it_out->second.end(); it_in++)
+			total += it_in->second.bytes();
+	}
+	return total;
+
+}
+
+// topics with at least one subscriber, and registered subscribers
+void MapWrap::table_sizes(size_t *topics, size_t *subscribers){
+
+	size_t n = 0;
+	std::map <std::string, std::map<std::string, IdSet>>::iterator it_out;
+	for (it_out = sMap.begin(); it_out != sMap.end(); it_out++)
+		n += it_out->second.size();
+	*topics = n;
+	*subscribers = addrOf.size() - freeIds.size();
+
 }
 
 void MapWrap::delete_all(){
@@ -180,6 +328,11 @@ void MapWrap::delete_all(){
 		}
 		it_out++;
 	}
+	sMap.clear();
+	subsIndex.clear();
+	addrOf.clear();
+	idOf.clear();
+	freeIds.clear();
 	
 }
 
@@ -188,22 +341,47 @@ void MapWrap::insert_pointers(const char *names, const char *topic, void *func_p
 
 	std::string c_names(names);
 	std::string c_topic(topic);
-	std::map<std::string, vector> inner_map = cMap[c_names];
+	// update in place, copying the namespace's map made inserts linear
+	std::map<std::string, vector> &inner_map = cMap[c_names];
+	std::map<std::string, vector>::iterator it = inner_map.find(c_topic);
 	VECTOR_INIT(v);
 	VECTOR_ADD(v, func_ptr);
 	VECTOR_ADD(v, func_args);
-	inner_map[c_topic] = v;
-	cMap[c_names] = inner_map;
+	if(it != inner_map.end()){
+		VECTOR_FREE(it->second);
+		it->second = v;
+	}else{
+		inner_map[c_topic] = v;
+	}
 	
 }
 
+bool MapWrap::get_pointers(const char *names, const char *topic, void **func_ptr, void **func_args){
+
+	std::map<std::string, std::map<std::string, vector> >::iterator it_out = cMap.find(names);
+	if(it_out == cMap.end())
+		return false;
+	std::map<std::string, vector>::iterator it_in = it_out->second.find(topic);
+	if(it_in == it_out->second.end())
+		return false;
+	*func_ptr = VECTOR_GET(it_in->second, void*, 0);
+	*func_args = VECTOR_GET(it_in->second, void*, 1);
+	return true;
+
+}
+
 void MapWrap::delete_topic(const char *names, const char *topic){
 	std::string c_names(names);
 	std::string c_topic(topic);
 
-	std::map<std::string, vector> inner_map = cMap[c_names];
-	inner_map.erase(c_topic);
-	cMap[c_names] = inner_map;
+	std::map<std::string, std::map<std::string, vector> >::iterator it_out = cMap.find(c_names);
+	if(it_out == cMap.end())
+		return;
+	std::map<std::string, vector>::iterator it_in = it_out->second.find(c_topic);
+	if(it_in == it_out->second.end())
+		return;
+	VECTOR_FREE(it_in->second);
+	it_out->second.erase(it_in);
 	
 }
 
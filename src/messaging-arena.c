@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-pool.h>
+#include <messaging-arena.h>
+
+#define HUGEPAGE_SIZE (2UL << 20)
+
+struct messaging_arena {
+    margo_instance_id mid;
+    char *base;
+    size_t size;
+    size_t slab_size;
+    int num_slabs;
+    int hugepages;
+    hg_bulk_t bulk;
+    ABT_mutex lock;
+    uint64_t *used;      /* bitmap of allocated slabs */
+    int *run_len;        /* slabs in the run starting at each allocated slab */
+    int hint;            /* where the next search starts */
+};
+
+static size_t parse_size(const char *s, size_t def)
+{
+    char *end;
+    unsigned long long v;
+
+    if (s == NULL || *s == '\0')
+        return def;
+    v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; break;
+    case 'm': case 'M': v <<= 20; break;
+    case 'g': case 'G': v <<= 30; break;
+    default: break;
+    }
+    return (size_t)v;
+}
+
+void messaging_arena_config_init(struct messaging_arena_config *cfg)
+{
+    const char *s;
+
+    cfg->size = parse_size(getenv("MESSAGING_ARENA_SIZE"), MESSAGING_ARENA_DEFAULT_SIZE);
+    cfg->slab_size = parse_size(getenv("MESSAGING_ARENA_SLAB"), MESSAGING_ARENA_DEFAULT_SLAB);
+    cfg->eager_size = parse_size(getenv("MESSAGING_EAGER_SIZE"), MESSAGING_EAGER_SIZE);
+    s = getenv("MESSAGING_ARENA_HUGEPAGES");
+    cfg->hugepages = s ? atoi(s) : 0;
+}
+
+static void *map_region(size_t *size, int *hugepages)
+{
+    void *p;
+
+    if (*hugepages) {
+        size_t sz = (*size + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+        p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *size = sz;
+            return p;
+        }
+        fprintf(stderr, "Warning: no hugepages for the messaging arena, using regular pages\n");
+        *hugepages = 0;
+    }
+    p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+int messaging_arena_create(margo_instance_id mid,
+        const struct messaging_arena_config *cfg, messaging_arena_t *a)
+{
+    messaging_arena_t arena;
+    hg_size_t bulk_size;
+    hg_return_t hret;
+    int nwords;
+
+    *a = MESSAGING_ARENA_NULL;
+    if (cfg->size == 0)
+        return MESSAGING_SUCCESS;
+    if (cfg->slab_size == 0 || cfg->slab_size > cfg->size)
+        return MESSAGING_ERR_INVALID_ARG;
+
+    arena = (messaging_arena_t)calloc(1, sizeof(*arena));
+    if (!arena)
+        return MESSAGING_ERR_ALLOCATION;
+    arena->mid = mid;
+    arena->size = cfg->size;
+    arena->slab_size = cfg->slab_size;
+    arena->hugepages = cfg->hugepages;
+    arena->base = (char *)map_region(&arena->size, &arena->hugepages);
+    if (arena->base == NULL) {
+        free(arena);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    arena->num_slabs = (int)(arena->size / arena->slab_size);
+    nwords = (arena->num_slabs + 63) / 64;
+    arena->used = (uint64_t *)calloc(nwords, sizeof(uint64_t));
+    arena->run_len = (int *)calloc(arena->num_slabs, sizeof(int));
+    if (!arena->used || !arena->run_len)
+        goto error;
+
+    bulk_size = arena->size;
+    hret = margo_bulk_create(mid, 1, (void **)&arena->base, &bulk_size,
+            HG_BULK_READWRITE, &arena->bulk);
+    if (hret != HG_SUCCESS) {
+        fprintf(stderr, "ERROR: margo_bulk_create() for the messaging arena returned %d\n", hret);
+        goto error;
+    }
+    ABT_mutex_create(&arena->lock);
+    *a = arena;
+    return MESSAGING_SUCCESS;
+
+error:
+    free(arena->used);
+    free(arena->run_len);
+    munmap(arena->base, arena->size);
+    free(arena);
+    return MESSAGING_ERR_MERCURY;
+}
+
+void messaging_arena_destroy(messaging_arena_t arena)
+{
+    if (arena == MESSAGING_ARENA_NULL)
+        return;
+    margo_bulk_free(arena->bulk);
+    ABT_mutex_free(&arena->lock);
+    munmap(arena->base, arena->size);
+    free(arena->used);
+    free(arena->run_len);
+    free(arena);
+}
+
+static inline int slab_used(messaging_arena_t arena, int i)
+{
+    return (arena->used[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void mark_slabs(messaging_arena_t arena, int first, int n, int used)
+{
+    for (int i = first; i < first + n; i++) {
+        if (used)
+            arena->used[i / 64] |= 1ULL << (i % 64);
+        else
+            arena->used[i / 64] &= ~(1ULL << (i % 64));
+    }
+}
+
+/* first fit for a run of n free slabs, starting the search at the hint */
+static int find_run(messaging_arena_t arena, int n)
+{
+    int start = arena->hint;
+    for (int pass = 0; pass < 2; pass++) {
+        int lo = pass == 0 ? start : 0;
+        int hi = pass == 0 ? arena->num_slabs : start + n - 1;
+        int run = 0;
+        if (hi > arena->num_slabs)
+            hi = arena->num_slabs;
+        for (int i = lo; i < hi; i++) {
+            /* skip whole words that are full */
+            if (i % 64 == 0 && arena->used[i / 64] == ~0ULL && i + 64 <= hi) {
+                run = 0;
+                i += 63;
+                continue;
+            }
+            if (slab_used(arena, i)) {
+                run = 0;
+                continue;
+            }
+            if (++run == n)
+                return i - n + 1;
+        }
+    }
+    return -1;
+}
+
+int messaging_arena_alloc(messaging_arena_t arena, size_t len, struct messaging_arena_buf *buf)
+{
+    int n, first;
+
+    if (arena == MESSAGING_ARENA_NULL || len == 0)
+        return MESSAGING_ERR_ALLOCATION;
+    n = (int)((len + arena->slab_size - 1) / arena->slab_size);
+    if (n > arena->num_slabs)
+        return MESSAGING_ERR_ALLOCATION;
+
+    ABT_mutex_lock(arena->lock);
+    first = find_run(arena, n);
+    if (first >= 0) {
+        mark_slabs(arena, first, n, 1);
+        arena->run_len[first] = n;
+        arena->hint = (first + n) % arena->num_slabs;
+    }
+    ABT_mutex_unlock(arena->lock);
+    if (first < 0)
+        return MESSAGING_ERR_ALLOCATION;
+
+    buf->offset = (size_t)first * arena->slab_size;
+    buf->ptr = arena->base + buf->offset;
+    buf->len = len;
+    buf->bulk = arena->bulk;
+    buf->registered = 0;
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_arena_get(messaging_arena_t arena, margo_instance_id mid,
+        size_t len, hg_uint8_t access, struct messaging_arena_buf *buf)
+{
+    hg_size_t size = len;
+    hg_return_t hret;
+
+    if (messaging_arena_alloc(arena, len, buf) == MESSAGING_SUCCESS)
+        return MESSAGING_SUCCESS;
+
+    /* arena full or disabled: register this buffer on its own */
+    buf->ptr = messaging_pool_alloc(len);
+    if (buf->ptr == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    hret = margo_bulk_create(mid, 1, &buf->ptr, &size, access, &buf->bulk);
+    if (hret != HG_SUCCESS) {
+        messaging_pool_free(buf->ptr);
+        buf->ptr = NULL;
+        return MESSAGING_ERR_MERCURY;
+    }
+    buf->len = len;
+    buf->offset = 0;
+    buf->registered = 1;
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_arena_pull(messaging_arena_t arena, margo_instance_id mid,
+        hg_addr_t origin, hg_bulk_t remote, size_t remote_offset,
+        size_t len, struct messaging_arena_buf *buf)
+{
+    hg_return_t hret;
+    int ret;
+
+    ret = messaging_arena_get(arena, mid, len, HG_BULK_READWRITE, buf);
+    if (ret != MESSAGING_SUCCESS)
+        return ret;
+    hret = margo_bulk_transfer(mid, HG_BULK_PULL, origin, remote, remote_offset,
+            buf->bulk, buf->offset, len);
+    if (hret != HG_SUCCESS) {
+        messaging_arena_release(arena, buf);
+        return MESSAGING_ERR_MERCURY;
+    }
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_arena_release(messaging_arena_t arena, struct messaging_arena_buf *buf)
+{
+    if (buf->ptr == NULL)
+        return;
+    if (buf->registered) {
+        margo_bulk_free(buf->bulk);
+        messaging_pool_free(buf->ptr);
+    } else {
+        int first = (int)(buf->offset / arena->slab_size);
+        ABT_mutex_lock(arena->lock);
+        mark_slabs(arena, first, arena->run_len[first], 0);
+        arena->run_len[first] = 0;
+        ABT_mutex_unlock(arena->lock);
+    }
+    buf->ptr = NULL;
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <messaging-common.h>
+#include <messaging-bootstrap.h>
+#include <ss_data.h>
+
+#define MAX_PROVIDERS      16
+#define BACKOFF_MIN_MS     10.0
+#define BACKOFF_MAX_MS     1000.0
+#define GROUP_RPC_TIMEOUT  1000.0   /* ms */
+#define ADDR_SEPARATORS    ", \r\n\t"
+
+DECLARE_MARGO_RPC_HANDLER(group_view_rpc);
+static void group_view_rpc(hg_handle_t h);
+
+static int file_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list);
+static int env_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list);
+static int group_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list);
+
+static const struct messaging_bootstrap_provider builtin[] = {
+    { "file",  file_load },
+    { "env",   env_load },
+    { "group", group_load },
+};
+
+static const struct messaging_bootstrap_provider *providers[MAX_PROVIDERS] = {
+    &builtin[0], &builtin[1], &builtin[2],
+};
+static int num_providers = 3;
+
+/* splits s into a list of addresses; MESSAGING_ERR_UNKNOWN_PR if there are none */
+static int split_addrs(const char *s, struct messaging_server_list *list)
+{
+    size_t n = strlen(s);
+    char *buf, *tok, *save;
+    int len = 0, num = 0;
+
+    buf = malloc(n + 1);
+    if (buf == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    memcpy(buf, s, n + 1);
+
+    /* tokens only ever shrink, so they are compacted in place */
+    for (tok = strtok_r(buf, ADDR_SEPARATORS, &save); tok != NULL;
+            tok = strtok_r(NULL, ADDR_SEPARATORS, &save)) {
+        size_t tlen = strlen(tok) + 1;
+        memmove(buf + len, tok, tlen);
+        len += tlen;
+        num++;
+    }
+    if (num == 0) {
+        free(buf);
+        return MESSAGING_ERR_UNKNOWN_PR;
+    }
+    list->addrs = buf;
+    list->addrs_len = len;
+    list->num_addrs = num;
+    return MESSAGING_SUCCESS;
+}
+
+uint16_t messaging_bootstrap_endpoint(const char *entry, size_t len, size_t *addr_len)
+{
+    unsigned long provider = 0;
+    size_t i = len;
+
+    /* Mercury addresses have no '#', so only a trailing "#<digits>" counts */
+    while (i > 0 && entry[i - 1] >= '0' && entry[i - 1] <= '9')
+        i--;
+    if (i == len || i < 2 || entry[i - 1] != '#' || len - i > 5) {
+        *addr_len = len;
+        return MARGO_DEFAULT_PROVIDER_ID;
+    }
+    for (size_t k = i; k < len; k++)
+        provider = provider * 10 + (unsigned long)(entry[k] - '0');
+    if (provider > UINT16_MAX) {
+        *addr_len = len;
+        return MARGO_DEFAULT_PROVIDER_ID;
+    }
+    *addr_len = i - 1;
+    return (uint16_t)provider;
+}
+
+const char *messaging_bootstrap_file(void)
+{
+    const char *path = getenv("MESSAGING_SERVER_FILE");
+
+    if (path == NULL)
+        return MESSAGING_BOOTSTRAP_DEFAULT_FILE;
+    return *path ? path : NULL;
+}
+
+static int file_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list)
+{
+    const char *path = (arg && *arg) ? arg : messaging_bootstrap_file();
+    struct stat st;
+    char *buf;
+    FILE *f;
+    int ret;
+
+    (void)mid;
+    if (path == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    /* servers write the file under a temporary name and rename it, so it is
+     * either missing or complete */
+    f = fopen(path, "r");
+    if (f == NULL)
+        return errno == ENOENT ? MESSAGING_ERR_UNKNOWN_PR : MESSAGING_ERR_INVALID_ARG;
+    if (fstat(fileno(f), &st) != 0) {
+        fclose(f);
+        return MESSAGING_ERR_INVALID_ARG;
+    }
+    buf = malloc(st.st_size + 1);
+    if (buf == NULL) {
+        fclose(f);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    if (fread(buf, 1, st.st_size, f) != (size_t)st.st_size) {
+        fprintf(stderr, "Error: Unable to read config file %s for server_address list\n", path);
+        free(buf);
+        fclose(f);
+        return MESSAGING_ERR_INVALID_ARG;
+    }
+    buf[st.st_size] = '\0';
+    fclose(f);
+
+    ret = split_addrs(buf, list);
+    free(buf);
+    return ret;
+}
+
+static int env_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list)
+{
+    const char *s = (arg && *arg) ? arg : getenv("MESSAGING_SERVERS");
+
+    (void)mid;
+    if (s == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    return split_addrs(s, list);
+}
+
+static hg_id_t group_view_id(margo_instance_id mid)
+{
+    hg_bool_t flag;
+    hg_id_t id;
+
+    margo_registered_name(mid, "group_view_rpc", &id, &flag);
+    if (flag == HG_TRUE)
+        return id;
+    return MARGO_REGISTER(mid, "group_view_rpc", void, group_view_t, NULL);
+}
+
+static int group_load(margo_instance_id mid, const char *arg, struct messaging_server_list *list)
+{
+    char server[256];
+    const char *s = (arg && *arg) ? arg : getenv("MESSAGING_SERVERS");
+    size_t n;
+    hg_addr_t addr;
+    hg_handle_t h;
+    hg_return_t hret;
+    group_view_t out;
+    int ret;
+
+    if (s == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    /* any server will do, use the first one named */
+    s += strspn(s, ADDR_SEPARATORS);
+    n = strcspn(s, ADDR_SEPARATORS);
+    if (n == 0 || n >= sizeof(server))
+        return MESSAGING_ERR_INVALID_ARG;
+    /* the group view is served on the default provider */
+    messaging_bootstrap_endpoint(s, n, &n);
+    memcpy(server, s, n);
+    server[n] = '\0';
+
+    if (margo_addr_lookup(mid, server, &addr) != HG_SUCCESS)
+        return MESSAGING_ERR_UNKNOWN_PR;
+    hret = margo_create(mid, addr, group_view_id(mid), &h);
+    margo_addr_free(mid, addr);
+    if (hret != HG_SUCCESS)
+        return MESSAGING_ERR_MERCURY;
+
+    /* a server that is not up yet times out and we try again */
+    hret = margo_forward_timed(h, NULL, GROUP_RPC_TIMEOUT);
+    if (hret != HG_SUCCESS) {
+        margo_destroy(h);
+        return MESSAGING_ERR_UNKNOWN_PR;
+    }
+    if (margo_get_output(h, &out) != HG_SUCCESS) {
+        margo_destroy(h);
+        return MESSAGING_ERR_MERCURY;
+    }
+
+    ret = out.ret;
+    if (ret == MESSAGING_SUCCESS) {
+        if (out.addrs.size == 0 || ((char *)out.addrs.raw_data)[out.addrs.size - 1] != '\0') {
+            ret = MESSAGING_ERR_PROTOCOL;
+        } else {
+            list->addrs = malloc(out.addrs.size);
+            if (list->addrs == NULL) {
+                ret = MESSAGING_ERR_ALLOCATION;
+            } else {
+                memcpy(list->addrs, out.addrs.raw_data, out.addrs.size);
+                list->addrs_len = out.addrs.size;
+                list->num_addrs = 0;
+                for (n = 0; n < out.addrs.size; n++)
+                    list->num_addrs += list->addrs[n] == '\0';
+                if (list->num_addrs != out.num_addrs) {
+                    free(list->addrs);
+                    list->addrs = NULL;
+                    ret = MESSAGING_ERR_PROTOCOL;
+                }
+            }
+        }
+    }
+    margo_free_output(h, &out);
+    margo_destroy(h);
+    return ret;
+}
+
+static void group_view_rpc(hg_handle_t hndl)
+{
+    margo_instance_id mid = margo_hg_handle_get_instance(hndl);
+    const struct hg_info *info = margo_get_info(hndl);
+    const struct messaging_server_list *list =
+        (const struct messaging_server_list *)margo_registered_data(mid, info->id);
+    group_view_t out;
+
+    /* until the servers have exchanged addresses the view is empty, and
+     * the client retries */
+    out.ret = list->num_addrs > 0 ? MESSAGING_SUCCESS : MESSAGING_ERR_UNKNOWN_PR;
+    out.num_addrs = list->num_addrs;
+    out.addrs.size = list->addrs_len;
+    out.addrs.raw_data = list->addrs;
+    margo_respond(hndl, &out);
+    margo_destroy(hndl);
+}
+DEFINE_MARGO_RPC_HANDLER(group_view_rpc)
+
+hg_id_t messaging_bootstrap_serve(margo_instance_id mid, const struct messaging_server_list *list)
+{
+    hg_bool_t flag;
+    hg_id_t id;
+
+    margo_registered_name(mid, "group_view_rpc", &id, &flag);
+    if (flag == HG_TRUE)
+        margo_deregister(mid, id);
+    id = MARGO_REGISTER(mid, "group_view_rpc", void, group_view_t, group_view_rpc);
+    margo_register_data(mid, id, (void *)list, NULL);
+    return id;
+}
+
+int messaging_bootstrap_register(const struct messaging_bootstrap_provider *provider)
+{
+    int i;
+
+    if (provider == NULL || provider->name == NULL || provider->load == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    for (i = 0; i < num_providers; i++) {
+        if (strcmp(providers[i]->name, provider->name) == 0) {
+            providers[i] = provider;
+            return MESSAGING_SUCCESS;
+        }
+    }
+    if (num_providers == MAX_PROVIDERS)
+        return MESSAGING_ERR_ALLOCATION;
+    providers[num_providers++] = provider;
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_bootstrap_load(margo_instance_id mid, const char *spec,
+        struct messaging_server_list *list)
+{
+    const struct messaging_bootstrap_provider *p = NULL;
+    const char *arg, *s;
+    size_t name_len;
+    double timeout_ms, waited = 0, backoff = BACKOFF_MIN_MS;
+    int i, ret;
+
+    if (spec == NULL)
+        spec = getenv("MESSAGING_BOOTSTRAP");
+    if (spec == NULL || *spec == '\0')
+        spec = MESSAGING_BOOTSTRAP_DEFAULT;
+    s = getenv("MESSAGING_BOOTSTRAP_TIMEOUT");
+    timeout_ms = 1000.0 * (s ? atof(s) : MESSAGING_BOOTSTRAP_TIMEOUT);
+
+    arg = strchr(spec, ':');
+    name_len = arg ? (size_t)(arg - spec) : strlen(spec);
+    arg = arg ? arg + 1 : NULL;
+    for (i = 0; i < num_providers; i++) {
+        if (strlen(providers[i]->name) == name_len &&
+                strncmp(providers[i]->name, spec, name_len) == 0)
+            p = providers[i];
+    }
+    if (p == NULL) {
+        fprintf(stderr, "Error: unknown bootstrap provider in '%s'\n", spec);
+        return MESSAGING_ERR_INVALID_ARG;
+    }
+
+    memset(list, 0, sizeof(*list));
+    while ((ret = p->load(mid, arg, list)) == MESSAGING_ERR_UNKNOWN_PR && waited < timeout_ms) {
+        margo_thread_sleep(mid, backoff);
+        waited += backoff;
+        backoff = backoff * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : backoff * 2;
+    }
+    if (ret != MESSAGING_SUCCESS)
+        fprintf(stderr, "Error: bootstrap '%s' found no servers (error %d)\n", spec, ret);
+    return ret;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-capture.h>
+
+#define CAPTURE_BUFFER  (1 << 20)   /* stdio buffer of the file */
+
+struct messaging_capture {
+    pthread_mutex_t lock;
+    FILE *file;
+    char *buf;
+    int payloads;
+    uint64_t last_ns;               /* time of the previous record */
+};
+
+void messaging_capture_config_init(struct messaging_capture_config *cfg)
+{
+    const char *s;
+
+    s = getenv("MESSAGING_CAPTURE");
+    snprintf(cfg->path, sizeof(cfg->path), "%s", s != NULL ? s : "");
+    s = getenv("MESSAGING_CAPTURE_PAYLOAD");
+    cfg->payloads = s != NULL && atoi(s) > 0;
+}
+
+int messaging_capture_open(const struct messaging_capture_config *cfg, uint32_t rank,
+        messaging_capture_t *capp)
+{
+    struct messaging_capture_header hdr;
+    messaging_capture_t cap;
+
+    if (cfg->path[0] == '\0')
+        return MESSAGING_ERR_INVALID_ARG;
+    cap = (messaging_capture_t)calloc(1, sizeof(*cap));
+    if (cap == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    cap->buf = (char *)malloc(CAPTURE_BUFFER);
+    cap->file = fopen(cfg->path, "wb");
+    if (cap->buf == NULL || cap->file == NULL) {
+        fprintf(stderr, "Warning: could not start the capture in %s\n", cfg->path);
+        if (cap->file)
+            fclose(cap->file);
+        free(cap->buf);
+        free(cap);
+        return MESSAGING_ERR_INVALID_ARG;
+    }
+    setvbuf(cap->file, cap->buf, _IOFBF, CAPTURE_BUFFER);
+    pthread_mutex_init(&cap->lock, NULL);
+    cap->payloads = cfg->payloads;
+    cap->last_ns = wire_now_ns();
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MESSAGING_CAPTURE_MAGIC, sizeof(MESSAGING_CAPTURE_MAGIC));
+    hdr.version = MESSAGING_CAPTURE_VERSION;
+    hdr.flags = cap->payloads ? MESSAGING_CAPTURE_FLAG_PAYLOAD : 0;
+    hdr.start_ns = cap->last_ns;
+    hdr.rank = rank;
+    fwrite(&hdr, sizeof(hdr), 1, cap->file);
+    *capp = cap;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_capture_close(messaging_capture_t cap)
+{
+    if (cap == NULL)
+        return;
+    fclose(cap->file);
+    pthread_mutex_destroy(&cap->lock);
+    free(cap->buf);
+    free(cap);
+}
+
+void messaging_capture_record(messaging_capture_t cap, uint32_t op, uint32_t who,
+        const char *namesp, const char *topic, const void *payload, uint64_t size)
+{
+    size_t nl = strlen(namesp) + 1, tl = strlen(topic) + 1;
+    size_t dl = (cap->payloads && payload != NULL) ? size : 0;
+    uint8_t *rec, *p;
+    uint64_t now;
+
+    rec = (uint8_t *)messaging_pool_alloc(1 + 6 * WIRE_VARINT_MAX + nl + tl + dl);
+    if (rec == NULL)
+        return;
+    pthread_mutex_lock(&cap->lock);
+    /* the time is taken under the lock so records are in time order */
+    now = wire_now_ns();
+    p = rec;
+    *p++ = (uint8_t)op;
+    p += wire_put_varint(p, now > cap->last_ns ? now - cap->last_ns : 0);
+    p += wire_put_varint(p, who);
+    p += wire_put_varint(p, size);
+    p += wire_put_varint(p, nl);
+    memcpy(p, namesp, nl);
+    p += nl;
+    p += wire_put_varint(p, tl);
+    memcpy(p, topic, tl);
+    p += tl;
+    p += wire_put_varint(p, dl);
+    if (dl) {
+        memcpy(p, payload, dl);
+        p += dl;
+    }
+    if (now > cap->last_ns)
+        cap->last_ns = now;
+    fwrite(rec, 1, p - rec, cap->file);
+    pthread_mutex_unlock(&cap->lock);
+    messaging_pool_free(rec);
+}
+
+int messaging_capture_reader_init(struct messaging_capture_reader *r, const void *buf, size_t len)
+{
+    if (len < sizeof(r->header))
+        return MESSAGING_ERR_PROTOCOL;
+    memcpy(&r->header, buf, sizeof(r->header));
+    if (memcmp(r->header.magic, MESSAGING_CAPTURE_MAGIC, sizeof(MESSAGING_CAPTURE_MAGIC)) != 0 ||
+            r->header.version != MESSAGING_CAPTURE_VERSION)
+        return MESSAGING_ERR_PROTOCOL;
+    r->p = (const uint8_t *)buf + sizeof(r->header);
+    r->end = (const uint8_t *)buf + len;
+    r->ts = r->header.start_ns;
+    return MESSAGING_SUCCESS;
+}
+
+/* reads a varint length and the NUL terminated string of that length after it */
+static size_t get_string(const uint8_t *p, const uint8_t *end, const char **s)
+{
+    uint64_t len;
+    size_t n = wire_get_varint(p, end, &len);
+
+    if (n == 0 || len == 0 || len > (uint64_t)(end - p - n) || p[n + len - 1] != '\0')
+        return 0;
+    *s = (const char *)(p + n);
+    return n + (size_t)len;
+}
+
+int messaging_capture_next(struct messaging_capture_reader *r, struct messaging_capture_event *ev)
+{
+    const uint8_t *p = r->p;
+    uint64_t dt, who, dl;
+    size_t n;
+
+    if (p == r->end)
+        return 0;
+    ev->op = *p++;
+    if ((n = wire_get_varint(p, r->end, &dt)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    if ((n = wire_get_varint(p, r->end, &who)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    if ((n = wire_get_varint(p, r->end, &ev->size)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    if ((n = get_string(p, r->end, &ev->namesp)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    if ((n = get_string(p, r->end, &ev->topic)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    if ((n = wire_get_varint(p, r->end, &dl)) == 0 || dl > (uint64_t)(r->end - p - n) ||
+            (dl != 0 && dl != ev->size))
+        return MESSAGING_ERR_PROTOCOL;
+    p += n;
+    ev->payload = dl ? p : NULL;
+    p += dl;
+
+    ev->who = (uint32_t)who;
+    r->ts += dt;
+    ev->ts = r->ts;
+    r->p = p;
+    return 1;
+}
@@ -32,12 +32,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
 #include <messaging-client.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-arena.h>
+#include <messaging-bootstrap.h>
+#include <messaging-shm.h>
+#include <messaging-trace.h>
+#include <messaging-transport.h>
+#include <messaging-stats.h>
+#include <messaging-filter.h>
+#include <messaging-route.h>
+#include <messaging-reorder.h>
 #include <CppWrapper.h>
 #include <vector.h>
 
@@ -49,21 +64,111 @@ struct messaging_client {
     hg_id_t unsub_id;
     hg_id_t notify_id;
     hg_id_t finalize_id;
-    char **server_address;
+    char **server_address;   /* server list entries, "address[#provider]" */
+    char **server_name;      /* their addresses, to look up */
+    uint16_t *server_provider;
     int num_servers;
     //MPI_Comm comm;
     char *addr_string;
     int addr_string_len;
     WrapperMap *t;
+    messaging_arena_t arena;
+    size_t eager_size;
+    hg_id_t register_id;
+    uint32_t *subscriber_ids;   /* our id at each server, SUBSCRIBER_NONE until registered */
+    hg_id_t stats_id;
+    int tracing;                /* holds a reference on the process tracer */
+    messaging_shm_t shm;
+    struct local_reader *readers;
+    int num_readers;
+    int max_readers;
+    ABT_mutex shm_lock;         /* recursive, callbacks may (un)subscribe */
+    ABT_thread poller;
+    int poller_stop;
+    int polling;                /* the poller is inside messaging_shm_poll */
+    int local_dispatch;         /* our own subscriptions are served by publish() */
+    uint64_t notify_count;      /* notifications received from servers */
+    int aggregate;              /* AGG_NONE, AGG_LEADER or AGG_MEMBER */
+    MPI_Comm node_comm;
+    int node_rank;
+    int node_size;
+    char **node_addrs;          /* leader: address of every rank on the node */
+    hg_addr_t leader;           /* member: the node's leader */
+    hg_id_t agg_sub_id;
+    hg_id_t agg_unsub_id;
+    WrapperMap *agg;            /* leader: the node's subscriptions, by node rank */
+    ABT_mutex agg_lock;
+    struct messaging_transport xport;
+    messaging_cstats_t stats;
+    pthread_t monitor;          /* statistics dumps and the callback watchdog */
+    int monitor_running;
+    int monitor_stop;
+    int monitor_poll_ms;
+    pthread_mutex_t monitor_lock;
+    pthread_cond_t monitor_cond;
+    char *stats_file;
+    int stats_interval_ms;
+    char instance[128];         /* label for dumped statistics */
+    int filtering;              /* MESSAGING_PUBLISH_FILTER */
+    uint64_t filter_refresh_ns;
+    messaging_filter_t *filters;    /* each server's subscription filter, NULL until fetched */
+    uint64_t *filter_fetched;       /* when each was last fetched */
+    ABT_mutex filter_lock;          /* serializes filter updates */
+    hg_id_t filter_id;
+    hg_id_t filter_update_id;
+    messaging_routes_t routes;  /* MESSAGING_DIRECT, NULL if every publish goes through the servers */
+    hg_id_t route_id;
+    hg_id_t route_invalidate_id;
+    messaging_reorder_t reorder;    /* MESSAGING_REORDER, NULL if notifications run as they arrive */
+    ABT_thread flusher;             /* gives up on the gaps nothing else will fill */
+    int flusher_stop;
+    hg_id_t pub_oneway_id;
+    hg_id_t notify_oneway_id;
+    WrapperMap *oneway;             /* topics published without waiting for the server */
+    int num_oneway;
+    ABT_mutex oneway_lock;
 };
 
+/* node aggregation roles */
+#define AGG_NONE    0
+#define AGG_LEADER  1   /* subscribes at the servers for the whole node */
+#define AGG_MEMBER  2   /* subscribes through the leader */
+
+#define AGG_RING_RETRIES 1000   /* yields waiting for room in a ring before falling back to RPCs */
+
+/* a shared memory ring we read a subscribed topic from */
+struct local_reader {
+    messaging_shm_reader_t reader;
+    int closing;                /* unsubscribed from a callback, freed after the poll */
+};
+
+#define SHM_POLL_BATCH  64
+#define SHM_IDLE_SPINS  1000    /* empty polls before the poller starts sleeping */
+#define SHM_IDLE_SLEEP  0.1     /* ms */
+
+#define SUBSCRIBER_NONE UINT32_MAX
+
+#define MONITOR_POLL_MS   100   /* how often the watchdog looks at running callbacks */
+
+#define FILTER_REFRESH_MS 1000  /* default age at which a filter is fetched again */
+
+/* who a message says it comes from */
+#define IDENT_NONE -1   /* nobody, for publish */
+#define IDENT_ADDR -2   /* our address, for registration */
+
 DECLARE_MARGO_RPC_HANDLER(notify_rpc);
+DECLARE_MARGO_RPC_HANDLER(notify_oneway_rpc);
+DECLARE_MARGO_RPC_HANDLER(aggregate_rpc);
+DECLARE_MARGO_RPC_HANDLER(filter_update_rpc);
+DECLARE_MARGO_RPC_HANDLER(route_invalidate_rpc);
 
 static void notify_rpc(hg_handle_t h);
+static void notify_oneway_rpc(hg_handle_t h);
+static void filter_update_rpc(hg_handle_t h);
+static void route_invalidate_rpc(hg_handle_t h);
 static int remove_all_subscriptions(messaging_client_t client);
-static int remove_all_subscriptions_new(messaging_client_t client);
 
-unsigned long hash(char *str)
+unsigned long hash(const char *str)
     {
         unsigned long hash = 5381;
         int c;
@@ -91,195 +196,1066 @@ char ** addr_str_buf_to_list(
 }
 
 
-static int build_address_with_mpi(messaging_client_t* cl, MPI_Comm comm){
-    /* open config file for reading */
+/* encodes a message for namesp/topic; ident is IDENT_NONE, IDENT_ADDR or the
+ * index of the server whose subscriber id the message should carry, exclude
+ * lists subscribers the server should not notify and a nonzero trace_id tags
+ * a sampled message */
+static int encode_message_ext(messaging_client_t client, const char *namesp, const char *topic,
+        const void *messg, size_t msg_len, int flags, int ident,
+        const uint32_t *exclude, int num_exclude, uint64_t trace_id, event_meta *raw_msg)
+{
+    struct wire_msg m;
+    void *raw_buf;
+    uint8_t id[4];
+    size_t ext_off;
+
+    wire_msg_init(&m, namesp, topic);
+    m.flags = flags;
+    m.payload = (void*)messg;
+    m.payload_len = msg_len;
+    if(ident == IDENT_ADDR)
+        m.ext_len = wire_ext_size(client->addr_string_len);
+    else if(ident >= 0)
+        m.ext_len = wire_ext_size(sizeof(id));
+    if(num_exclude > 0)
+        m.ext_len += wire_ext_size(4 * num_exclude);
+    if(trace_id)
+        m.ext_len += wire_ext_size(8);
+
+    raw_msg->size = wire_encoded_size(&m);
+    raw_buf = messaging_pool_alloc(raw_msg->size);
+    if(raw_buf == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    wire_encode(raw_buf, raw_msg->size, &m);
+    ext_off = wire_ext_offset(&m);
+    if(ident == IDENT_ADDR){
+        ext_off += wire_ext_put((char*)raw_buf + ext_off, WIRE_EXT_ADDR,
+                client->addr_string, client->addr_string_len);
+    }else if(ident >= 0){
+        wire_put_u32(id, client->subscriber_ids[ident]);
+        ext_off += wire_ext_put((char*)raw_buf + ext_off, WIRE_EXT_SUBID, id, sizeof(id));
+    }
+    if(num_exclude > 0){
+        uint8_t ids[4 * (MESSAGING_SHM_MAX_READERS + 1)];
+        for(int i = 0; i < num_exclude; i++)
+            wire_put_u32(ids + 4*i, exclude[i]);
+        ext_off += wire_ext_put((char*)raw_buf + ext_off, WIRE_EXT_EXCLUDE, ids, 4 * num_exclude);
+    }
+    if(trace_id){
+        uint8_t tid[8];
+        wire_put_u64(tid, trace_id);
+        wire_ext_put((char*)raw_buf + ext_off, WIRE_EXT_TRACE, tid, sizeof(tid));
+    }
+    raw_msg->raw_data = raw_buf;
+    return MESSAGING_SUCCESS;
+}
+
+static int encode_message(messaging_client_t client, const char *namesp, const char *topic,
+        const void *messg, size_t msg_len, int flags, int ident, event_meta *raw_msg)
+{
+    return encode_message_ext(client, namesp, topic, messg, msg_len, flags, ident, NULL, 0, 0, raw_msg);
+}
+
+/* gets a subscriber id from server_id the first time we subscribe there */
+static int client_register(messaging_client_t client, int server_id)
+{
+    bulk_data_t in;
+    register_out_t out;
+    hg_addr_t svr_addr;
+    hg_handle_t h;
+    hg_return_t hret;
     int ret;
-    struct stat st;
-    char *rd_buf = NULL;
-    ssize_t rd_buf_size;
-    char *tok;
-    void *addr_str_buf = NULL;
-    int addr_str_buf_len = 0, num_addrs = 0;
-    int fd;
 
-    messaging_client_t client;
-    client = *cl;
-    int comm_size, rank;
-    MPI_Comm_size(comm, &comm_size);
-    MPI_Comm_rank(comm, &rank);
+    if(client->subscriber_ids[server_id] != SUBSCRIBER_NONE)
+        return MESSAGING_SUCCESS;
 
-    char* file_name = "servids.0";
-    if(rank==0){
-        fd = open(file_name, O_RDONLY);
-        if (fd == -1)
-        {
-            fprintf(stderr, "Error: Unable to open config file %s for server_address list\n",
-                file_name);
-            goto fini;
+    ret = encode_message(client, "", "", NULL, 0, 0, IDENT_ADDR, &in.evnt);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    hret = xport_lookup(&client->xport, client->server_name[server_id], &svr_addr);
+    if(hret != HG_SUCCESS){
+        messaging_pool_free(in.evnt.raw_data);
+        return MESSAGING_ERR_MERCURY;
+    }
+    hret = xport_create(&client->xport, svr_addr, client->register_id, &h);
+    xport_addr_free(&client->xport, svr_addr);
+    if(hret == HG_SUCCESS){
+        hret = xport_provider_forward(&client->xport, h, client->server_provider[server_id], &in);
+        if(hret == HG_SUCCESS && xport_get_output(&client->xport, h, &out) == HG_SUCCESS){
+            ret = out.ret;
+            if(ret == MESSAGING_SUCCESS)
+                client->subscriber_ids[server_id] = out.id;
+            xport_free_output(&client->xport, h, &out);
         }
+        xport_destroy(&client->xport, h);
+    }
+    if(hret != HG_SUCCESS)
+        ret = MESSAGING_ERR_MERCURY;
+    messaging_pool_free(in.evnt.raw_data);
+    if(ret != MESSAGING_SUCCESS)
+        fprintf(stderr, "Could not register with server %s (error %d)\n",
+                client->server_address[server_id], ret);
+    return ret;
+}
 
-        /* get file size and allocate a buffer to store it */
-        ret = fstat(fd, &st);
-        if (ret == -1)
-        {
-            fprintf(stderr, "Error: Unable to stat config file %s for server_address list\n",
-                file_name);
-            goto fini;
+/* the index of the server at addr (len bytes, without the NUL), -1 if none */
+static int server_index(messaging_client_t client, const char *addr, size_t len)
+{
+    for(int i = 0; i < client->num_servers; i++)
+        if(strlen(client->server_address[i]) == len &&
+                memcmp(client->server_address[i], addr, len) == 0)
+            return i;
+    return -1;
+}
+
+/* installs a filter message from a server: our copy, or a newer version of it */
+static int filter_install(messaging_client_t client, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)buf, *end = p + len;
+    uint64_t alen;
+    size_t n;
+    int i, ret = MESSAGING_SUCCESS;
+
+    n = wire_get_varint(p, end, &alen);
+    if(n == 0 || alen > (uint64_t)(end - p - n))
+        return MESSAGING_ERR_PROTOCOL;
+    if((i = server_index(client, (const char*)p + n, alen)) < 0)
+        return MESSAGING_ERR_UNKNOWN_OBJ;
+    p += n + alen;
+
+    ABT_mutex_lock(client->filter_lock);
+    if(client->filters[i] == MESSAGING_FILTER_NULL){
+        messaging_filter_t f;
+        ret = messaging_filter_decode(p, end - p, &f);
+        if(ret == MESSAGING_SUCCESS)
+            __atomic_store_n(&client->filters[i], f, __ATOMIC_RELEASE);
+    }else{
+        ret = messaging_filter_apply(client->filters[i], p, end - p);
+    }
+    if(ret == MESSAGING_SUCCESS)
+        __atomic_store_n(&client->filter_fetched[i], wire_now_ns(), __ATOMIC_RELAXED);
+    ABT_mutex_unlock(client->filter_lock);
+    return ret;
+}
+
+/* asks server_id for its filter; from then on it pushes every topic that
+ * gains subscribers once it has acknowledged the subscription */
+static int filter_fetch(messaging_client_t client, int server_id)
+{
+    bulk_data_t in;
+    stats_out_t out;
+    hg_addr_t svr_addr;
+    hg_handle_t h;
+    int ret;
+
+    ret = client_register(client, server_id);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    ret = encode_message(client, "", "", NULL, 0, 0, server_id, &in.evnt);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    ret = MESSAGING_ERR_MERCURY;
+    if(xport_lookup(&client->xport, client->server_name[server_id], &svr_addr) == HG_SUCCESS){
+        if(xport_create(&client->xport, svr_addr, client->filter_id, &h) == HG_SUCCESS){
+            if(xport_provider_forward(&client->xport, h, client->server_provider[server_id], &in) == HG_SUCCESS &&
+                    xport_get_output(&client->xport, h, &out) == HG_SUCCESS){
+                ret = out.ret;
+                if(ret == MESSAGING_SUCCESS)
+                    ret = filter_install(client, out.data.raw_data, out.data.size);
+                xport_free_output(&client->xport, h, &out);
+            }
+            xport_destroy(&client->xport, h);
         }
-        ret = -1;
-        rd_buf = malloc(st.st_size);
-        if (rd_buf == NULL) goto fini;
+        xport_addr_free(&client->xport, svr_addr);
+    }
+    messaging_pool_free(in.evnt.raw_data);
+    return ret;
+}
 
-        /* load it all in one fell swoop */
-        rd_buf_size = read(fd, rd_buf, st.st_size);
-        if (rd_buf_size != st.st_size)
-        {
-            fprintf(stderr, "Error: Unable to stat config file %s for server_address list\n",
-                file_name);
-            goto fini;
+/* 1 if server_id has no subscriber for namesp/topic, so a publish can be
+ * dropped; a filter that says otherwise is refreshed once it gets old, as
+ * topics losing their subscribers are not pushed */
+static int publish_filtered(messaging_client_t client, const char *namesp, const char *topic,
+        int server_id)
+{
+    messaging_filter_t f;
+    uint64_t h, fetched, now;
+
+    if(!client->filtering)
+        return 0;
+    h = wire_topic_hash(namesp, topic);
+    f = __atomic_load_n(&client->filters[server_id], __ATOMIC_ACQUIRE);
+    if(f != MESSAGING_FILTER_NULL && !messaging_filter_test(f, h))
+        return 1;
+    now = wire_now_ns();
+    fetched = __atomic_load_n(&client->filter_fetched[server_id], __ATOMIC_RELAXED);
+    if(fetched != 0 && now - fetched < client->filter_refresh_ns)
+        return 0;
+    /* one caller refreshes, the others go ahead and publish */
+    if(!__atomic_compare_exchange_n(&client->filter_fetched[server_id], &fetched, now, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return 0;
+    if(filter_fetch(client, server_id) != MESSAGING_SUCCESS)
+        return 0;
+    f = __atomic_load_n(&client->filters[server_id], __ATOMIC_ACQUIRE);
+    return f != MESSAGING_FILTER_NULL && !messaging_filter_test(f, h);
+}
+
+static int filter_setup(messaging_client_t client)
+{
+    const char *s;
+
+    s = getenv("MESSAGING_PUBLISH_FILTER");
+    client->filtering = s ? atoi(s) : 0;
+    if(!client->filtering)
+        return MESSAGING_SUCCESS;
+    s = getenv("MESSAGING_PUBLISH_FILTER_REFRESH");
+    client->filter_refresh_ns = (uint64_t)((s && atof(s) > 0 ? atof(s) : FILTER_REFRESH_MS) * 1e6);
+    client->filters = calloc(client->num_servers, sizeof(*client->filters));
+    client->filter_fetched = calloc(client->num_servers, sizeof(*client->filter_fetched));
+    if(client->filters == NULL || client->filter_fetched == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    if(ABT_mutex_create(&client->filter_lock) != ABT_SUCCESS)
+        return MESSAGING_ERR_ARGOBOTS;
+    return MESSAGING_SUCCESS;
+}
+
+static void filter_teardown(messaging_client_t client)
+{
+    if(client->filters)
+        for(int i = 0; i < client->num_servers; i++)
+            messaging_filter_destroy(client->filters[i]);
+    free(client->filters);
+    free(client->filter_fetched);
+    if(client->filter_lock != ABT_MUTEX_NULL)
+        ABT_mutex_free(&client->filter_lock);
+}
+
+/* asks server_id for the subscribers of namesp/topic and caches them; from
+ * then on it tells us of any change to them once it has acknowledged it */
+static int route_fetch(messaging_client_t client, int server_id, const char *namesp,
+        const char *topic)
+{
+    bulk_data_t in;
+    stats_out_t out;
+    hg_addr_t svr_addr;
+    hg_handle_t h;
+    int ret;
+
+    ret = client_register(client, server_id);
+    if(ret == MESSAGING_SUCCESS)
+        ret = encode_message(client, namesp, topic, NULL, 0, 0, server_id, &in.evnt);
+    if(ret != MESSAGING_SUCCESS){
+        messaging_routes_install(client->routes, server_id, namesp, topic, NULL, 0);
+        return ret;
+    }
+    ret = MESSAGING_ERR_MERCURY;
+    if(xport_lookup(&client->xport, client->server_name[server_id], &svr_addr) == HG_SUCCESS){
+        if(xport_create(&client->xport, svr_addr, client->route_id, &h) == HG_SUCCESS){
+            if(xport_provider_forward(&client->xport, h, client->server_provider[server_id], &in) == HG_SUCCESS &&
+                    xport_get_output(&client->xport, h, &out) == HG_SUCCESS){
+                ret = out.ret;
+                if(ret == MESSAGING_SUCCESS)
+                    ret = messaging_routes_install(client->routes, server_id, namesp, topic,
+                            out.data.raw_data, out.data.size);
+                xport_free_output(&client->xport, h, &out);
+            }
+            xport_destroy(&client->xport, h);
         }
-        rd_buf[rd_buf_size]='\0';
+        xport_addr_free(&client->xport, svr_addr);
+    }
+    /* back to counting, the topic goes through the server for now */
+    if(ret != MESSAGING_SUCCESS)
+        messaging_routes_install(client->routes, server_id, namesp, topic, NULL, 0);
+    messaging_pool_free(in.evnt.raw_data);
+    return ret;
+}
 
-        // strtok the result - each space-delimited address is assumed to be
-        // a unique mercury address
+/* the route to send a publish on, NULL to send it to the server */
+static struct messaging_route *publish_route(messaging_client_t client, const char *namesp,
+        const char *topic, int server_id)
+{
+    struct messaging_route *route;
+    int fetch;
+
+    if(client->routes == MESSAGING_ROUTES_NULL)
+        return NULL;
+    route = messaging_routes_get(client->routes, server_id, namesp, topic, &fetch);
+    if(fetch && route_fetch(client, server_id, namesp, topic) == MESSAGING_SUCCESS)
+        route = messaging_routes_get(client->routes, server_id, namesp, topic, &fetch);
+    return route;
+}
 
-        tok = strtok(rd_buf, "\r\n\t ");
-        if (tok == NULL) goto fini;
+/* runs a topic's callback, timed for the statistics and the watchdog;
+ * recv is when the message arrived, 0 if it is being delivered as it arrives */
+static void run_callback(messaging_client_t client, void *handler_ptr, void *handler_args,
+        void *payload, const char *namesp, const char *topic, uint64_t recv)
+{
+    struct messaging_cstats_cb cb;
 
-        // build up the address buffer
-        addr_str_buf = malloc(rd_buf_size);
-        if (addr_str_buf == NULL) goto fini;
-        do
-        {
-            int tok_size = strlen(tok);
-            memcpy((char*)addr_str_buf + addr_str_buf_len, tok, tok_size+1);
-            addr_str_buf_len += tok_size+1;
-            num_addrs++;
-            tok = strtok(NULL, "\r\n\t ");
-        } while (tok != NULL);
-        if (addr_str_buf_len != rd_buf_size)
-        {
-            // adjust buffer size if our initial guess was wrong
-            fprintf(stderr, "Read size and buffer_len are not equal\n");
-            void *tmp = realloc(addr_str_buf, addr_str_buf_len);
-            if (tmp == NULL) goto fini;
-            addr_str_buf = tmp;
-        }
-        free(rd_buf);
-    }
-
-    MPI_Barrier(comm);
-    // Broadcasting buffer_len and buffer to all client ranks
-    MPI_Bcast(&addr_str_buf_len, 1, MPI_INT, 0, comm);
-    MPI_Bcast(&num_addrs, 1, MPI_INT, 0, comm);
-    if(rank!=0)
-        addr_str_buf = malloc(addr_str_buf_len);
-    MPI_Bcast(addr_str_buf, addr_str_buf_len, MPI_CHAR, 0, comm);
-    
-    /* set up address string array for group members */
-    client->server_address = (char **)addr_str_buf_to_list(addr_str_buf, num_addrs);
-    client->num_servers = num_addrs;
-    *cl = client;
-    ret = 0;
+    messaging_cstats_callback_begin(client->stats, &cb, namesp, topic, recv);
+    ((void (*)(void *, void *))handler_ptr)(handler_args, payload);
+    messaging_cstats_callback_end(client->stats, &cb);
+}
+
+/* hands a message read from a ring to the topic's callback */
+static void local_deliver(void *arg, const char *namesp, const char *topic,
+        const void *data, size_t len)
+{
+    messaging_client_t client = (messaging_client_t)arg;
+    void *handler_ptr, *handler_args;
+
+    messaging_cstats_received(client->stats, namesp, topic, len);
+    if(get_handler(client->t, (char*)namesp, (char*)topic, &handler_ptr, &handler_args) && handler_ptr)
+        run_callback(client, handler_ptr, handler_args, (void*)data, namesp, topic, 0);
+}
+
+/* hands a notification the reorder buffer let through to the topic's
+ * callback, which is when a traced one records its callback span */
+static void reorder_deliver(void *arg, const char *namesp, const char *topic,
+        void *payload, uint64_t recv, uint64_t trace_id)
+{
+    messaging_client_t client = (messaging_client_t)arg;
+    void *handler_ptr, *handler_args;
+    uint32_t sub_id = SUBSCRIBER_NONE;
+
+    if(!get_handler(client->t, (char*)namesp, (char*)topic, &handler_ptr, &handler_args) || !handler_ptr)
+        return;
+    if(trace_id)
+        sub_id = client->subscriber_ids[hash(topic) % client->num_servers];
+    messaging_trace_record(trace_id, MESSAGING_TRACE_CALLBACK_START, sub_id, trace_id ? wire_now_ns() : 0);
+    run_callback(client, handler_ptr, handler_args, payload, namesp, topic, recv);
+    messaging_trace_record(trace_id, MESSAGING_TRACE_CALLBACK_END, sub_id, trace_id ? wire_now_ns() : 0);
+}
+
+static void reorder_flusher(void *arg)
+{
+    messaging_client_t client = (messaging_client_t)arg;
+    double period_ms = messaging_reorder_timeout(client->reorder) / 2e6;
+
+    if(period_ms < 1)
+        period_ms = 1;
+    while(!__atomic_load_n(&client->flusher_stop, __ATOMIC_ACQUIRE)){
+        margo_thread_sleep(client->mid, period_ms);
+        messaging_reorder_expire(client->reorder, wire_now_ns());
+    }
+}
 
+static int reorder_setup(messaging_client_t client)
+{
+    const char *s = getenv("MESSAGING_REORDER");
+    ABT_pool pool;
+    int ret;
+
+    client->reorder = MESSAGING_REORDER_NULL;
+    if(s == NULL || atoi(s) <= 0)
+        return MESSAGING_SUCCESS;
+    ret = messaging_reorder_create(0, 0, reorder_deliver, client, &client->reorder);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    margo_get_handler_pool(client->mid, &pool);
+    if(ABT_thread_create(pool, reorder_flusher, client, ABT_THREAD_ATTR_NULL, &client->flusher) != ABT_SUCCESS){
+        messaging_reorder_destroy(client->reorder);
+        client->reorder = MESSAGING_REORDER_NULL;
+        return MESSAGING_ERR_ARGOBOTS;
+    }
+    return MESSAGING_SUCCESS;
+}
+
+static void reorder_teardown(messaging_client_t client)
+{
+    if(client->reorder == MESSAGING_REORDER_NULL)
+        return;
+    __atomic_store_n(&client->flusher_stop, 1, __ATOMIC_RELEASE);
+    ABT_thread_join(client->flusher);
+    ABT_thread_free(&client->flusher);
+    messaging_reorder_destroy(client->reorder);
+}
+
+/* starts namesp/topic's sequence over, a new subscription numbers from wherever the server is */
+static void reorder_forget(messaging_client_t client, const char *namesp, const char *topic)
+{
+    if(client->reorder != MESSAGING_REORDER_NULL)
+        messaging_reorder_forget(client->reorder, namesp, topic);
+}
+
+static int local_find(messaging_client_t client, const char *namesp, const char *topic)
+{
+    for(int i = 0; i < client->num_readers; i++){
+        messaging_shm_reader_t r = client->readers[i].reader;
+        if(strcmp(messaging_shm_reader_topic(r), topic) == 0 &&
+                strcmp(messaging_shm_reader_namesp(r), namesp) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void local_remove(messaging_client_t client, int i)
+{
+    messaging_shm_unsubscribe(client->readers[i].reader);
+    client->readers[i] = client->readers[--client->num_readers];
+}
+
+/* starts reading namesp/topic from shared memory; on failure the topic is
+ * simply served by the server alone */
+static int local_subscribe(messaging_client_t client, const char *namesp, const char *topic, uint32_t sub_id)
+{
+    messaging_shm_reader_t reader;
+    int i, ret = MESSAGING_ERR_ALLOCATION;
+
+    if(client->shm == MESSAGING_SHM_NULL || sub_id == SUBSCRIBER_NONE)
+        return MESSAGING_ERR_INVALID_ARG;
+    ABT_mutex_lock(client->shm_lock);
+    i = local_find(client, namesp, topic);
+    if(i >= 0){
+        client->readers[i].closing = 0;
+        ret = MESSAGING_SUCCESS;
+        goto fini;
+    }
+    if(client->num_readers == client->max_readers){
+        int max = client->max_readers ? 2 * client->max_readers : 16;
+        struct local_reader *r = realloc(client->readers, max * sizeof(*r));
+        if(r == NULL)
+            goto fini;
+        client->readers = r;
+        client->max_readers = max;
+    }
+    ret = messaging_shm_subscribe(client->shm, namesp, topic, sub_id, &reader);
+    if(ret == MESSAGING_SUCCESS){
+        client->readers[client->num_readers].reader = reader;
+        client->readers[client->num_readers].closing = 0;
+        client->num_readers++;
+    }
 fini:
+    ABT_mutex_unlock(client->shm_lock);
     return ret;
 }
 
-static int build_address(messaging_client_t* cl){
-    /* open config file for reading */
+/* returns 1 if we were reading namesp/topic from shared memory */
+static int local_unsubscribe(messaging_client_t client, const char *namesp, const char *topic)
+{
+    int i;
+
+    if(client->shm == MESSAGING_SHM_NULL)
+        return 0;
+    ABT_mutex_lock(client->shm_lock);
+    i = local_find(client, namesp, topic);
+    if(i >= 0){
+        /* only the poller itself can hold the lock while polling */
+        if(client->polling)
+            client->readers[i].closing = 1;
+        else
+            local_remove(client, i);
+    }
+    ABT_mutex_unlock(client->shm_lock);
+    return i >= 0;
+}
+
+static void shm_poller(void *arg)
+{
+    messaging_client_t client = (messaging_client_t)arg;
+    int idle = 0;
+
+    while(!__atomic_load_n(&client->poller_stop, __ATOMIC_ACQUIRE)){
+        int n = 0;
+
+        ABT_mutex_lock(client->shm_lock);
+        client->polling = 1;
+        for(int i = 0; i < client->num_readers; i++)
+            if(!client->readers[i].closing)
+                n += messaging_shm_poll(client->readers[i].reader, local_deliver, client, SHM_POLL_BATCH);
+        client->polling = 0;
+        for(int i = client->num_readers - 1; i >= 0; i--)
+            if(client->readers[i].closing)
+                local_remove(client, i);
+        ABT_mutex_unlock(client->shm_lock);
+
+        if(n > 0)
+            idle = 0;
+        if(++idle < SHM_IDLE_SPINS)
+            ABT_thread_yield();
+        else
+            margo_thread_sleep(client->mid, SHM_IDLE_SLEEP);
+    }
+}
+
+static void local_setup(messaging_client_t client)
+{
+    struct messaging_shm_config cfg;
+    ABT_mutex_attr attr;
+    ABT_pool pool;
     int ret;
-    struct stat st;
-    char *rd_buf = NULL;
-    ssize_t rd_buf_size;
-    char *tok;
-    void *addr_str_buf = NULL;
-    int addr_str_buf_len = 0, num_addrs = 0;
-    int fd;
 
-    messaging_client_t client;
-    client = *cl;
+    client->shm = MESSAGING_SHM_NULL;
+    messaging_shm_config_init(&cfg);
+    ret = messaging_shm_attach(&cfg, &client->shm);
+    if(ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "Warning: client running without shared memory delivery (error %d)\n", ret);
+        client->shm = MESSAGING_SHM_NULL;
+    }
+    if(client->shm == MESSAGING_SHM_NULL)
+        return;
+
+    ABT_mutex_attr_create(&attr);
+    ABT_mutex_attr_set_recursive(attr, ABT_TRUE);
+    ABT_mutex_create_with_attr(attr, &client->shm_lock);
+    ABT_mutex_attr_free(&attr);
+    margo_get_handler_pool(client->mid, &pool);
+    if(ABT_thread_create(pool, shm_poller, client, ABT_THREAD_ATTR_NULL, &client->poller) != ABT_SUCCESS){
+        fprintf(stderr, "Warning: could not start the shared memory poller\n");
+        ABT_mutex_free(&client->shm_lock);
+        messaging_shm_detach(client->shm);
+        client->shm = MESSAGING_SHM_NULL;
+    }
+}
 
-    char* file_name = "servids.0";
-    fd = open(file_name, O_RDONLY);
-    if (fd == -1)
-    {
-        fprintf(stderr, "Error: Unable to open config file %s for server_address list\n",
-            file_name);
+static void local_teardown(messaging_client_t client)
+{
+    if(client->shm == MESSAGING_SHM_NULL)
+        return;
+    __atomic_store_n(&client->poller_stop, 1, __ATOMIC_RELEASE);
+    ABT_thread_join(client->poller);
+    ABT_thread_free(&client->poller);
+    while(client->num_readers > 0)
+        local_remove(client, client->num_readers - 1);
+    free(client->readers);
+    ABT_mutex_free(&client->shm_lock);
+    messaging_shm_detach(client->shm);
+}
+
+/* sends a (un)subscribe for namesp/topic to the server owning it */
+static int server_update(messaging_client_t client, const char *namesp, const char *topic,
+        int server_id, hg_id_t rpc_id)
+{
+    bulk_data_t raw_msg;
+    hg_addr_t svr_addr;
+    hg_handle_t h;
+    response_t resp;
+    uint64_t start;
+    int ret;
+
+    ret = encode_message(client, namesp, topic, NULL, 0, 0, server_id, &raw_msg.evnt);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    ret = MESSAGING_ERR_MERCURY;
+    if(xport_lookup(&client->xport, client->server_name[server_id], &svr_addr) != HG_SUCCESS)
         goto fini;
+    if(xport_create(&client->xport, svr_addr, rpc_id, &h) != HG_SUCCESS){
+        xport_addr_free(&client->xport, svr_addr);
+        goto fini;
+    }
+    start = wire_now_ns();
+    if(xport_provider_forward(&client->xport, h, client->server_provider[server_id], &raw_msg) == HG_SUCCESS &&
+            xport_get_output(&client->xport, h, &resp) == HG_SUCCESS){
+        ret = resp.ret;
+        if(xport_free_output(&client->xport, h, &resp) != HG_SUCCESS && ret == MESSAGING_SUCCESS)
+            ret = MESSAGING_ERR_MERCURY;
+    }
+    messaging_cstats_update_rtt(client->stats, server_id, wire_now_ns() - start,
+            ret == MESSAGING_SUCCESS);
+    xport_addr_free(&client->xport, svr_addr);
+    xport_destroy(&client->xport, h);
+fini:
+    messaging_pool_free(raw_msg.evnt.raw_data);
+    return ret;
+}
+
+/* asks the node leader to (un)subscribe namesp/topic for us; leader_id gets
+ * the leader's subscriber id at the topic's server, which our ring reader uses */
+static int aggregate_update(messaging_client_t client, const char *namesp, const char *topic,
+        hg_id_t rpc_id, uint32_t *leader_id)
+{
+    struct wire_msg m;
+    bulk_data_t in;
+    register_out_t out;
+    hg_handle_t h;
+    hg_return_t hret;
+    uint8_t rank[4];
+    int ret = MESSAGING_ERR_MERCURY;
+
+    wire_msg_init(&m, namesp, topic);
+    m.ext_len = wire_ext_size(sizeof(rank));
+    in.evnt.size = wire_encoded_size(&m);
+    in.evnt.raw_data = messaging_pool_alloc(in.evnt.size);
+    if(in.evnt.raw_data == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    wire_encode(in.evnt.raw_data, in.evnt.size, &m);
+    wire_put_u32(rank, (uint32_t)client->node_rank);
+    wire_ext_put((char*)in.evnt.raw_data + wire_ext_offset(&m), WIRE_EXT_SUBID, rank, sizeof(rank));
+
+    hret = xport_create(&client->xport, client->leader, rpc_id, &h);
+    if(hret == HG_SUCCESS){
+        hret = xport_forward(&client->xport, h, &in);
+        if(hret == HG_SUCCESS && xport_get_output(&client->xport, h, &out) == HG_SUCCESS){
+            ret = out.ret;
+            if(leader_id)
+                *leader_id = out.id;
+            xport_free_output(&client->xport, h, &out);
+        }
+        xport_destroy(&client->xport, h);
     }
+    messaging_pool_free(in.evnt.raw_data);
+    return ret;
+}
 
-    /* get file size and allocate a buffer to store it */
-    ret = fstat(fd, &st);
-    if (ret == -1)
-    {
-        fprintf(stderr, "Error: Unable to stat config file %s for server_address list\n",
-            file_name);
+/* leader side of aggregate_update(): the first rank of the node to want a
+ * topic subscribes us at its server, the last one to leave unsubscribes */
+static void aggregate_rpc(hg_handle_t h)
+{
+    margo_instance_id mid = margo_hg_handle_get_instance(h);
+    const struct hg_info* info = margo_get_info(h);
+    messaging_client_t client = (messaging_client_t) margo_registered_data(mid, info->id);
+    bulk_data_t in;
+    register_out_t out = { MESSAGING_SUCCESS, SUBSCRIBER_NONE };
+    struct wire_msg m;
+    uint32_t rank;
+    int server_id;
+    size_t before;
+    void *fp, *args;
+
+    margo_get_input(h, &in);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS && !wire_ext_u32(&m, WIRE_EXT_SUBID, &rank))
+        out.ret = MESSAGING_ERR_PROTOCOL;
+    if(out.ret != MESSAGING_SUCCESS)
         goto fini;
+
+    server_id = hash(m.topic) % client->num_servers;
+    ABT_mutex_lock(client->agg_lock);
+    before = map_get_value(client->agg, m.namesp, m.topic, NULL, 0);
+    if(info->id == client->agg_sub_id){
+        out.ret = client_register(client, server_id);
+        if(out.ret == MESSAGING_SUCCESS && before == 0)
+            out.ret = server_update(client, m.namesp, m.topic, server_id, client->sub_id);
+        if(out.ret == MESSAGING_SUCCESS)
+            map_subscribe(client->agg, m.namesp, m.topic, rank);
+        out.id = client->subscriber_ids[server_id];
+    }else{
+        map_unsubscribe(client->agg, m.namesp, m.topic, rank);
+        if(before > 0 && map_get_value(client->agg, m.namesp, m.topic, NULL, 0) == 0 &&
+                !get_handler(client->t, m.namesp, m.topic, &fp, &args) &&
+                client->subscriber_ids[server_id] != SUBSCRIBER_NONE)
+            out.ret = server_update(client, m.namesp, m.topic, server_id, client->unsub_id);
     }
-    ret = -1;
-    rd_buf = malloc(st.st_size);
-    if (rd_buf == NULL) goto fini;
+    ABT_mutex_unlock(client->agg_lock);
 
-    /* load it all in one fell swoop */
-    rd_buf_size = read(fd, rd_buf, st.st_size);
-    if (rd_buf_size != st.st_size)
-    {
-        fprintf(stderr, "Error: Unable to stat config file %s for server_address list\n",
-            file_name);
+fini:
+    xport_respond(&client->xport, h, &out);
+    margo_free_input(h, &in);
+    xport_destroy(&client->xport, h);
+}
+DEFINE_MARGO_RPC_HANDLER(aggregate_rpc)
+
+/* leader: passes a notification on to the ranks of the node subscribed to it,
+ * through their shared memory rings or, if the payload does not fit or the
+ * ring stays full, with a notify RPC to each of them */
+static void aggregate_forward(messaging_client_t client, const struct wire_msg *m,
+        const event_meta *evnt, const struct messaging_arena_buf *pbuf)
+{
+    uint32_t ranks[MESSAGING_SHM_MAX_READERS], ids[MESSAGING_SHM_MAX_READERS];
+    margo_request reqs[MESSAGING_SHM_MAX_READERS];
+    hg_handle_t hs[MESSAGING_SHM_MAX_READERS];
+    message_t in;
+    size_t n;
+    int i, tries;
+
+    /* members hold ring reader slots, so there are never more than a ring has */
+    ABT_mutex_lock(client->agg_lock);
+    n = map_get_value(client->agg, m->namesp, m->topic, ranks, MESSAGING_SHM_MAX_READERS);
+    ABT_mutex_unlock(client->agg_lock);
+    if(n == 0)
+        return;
+    if(n > MESSAGING_SHM_MAX_READERS)
+        n = MESSAGING_SHM_MAX_READERS;
+
+    if(m->payload_len <= messaging_shm_max_payload(client->shm)){
+        for(tries = 0; tries < AGG_RING_RETRIES; tries++){
+            if(messaging_shm_publish(client->shm, m->namesp, m->topic, m->payload,
+                        m->payload_len, 1, ids) > 0)
+                return;
+            ABT_thread_yield();
+        }
+    }
+
+    /* as the server does, members pull a bulk payload from our copy */
+    in.evnt = *evnt;
+    in.bulk = pbuf->ptr ? pbuf->bulk : HG_BULK_NULL;
+    in.offset = pbuf->offset;
+    for(i = 0; i < (int)n; i++){
+        hg_addr_t addr;
+        hs[i] = HG_HANDLE_NULL;
+        if(xport_lookup(&client->xport, client->node_addrs[ranks[i]], &addr) != HG_SUCCESS)
+            continue;
+        if(xport_create(&client->xport, addr, client->notify_id, &hs[i]) == HG_SUCCESS &&
+                xport_iforward(&client->xport, hs[i], &in, &reqs[i]) != HG_SUCCESS){
+            xport_destroy(&client->xport, hs[i]);
+            hs[i] = HG_HANDLE_NULL;
+        }
+        xport_addr_free(&client->xport, addr);
+    }
+    for(i = 0; i < (int)n; i++){
+        if(hs[i] == HG_HANDLE_NULL)
+            continue;
+        xport_wait(&client->xport, reqs[i]);
+        xport_destroy(&client->xport, hs[i]);
+    }
+}
+
+/* an MPI barrier across the node that keeps serving RPCs while it waits */
+static void node_barrier(messaging_client_t client)
+{
+    MPI_Request req;
+    int done = 0;
+
+    MPI_Ibarrier(client->node_comm, &req);
+    for(;;){
+        MPI_Test(&req, &done, MPI_STATUS_IGNORE);
+        if(done)
+            break;
+        margo_thread_sleep(client->mid, 1);
+    }
+}
+
+/* picks the node's leader with MPI_COMM_TYPE_SHARED when MESSAGING_AGGREGATE is
+ * set; the leader subscribes at the servers for every rank of the node and
+ * passes notifications on locally, so servers send one per node */
+static int aggregate_setup(messaging_client_t client, MPI_Comm comm)
+{
+    const char *s = getenv("MESSAGING_AGGREGATE");
+    int enabled = s ? atoi(s) : 0, all_enabled, len, *lens = NULL, *displs = NULL, total, i;
+    char *buf = NULL;
+    int ret = MESSAGING_SUCCESS;
+
+    client->aggregate = AGG_NONE;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &client->node_comm);
+    MPI_Comm_rank(client->node_comm, &client->node_rank);
+    MPI_Comm_size(client->node_comm, &client->node_size);
+
+    /* notifications are passed on through the rings, so every rank needs them */
+    if(enabled && client->shm == MESSAGING_SHM_NULL){
+        if(client->node_rank == 0)
+            fprintf(stderr, "Warning: MESSAGING_AGGREGATE needs MESSAGING_SHM, not aggregating\n");
+        enabled = 0;
+    }
+    MPI_Allreduce(&enabled, &all_enabled, 1, MPI_INT, MPI_MIN, client->node_comm);
+    if(!all_enabled || client->node_size < 2)
+        return MESSAGING_SUCCESS;
+
+    /* everyone learns the leader's address, the leader learns everyone's */
+    len = client->addr_string_len;
+    lens = malloc(client->node_size * sizeof(*lens));
+    displs = malloc(client->node_size * sizeof(*displs));
+    if(lens == NULL || displs == NULL){
+        ret = MESSAGING_ERR_ALLOCATION;
+        goto fini;
+    }
+    MPI_Allgather(&len, 1, MPI_INT, lens, 1, MPI_INT, client->node_comm);
+    for(i = 0, total = 0; i < client->node_size; i++){
+        displs[i] = total;
+        total += lens[i];
+    }
+    buf = malloc(total);
+    if(buf == NULL){
+        ret = MESSAGING_ERR_ALLOCATION;
         goto fini;
     }
-    rd_buf[rd_buf_size]='\0';
+    MPI_Allgatherv(client->addr_string, len, MPI_CHAR, buf, lens, displs, MPI_CHAR, client->node_comm);
+
+    hg_bool_t flag;
+    margo_registered_name(client->mid, "aggregate_subscribe_rpc", &client->agg_sub_id, &flag);
+    if(flag == HG_TRUE) { /* RPCs already registered */
+        margo_registered_name(client->mid, "aggregate_unsubscribe_rpc", &client->agg_unsub_id, &flag);
+    } else {
+        client->agg_sub_id = MARGO_REGISTER(client->mid, "aggregate_subscribe_rpc",
+                bulk_data_t, register_out_t, aggregate_rpc);
+        client->agg_unsub_id = MARGO_REGISTER(client->mid, "aggregate_unsubscribe_rpc",
+                bulk_data_t, register_out_t, aggregate_rpc);
+    }
+    if(client->node_rank == 0){
+        client->aggregate = AGG_LEADER;
+        client->node_addrs = addr_str_buf_to_list(buf, client->node_size);
+        client->agg = map_new();
+        ABT_mutex_create(&client->agg_lock);
+        /* node ranks are registered in order, so each gets its rank as id */
+        for(i = 0; i < client->node_size; i++)
+            map_register(client->agg, client->node_addrs[i]);
+        margo_register_data(client->mid, client->agg_sub_id, (void*)client, NULL);
+        margo_register_data(client->mid, client->agg_unsub_id, (void*)client, NULL);
+        buf = NULL;
+    }else{
+        client->aggregate = AGG_MEMBER;
+        if(xport_lookup(&client->xport, buf, &client->leader) != HG_SUCCESS){
+            client->aggregate = AGG_NONE;
+            ret = MESSAGING_ERR_MERCURY;
+        }
+    }
+    MPI_Barrier(client->node_comm);
 
-    // strtok the result - each space-delimited address is assumed to be
-    // a unique mercury address
+fini:
+    free(buf);
+    free(displs);
+    free(lens);
+    return ret;
+}
 
-    tok = strtok(rd_buf, "\r\n\t ");
-    if (tok == NULL) goto fini;
+/* members drop their subscriptions at the leader, which waits for all of them */
+static void aggregate_teardown(messaging_client_t client)
+{
+    if(client->aggregate == AGG_MEMBER){
+        vector topics = map_get_topics(client->t);
+        for(int i = 0; i + 1 < VECTOR_TOTAL(topics); i += 2){
+            char *namesp = VECTOR_GET(topics, char*, i);
+            char *topic = VECTOR_GET(topics, char*, i + 1);
+            aggregate_update(client, namesp, topic, client->agg_unsub_id, NULL);
+            free(namesp);
+            free(topic);
+        }
+        VECTOR_FREE(topics);
+        node_barrier(client);
+        xport_addr_free(&client->xport, client->leader);
+    }else if(client->aggregate == AGG_LEADER){
+        node_barrier(client);
+        map_delete(client->agg);
+        ABT_mutex_free(&client->agg_lock);
+        free(client->node_addrs[0]);
+        free(client->node_addrs);
+    }
+    if(client->node_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&client->node_comm);
+    client->aggregate = AGG_NONE;
+}
 
-    // build up the address buffer
-    addr_str_buf = malloc(rd_buf_size);
-    if (addr_str_buf == NULL) goto fini;
-    do
-    {
-        int tok_size = strlen(tok);
-        memcpy((char*)addr_str_buf + addr_str_buf_len, tok, tok_size+1);
-        addr_str_buf_len += tok_size+1;
-        num_addrs++;
-        tok = strtok(NULL, "\r\n\t ");
-    } while (tok != NULL);
-    if (addr_str_buf_len != rd_buf_size)
-    {
-        void *tmp = realloc(addr_str_buf, addr_str_buf_len);
-        if (tmp == NULL) goto fini;
-        addr_str_buf = tmp;
+/* splits the server list entries into the addresses to look up and the
+ * providers to send to, see messaging-bootstrap.h */
+static int endpoints_setup(messaging_client_t client, int len)
+{
+    char *names;
+
+    client->server_name = malloc(client->num_servers * sizeof(*client->server_name));
+    client->server_provider = malloc(client->num_servers * sizeof(*client->server_provider));
+    names = malloc(len);
+    if(client->server_address == NULL || client->server_name == NULL ||
+            client->server_provider == NULL || names == NULL){
+        free(names);
+        return MESSAGING_ERR_ALLOCATION;
     }
-    free(rd_buf);
-   
+    memcpy(names, client->server_address[0], len);
+    for(int i = 0; i < client->num_servers; i++){
+        size_t addr_len;
+
+        client->server_name[i] = names + (client->server_address[i] - client->server_address[0]);
+        client->server_provider[i] = messaging_bootstrap_endpoint(client->server_address[i],
+                strlen(client->server_address[i]), &addr_len);
+        client->server_name[i][addr_len] = '\0';
+    }
+    return MESSAGING_SUCCESS;
+}
+
+static int build_address_with_mpi(messaging_client_t* cl, MPI_Comm comm){
+    struct messaging_server_list list = {0};
+    int ret = MESSAGING_SUCCESS;
+    int rank, hdr[3];
+
+    messaging_client_t client;
+    client = *cl;
+    MPI_Comm_rank(comm, &rank);
+
+    /* only rank 0 talks to the bootstrap provider, the rest get its answer */
+    if(rank==0)
+        ret = messaging_bootstrap_load(client->mid, NULL, &list);
+    hdr[0] = ret;
+    hdr[1] = list.addrs_len;
+    hdr[2] = list.num_addrs;
+    MPI_Bcast(hdr, 3, MPI_INT, 0, comm);
+    if(hdr[0] != MESSAGING_SUCCESS)
+        return hdr[0];
+    if(rank!=0){
+        list.addrs = malloc(hdr[1]);
+        list.addrs_len = hdr[1];
+        list.num_addrs = hdr[2];
+    }
+    MPI_Bcast(list.addrs, list.addrs_len, MPI_CHAR, 0, comm);
+
     /* set up address string array for group members */
-    client->server_address = (char **)addr_str_buf_to_list(addr_str_buf, num_addrs);
-    client->num_servers = num_addrs;
+    client->server_address = (char **)addr_str_buf_to_list(list.addrs, list.num_addrs);
+    client->num_servers = list.num_addrs;
     *cl = client;
-    ret = 0;
+    return endpoints_setup(client, list.addrs_len);
+}
 
-fini:
-    return ret;
+static int build_address(messaging_client_t* cl, const char *spec){
+    struct messaging_server_list list;
+    int ret;
+
+    messaging_client_t client;
+    client = *cl;
+
+    ret = messaging_bootstrap_load(client->mid, spec, &list);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    /* set up address string array for group members */
+    client->server_address = (char **)addr_str_buf_to_list(list.addrs, list.num_addrs);
+    client->num_servers = list.num_addrs;
+    *cl = client;
+    return endpoints_setup(client, list.addrs_len);
 }
 
-int client_init_with_mpi(margo_instance_id mid, MPI_Comm comm, messaging_client_t* cl)
+/* the statistics kept by the pieces of the client, together */
+static void client_snapshot(messaging_client_t client, struct messaging_client_stats *s)
 {
-    
-    messaging_client_t client  = (messaging_client_t)calloc(1, sizeof(*client));
-    if(!client) return MESSAGING_ERR_ALLOCATION;
+    struct messaging_reorder_counters c;
+
+    messaging_cstats_snapshot(client->stats, s);
+    if(client->reorder != MESSAGING_REORDER_NULL){
+        messaging_reorder_counters(client->reorder, &c);
+        s->reorder_held = c.held;
+        s->reorder_gaps = c.gaps;
+        s->reorder_duplicates = c.duplicates;
+    }
+}
 
-    int ret = 0;
+static void client_stats_dump(messaging_client_t client)
+{
+    struct messaging_client_stats *s;
+    size_t len = strlen(client->stats_file);
+    char *tmp;
+    FILE *f;
+
+    s = (struct messaging_client_stats*)malloc(sizeof(*s));
+    tmp = (char*)malloc(len + 5);
+    if(s == NULL || tmp == NULL)
+        goto out;
+    client_snapshot(client, s);
+    /* write aside and rename so scrapers never see a partial file */
+    memcpy(tmp, client->stats_file, len);
+    memcpy(tmp + len, ".tmp", 5);
+    f = fopen(tmp, "w");
+    if(f == NULL){
+        fprintf(stderr, "Warning: could not write statistics to %s (%s)\n", tmp, strerror(errno));
+        goto out;
+    }
+    messaging_client_stats_write_prometheus(f, s, client->instance);
+    if(fclose(f) == 0)
+        rename(tmp, client->stats_file);
+out:
+    free(tmp);
+    free(s);
+}
 
-    hg_return_t hret          = HG_SUCCESS;
-    client->mid = mid;
+/* a plain thread rather than a ULT, so callbacks hogging the handler
+ * streams cannot keep the watchdog from reporting them */
+static void *client_monitor(void *arg)
+{
+    messaging_client_t client = (messaging_client_t)arg;
+    int poll_ms = client->monitor_poll_ms, waited = 0;
+    ABT_pool pool;
+    struct timespec ts;
+
+    margo_get_handler_pool(client->mid, &pool);
+
+    pthread_mutex_lock(&client->monitor_lock);
+    while(!client->monitor_stop){
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)poll_ms * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        if(pthread_cond_timedwait(&client->monitor_cond, &client->monitor_lock, &ts) != ETIMEDOUT)
+            continue;
+        pthread_mutex_unlock(&client->monitor_lock);
+        {
+            size_t queued;
+            messaging_cstats_watch(client->stats,
+                    ABT_pool_get_size(pool, &queued) == ABT_SUCCESS ? (long)queued : -1);
+        }
+        waited += poll_ms;
+        if(client->stats_file != NULL && waited >= client->stats_interval_ms){
+            client_stats_dump(client);
+            waited = 0;
+        }
+        pthread_mutex_lock(&client->monitor_lock);
+    }
+    pthread_mutex_unlock(&client->monitor_lock);
+    return NULL;
+}
 
-    ret = build_address_with_mpi(&client, comm);
-    if(ret!=0)
-        goto finish;
+/* sets up the statistics; the monitor runs if they are dumped or callbacks
+ * are watched.  Each client dumps to MESSAGING_CLIENT_STATS_FILE.<pid>, and
+ * clients after the first in a process add .<n> */
+static int client_stats_start(messaging_client_t client)
+{
+    static int instances;
+    const char *file = getenv("MESSAGING_CLIENT_STATS_FILE");
+    const char *s;
+    uint64_t warn_ms = 1000;
+    int ret, n;
+
+    if((s = getenv("MESSAGING_CALLBACK_WARN_MS")) != NULL)
+        warn_ms = strtoull(s, NULL, 10);
+    ret = messaging_cstats_create(client->num_servers, warn_ms * 1000000, &client->stats);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    n = __atomic_fetch_add(&instances, 1, __ATOMIC_RELAXED);
+    if(file != NULL && *file != '\0'){
+        client->stats_interval_ms = 10000;
+        if((s = getenv("MESSAGING_CLIENT_STATS_INTERVAL")) != NULL && atof(s) > 0)
+            client->stats_interval_ms = (int)(atof(s) * 1000);
+        client->stats_file = (char*)malloc(strlen(file) + 32);
+        if(client->stats_file != NULL){
+            if(n > 0)
+                sprintf(client->stats_file, "%s.%d.%d", file, (int)getpid(), n);
+            else
+                sprintf(client->stats_file, "%s.%d", file, (int)getpid());
+        }
+    }
+    snprintf(client->instance, sizeof(client->instance), "%s", client->addr_string);
+
+    if(client->stats_file == NULL && warn_ms == 0)
+        return MESSAGING_SUCCESS;
+    /* check often enough to report a callback soon after it goes over */
+    client->monitor_poll_ms = MONITOR_POLL_MS;
+    if(warn_ms > 0 && warn_ms < 2 * MONITOR_POLL_MS)
+        client->monitor_poll_ms = warn_ms / 2 > 0 ? (int)(warn_ms / 2) : 1;
+    pthread_mutex_init(&client->monitor_lock, NULL);
+    pthread_cond_init(&client->monitor_cond, NULL);
+    if(pthread_create(&client->monitor, NULL, client_monitor, client) != 0){
+        fprintf(stderr, "Warning: could not start the client statistics monitor\n");
+        pthread_cond_destroy(&client->monitor_cond);
+        pthread_mutex_destroy(&client->monitor_lock);
+        return MESSAGING_SUCCESS;
+    }
+    client->monitor_running = 1;
+    return MESSAGING_SUCCESS;
+}
+
+static void client_stats_stop(messaging_client_t client)
+{
+    if(client->monitor_running){
+        pthread_mutex_lock(&client->monitor_lock);
+        client->monitor_stop = 1;
+        pthread_cond_signal(&client->monitor_cond);
+        pthread_mutex_unlock(&client->monitor_lock);
+        pthread_join(client->monitor, NULL);
+        pthread_cond_destroy(&client->monitor_cond);
+        pthread_mutex_destroy(&client->monitor_lock);
+    }
+    /* one last time, so short runs leave something behind */
+    if(client->stats_file != NULL)
+        client_stats_dump(client);
+    free(client->stats_file);
+    messaging_cstats_destroy(client->stats);
+}
+
+/* registers the RPCs and sets up everything that does not depend on how servers were found */
+static int client_setup(messaging_client_t client)
+{
+    margo_instance_id mid = client->mid;
+    struct messaging_arena_config cfg;
+    struct messaging_trace_config tcfg;
+    const char *s;
+    int ret;
 
     hg_bool_t flag;
     hg_id_t id;
@@ -291,11 +1267,19 @@ int client_init_with_mpi(margo_instance_id mid, MPI_Comm comm, messaging_client_
         margo_registered_name(mid, "unsubscribe_rpc",                   &client->unsub_id,                   &flag);
         margo_registered_name(mid, "client_finalize_rpc",                   &client->finalize_id,                   &flag);
         margo_registered_name(mid, "notify_rpc",                   &client->notify_id,                   &flag);
+        margo_registered_name(mid, "register_rpc",                   &client->register_id,                   &flag);
+        margo_registered_name(mid, "server_get_stats_rpc",                   &client->stats_id,                   &flag);
+        margo_registered_name(mid, "filter_rpc",                   &client->filter_id,                   &flag);
+        margo_registered_name(mid, "filter_update_rpc",                   &client->filter_update_id,                   &flag);
+        margo_registered_name(mid, "route_rpc",                   &client->route_id,                   &flag);
+        margo_registered_name(mid, "route_invalidate_rpc",                   &client->route_invalidate_id,                   &flag);
+        margo_registered_name(mid, "publish_oneway_rpc",                   &client->pub_oneway_id,                   &flag);
+        margo_registered_name(mid, "notify_oneway_rpc",                   &client->notify_oneway_id,                   &flag);
    
     } else {
 
         client->pub_id =
-            MARGO_REGISTER(mid, "publish_rpc", bulk_data_t, response_t, NULL);
+            MARGO_REGISTER(mid, "publish_rpc", message_t, response_t, NULL);
         client->sub_id =
             MARGO_REGISTER(mid, "subscribe_rpc", bulk_data_t, response_t, NULL);
         client->unsub_id =
@@ -303,8 +1287,29 @@ int client_init_with_mpi(margo_instance_id mid, MPI_Comm comm, messaging_client_
         client->finalize_id =
             MARGO_REGISTER(mid, "client_finalize_rpc", bulk_data_t, response_t, NULL);
         client->notify_id =
-            MARGO_REGISTER(mid, "notify_rpc", bulk_data_t, response_t, notify_rpc);
+            MARGO_REGISTER(mid, "notify_rpc", message_t, response_t, notify_rpc);
         margo_register_data(mid, client->notify_id, (void*)client, NULL);
+        client->register_id =
+            MARGO_REGISTER(mid, "register_rpc", bulk_data_t, register_out_t, NULL);
+        client->stats_id =
+            MARGO_REGISTER(mid, "server_get_stats_rpc", void, stats_out_t, NULL);
+        client->filter_id =
+            MARGO_REGISTER(mid, "filter_rpc", bulk_data_t, stats_out_t, NULL);
+        client->filter_update_id =
+            MARGO_REGISTER(mid, "filter_update_rpc", bulk_data_t, response_t, filter_update_rpc);
+        margo_register_data(mid, client->filter_update_id, (void*)client, NULL);
+        client->route_id =
+            MARGO_REGISTER(mid, "route_rpc", bulk_data_t, stats_out_t, NULL);
+        client->route_invalidate_id =
+            MARGO_REGISTER(mid, "route_invalidate_rpc", bulk_data_t, response_t, route_invalidate_rpc);
+        margo_register_data(mid, client->route_invalidate_id, (void*)client, NULL);
+        client->pub_oneway_id =
+            MARGO_REGISTER(mid, "publish_oneway_rpc", message_t, void, NULL);
+        margo_registered_disable_response(mid, client->pub_oneway_id, HG_TRUE);
+        client->notify_oneway_id =
+            MARGO_REGISTER(mid, "notify_oneway_rpc", message_t, void, notify_oneway_rpc);
+        margo_register_data(mid, client->notify_oneway_id, (void*)client, NULL);
+        margo_registered_disable_response(mid, client->notify_oneway_id, HG_TRUE);
     }
     
     hg_addr_t my_addr  = HG_ADDR_NULL;
@@ -319,6 +1324,79 @@ int client_init_with_mpi(margo_instance_id mid, MPI_Comm comm, messaging_client_
     client->addr_string = my_addr_str;
     client->addr_string_len = my_addr_size;
     client->t = map_new();
+    client->oneway = map_new();
+    /* a topic is one-way while we, the table's only subscriber (id 0), are
+     * subscribed to it; unregistered ids cannot subscribe */
+    map_register(client->oneway, client->addr_string);
+    ABT_mutex_create(&client->oneway_lock);
+    client->node_comm = MPI_COMM_NULL;
+    client->subscriber_ids = malloc(client->num_servers * sizeof(*client->subscriber_ids));
+    if(client->subscriber_ids == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    for(int i = 0; i < client->num_servers; i++)
+        client->subscriber_ids[i] = SUBSCRIBER_NONE;
+
+    s = getenv("MESSAGING_LOCAL_DISPATCH");
+    client->local_dispatch = s ? atoi(s) : 1;
+
+    ret = filter_setup(client);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    s = getenv("MESSAGING_DIRECT");
+    if(s && atoi(s)){
+        ret = messaging_routes_create(&client->xport, client->num_servers, 0, 0, &client->routes);
+        if(ret != MESSAGING_SUCCESS)
+            return ret;
+    }
+
+    ret = reorder_setup(client);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    /* before anything that can deliver messages */
+    ret = client_stats_start(client);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    messaging_arena_config_init(&cfg);
+    client->eager_size = cfg.eager_size;
+    ret = messaging_arena_create(mid, &cfg, &client->arena);
+    if(ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "Warning: client running without a registered arena (error %d)\n", ret);
+        client->arena = MESSAGING_ARENA_NULL;
+    }
+    local_setup(client);
+
+    messaging_trace_config_init(&tcfg);
+    if(tcfg.rate)
+        client->tracing = messaging_trace_start(mid, &tcfg) == MESSAGING_SUCCESS;
+
+    return MESSAGING_SUCCESS;
+}
+
+int client_init_with_mpi(margo_instance_id mid, MPI_Comm comm, messaging_client_t* cl)
+{
+    
+    messaging_client_t client  = (messaging_client_t)calloc(1, sizeof(*client));
+    if(!client) return MESSAGING_ERR_ALLOCATION;
+
+    int ret = 0;
+
+    client->mid = mid;
+    messaging_transport_margo(mid, &client->xport);
+
+    ret = build_address_with_mpi(&client, comm);
+    if(ret!=0)
+        goto finish;
+
+    ret = client_setup(client);
+    if(ret!=0)
+        goto finish;
+
+    ret = aggregate_setup(client, comm);
+    if(ret!=0)
+        goto finish;
 
     *cl = client;
 
@@ -328,6 +1406,11 @@ finish:
 }
 
 int client_init(margo_instance_id mid, messaging_client_t* cl)
+{
+    return client_init_with_bootstrap(mid, NULL, cl);
+}
+
+int client_init_with_bootstrap(margo_instance_id mid, const char *spec, messaging_client_t* cl)
 {
     
     messaging_client_t client  = (messaging_client_t)calloc(1, sizeof(*client));
@@ -335,117 +1418,366 @@ int client_init(margo_instance_id mid, messaging_client_t* cl)
 
     int ret = 0;
 
-    hg_return_t hret          = HG_SUCCESS;
     client->mid = mid;
+    messaging_transport_margo(mid, &client->xport);
 
-    ret = build_address(&client);
+    ret = build_address(&client, spec);
     if(ret!=0)
         goto finish;
 
-    hg_bool_t flag;
-    hg_id_t id;
-    margo_registered_name(mid, "publish_rpc", &id, &flag);
+    ret = client_setup(client);
+    if(ret!=0)
+        goto finish;
 
-    if(flag == HG_TRUE) { /* RPCs already registered */
-        margo_registered_name(mid, "publish_rpc",                   &client->pub_id,                   &flag);
-        margo_registered_name(mid, "subscribe_rpc",                   &client->sub_id,                   &flag);
-        margo_registered_name(mid, "unsubscribe_rpc",                   &client->unsub_id,                   &flag);
-        margo_registered_name(mid, "client_finalize_rpc",                   &client->finalize_id,                   &flag);
-        margo_registered_name(mid, "notify_rpc",                   &client->notify_id,                   &flag);
-   
-    } else {
+    *cl = client;
 
-        client->pub_id =
-            MARGO_REGISTER(mid, "publish_rpc", bulk_data_t, response_t, NULL);
-        client->sub_id =
-            MARGO_REGISTER(mid, "subscribe_rpc", bulk_data_t, response_t, NULL);
-        client->unsub_id =
-            MARGO_REGISTER(mid, "unsubscribe_rpc", bulk_data_t, response_t, NULL);
-        client->finalize_id =
-            MARGO_REGISTER(mid, "client_finalize_rpc", bulk_data_t, response_t, NULL);
-        client->notify_id =
-            MARGO_REGISTER(mid, "notify_rpc", bulk_data_t, response_t, notify_rpc);
-        margo_register_data(mid, client->notify_id, (void*)client, NULL);
+    return MESSAGING_SUCCESS;
+finish:
+    return ret;
+}
+
+int client_finalize(messaging_client_t client){
+    int ret;
+
+    aggregate_teardown(client);
+    if(client->tracing)
+        messaging_trace_stop();
+    /* stop reading locally before the servers forget our ids */
+    local_teardown(client);
+    ret = remove_all_subscriptions(client);
+    margo_deregister(client->mid, client->notify_id);
+    margo_deregister(client->mid, client->filter_update_id);
+    margo_deregister(client->mid, client->route_invalidate_id);
+    margo_deregister(client->mid, client->notify_oneway_id);
+    reorder_teardown(client);
+    filter_teardown(client);
+    messaging_routes_destroy(client->routes);
+    client_stats_stop(client);
+    map_delete(client->t);
+    map_delete(client->oneway);
+    ABT_mutex_free(&client->oneway_lock);
+    messaging_arena_destroy(client->arena);
+    free(client->addr_string);
+    free(client->subscriber_ids);
+    free(client->server_address[0]);
+    free(client->server_address);
+    free(client->server_name[0]);
+    free(client->server_name);
+    free(client->server_provider);
+    //margo_finalize(client->mid);
+    free(client);
+    return ret;
+
+}
+
+struct messaging_request {
+    messaging_client_t client;
+    int count;
+    hg_handle_t *handles;
+    margo_request *reqs;
+    bulk_data_t *in;
+    int ret;
+    message_t *pub;             /* a publish, then in is NULL */
+    struct messaging_arena_buf pbuf;
+    struct messaging_route *route;  /* a publish sent straight to the subscribers */
+    int failed;                     /* subscribers it could not reach */
+    int server;
+    size_t len;
+    uint64_t trace_id;
+    uint64_t start;
+    int oneway;                     /* a publish the server does not answer */
+};
+
+static void request_free(struct messaging_request *req)
+{
+    int i;
+
+    for(i = 0; i < req->count; i++){
+        if(req->handles[i] != HG_HANDLE_NULL)
+            xport_destroy(&req->client->xport, req->handles[i]);
+        if(req->in)
+            messaging_pool_free(req->in[i].evnt.raw_data);
     }
-    
-    hg_addr_t my_addr  = HG_ADDR_NULL;
-    hg_size_t my_addr_size;
-    char *my_addr_str = NULL;
-    margo_addr_self(client->mid, &my_addr);
-    margo_addr_to_string(client->mid, NULL, &my_addr_size, my_addr);
-    my_addr_str = malloc(my_addr_size);
-    margo_addr_to_string(client->mid, my_addr_str, &my_addr_size, my_addr);
-    margo_addr_free(client->mid, my_addr);
-    client->addr_string = my_addr_str;
-    client->addr_string_len = my_addr_size;
-    client->t = map_new();
+    if(req->pub){
+        messaging_pool_free(req->pub->evnt.raw_data);
+        messaging_arena_release(req->client->arena, &req->pbuf);
+        free(req->pub);
+    }
+    if(req->route)
+        messaging_routes_put(req->client->routes, req->route);
+    free(req->handles);
+    free(req->reqs);
+    free(req->in);
+    free(req);
+}
 
-    *cl = client;
+/* whether publishes to namesp/topic go out without waiting for the server */
+static int publish_is_oneway(messaging_client_t client, const char *namesp, const char *topic)
+{
+    int oneway;
+
+    if(__atomic_load_n(&client->num_oneway, __ATOMIC_RELAXED) == 0)
+        return 0;
+    ABT_mutex_lock(client->oneway_lock);
+    oneway = map_get_value(client->oneway, namesp, topic, NULL, 0) > 0;
+    ABT_mutex_unlock(client->oneway_lock);
+    return oneway;
+}
 
+int publish_set_oneway(messaging_client_t client, const char *namesp, const char *topic, int oneway)
+{
+    size_t before;
+
+    if(client == NULL || namesp == NULL || topic == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    ABT_mutex_lock(client->oneway_lock);
+    before = map_get_value(client->oneway, namesp, topic, NULL, 0);
+    if(oneway && before == 0){
+        map_subscribe(client->oneway, namesp, topic, 0);
+        __atomic_add_fetch(&client->num_oneway, 1, __ATOMIC_RELAXED);
+    }else if(!oneway && before > 0){
+        map_unsubscribe(client->oneway, namesp, topic, 0);
+        __atomic_sub_fetch(&client->num_oneway, 1, __ATOMIC_RELAXED);
+    }
+    ABT_mutex_unlock(client->oneway_lock);
+    return MESSAGING_SUCCESS;
+}
+
+/* where a prepared publish goes */
+struct publish_target {
+    int skip;                       /* nowhere, the server has nobody to send it to */
+    struct messaging_route *route;  /* straight to these subscribers, NULL through the server */
+    uint32_t exclude[MESSAGING_SHM_MAX_READERS + 1];    /* route members reached already */
+    int num_exclude;
+};
+
+/* everything a publish does before it goes out: delivery to ourselves and
+ * through shared memory, staging a large payload in the arena and encoding;
+ * on success raw_msg, pbuf and the route in target belong to the caller,
+ * unless target->skip is set and nothing was encoded */
+static int publish_prepare(messaging_client_t client, char *namesp, char *topic, void *messg,
+        int msg_len, int server_id, uint64_t trace_id, message_t *raw_msg,
+        struct messaging_arena_buf *pbuf, struct publish_target *target)
+{
+    int ret;
+    int flags = 0;
+    uint32_t local_ids[MESSAGING_SHM_MAX_READERS + 1];
+    int num_local = 0;
+    void *handler_ptr = NULL, *handler_args = NULL;
+    int self = 0;
+
+    /* if we subscribe to the topic ourselves the callback runs right here,
+     * and the server leaves us out of the fan-out */
+    if(client->local_dispatch && client->subscriber_ids[server_id] != SUBSCRIBER_NONE &&
+            get_handler(client->t, namesp, topic, &handler_ptr, &handler_args) && handler_ptr)
+        self = 1;
+
+    /* subscribers on this node read it from shared memory, the server skips them */
+    if(client->shm != MESSAGING_SHM_NULL)
+        num_local = messaging_shm_publish(client->shm, namesp, topic, messg, msg_len, self, local_ids);
+    if(self)
+        local_ids[num_local++] = client->subscriber_ids[server_id];
+
+    target->route = NULL;
+    target->skip = publish_filtered(client, namesp, topic, server_id);
+    if(target->skip){
+        messaging_cstats_filtered(client->stats, msg_len);
+        goto deliver;
+    }
+    target->route = publish_route(client, namesp, topic, server_id);
+    memcpy(target->exclude, local_ids, num_local * sizeof(*local_ids));
+    target->num_exclude = num_local;
+
+    /* large payloads go through the registered arena, the server pulls them */
+    raw_msg->bulk = HG_BULK_NULL;
+    raw_msg->offset = 0;
+    if((size_t)msg_len > client->eager_size &&
+        messaging_arena_alloc(client->arena, msg_len, pbuf) == MESSAGING_SUCCESS){
+        memcpy(pbuf->ptr, messg, msg_len);
+        raw_msg->bulk = pbuf->bulk;
+        raw_msg->offset = pbuf->offset;
+        flags |= WIRE_FLAG_BULK;
+    }
+
+    ret = encode_message_ext(client, namesp, topic, messg, msg_len, flags, IDENT_NONE,
+            local_ids, num_local, trace_id, &raw_msg->evnt);
+    if(ret != MESSAGING_SUCCESS){
+        messaging_arena_release(client->arena, pbuf);
+        if(target->route)
+            messaging_routes_put(client->routes, target->route);
+        return ret;
+    }
+
+deliver:
+    /* the payload is copied out by now, the callback may reuse messg */
+    if(self){
+        messaging_cstats_received(client->stats, namesp, topic, msg_len);
+        run_callback(client, handler_ptr, handler_args, messg, namesp, topic, 0);
+    }
     return MESSAGING_SUCCESS;
-finish:
-    return ret;
 }
 
-int client_finalize(messaging_client_t client){
+/* sends the publish prepared in req: to the server, or as a notification to
+ * every subscriber on target's route that was not reached already */
+static int publish_start(messaging_client_t client, struct messaging_request *req,
+        struct publish_target *target)
+{
+    struct messaging_route *route = target->route;
+    size_t n = route ? route->count : 1;
+    hg_addr_t svr_addr;
+    hg_return_t hret = HG_SUCCESS;
+    int i, j;
+
+    req->route = route;
+    req->handles = calloc(n + 1, sizeof(*req->handles));
+    req->reqs = calloc(n + 1, sizeof(*req->reqs));
+    if(req->handles == NULL || req->reqs == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    req->start = wire_now_ns();
+    if(route == NULL){
+        req->count = 1;
+        req->handles[0] = HG_HANDLE_NULL;
+        hret = xport_lookup(&client->xport, client->server_name[req->server], &svr_addr);
+        if(hret == HG_SUCCESS){
+            hret = xport_create(&client->xport, svr_addr, req->oneway ? client->pub_oneway_id : client->pub_id,
+                    &req->handles[0]);
+            xport_addr_free(&client->xport, svr_addr);
+        }
+        if(hret == HG_SUCCESS)
+            hret = xport_provider_iforward(&client->xport, req->handles[0], client->server_provider[req->server],
+                    req->pub, &req->reqs[0]);
+        if(hret != HG_SUCCESS){
+            if(req->oneway)
+                messaging_cstats_oneway(client->stats, req->server, req->len, 0);
+            else
+                messaging_cstats_publish(client->stats, req->server, req->len, 0, 0);
+            return MESSAGING_ERR_MERCURY;
+        }
+        return MESSAGING_SUCCESS;
+    }
 
-    //remove_all_subscriptions(client);
-    remove_all_subscriptions_new(client);
-    margo_deregister(client->mid, client->notify_id);
-    map_delete(client->t);
-    free(client->addr_string);
-    free(client->server_address[0]);
-    free(client->server_address);
-    //margo_finalize(client->mid);
-    free(client);
+    /* subscribers take the message as if the server sent it, and pull a
+     * bulk payload from our arena */
+    for(i = 0; i < (int)route->count; i++){
+        for(j = 0; j < target->num_exclude && target->exclude[j] != route->ids[i]; j++)
+            ;
+        if(j < target->num_exclude)
+            continue;
+        hret = xport_create(&client->xport, route->addrs[i], client->notify_id,
+                &req->handles[req->count]);
+        if(hret != HG_SUCCESS){
+            req->failed++;
+            continue;
+        }
+        hret = xport_iforward(&client->xport, req->handles[req->count], req->pub,
+                &req->reqs[req->count]);
+        if(hret != HG_SUCCESS){
+            xport_destroy(&client->xport, req->handles[req->count]);
+            req->failed++;
+            continue;
+        }
+        req->count++;
+    }
     return MESSAGING_SUCCESS;
-
 }
 
 int publish(messaging_client_t client, char *namesp, char* topic, void* messg, int msg_len){
     
     int server_id= hash(topic) % client->num_servers;
     
-    char* raw_buf;
-    
-    int name_len, topic_len;
     int ret = 0;
 
-    name_len = strlen(namesp)+1;
-    topic_len = strlen(topic)+1;
-
-    bulk_data_t raw_msg;
-    raw_msg.evnt.size = sizeof(int)*3 + name_len + topic_len + msg_len;
-    raw_buf = malloc(raw_msg.evnt.size);
-
-    ((int *)raw_buf)[0] = name_len;
-    ((int *)raw_buf)[1] = topic_len;
-    ((int *)raw_buf)[2] = msg_len;
+    message_t raw_msg;
+    struct messaging_arena_buf pbuf = {0};
+    uint64_t trace_id = messaging_trace_sample();
+    struct publish_target target;
 
-    memcpy(&raw_buf[sizeof(int)*3], namesp, name_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len], topic, topic_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len+topic_len], messg, msg_len);
+    messaging_trace_record(trace_id, MESSAGING_TRACE_PUBLISH, 0, trace_id ? wire_now_ns() : 0);
 
-    raw_msg.evnt.raw_data = raw_buf;
+    ret = publish_prepare(client, namesp, topic, messg, msg_len, server_id, trace_id,
+            &raw_msg, &pbuf, &target);
+    if(ret != MESSAGING_SUCCESS || target.skip){
+        messaging_trace_record(trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0, trace_id ? wire_now_ns() : 0);
+        return ret;
+    }
 
-    hg_addr_t svr_addr;
-    margo_addr_lookup(client->mid, client->server_address[server_id], &svr_addr);
+    /* straight to the subscribers: one notification each, waited for like a request */
+    if(target.route){
+        struct messaging_request *req = calloc(1, sizeof(*req));
+        message_t *pub = malloc(sizeof(*pub));
+
+        if(req == NULL || pub == NULL){
+            free(req);
+            free(pub);
+            messaging_routes_put(client->routes, target.route);
+            messaging_pool_free(raw_msg.evnt.raw_data);
+            messaging_arena_release(client->arena, &pbuf);
+            return MESSAGING_ERR_ALLOCATION;
+        }
+        *pub = raw_msg;
+        req->client = client;
+        req->pub = pub;
+        req->pbuf = pbuf;
+        req->server = server_id;
+        req->len = msg_len;
+        req->trace_id = trace_id;
+        ret = publish_start(client, req, &target);
+        if(ret != MESSAGING_SUCCESS){
+            request_free(req);
+            return ret;
+        }
+        return messaging_wait(req);
+    }
 
-    hg_handle_t h;
-    margo_create(client->mid, svr_addr, client->pub_id, &h);
-    margo_forward(h, &raw_msg);
+    hg_addr_t svr_addr = HG_ADDR_NULL;
+    hg_handle_t h = HG_HANDLE_NULL;
+    hg_return_t hret;
+
+    /* the server pulls a bulk payload before answering, those always wait */
+    int oneway = raw_msg.bulk == HG_BULK_NULL && publish_is_oneway(client, namesp, topic);
+    uint64_t start = wire_now_ns();
+    hret = xport_lookup(&client->xport, client->server_name[server_id], &svr_addr);
+    if(hret != HG_SUCCESS)
+        svr_addr = HG_ADDR_NULL;
+    if(hret == HG_SUCCESS){
+        hret = xport_create(&client->xport, svr_addr, oneway ? client->pub_oneway_id : client->pub_id, &h);
+        if(hret != HG_SUCCESS)
+            h = HG_HANDLE_NULL;
+    }
+    if(hret == HG_SUCCESS)
+        hret = xport_provider_forward(&client->xport, h, client->server_provider[server_id], &raw_msg);
     //margo_request req;
     //margo_iforward(h, &raw_msg, &req);
     //margo_wait(req);
-    response_t resp;
-    margo_get_output(h, &resp);
-    if(resp.ret != MESSAGING_SUCCESS)
-        fprintf(stderr, "Publish message got bad response. Publish failed\n");
-    
-    ret = resp.ret;
-    margo_addr_free(client->mid, svr_addr);
-    margo_free_output(h, &resp);
-    margo_destroy(h);
+    if(oneway){
+        /* sent is all we get to know */
+        ret = hret == HG_SUCCESS ? MESSAGING_SUCCESS : MESSAGING_ERR_MERCURY;
+        messaging_trace_record(trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0, trace_id ? wire_now_ns() : 0);
+        messaging_cstats_oneway(client->stats, server_id, msg_len, ret == MESSAGING_SUCCESS);
+        if(ret != MESSAGING_SUCCESS)
+            fprintf(stderr, "Publish message could not be sent. Publish failed\n");
+    } else {
+        response_t resp;
+        ret = MESSAGING_ERR_MERCURY;
+        if(hret == HG_SUCCESS && xport_get_output(&client->xport, h, &resp) == HG_SUCCESS){
+            ret = resp.ret;
+            xport_free_output(&client->xport, h, &resp);
+        }
+        messaging_trace_record(trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0, trace_id ? wire_now_ns() : 0);
+        messaging_cstats_publish(client->stats, server_id, msg_len, wire_now_ns() - start,
+                ret == MESSAGING_SUCCESS);
+        if(ret == MESSAGING_ERR_MERCURY)
+            fprintf(stderr, "Publish message could not be sent. Publish failed\n");
+        else if(ret != MESSAGING_SUCCESS)
+            fprintf(stderr, "Publish message got bad response. Publish failed\n");
+    }
+
+    if(h != HG_HANDLE_NULL)
+        xport_destroy(&client->xport, h);
+    if(svr_addr != HG_ADDR_NULL)
+        xport_addr_free(&client->xport, svr_addr);
+    messaging_pool_free(raw_msg.evnt.raw_data);
+    messaging_arena_release(client->arena, &pbuf);
     return ret;
 
 
@@ -455,47 +1787,33 @@ int subscribe(messaging_client_t client, char *namesp, char* topic, void (*handl
 
     int ret=0;
     int server_id= hash(topic) % client->num_servers;
+    uint32_t leader_id;
 
-    int name_len, topic_len;
-
-    name_len = strlen(namesp)+1;
-    topic_len = strlen(topic)+1;
-
-    bulk_data_t raw_msg;
-    raw_msg.evnt.size = sizeof(int)*3 + name_len + topic_len + client->addr_string_len;
-
-    char *raw_buf;
-    raw_buf = malloc(raw_msg.evnt.size);
-    
-    ((int *)raw_buf)[0] = name_len;
-    ((int *)raw_buf)[1] = topic_len;
-    ((int *)raw_buf)[2] = client->addr_string_len;
-
-    memcpy(&raw_buf[sizeof(int)*3], namesp, name_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len], topic, topic_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len+topic_len], client->addr_string, client->addr_string_len);
-    
-    raw_msg.evnt.raw_data = raw_buf;
+    messaging_cstats_updates(client->stats, 1, 1);
 
-    hg_addr_t svr_addr;
-    margo_addr_lookup(client->mid, client->server_address[server_id], &svr_addr);
-    hg_handle_t h;
-    margo_create(client->mid, svr_addr, client->sub_id, &h);
-    margo_forward(h, &raw_msg);
-    //margo_request req;
-    //margo_iforward(h, &raw_msg, &req);
-    //margo_wait(req);
-    response_t resp;
-    margo_get_output(h, &resp);
+    /* members read the topic from the ring the leader feeds; if they cannot
+     * get a reader slot they subscribe at the server like everyone else */
+    if(client->aggregate == AGG_MEMBER){
+        insert_handler(client->t, namesp, topic, handler_func, handler_args);
+        ret = aggregate_update(client, namesp, topic, client->agg_sub_id, &leader_id);
+        if(ret == MESSAGING_SUCCESS &&
+                local_subscribe(client, namesp, topic, leader_id) == MESSAGING_SUCCESS)
+            return ret;
+        if(ret == MESSAGING_SUCCESS)
+            aggregate_update(client, namesp, topic, client->agg_unsub_id, NULL);
+        else
+            fprintf(stderr, "subscribe through the node leader failed (%d)\n", ret);
+    }
 
-    if(resp.ret != MESSAGING_SUCCESS)
+    ret = client_register(client, server_id);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    reorder_forget(client, namesp, topic);
+    ret = server_update(client, namesp, topic, server_id, client->sub_id);
+    if(ret != MESSAGING_SUCCESS)
         fprintf(stderr, "subscribe message got bad response. subscribe failed\n");
-    
-    ret = resp.ret;
     insert_handler(client->t, namesp, topic, handler_func, handler_args);
-    margo_addr_free(client->mid, svr_addr);
-    margo_free_output(h, &resp);
-    margo_destroy(h);
+    local_subscribe(client, namesp, topic, client->subscriber_ids[server_id]);
     return ret;
 
 
@@ -506,164 +1824,450 @@ int unsubscribe(messaging_client_t client, char *namesp, char *topic){
     int server_id= hash(topic) % client->num_servers;
     int ret = 0;
 
-    int name_len, topic_len;
-    name_len = strlen(namesp);
-    topic_len = strlen(topic);
+    messaging_cstats_updates(client->stats, 0, 1);
+    if(local_unsubscribe(client, namesp, topic) && client->aggregate == AGG_MEMBER){
+        delete_handler(client->t, namesp, topic);
+        return aggregate_update(client, namesp, topic, client->agg_unsub_id, NULL);
+    }
+    /* never registered there, so never subscribed there */
+    if(client->subscriber_ids[server_id] == SUBSCRIBER_NONE){
+        delete_handler(client->t, namesp, topic);
+        return MESSAGING_SUCCESS;
+    }
 
-    bulk_data_t raw_msg;
-    raw_msg.evnt.size = sizeof(int)*3 + name_len + topic_len + client->addr_string_len;
+    if(client->aggregate == AGG_LEADER)
+        ABT_mutex_lock(client->agg_lock);
+    delete_handler(client->t, namesp, topic);
+    /* the rest of the node may still need the subscription */
+    if(client->aggregate != AGG_LEADER || map_get_value(client->agg, namesp, topic, NULL, 0) == 0){
+        ret = server_update(client, namesp, topic, server_id, client->unsub_id);
+        if(ret != MESSAGING_SUCCESS)
+            fprintf(stderr, "Unubscribe message got bad response. Unsubscribe failed\n");
+    }
+    if(client->aggregate == AGG_LEADER)
+        ABT_mutex_unlock(client->agg_lock);
+    return ret;
 
-    char* raw_buf;
-    raw_buf = malloc(raw_msg.evnt.size);
-    
-    ((int *)raw_buf)[0] = name_len;
-    ((int *)raw_buf)[1] = topic_len;
-    ((int *)raw_buf)[2] = client->addr_string_len;
 
-    memcpy(&raw_buf[sizeof(int)*3], namesp, name_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len], topic, topic_len);
-    memcpy(&raw_buf[sizeof(int)*3+name_len+topic_len], client->addr_string, client->addr_string_len);
+}
 
-    
-    raw_msg.evnt.raw_data = raw_buf;
+int publish_async(messaging_client_t client, char *namesp, char *topic, void *messg, int msg_len,
+        messaging_request_t *request)
+{
+    struct messaging_request *req;
+    struct publish_target target;
+    int ret;
+
+    if(request == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    req = calloc(1, sizeof(*req));
+    if(req == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    req->client = client;
+    req->pub = calloc(1, sizeof(*req->pub));
+    if(req->pub == NULL){
+        free(req);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    req->server = hash(topic) % client->num_servers;
+    req->len = msg_len;
+    req->trace_id = messaging_trace_sample();
+    messaging_trace_record(req->trace_id, MESSAGING_TRACE_PUBLISH, 0, req->trace_id ? wire_now_ns() : 0);
+
+    ret = publish_prepare(client, namesp, topic, messg, msg_len, req->server, req->trace_id,
+            req->pub, &req->pbuf, &target);
+    if(ret != MESSAGING_SUCCESS || target.skip){
+        messaging_trace_record(req->trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0,
+                req->trace_id ? wire_now_ns() : 0);
+        free(req->pub);
+        req->pub = NULL;
+        if(ret != MESSAGING_SUCCESS){
+            request_free(req);
+            return ret;
+        }
+        /* nothing in flight, the request is already complete */
+        *request = req;
+        return MESSAGING_SUCCESS;
+    }
+
+    req->oneway = target.route == NULL && req->pub->bulk == HG_BULK_NULL &&
+        publish_is_oneway(client, namesp, topic);
+    ret = publish_start(client, req, &target);
+    if(ret != MESSAGING_SUCCESS){
+        request_free(req);
+        return ret;
+    }
+    *request = req;
+    return MESSAGING_SUCCESS;
+}
 
+/* sends one batched (un)subscribe per server owning at least one of subs */
+static int update_many_async(messaging_client_t client, const struct messaging_subscription *subs,
+        size_t count, hg_id_t rpc_id, messaging_request_t *request)
+{
+    struct messaging_request *req;
+    size_t *len, *off, total = 0, i;
+    int *server_of, nservers = client->num_servers, s, ret = MESSAGING_SUCCESS;
+    char *scratch = NULL;
     hg_addr_t svr_addr;
-    hg_handle_t h;
-    response_t resp;
-    margo_addr_lookup(client->mid, client->server_address[server_id], &svr_addr);
-    margo_create(client->mid, svr_addr, client->unsub_id, &h);
-    margo_forward(h, &raw_msg);
-    margo_get_output(h, &resp);
+    hg_return_t hret;
+
+    if(request == NULL || (count > 0 && subs == NULL))
+        return MESSAGING_ERR_INVALID_ARG;
+
+    /* the node leader decides which subscriptions reach the servers, one at a time */
+    if(client->aggregate != AGG_NONE){
+        req = calloc(1, sizeof(*req));
+        if(req == NULL)
+            return MESSAGING_ERR_ALLOCATION;
+        req->client = client;
+        for(i = 0; i < count; i++){
+            ret = rpc_id == client->sub_id ?
+                subscribe(client, subs[i].namesp, subs[i].topic, subs[i].callback, subs[i].callback_args) :
+                unsubscribe(client, subs[i].namesp, subs[i].topic);
+            if(ret != MESSAGING_SUCCESS && req->ret == MESSAGING_SUCCESS)
+                req->ret = ret;
+        }
+        *request = req;
+        return MESSAGING_SUCCESS;
+    }
 
-    if(resp.ret != MESSAGING_SUCCESS)
-        fprintf(stderr, "Unubscribe message got bad response. Unsubscribe failed\n");
-    
-    ret = resp.ret;
-    delete_handler(client->t, namesp, topic);
-    margo_addr_free(client->mid, svr_addr);
-    margo_free_output(h, &resp);
-    margo_destroy(h);
+    messaging_cstats_updates(client->stats, rpc_id == client->sub_id, count);
+    req = calloc(1, sizeof(*req));
+    len = calloc(nservers, sizeof(*len));
+    off = calloc(nservers, sizeof(*off));
+    server_of = malloc(count * sizeof(*server_of) + 1);
+    if(req == NULL || len == NULL || off == NULL || server_of == NULL){
+        ret = MESSAGING_ERR_ALLOCATION;
+        goto fini;
+    }
+    req->client = client;
+
+    /* size the batch for each server */
+    for(i = 0; i < count; i++){
+        server_of[i] = hash(subs[i].topic) % nservers;
+        len[server_of[i]] += wire_topic_rec_size(strlen(subs[i].namesp) + 1,
+                strlen(subs[i].topic) + 1);
+    }
+    for(s = 0; s < nservers; s++){
+        off[s] = total;
+        total += len[s];
+        if(len[s] > 0)
+            req->count++;
+    }
+
+    req->handles = calloc(req->count + 1, sizeof(*req->handles));
+    req->reqs = calloc(req->count + 1, sizeof(*req->reqs));
+    req->in = calloc(req->count + 1, sizeof(*req->in));
+    scratch = messaging_pool_alloc(total + 1);
+    if(req->handles == NULL || req->reqs == NULL || req->in == NULL || scratch == NULL){
+        req->count = 0;
+        ret = MESSAGING_ERR_ALLOCATION;
+        goto fini;
+    }
+
+    /* lay the records out grouped by server, off[s] ends up at the end of each group */
+    for(i = 0; i < count; i++){
+        s = server_of[i];
+        off[s] += wire_put_topic_rec(scratch + off[s], subs[i].namesp, strlen(subs[i].namesp) + 1,
+                subs[i].topic, strlen(subs[i].topic) + 1);
+        reorder_forget(client, subs[i].namesp, subs[i].topic);
+        if(rpc_id == client->sub_id){
+            insert_handler(client->t, subs[i].namesp, subs[i].topic,
+                    subs[i].callback, subs[i].callback_args);
+        }else{
+            local_unsubscribe(client, subs[i].namesp, subs[i].topic);
+            delete_handler(client->t, subs[i].namesp, subs[i].topic);
+        }
+    }
+
+    req->count = 0;
+    for(s = 0; s < nservers; s++){
+        int k;
+
+        if(len[s] == 0)
+            continue;
+        if(rpc_id == client->sub_id){
+            ret = client_register(client, s);
+            if(ret != MESSAGING_SUCCESS)
+                break;
+        }else if(client->subscriber_ids[s] == SUBSCRIBER_NONE){
+            continue;
+        }
+        k = req->count++;
+        req->handles[k] = HG_HANDLE_NULL;
+        ret = encode_message(client, "", "", scratch + off[s] - len[s], len[s],
+                WIRE_FLAG_BATCH, s, &req->in[k].evnt);
+        if(ret != MESSAGING_SUCCESS)
+            break;
+        hret = xport_lookup(&client->xport, client->server_name[s], &svr_addr);
+        if(hret != HG_SUCCESS){
+            ret = MESSAGING_ERR_MERCURY;
+            break;
+        }
+        hret = xport_create(&client->xport, svr_addr, rpc_id, &req->handles[k]);
+        xport_addr_free(&client->xport, svr_addr);
+        if(hret == HG_SUCCESS)
+            hret = xport_provider_iforward(&client->xport, req->handles[k], client->server_provider[s],
+                    &req->in[k], &req->reqs[k]);
+        if(hret != HG_SUCCESS){
+            if(req->handles[k] != HG_HANDLE_NULL)
+                xport_destroy(&client->xport, req->handles[k]);
+            req->handles[k] = HG_HANDLE_NULL;
+            ret = MESSAGING_ERR_MERCURY;
+            break;
+        }
+    }
+    if(ret == MESSAGING_SUCCESS && rpc_id == client->sub_id)
+        for(i = 0; i < count; i++)
+            local_subscribe(client, subs[i].namesp, subs[i].topic,
+                    client->subscriber_ids[server_of[i]]);
+
+fini:
+    messaging_pool_free(scratch);
+    free(server_of);
+    free(off);
+    free(len);
+    if(ret != MESSAGING_SUCCESS && req != NULL){
+        /* wait for whatever was already sent before tearing down */
+        req->ret = ret;
+        messaging_wait(req);
+        return ret;
+    }
+    *request = req;
     return ret;
+}
 
+int subscribe_many_async(messaging_client_t client, const struct messaging_subscription *subs,
+        size_t count, messaging_request_t *req)
+{
+    return update_many_async(client, subs, count, client->sub_id, req);
+}
 
+int unsubscribe_many_async(messaging_client_t client, const struct messaging_subscription *subs,
+        size_t count, messaging_request_t *req)
+{
+    return update_many_async(client, subs, count, client->unsub_id, req);
 }
 
-static int remove_all_subscriptions(messaging_client_t client){
-    int i, ret;
-    char *my_addr_str;
-    bulk_data_t in;
+int subscribe_many(messaging_client_t client, const struct messaging_subscription *subs, size_t count)
+{
+    messaging_request_t req;
+    int ret = subscribe_many_async(client, subs, count, &req);
 
-    in.evnt.size = client->addr_string_len;
-    in.evnt.raw_data = client->addr_string;
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    return messaging_wait(req);
+}
 
-    margo_request *serv_req;
-    hg_handle_t *hndl;
-    hndl = (hg_handle_t*)malloc(sizeof(hg_handle_t)*client->num_servers);
-    serv_req = (margo_request*)malloc(sizeof(margo_request)*client->num_servers);
-    
-    for (i = 0; i < client->num_servers; ++i)
-    {
-        hg_addr_t svr_addr;
-        margo_request req;
-        hg_handle_t h;
-        margo_addr_lookup(client->mid, client->server_address[i], &svr_addr);
-        margo_create(client->mid, svr_addr, client->finalize_id, &h);
-        margo_iforward(h, &in, &req);
-        hndl[i] = h;
-        serv_req[i] = req;
-        margo_addr_free(client->mid, svr_addr);
-    }
-    for (i = 0; i < client->num_servers; ++i){
-        margo_wait(serv_req[i]);
-        response_t resp;
-        margo_get_output(hndl[i], &resp);
-        ret = resp.ret;
-        margo_free_output(hndl[i], &resp);
-        margo_destroy(hndl[i]);
-        if(ret!=MESSAGING_SUCCESS){
-            fprintf(stderr, "Could not unregister client %s from server %s\n", client->addr_string, client->server_address[i]);
-            return ret;
+int unsubscribe_many(messaging_client_t client, const struct messaging_subscription *subs, size_t count)
+{
+    messaging_request_t req;
+    int ret = unsubscribe_many_async(client, subs, count, &req);
+
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    return messaging_wait(req);
+}
+
+int messaging_test(messaging_request_t req, int *flag)
+{
+    int i, done;
+
+    if(req == NULL || flag == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    *flag = 1;
+    for(i = 0; i < req->count; i++){
+        if(req->handles[i] == HG_HANDLE_NULL)
+            continue;
+        if(xport_test(&req->client->xport, req->reqs[i], &done) != HG_SUCCESS)
+            return MESSAGING_ERR_MERCURY;
+        if(!done){
+            *flag = 0;
+            break;
         }
-        
     }
-    free(hndl);
-    free(serv_req);
+    return MESSAGING_SUCCESS;
+}
+
+uint64_t messaging_notify_count(messaging_client_t client)
+{
+    return __atomic_load_n(&client->notify_count, __ATOMIC_RELAXED);
+}
+
+int messaging_num_servers(messaging_client_t client)
+{
+    return client->num_servers;
+}
+
+margo_instance_id messaging_client_mid(messaging_client_t client)
+{
+    return client->mid;
+}
+
+int messaging_get_server_stats(messaging_client_t client, int server,
+        struct messaging_server_stats *stats)
+{
+    stats_out_t out;
+    hg_addr_t svr_addr;
+    hg_handle_t h;
+    hg_return_t hret;
+    int ret = MESSAGING_ERR_MERCURY;
+
+    if(server < 0 || server >= client->num_servers || stats == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    hret = xport_lookup(&client->xport, client->server_name[server], &svr_addr);
+    if(hret != HG_SUCCESS)
+        return MESSAGING_ERR_MERCURY;
+    hret = xport_create(&client->xport, svr_addr, client->stats_id, &h);
+    xport_addr_free(&client->xport, svr_addr);
+    if(hret != HG_SUCCESS)
+        return MESSAGING_ERR_MERCURY;
+    if(xport_provider_forward(&client->xport, h, client->server_provider[server], NULL) == HG_SUCCESS &&
+            xport_get_output(&client->xport, h, &out) == HG_SUCCESS){
+        ret = out.ret;
+        if(ret == MESSAGING_SUCCESS)
+            ret = messaging_stats_decode(out.data.raw_data, out.data.size, stats);
+        xport_free_output(&client->xport, h, &out);
+    }
+    xport_destroy(&client->xport, h);
     return ret;
+}
 
+int client_get_stats(messaging_client_t client, struct messaging_client_stats *stats)
+{
+    if(client == NULL || stats == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    client_snapshot(client, stats);
+    return MESSAGING_SUCCESS;
 }
 
-static int remove_all_subscriptions_new(messaging_client_t client){
-    int ret;
-    char *my_addr_str;
-    bulk_data_t in;
+int messaging_wait(messaging_request_t req)
+{
+    response_t resp;
+    int i, ret, rret;
 
-    in.evnt.size = client->addr_string_len;
-    in.evnt.raw_data = client->addr_string;
+    if(req == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    ret = req->ret;
+    for(i = 0; i < req->count; i++){
+        if(req->handles[i] == HG_HANDLE_NULL)
+            continue;
+        rret = MESSAGING_ERR_MERCURY;
+        if(xport_wait(&req->client->xport, req->reqs[i]) == HG_SUCCESS){
+            if(req->oneway){
+                rret = MESSAGING_SUCCESS;
+            }else if(xport_get_output(&req->client->xport, req->handles[i], &resp) == HG_SUCCESS){
+                rret = resp.ret;
+                xport_free_output(&req->client->xport, req->handles[i], &resp);
+            }
+        }
+        if(rret == MESSAGING_SUCCESS)
+            continue;
+        /* like the server, a subscriber that fails does not fail the publish */
+        if(req->route){
+            req->failed++;
+            continue;
+        }
+        if(!req->pub)
+            fprintf(stderr, "batched subscription update got bad response (%d)\n", rret);
+        if(ret == MESSAGING_SUCCESS)
+            ret = rret;
+    }
+    if(req->pub){
+        /* the round trip runs until the caller collects it */
+        messaging_trace_record(req->trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0,
+                req->trace_id ? wire_now_ns() : 0);
+        if(req->oneway)
+            messaging_cstats_oneway(req->client->stats, req->server, req->len, ret == MESSAGING_SUCCESS);
+        else
+            messaging_cstats_publish(req->client->stats, req->server, req->len,
+                    wire_now_ns() - req->start, ret == MESSAGING_SUCCESS);
+        if(req->route)
+            messaging_cstats_direct(req->client->stats, req->failed);
+    }
+    /* it may have left, ask the server again next time */
+    if(req->route && req->failed){
+        fprintf(stderr, "Could not notify %d subscriber%s directly\n", req->failed,
+                req->failed > 1 ? "s" : "");
+        messaging_routes_drop(req->client->routes, req->route);
+    }
+    request_free(req);
+    return ret;
+}
 
+static int remove_all_subscriptions(messaging_client_t client){
+    int ret = MESSAGING_SUCCESS;
+    bulk_data_t *in;
     margo_request *serv_req;
     hg_handle_t *hndl;
-    vector v;
     int *arr;
-    v = map_get_topics(client->t);
-    int serv_size = VECTOR_TOTAL(v)/2;
-    arr = (int*)malloc(sizeof(int)*serv_size);
-    //get server ids in an array
-    for (int i = 0; i < VECTOR_TOTAL(v); ++i)
-    {
-        int j = 0;
-        if((i%2)==0)
-            continue;
-        arr[j] = hash(VECTOR_GET(v, char*, i)) % client->num_servers;
-        j++;
-        free(VECTOR_GET(v, char*, i)); 
-    }
-    //remove duplicte server ids
-    for (int i = 0; i < serv_size; i++)
-    {
-        for(int j = i + 1; j < serv_size; j++)
-        {
-            if(arr[i] == arr[j])
-            {
-                for(int k = j; k < serv_size; k++)
-                {
-                    arr[k] = arr[k + 1];
-                }
-                serv_size--;
-                j--;
-            }
-        }
+    int serv_size = 0;
+
+    /* only the servers we registered with know about us */
+    in = (bulk_data_t*)calloc(client->num_servers, sizeof(*in));
+    arr = (int*)malloc(sizeof(int)*client->num_servers);
+    hndl = (hg_handle_t*)malloc(sizeof(hg_handle_t)*client->num_servers);
+    serv_req = (margo_request*)malloc(sizeof(margo_request)*client->num_servers);
+    if(in == NULL || arr == NULL || hndl == NULL || serv_req == NULL){
+        ret = MESSAGING_ERR_ALLOCATION;
+        goto fini;
     }
 
-    hndl = (hg_handle_t*)malloc(sizeof(hg_handle_t)*serv_size);
-    serv_req = (margo_request*)malloc(sizeof(margo_request)*serv_size);
-    
-    for (int i = 0; i < serv_size; ++i)
+    for (int i = 0; i < client->num_servers; ++i)
     {
         hg_addr_t svr_addr;
-        margo_request req;
-        hg_handle_t h;
-        int serv_id = arr[i];
-        margo_addr_lookup(client->mid, client->server_address[serv_id], &svr_addr);
-        margo_create(client->mid, svr_addr, client->finalize_id, &h);
-        margo_iforward(h, &in, &req);
-        hndl[i] = h;
-        serv_req[i] = req;
-        margo_addr_free(client->mid, svr_addr);
+        int status;
+        if(client->subscriber_ids[i] == SUBSCRIBER_NONE)
+            continue;
+        status = encode_message(client, "", "", NULL, 0, 0, i, &in[serv_size].evnt);
+        if(status != MESSAGING_SUCCESS){
+            ret = status;
+            break;
+        }
+        if(xport_lookup(&client->xport, client->server_name[i], &svr_addr) != HG_SUCCESS){
+            messaging_pool_free(in[serv_size].evnt.raw_data);
+            ret = MESSAGING_ERR_MERCURY;
+            continue;
+        }
+        if(xport_create(&client->xport, svr_addr, client->finalize_id, &hndl[serv_size]) != HG_SUCCESS){
+            xport_addr_free(&client->xport, svr_addr);
+            messaging_pool_free(in[serv_size].evnt.raw_data);
+            ret = MESSAGING_ERR_MERCURY;
+            continue;
+        }
+        if(xport_provider_iforward(&client->xport, hndl[serv_size], client->server_provider[i], &in[serv_size],
+                &serv_req[serv_size]) != HG_SUCCESS){
+            xport_destroy(&client->xport, hndl[serv_size]);
+            xport_addr_free(&client->xport, svr_addr);
+            messaging_pool_free(in[serv_size].evnt.raw_data);
+            ret = MESSAGING_ERR_MERCURY;
+            continue;
+        }
+        xport_addr_free(&client->xport, svr_addr);
+        arr[serv_size++] = i;
     }
     for (int i = 0; i < serv_size; ++i){
-        margo_wait(serv_req[i]);
         response_t resp;
-        margo_get_output(hndl[i], &resp);
-        ret = resp.ret;
-        margo_free_output(hndl[i], &resp);
-        margo_destroy(hndl[i]);
         int serv_id = arr[i];
-        if(ret!=MESSAGING_SUCCESS){
+        int status = MESSAGING_ERR_MERCURY;
+        if(xport_wait(&client->xport, serv_req[i]) == HG_SUCCESS &&
+                xport_get_output(&client->xport, hndl[i], &resp) == HG_SUCCESS){
+            status = resp.ret;
+            if(xport_free_output(&client->xport, hndl[i], &resp) != HG_SUCCESS && status == MESSAGING_SUCCESS)
+                status = MESSAGING_ERR_MERCURY;
+        }
+        if(status!=MESSAGING_SUCCESS){
             fprintf(stderr, "Could not unregister client %s from server %s\n", client->addr_string, client->server_address[serv_id]);
-            return ret;
+            ret = status;
         }
-        
+        xport_destroy(&client->xport, hndl[i]);
+        messaging_pool_free(in[i].evnt.raw_data);
+        client->subscriber_ids[serv_id] = SUBSCRIBER_NONE;
     }
+
+fini:
+    free(in);
     free(hndl);
     free(serv_req);
     free(arr);
@@ -672,7 +2276,101 @@ static int remove_all_subscriptions_new(messaging_client_t client){
 }
 
 
+/* a notification; with oneway the server is not waiting for an answer */
+static void notify_handle(hg_handle_t h, int oneway)
+{
+    hg_return_t ret;
+
+    message_t in;
+    response_t out;
+
+    margo_instance_id mid = margo_hg_handle_get_instance(h);
+    const struct hg_info* info = margo_get_info(h);
+    messaging_client_t client = (messaging_client_t) margo_registered_data(mid, info->id);
+    uint64_t recv = wire_now_ns();
+    uint64_t trace_id = 0;
+    uint32_t sub_id = SUBSCRIBER_NONE;
+  
+    ret = margo_get_input(h, &in);
+    assert(ret == HG_SUCCESS);
+
+    struct wire_msg m;
+    struct messaging_arena_buf pbuf = {0};
+
+    messaging_cstats_pending(client->stats, 1);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS && messaging_trace_enabled() &&
+            wire_ext_u64(&m, WIRE_EXT_TRACE, &trace_id)){
+        /* the server matches our spans to its own by the id it gave us */
+        sub_id = client->subscriber_ids[hash(m.topic) % client->num_servers];
+        messaging_trace_record(trace_id, MESSAGING_TRACE_SUB_RECV, sub_id, recv);
+    }
+    /* servers acknowledge whatever we have to pull */
+    if(out.ret == MESSAGING_SUCCESS && oneway && (m.flags & WIRE_FLAG_BULK))
+        out.ret = MESSAGING_ERR_PROTOCOL;
+    if(out.ret == MESSAGING_SUCCESS && (m.flags & WIRE_FLAG_BULK)){
+        /* pull the payload before answering, the server holds it until then */
+        out.ret = messaging_arena_pull(client->arena, mid, info->addr, in.bulk,
+                in.offset, m.payload_len, &pbuf);
+        m.payload = pbuf.ptr;
+    }
+    if(!oneway){
+        xport_respond(&client->xport, h, &out);
+        messaging_trace_record(trace_id, MESSAGING_TRACE_SUB_RESPOND, sub_id, trace_id ? wire_now_ns() : 0);
+    }
+    if(out.ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "Notification dropped (error %d)\n", out.ret);
+        goto fini;
+    }
+    /* a number the server took for a message we got from the publisher */
+    if(m.flags & WIRE_FLAG_SKIP){
+        if(client->reorder != MESSAGING_REORDER_NULL)
+            messaging_reorder_skip(client->reorder, m.namesp, m.topic, m.seq);
+        goto fini;
+    }
+    __atomic_add_fetch(&client->notify_count, 1, __ATOMIC_RELAXED);
+    messaging_cstats_received(client->stats, m.namesp, m.topic, m.payload_len);
+
+    void *handler_args;
+    void *handler_ptr;
+    /* the payload is handed out in place and released once the callback
+     * returns; the reorder buffer copies what has to wait */
+    if(client->reorder != MESSAGING_REORDER_NULL && m.seq != 0){
+        messaging_reorder_push(client->reorder, m.namesp, m.topic, m.seq, m.payload, m.payload_len,
+                recv, trace_id);
+    } else if(get_handler(client->t, m.namesp, m.topic, &handler_ptr, &handler_args) && handler_ptr){
+        messaging_trace_record(trace_id, MESSAGING_TRACE_CALLBACK_START, sub_id, trace_id ? wire_now_ns() : 0);
+        run_callback(client, handler_ptr, handler_args, m.payload, m.namesp, m.topic, recv);
+        messaging_trace_record(trace_id, MESSAGING_TRACE_CALLBACK_END, sub_id, trace_id ? wire_now_ns() : 0);
+    }
+    if(client->aggregate == AGG_LEADER)
+        aggregate_forward(client, &m, &in.evnt, &pbuf);
+
+fini:
+    messaging_cstats_pending(client->stats, -1);
+    messaging_arena_release(client->arena, &pbuf);
+    ret = margo_free_input(h, &in);
+    assert(ret == HG_SUCCESS);
+
+    ret = xport_destroy(&client->xport, h);
+    assert(ret == HG_SUCCESS);
+    
+}
+
 static void notify_rpc(hg_handle_t h)
+{
+    notify_handle(h, 0);
+}
+DEFINE_MARGO_RPC_HANDLER(notify_rpc)
+
+static void notify_oneway_rpc(hg_handle_t h)
+{
+    notify_handle(h, 1);
+}
+DEFINE_MARGO_RPC_HANDLER(notify_oneway_rpc)
+
+/* a server's filter changed; it drops us if we do not answer in time */
+static void filter_update_rpc(hg_handle_t h)
 {
     hg_return_t ret;
 
@@ -682,42 +2380,73 @@ static void notify_rpc(hg_handle_t h)
     margo_instance_id mid = margo_hg_handle_get_instance(h);
     const struct hg_info* info = margo_get_info(h);
     messaging_client_t client = (messaging_client_t) margo_registered_data(mid, info->id);
-  
+
     ret = margo_get_input(h, &in);
     assert(ret == HG_SUCCESS);
 
-    char *namesp, *topic, *tag_msg, *raw_buf;
-    int namespace_len, topic_len, tag_len;
+    out.ret = client->filtering ?
+        filter_install(client, in.evnt.raw_data, in.evnt.size) : MESSAGING_SUCCESS;
+    xport_respond(&client->xport, h, &out);
+
+    ret = margo_free_input(h, &in);
+    assert(ret == HG_SUCCESS);
+
+    ret = xport_destroy(&client->xport, h);
+    assert(ret == HG_SUCCESS);
+}
+DEFINE_MARGO_RPC_HANDLER(filter_update_rpc)
 
-    raw_buf = (char*) in.evnt.raw_data;
-    namespace_len = ((int *)raw_buf)[0];
-    topic_len = ((int *)raw_buf)[1];
-    tag_len = ((int *)raw_buf)[2];
+/* the subscribers of topics we send to directly changed; the server drops
+ * us if we do not answer in time */
+static void route_invalidate_rpc(hg_handle_t h)
+{
+    hg_return_t ret;
 
-    namesp = (char *)malloc(namespace_len);
-    topic = (char *)malloc(topic_len);
-    tag_msg = malloc(tag_len);
-    memcpy(namesp, &raw_buf[sizeof(int)*3], namespace_len);
-    memcpy(topic, &raw_buf[sizeof(int)*3+namespace_len], topic_len);
-    memcpy(tag_msg, &raw_buf[sizeof(int)*3+namespace_len+topic_len], tag_len);
+    bulk_data_t in;
+    response_t out;
 
-    out.ret = MESSAGING_SUCCESS;
-    margo_respond(h, &out);
+    margo_instance_id mid = margo_hg_handle_get_instance(h);
+    const struct hg_info* info = margo_get_info(h);
+    messaging_client_t client = (messaging_client_t) margo_registered_data(mid, info->id);
 
+    ret = margo_get_input(h, &in);
+    assert(ret == HG_SUCCESS);
 
-    vector v;
-    v = map_get_value(client->t, namesp, topic);
-    void *handler_args;
-    void (*handler_func)(void *, void *);
-    handler_args = VECTOR_GET(v, void*, 1);
-    handler_func = VECTOR_GET(v, void*, 0);
-    (*handler_func)(handler_args, (void *)tag_msg);
+    struct wire_msg m;
+    const char *addr, *p, *end, *ns, *topic;
+    int server = -1;
+
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS && client->routes != MESSAGING_ROUTES_NULL){
+        if((addr = wire_ext_string(&m, WIRE_EXT_ADDR)) != NULL)
+            server = server_index(client, addr, strlen(addr));
+        if(server < 0){
+            out.ret = MESSAGING_ERR_UNKNOWN_OBJ;
+        }else if(m.flags & WIRE_FLAG_BATCH){
+            p = (const char *)m.payload;
+            end = p + m.payload_len;
+            while(p < end){
+                size_t n = wire_get_topic_rec(p, end, &ns, &topic);
+                if(n == 0)
+                    break;
+                p += n;
+                messaging_routes_invalidate(client->routes, server, ns, topic, m.seq);
+            }
+            /* a malformed batch still moves the epoch, dropping everything is safe */
+            if(p != end)
+                messaging_routes_invalidate(client->routes, server, NULL, NULL, m.seq);
+        }else if(m.namesp[0] == '\0' && m.topic[0] == '\0'){
+            messaging_routes_invalidate(client->routes, server, NULL, NULL, m.seq);
+        }else{
+            messaging_routes_invalidate(client->routes, server, m.namesp, m.topic, m.seq);
+        }
+    }
+    xport_respond(&client->xport, h, &out);
 
     ret = margo_free_input(h, &in);
     assert(ret == HG_SUCCESS);
 
-    ret = margo_destroy(h);
+    ret = xport_destroy(&client->xport, h);
     assert(ret == HG_SUCCESS);
-    
 }
-DEFINE_MARGO_RPC_HANDLER(notify_rpc)
+DEFINE_MARGO_RPC_HANDLER(route_invalidate_rpc)
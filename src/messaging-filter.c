@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-filter.h>
+
+#define FILTER_MAX_BITS  (1u << 26)
+
+struct messaging_filter {
+    uint32_t nbits;             /* a power of two */
+    uint64_t version;
+    uint8_t *counts;            /* NULL in a publisher's copy */
+    uint64_t *bits;
+};
+
+int messaging_filter_create(uint32_t nbits, messaging_filter_t *filter)
+{
+    struct messaging_filter *f;
+    uint32_t n = 64;
+    const char *s;
+
+    if (nbits == 0) {
+        nbits = MESSAGING_FILTER_BITS;
+        if ((s = getenv("MESSAGING_FILTER_BITS")) != NULL && atol(s) > 0)
+            nbits = (uint32_t)atol(s);
+    }
+    if (nbits > FILTER_MAX_BITS)
+        nbits = FILTER_MAX_BITS;
+    while (n < nbits)
+        n <<= 1;
+    if (!(f = calloc(1, sizeof(*f))))
+        return MESSAGING_ERR_ALLOCATION;
+    f->nbits = n;
+    f->counts = calloc(n, 1);
+    f->bits = calloc(n / 64, sizeof(uint64_t));
+    if (!f->counts || !f->bits) {
+        messaging_filter_destroy(f);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    *filter = f;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_filter_destroy(messaging_filter_t filter)
+{
+    if (!filter)
+        return;
+    free(filter->counts);
+    free(filter->bits);
+    free(filter);
+}
+
+/* double hashing over the two halves of the topic hash */
+static uint32_t bit_of(const struct messaging_filter *f, uint64_t topic_hash, int i)
+{
+    uint32_t h1 = (uint32_t)topic_hash, h2 = (uint32_t)(topic_hash >> 32) | 1;
+
+    return (h1 + (uint32_t)i * h2) & (f->nbits - 1);
+}
+
+int messaging_filter_add(messaging_filter_t f, uint64_t topic_hash)
+{
+    int set = 0;
+
+    for (int i = 0; i < MESSAGING_FILTER_HASHES; i++) {
+        uint32_t b = bit_of(f, topic_hash, i);
+
+        if (f->counts[b] == UINT8_MAX)
+            continue;
+        if (f->counts[b]++ == 0) {
+            __atomic_or_fetch(&f->bits[b / 64], 1ull << (b % 64), __ATOMIC_RELAXED);
+            set = 1;
+        }
+    }
+    f->version++;
+    return set;
+}
+
+int messaging_filter_remove(messaging_filter_t f, uint64_t topic_hash)
+{
+    int cleared = 0;
+
+    for (int i = 0; i < MESSAGING_FILTER_HASHES; i++) {
+        uint32_t b = bit_of(f, topic_hash, i);
+
+        /* a saturated counter has lost track, leave it set */
+        if (f->counts[b] == 0 || f->counts[b] == UINT8_MAX)
+            continue;
+        if (--f->counts[b] == 0) {
+            __atomic_and_fetch(&f->bits[b / 64], ~(1ull << (b % 64)), __ATOMIC_RELAXED);
+            cleared = 1;
+        }
+    }
+    f->version++;
+    return cleared;
+}
+
+int messaging_filter_test(messaging_filter_t f, uint64_t topic_hash)
+{
+    for (int i = 0; i < MESSAGING_FILTER_HASHES; i++) {
+        uint32_t b = bit_of(f, topic_hash, i);
+
+        if (!(__atomic_load_n(&f->bits[b / 64], __ATOMIC_RELAXED) & (1ull << (b % 64))))
+            return 0;
+    }
+    return 1;
+}
+
+uint64_t messaging_filter_version(messaging_filter_t f)
+{
+    return __atomic_load_n(&f->version, __ATOMIC_RELAXED);
+}
+
+/*
+ * Encoding: a format byte, the version and the number of bits as varints,
+ * then the bits as little endian u64 words.
+ */
+
+int messaging_filter_encode(messaging_filter_t f, void **buf, size_t *len)
+{
+    size_t words = f->nbits / 64, n;
+    uint8_t *p;
+
+    n = 1 + wire_varint_size(f->version) + wire_varint_size(f->nbits) + words * 8;
+    if (!(p = messaging_pool_alloc(n)))
+        return MESSAGING_ERR_ALLOCATION;
+    *buf = p;
+    *len = n;
+    *p++ = MESSAGING_FILTER_FORMAT;
+    p += wire_put_varint(p, f->version);
+    p += wire_put_varint(p, f->nbits);
+    for (size_t i = 0; i < words; i++, p += 8)
+        wire_put_u64(p, __atomic_load_n(&f->bits[i], __ATOMIC_RELAXED));
+    return MESSAGING_SUCCESS;
+}
+
+/* parses the header; bits points at the words */
+static int parse(const void *buf, size_t len, uint64_t *version, uint32_t *nbits,
+        const uint8_t **bits)
+{
+    const uint8_t *p = buf, *end = p + len;
+    uint64_t v, n;
+    size_t c;
+
+    if (len < 1 || *p++ != MESSAGING_FILTER_FORMAT)
+        return MESSAGING_ERR_PROTOCOL;
+    if ((c = wire_get_varint(p, end, &v)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += c;
+    if ((c = wire_get_varint(p, end, &n)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += c;
+    if (n < 64 || n > FILTER_MAX_BITS || (n & (n - 1)) || (size_t)(end - p) != n / 8)
+        return MESSAGING_ERR_PROTOCOL;
+    *version = v;
+    *nbits = (uint32_t)n;
+    *bits = p;
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_filter_decode(const void *buf, size_t len, messaging_filter_t *filter)
+{
+    struct messaging_filter *f;
+    const uint8_t *bits;
+    uint64_t version;
+    uint32_t nbits;
+    int ret;
+
+    if ((ret = parse(buf, len, &version, &nbits, &bits)) != MESSAGING_SUCCESS)
+        return ret;
+    if (!(f = calloc(1, sizeof(*f))) || !(f->bits = malloc(nbits / 8))) {
+        free(f);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    f->nbits = nbits;
+    f->version = version;
+    for (uint32_t i = 0; i < nbits / 64; i++)
+        f->bits[i] = wire_get_u64(bits + 8 * i);
+    *filter = f;
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_filter_apply(messaging_filter_t f, const void *buf, size_t len)
+{
+    const uint8_t *bits;
+    uint64_t version;
+    uint32_t nbits;
+    int ret;
+
+    if ((ret = parse(buf, len, &version, &nbits, &bits)) != MESSAGING_SUCCESS)
+        return ret;
+    if (nbits != f->nbits)
+        return MESSAGING_ERR_PROTOCOL;
+    /* updates can arrive out of order, an older one changes nothing */
+    if (version <= f->version)
+        return MESSAGING_SUCCESS;
+    for (uint32_t i = 0; i < nbits / 64; i++)
+        __atomic_store_n(&f->bits[i], wire_get_u64(bits + 8 * i), __ATOMIC_RELAXED);
+    __atomic_store_n(&f->version, version, __ATOMIC_RELAXED);
+    return MESSAGING_SUCCESS;
+}
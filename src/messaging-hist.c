@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <string.h>
+#include <messaging-hist.h>
+
+void messaging_hist_init(struct messaging_hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void messaging_hist_merge(struct messaging_hist *dst, const struct messaging_hist *src)
+{
+    for (int i = 0; i < MESSAGING_HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t messaging_hist_bucket_top(int bucket)
+{
+    int shift;
+
+    if (bucket < MESSAGING_HIST_SUB)
+        return (uint64_t)bucket;
+    shift = bucket / MESSAGING_HIST_HALF - 1;
+    return (((uint64_t)(bucket % MESSAGING_HIST_HALF + MESSAGING_HIST_HALF) + 1) << shift) - 1;
+}
+
+uint64_t messaging_hist_quantile(const struct messaging_hist *h, double q)
+{
+    uint64_t rank, seen = 0, v;
+
+    if (h->count == 0)
+        return 0;
+    if (q <= 0)
+        return h->min;
+    rank = (uint64_t)(q * h->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    if (rank >= h->count)
+        return h->max;
+    for (int i = 0; i < MESSAGING_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            v = messaging_hist_bucket_top(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+double messaging_hist_mean(const struct messaging_hist *h)
+{
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
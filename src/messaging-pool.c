@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <messaging-pool.h>
+
+#define NUM_CLASSES (MESSAGING_POOL_MAX_SHIFT - MESSAGING_POOL_MIN_SHIFT + 1)
+#define HEAP_CLASS  NUM_CLASSES
+#define BLOCK_MAGIC 0x706f6f6cU
+
+/* blocks a thread keeps per size class before spilling to the depot */
+#define CACHE_LIMIT(cls) ((cls) < 8 ? 64 : (cls) < 12 ? 16 : 4)
+/* blocks moved between a thread cache and the depot at once */
+#define CACHE_BATCH(cls) (CACHE_LIMIT(cls) / 2)
+
+/*
+ * Every block is preceded by a header that keeps the buffer aligned and
+ * records its size class.  While a block sits in a free list the first
+ * word of the buffer links it to the next one.
+ */
+struct block_hdr {
+    uint32_t magic;
+    uint32_t cls;
+    char pad[MESSAGING_POOL_ALIGN - 2 * sizeof(uint32_t)];
+};
+
+struct free_block {
+    struct free_block *next;
+};
+
+struct free_list {
+    struct free_block *head;
+    int count;
+};
+
+struct pool_cache {
+    struct free_list lists[NUM_CLASSES];
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t heap_allocs;
+    uint64_t heap_frees;
+    struct pool_cache *prev, *next;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct free_list lists[NUM_CLASSES];
+    struct pool_cache *caches;   /* live thread caches */
+    struct messaging_pool_stats retired; /* counters of exited threads */
+    pthread_key_t key;
+    pthread_once_t once;
+} depot = { PTHREAD_MUTEX_INITIALIZER, {{0}}, NULL, {0}, 0, PTHREAD_ONCE_INIT };
+
+static __thread struct pool_cache *tcache;
+
+static inline size_t class_size(int cls)
+{
+    return (size_t)1 << (cls + MESSAGING_POOL_MIN_SHIFT);
+}
+
+static inline int size_to_class(size_t size)
+{
+    int cls = 0;
+    if (size > MESSAGING_POOL_MAX_SIZE)
+        return HEAP_CLASS;
+    while (class_size(cls) < size)
+        cls++;
+    return cls;
+}
+
+static inline void list_push(struct free_list *l, struct free_block *b)
+{
+    b->next = l->head;
+    l->head = b;
+    l->count++;
+}
+
+static inline struct free_block *list_pop(struct free_list *l)
+{
+    struct free_block *b = l->head;
+    if (b) {
+        l->head = b->next;
+        l->count--;
+    }
+    return b;
+}
+
+static void cache_destroy(void *arg)
+{
+    struct pool_cache *c = (struct pool_cache *)arg;
+
+    pthread_mutex_lock(&depot.lock);
+    for (int cls = 0; cls < NUM_CLASSES; cls++) {
+        struct free_block *b;
+        while ((b = list_pop(&c->lists[cls])) != NULL)
+            list_push(&depot.lists[cls], b);
+    }
+    depot.retired.allocs += c->allocs;
+    depot.retired.frees += c->frees;
+    depot.retired.heap_allocs += c->heap_allocs;
+    depot.retired.heap_frees += c->heap_frees;
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        depot.caches = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    pthread_mutex_unlock(&depot.lock);
+    free(c);
+}
+
+static void depot_init(void)
+{
+    pthread_key_create(&depot.key, cache_destroy);
+}
+
+static struct pool_cache *get_cache(void)
+{
+    struct pool_cache *c = tcache;
+    if (c)
+        return c;
+
+    pthread_once(&depot.once, depot_init);
+    c = (struct pool_cache *)calloc(1, sizeof(*c));
+    if (c == NULL)
+        return NULL;
+    pthread_mutex_lock(&depot.lock);
+    c->next = depot.caches;
+    if (depot.caches)
+        depot.caches->prev = c;
+    depot.caches = c;
+    pthread_mutex_unlock(&depot.lock);
+    pthread_setspecific(depot.key, c);
+    tcache = c;
+    return c;
+}
+
+static void *heap_block(struct pool_cache *c, int cls, size_t size)
+{
+    struct block_hdr *h;
+    size_t bytes = cls == HEAP_CLASS ? size : class_size(cls);
+
+    if (posix_memalign((void **)&h, MESSAGING_POOL_ALIGN, sizeof(*h) + bytes) != 0)
+        return NULL;
+    h->magic = BLOCK_MAGIC;
+    h->cls = (uint32_t)cls;
+    c->heap_allocs++;
+    return h + 1;
+}
+
+void *messaging_pool_alloc(size_t size)
+{
+    struct pool_cache *c = get_cache();
+    struct free_block *b;
+    int cls;
+
+    if (c == NULL)
+        return NULL;
+    c->allocs++;
+    cls = size_to_class(size);
+    if (cls == HEAP_CLASS)
+        return heap_block(c, cls, size);
+
+    b = list_pop(&c->lists[cls]);
+    if (b == NULL) {
+        /* refill half a cache worth from the depot */
+        pthread_mutex_lock(&depot.lock);
+        for (int i = 0; i < CACHE_BATCH(cls); i++) {
+            struct free_block *d = list_pop(&depot.lists[cls]);
+            if (d == NULL)
+                break;
+            list_push(&c->lists[cls], d);
+        }
+        pthread_mutex_unlock(&depot.lock);
+        b = list_pop(&c->lists[cls]);
+    }
+    if (b == NULL)
+        return heap_block(c, cls, size);
+    return b;
+}
+
+void messaging_pool_free(void *ptr)
+{
+    struct block_hdr *h;
+    struct pool_cache *c;
+    int cls;
+
+    if (ptr == NULL)
+        return;
+    h = (struct block_hdr *)ptr - 1;
+    if (h->magic != BLOCK_MAGIC) {
+        fprintf(stderr, "messaging_pool_free: %p was not allocated by the pool\n", ptr);
+        abort();
+    }
+    cls = (int)h->cls;
+    c = get_cache();
+    if (c == NULL || cls == HEAP_CLASS) {
+        if (c) {
+            c->frees++;
+            c->heap_frees++;
+        }
+        free(h);
+        return;
+    }
+    c->frees++;
+    list_push(&c->lists[cls], (struct free_block *)ptr);
+
+    /* spill half the cache to the depot so other threads can reuse it */
+    if (c->lists[cls].count > CACHE_LIMIT(cls)) {
+        pthread_mutex_lock(&depot.lock);
+        for (int i = 0; i < CACHE_BATCH(cls); i++)
+            list_push(&depot.lists[cls], list_pop(&c->lists[cls]));
+        pthread_mutex_unlock(&depot.lock);
+    }
+}
+
+/* other threads' counters are read without stopping them, so the sums are a snapshot */
+void messaging_pool_get_stats(struct messaging_pool_stats *stats)
+{
+    struct pool_cache *c;
+
+    pthread_mutex_lock(&depot.lock);
+    *stats = depot.retired;
+    stats->cached_bytes = 0;
+    for (int cls = 0; cls < NUM_CLASSES; cls++)
+        stats->cached_bytes += (uint64_t)depot.lists[cls].count * class_size(cls);
+    for (c = depot.caches; c != NULL; c = c->next) {
+        stats->allocs += c->allocs;
+        stats->frees += c->frees;
+        stats->heap_allocs += c->heap_allocs;
+        stats->heap_frees += c->heap_frees;
+        for (int cls = 0; cls < NUM_CLASSES; cls++)
+            stats->cached_bytes += (uint64_t)c->lists[cls].count * class_size(cls);
+    }
+    pthread_mutex_unlock(&depot.lock);
+}
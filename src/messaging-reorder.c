@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-reorder.h>
+
+/* where a topic's sequence stands */
+#define TOPIC_IDLE      0   /* nothing seen since created or forgotten */
+#define TOPIC_STARTING  1   /* holding the first messages for the timeout */
+#define TOPIC_READY     2   /* delivering in order */
+
+#define REORDER_BUCKETS 256
+
+/* a message that arrived before its turn; seq 0 marks a free slot */
+struct held {
+    uint64_t seq;
+    uint64_t recv_ns;
+    uint64_t held_ns;            /* when it was put aside, for the timeout */
+    uint64_t trace_id;
+    void *payload;               /* copy from messaging_pool_alloc() */
+    int skip;                    /* only moves the sequence on, nothing to deliver */
+};
+
+struct reorder_entry {
+    struct reorder_entry *next;
+    uint64_t hash;
+    char *namesp;
+    char *topic;
+    ABT_mutex lock;              /* recursive, held while delivering */
+    int state;
+    uint64_t next_seq;           /* the next to deliver, the lowest held while starting */
+    uint64_t start_ns;           /* when the first message arrived */
+    size_t num_held;
+    struct held *slots;          /* window of them, by seq % window */
+};
+
+struct messaging_reorder {
+    size_t window;
+    uint64_t timeout_ns;
+    messaging_reorder_deliver_t deliver;
+    void *arg;
+    /* entries are only added, so lookups walk the chains without a lock */
+    struct reorder_entry *buckets[REORDER_BUCKETS];
+    ABT_mutex insert_lock;
+    uint64_t held;
+    uint64_t gaps;
+    uint64_t duplicates;
+};
+
+int messaging_reorder_create(size_t window, uint64_t timeout_ns, messaging_reorder_deliver_t deliver,
+        void *arg, messaging_reorder_t *reorder)
+{
+    struct messaging_reorder *r;
+    const char *s;
+
+    if (deliver == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    if (window == 0) {
+        window = MESSAGING_REORDER_WINDOW;
+        if ((s = getenv("MESSAGING_REORDER_WINDOW")) != NULL && atol(s) > 0)
+            window = (size_t)atol(s);
+    }
+    if (timeout_ns == 0) {
+        timeout_ns = MESSAGING_REORDER_TIMEOUT * 1000000ull;
+        if ((s = getenv("MESSAGING_REORDER_TIMEOUT")) != NULL && atof(s) > 0)
+            timeout_ns = (uint64_t)(atof(s) * 1e6);
+    }
+    if (!(r = calloc(1, sizeof(*r))))
+        return MESSAGING_ERR_ALLOCATION;
+    r->window = window;
+    r->timeout_ns = timeout_ns;
+    r->deliver = deliver;
+    r->arg = arg;
+    if (ABT_mutex_create(&r->insert_lock) != ABT_SUCCESS) {
+        free(r);
+        return MESSAGING_ERR_ARGOBOTS;
+    }
+    *reorder = r;
+    return MESSAGING_SUCCESS;
+}
+
+/* drops everything held; called with the entry locked */
+static void reset(messaging_reorder_t r, struct reorder_entry *e)
+{
+    for (size_t i = 0; e->num_held > 0 && i < r->window; i++) {
+        if (e->slots[i].seq != 0) {
+            messaging_pool_free(e->slots[i].payload);
+            e->slots[i].seq = 0;
+            e->num_held--;
+        }
+    }
+    e->state = TOPIC_IDLE;
+    e->next_seq = 0;
+}
+
+void messaging_reorder_destroy(messaging_reorder_t r)
+{
+    struct reorder_entry *e, *next;
+
+    if (!r)
+        return;
+    for (size_t b = 0; b < REORDER_BUCKETS; b++) {
+        for (e = r->buckets[b]; e; e = next) {
+            next = e->next;
+            reset(r, e);
+            ABT_mutex_free(&e->lock);
+            free(e->slots);
+            free(e->namesp);
+            free(e->topic);
+            free(e);
+        }
+    }
+    ABT_mutex_free(&r->insert_lock);
+    free(r);
+}
+
+static struct reorder_entry *find(messaging_reorder_t r, uint64_t hash, const char *namesp,
+        const char *topic)
+{
+    struct reorder_entry *e;
+
+    for (e = __atomic_load_n(&r->buckets[hash % REORDER_BUCKETS], __ATOMIC_ACQUIRE); e; e = e->next)
+        if (e->hash == hash && strcmp(e->topic, topic) == 0 && strcmp(e->namesp, namesp) == 0)
+            return e;
+    return NULL;
+}
+
+/* the entry of namesp/topic, added if it is new; NULL if out of memory */
+static struct reorder_entry *entry(messaging_reorder_t r, const char *namesp, const char *topic)
+{
+    uint64_t hash = wire_topic_hash(namesp, topic);
+    struct reorder_entry *e;
+    ABT_mutex_attr attr;
+
+    if ((e = find(r, hash, namesp, topic)) != NULL)
+        return e;
+    ABT_mutex_lock(r->insert_lock);
+    if ((e = find(r, hash, namesp, topic)) != NULL || (e = calloc(1, sizeof(*e))) == NULL)
+        goto out;
+    e->hash = hash;
+    e->namesp = strdup(namesp);
+    e->topic = strdup(topic);
+    e->slots = calloc(r->window, sizeof(*e->slots));
+    if (!e->namesp || !e->topic || !e->slots) {
+        free(e->namesp);
+        free(e->topic);
+        free(e->slots);
+        free(e);
+        e = NULL;
+        goto out;
+    }
+    /* a callback may forget its own topic */
+    ABT_mutex_attr_create(&attr);
+    ABT_mutex_attr_set_recursive(attr, ABT_TRUE);
+    ABT_mutex_create_with_attr(attr, &e->lock);
+    ABT_mutex_attr_free(&attr);
+    e->next = r->buckets[hash % REORDER_BUCKETS];
+    __atomic_store_n(&r->buckets[hash % REORDER_BUCKETS], e, __ATOMIC_RELEASE);
+out:
+    ABT_mutex_unlock(r->insert_lock);
+    return e;
+}
+
+/* keeps a copy of message seq; 0 if it was already there */
+static int hold(messaging_reorder_t r, struct reorder_entry *e, uint64_t seq, const void *payload,
+        size_t len, uint64_t recv_ns, uint64_t trace_id, uint64_t now, int skip)
+{
+    struct held *h = &e->slots[seq % r->window];
+
+    if (h->seq == seq)
+        return 0;
+    h->payload = NULL;
+    if (!skip && (h->payload = messaging_pool_alloc(len ? len : 1)) == NULL) {
+        /* better late than never */
+        r->deliver(r->arg, e->namesp, e->topic, (void *)payload, recv_ns, trace_id);
+        return 1;
+    }
+    if (!skip)
+        memcpy(h->payload, payload, len);
+    h->skip = skip;
+    h->recv_ns = recv_ns;
+    h->trace_id = trace_id;
+    h->held_ns = now;
+    h->seq = seq;
+    e->num_held++;
+    return 1;
+}
+
+/* delivers the held message seq if there is one, returns whether there was */
+static int release(messaging_reorder_t r, struct reorder_entry *e, uint64_t seq)
+{
+    struct held *h = &e->slots[seq % r->window];
+    struct held msg = *h;
+
+    if (h->seq != seq)
+        return 0;
+    /* off the slot first, the callback may forget the topic */
+    h->seq = 0;
+    e->num_held--;
+    if (!msg.skip)
+        r->deliver(r->arg, e->namesp, e->topic, msg.payload, msg.recv_ns, msg.trace_id);
+    messaging_pool_free(msg.payload);
+    return 1;
+}
+
+/* delivers what is held in order from next_seq on */
+static void drain(messaging_reorder_t r, struct reorder_entry *e)
+{
+    while (e->state == TOPIC_READY && e->num_held > 0 && release(r, e, e->next_seq))
+        e->next_seq++;
+}
+
+/* gives up on everything before seq, delivering what is held of it */
+static void skip_to(messaging_reorder_t r, struct reorder_entry *e, uint64_t seq)
+{
+    uint64_t gaps = 0;
+
+    while (e->state == TOPIC_READY && e->next_seq < seq) {
+        if (e->num_held == 0) {
+            gaps += seq - e->next_seq;
+            e->next_seq = seq;
+            break;
+        }
+        if (!release(r, e, e->next_seq))
+            gaps++;
+        e->next_seq++;
+    }
+    if (gaps)
+        __atomic_add_fetch(&r->gaps, gaps, __ATOMIC_RELAXED);
+}
+
+/* the lowest and highest held sequence numbers, next_seq if none, and when
+ * the oldest held message was put aside */
+static void scan(messaging_reorder_t r, struct reorder_entry *e, uint64_t *lowest,
+        uint64_t *highest, uint64_t *oldest_ns)
+{
+    *lowest = e->num_held ? UINT64_MAX : e->next_seq;
+    *highest = e->next_seq;
+    *oldest_ns = UINT64_MAX;
+    for (size_t i = 0; e->num_held > 0 && i < r->window; i++) {
+        if (e->slots[i].seq == 0)
+            continue;
+        if (e->slots[i].seq < *lowest)
+            *lowest = e->slots[i].seq;
+        if (e->slots[i].seq > *highest)
+            *highest = e->slots[i].seq;
+        if (e->slots[i].held_ns < *oldest_ns)
+            *oldest_ns = e->slots[i].held_ns;
+    }
+}
+
+/* ends the start once the timeout has passed, and gives up on a gap that has
+ * been open as long; called with the entry locked */
+static void check_timeout(messaging_reorder_t r, struct reorder_entry *e, uint64_t now)
+{
+    uint64_t lowest, highest, oldest;
+
+    if (e->state == TOPIC_STARTING && now - e->start_ns >= r->timeout_ns) {
+        e->state = TOPIC_READY;
+        drain(r, e);
+    }
+    if (e->state != TOPIC_READY || e->num_held == 0)
+        return;
+    scan(r, e, &lowest, &highest, &oldest);
+    if (now >= oldest && now - oldest >= r->timeout_ns) {
+        skip_to(r, e, lowest);
+        drain(r, e);
+    }
+}
+
+/* a message for a topic delivering in order, returns 1 if it is a duplicate */
+static int take(messaging_reorder_t r, struct reorder_entry *e, uint64_t seq, void *payload,
+        size_t len, uint64_t recv_ns, uint64_t trace_id, uint64_t now, int skip)
+{
+    if (seq < e->next_seq)
+        return 1;
+    if (seq - e->next_seq >= r->window)
+        skip_to(r, e, seq - r->window + 1);
+    if (e->state != TOPIC_READY || seq == e->next_seq) {
+        /* its turn, or a callback forgot the topic under us */
+        if (e->state == TOPIC_READY)
+            e->next_seq++;
+        if (!skip)
+            r->deliver(r->arg, e->namesp, e->topic, payload, recv_ns, trace_id);
+        drain(r, e);
+        return 0;
+    }
+    if (e->slots[seq % r->window].seq == seq)
+        return 1;
+    if (hold(r, e, seq, payload, len, recv_ns, trace_id, now, skip))
+        __atomic_add_fetch(&r->held, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* messaging_reorder_push(), or with skip messaging_reorder_skip() */
+static int push(messaging_reorder_t r, const char *namesp, const char *topic,
+        uint64_t seq, void *payload, size_t len, uint64_t recv_ns, uint64_t trace_id, int skip)
+{
+    struct reorder_entry *e;
+    uint64_t now = wire_now_ns(), lowest, highest, oldest;
+    int dup;
+
+    if (seq == 0 || (e = entry(r, namesp, topic)) == NULL) {
+        if (!skip)
+            r->deliver(r->arg, namesp, topic, payload, recv_ns, trace_id);
+        return seq == 0 ? MESSAGING_SUCCESS : MESSAGING_ERR_ALLOCATION;
+    }
+    ABT_mutex_lock(e->lock);
+    if (e->state == TOPIC_IDLE) {
+        e->state = TOPIC_STARTING;
+        e->next_seq = seq;
+        e->start_ns = now;
+    }
+    if (e->state == TOPIC_STARTING) {
+        /* start from the lowest seen, as long as all that is held still fits */
+        scan(r, e, &lowest, &highest, &oldest);
+        if (seq < e->next_seq && highest - seq < r->window)
+            e->next_seq = seq;
+        if (seq < e->next_seq) {
+            dup = 1;
+        } else if (seq - e->next_seq < r->window) {
+            dup = !hold(r, e, seq, payload, len, recv_ns, trace_id, now, skip);
+        } else {
+            /* too far ahead to wait for the rest */
+            e->state = TOPIC_READY;
+            dup = take(r, e, seq, payload, len, recv_ns, trace_id, now, skip);
+        }
+    } else {
+        dup = take(r, e, seq, payload, len, recv_ns, trace_id, now, skip);
+    }
+    if (dup)
+        __atomic_add_fetch(&r->duplicates, 1, __ATOMIC_RELAXED);
+    check_timeout(r, e, now);
+    ABT_mutex_unlock(e->lock);
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_reorder_push(messaging_reorder_t r, const char *namesp, const char *topic,
+        uint64_t seq, void *payload, size_t len, uint64_t recv_ns, uint64_t trace_id)
+{
+    return push(r, namesp, topic, seq, payload, len, recv_ns, trace_id, 0);
+}
+
+int messaging_reorder_skip(messaging_reorder_t r, const char *namesp, const char *topic, uint64_t seq)
+{
+    return push(r, namesp, topic, seq, NULL, 0, 0, 0, 1);
+}
+
+void messaging_reorder_expire(messaging_reorder_t r, uint64_t now_ns)
+{
+    struct reorder_entry *e;
+
+    for (size_t b = 0; b < REORDER_BUCKETS; b++) {
+        for (e = __atomic_load_n(&r->buckets[b], __ATOMIC_ACQUIRE); e; e = e->next) {
+            if (__atomic_load_n(&e->state, __ATOMIC_RELAXED) == TOPIC_IDLE)
+                continue;
+            ABT_mutex_lock(e->lock);
+            check_timeout(r, e, now_ns);
+            ABT_mutex_unlock(e->lock);
+        }
+    }
+}
+
+void messaging_reorder_forget(messaging_reorder_t r, const char *namesp, const char *topic)
+{
+    struct reorder_entry *e = find(r, wire_topic_hash(namesp, topic), namesp, topic);
+
+    if (e == NULL)
+        return;
+    ABT_mutex_lock(e->lock);
+    reset(r, e);
+    ABT_mutex_unlock(e->lock);
+}
+
+void messaging_reorder_counters(messaging_reorder_t r, struct messaging_reorder_counters *c)
+{
+    c->held = __atomic_load_n(&r->held, __ATOMIC_RELAXED);
+    c->gaps = __atomic_load_n(&r->gaps, __ATOMIC_RELAXED);
+    c->duplicates = __atomic_load_n(&r->duplicates, __ATOMIC_RELAXED);
+}
+
+uint64_t messaging_reorder_timeout(messaging_reorder_t r)
+{
+    return r->timeout_ns;
+}
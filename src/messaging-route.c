@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-route.h>
+
+/* what a publisher does with a topic */
+#define ROUTE_COUNTING  0   /* through the server, counting publishes */
+#define ROUTE_FETCHING  1   /* one publisher is asking for the subscribers */
+#define ROUTE_READY     2   /* straight to the subscribers */
+
+#define ROUTE_ADDR_MAX  4096
+
+struct route_entry {
+    struct route_entry *next;
+    uint64_t hash;
+    int server;
+    int state;
+    uint32_t publishes;          /* since the topic last went back to counting */
+    struct messaging_route *route;
+    char *namesp;
+    char *topic;
+};
+
+struct messaging_routes {
+    const struct messaging_transport *xport;
+    int num_servers;
+    uint32_t threshold;
+    size_t max_topics;
+    size_t num_topics;
+    size_t mask;
+    struct route_entry **buckets;
+    uint64_t *epochs;            /* newest invalidation from each server */
+    ABT_rwlock lock;
+};
+
+int messaging_routes_create(const struct messaging_transport *xport, int num_servers,
+        uint32_t threshold, size_t max_topics, messaging_routes_t *routes)
+{
+    struct messaging_routes *r;
+    size_t n = 16;
+    const char *s;
+
+    if (threshold == 0) {
+        threshold = MESSAGING_DIRECT_THRESHOLD;
+        if ((s = getenv("MESSAGING_DIRECT_THRESHOLD")) != NULL && atol(s) > 0)
+            threshold = (uint32_t)atol(s);
+    }
+    if (max_topics == 0) {
+        max_topics = MESSAGING_DIRECT_TOPICS;
+        if ((s = getenv("MESSAGING_DIRECT_TOPICS")) != NULL && atol(s) > 0)
+            max_topics = (size_t)atol(s);
+    }
+    while (n < max_topics)
+        n <<= 1;
+    if (!(r = calloc(1, sizeof(*r))))
+        return MESSAGING_ERR_ALLOCATION;
+    r->xport = xport;
+    r->num_servers = num_servers;
+    r->threshold = threshold;
+    r->max_topics = max_topics;
+    r->mask = n - 1;
+    r->buckets = calloc(n, sizeof(*r->buckets));
+    r->epochs = calloc(num_servers, sizeof(*r->epochs));
+    if (!r->buckets || !r->epochs || ABT_rwlock_create(&r->lock) != ABT_SUCCESS) {
+        free(r->buckets);
+        free(r->epochs);
+        free(r);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    *routes = r;
+    return MESSAGING_SUCCESS;
+}
+
+static void route_free(const struct messaging_transport *xport, struct messaging_route *route)
+{
+    for (uint32_t i = 0; i < route->count; i++)
+        xport_addr_free(xport, route->addrs[i]);
+    free(route->ids);
+    free(route->addrs);
+    free(route);
+}
+
+void messaging_routes_put(messaging_routes_t r, struct messaging_route *route)
+{
+    if (route && __atomic_sub_fetch(&route->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        route_free(r->xport, route);
+}
+
+void messaging_routes_destroy(messaging_routes_t r)
+{
+    struct route_entry *e, *next;
+
+    if (!r)
+        return;
+    for (size_t b = 0; b <= r->mask; b++) {
+        for (e = r->buckets[b]; e; e = next) {
+            next = e->next;
+            messaging_routes_put(r, e->route);
+            free(e->namesp);
+            free(e->topic);
+            free(e);
+        }
+    }
+    ABT_rwlock_free(&r->lock);
+    free(r->buckets);
+    free(r->epochs);
+    free(r);
+}
+
+static struct route_entry *find(messaging_routes_t r, uint64_t hash, int server,
+        const char *namesp, const char *topic)
+{
+    struct route_entry *e;
+
+    for (e = r->buckets[hash & r->mask]; e; e = e->next)
+        if (e->hash == hash && e->server == server &&
+                strcmp(e->topic, topic) == 0 && strcmp(e->namesp, namesp) == 0)
+            return e;
+    return NULL;
+}
+
+/* back to counting; called with the write lock held */
+static void reset(messaging_routes_t r, struct route_entry *e)
+{
+    if (e->state == ROUTE_READY) {
+        messaging_routes_put(r, e->route);
+        e->route = NULL;
+        e->state = ROUTE_COUNTING;
+    }
+    /* a fetch in flight is checked against the epoch when it lands */
+    e->publishes = 0;
+}
+
+struct messaging_route *messaging_routes_get(messaging_routes_t r, int server,
+        const char *namesp, const char *topic, int *fetch)
+{
+    uint64_t hash = wire_topic_hash(namesp, topic);
+    struct messaging_route *route = NULL;
+    struct route_entry *e;
+    int counting = ROUTE_COUNTING;
+
+    *fetch = 0;
+    ABT_rwlock_rdlock(r->lock);
+    e = find(r, hash, server, namesp, topic);
+    if (e) {
+        if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == ROUTE_READY) {
+            route = e->route;
+            __atomic_add_fetch(&route->refs, 1, __ATOMIC_RELAXED);
+        } else if (__atomic_add_fetch(&e->publishes, 1, __ATOMIC_RELAXED) >= r->threshold) {
+            *fetch = __atomic_compare_exchange_n(&e->state, &counting, ROUTE_FETCHING, 0,
+                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        }
+        ABT_rwlock_unlock(r->lock);
+        return route;
+    }
+    ABT_rwlock_unlock(r->lock);
+
+    ABT_rwlock_wrlock(r->lock);
+    if (!find(r, hash, server, namesp, topic) && r->num_topics < r->max_topics &&
+            (e = calloc(1, sizeof(*e))) != NULL) {
+        e->hash = hash;
+        e->server = server;
+        e->namesp = strdup(namesp);
+        e->topic = strdup(topic);
+        if (!e->namesp || !e->topic) {
+            free(e->namesp);
+            free(e->topic);
+            free(e);
+        } else {
+            e->publishes = 1;
+            if (e->publishes >= r->threshold) {
+                e->state = ROUTE_FETCHING;
+                *fetch = 1;
+            }
+            e->next = r->buckets[hash & r->mask];
+            r->buckets[hash & r->mask] = e;
+            r->num_topics++;
+        }
+    }
+    ABT_rwlock_unlock(r->lock);
+    return NULL;
+}
+
+/*
+ * Encoding: a format byte, the epoch and the number of subscribers as
+ * varints, then each subscriber's id, address length and address.
+ */
+
+int messaging_route_encode(uint64_t epoch, const uint32_t *ids, const char **addrs,
+        uint32_t count, void **buf, size_t *len)
+{
+    size_t n = 1 + wire_varint_size(epoch) + wire_varint_size(count);
+    uint8_t *p;
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t l = strlen(addrs[i]);
+        n += wire_varint_size(ids[i]) + wire_varint_size(l) + l;
+    }
+    if (!(p = messaging_pool_alloc(n)))
+        return MESSAGING_ERR_ALLOCATION;
+    *buf = p;
+    *len = n;
+    *p++ = MESSAGING_ROUTE_FORMAT;
+    p += wire_put_varint(p, epoch);
+    p += wire_put_varint(p, count);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t l = strlen(addrs[i]);
+        p += wire_put_varint(p, ids[i]);
+        p += wire_put_varint(p, l);
+        memcpy(p, addrs[i], l);
+        p += l;
+    }
+    return MESSAGING_SUCCESS;
+}
+
+/* parses buf and resolves the addresses */
+static int decode(messaging_routes_t r, const void *buf, size_t len,
+        struct messaging_route **out)
+{
+    const uint8_t *p = buf, *end = p + len;
+    struct messaging_route *route;
+    char addr[ROUTE_ADDR_MAX];
+    uint64_t epoch, count, v, l;
+    size_t c;
+
+    if (len < 1 || *p++ != MESSAGING_ROUTE_FORMAT)
+        return MESSAGING_ERR_PROTOCOL;
+    if ((c = wire_get_varint(p, end, &epoch)) == 0)
+        return MESSAGING_ERR_PROTOCOL;
+    p += c;
+    /* every subscriber takes at least three bytes */
+    if ((c = wire_get_varint(p, end, &count)) == 0 || count > (uint64_t)(end - p) / 3)
+        return MESSAGING_ERR_PROTOCOL;
+    p += c;
+    if (!(route = calloc(1, sizeof(*route))))
+        return MESSAGING_ERR_ALLOCATION;
+    route->epoch = epoch;
+    route->ids = malloc((count + 1) * sizeof(*route->ids));
+    route->addrs = malloc((count + 1) * sizeof(*route->addrs));
+    if (!route->ids || !route->addrs) {
+        route_free(r->xport, route);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if ((c = wire_get_varint(p, end, &v)) == 0 || v > UINT32_MAX)
+            goto bad;
+        p += c;
+        if ((c = wire_get_varint(p, end, &l)) == 0 || l >= sizeof(addr) ||
+                l > (uint64_t)(end - p - c))
+            goto bad;
+        p += c;
+        memcpy(addr, p, l);
+        addr[l] = '\0';
+        p += l;
+        if (xport_lookup(r->xport, addr, &route->addrs[route->count]) != HG_SUCCESS) {
+            route_free(r->xport, route);
+            return MESSAGING_ERR_MERCURY;
+        }
+        route->ids[route->count++] = (uint32_t)v;
+    }
+    if (p != end)
+        goto bad;
+    *out = route;
+    return MESSAGING_SUCCESS;
+bad:
+    route_free(r->xport, route);
+    return MESSAGING_ERR_PROTOCOL;
+}
+
+int messaging_routes_install(messaging_routes_t r, int server, const char *namesp,
+        const char *topic, const void *buf, size_t len)
+{
+    struct messaging_route *route = NULL;
+    struct route_entry *e;
+    int ret = buf ? decode(r, buf, len, &route) : MESSAGING_ERR_INVALID_ARG;
+
+    ABT_rwlock_wrlock(r->lock);
+    e = find(r, wire_topic_hash(namesp, topic), server, namesp, topic);
+    if (e && e->state == ROUTE_FETCHING) {
+        /* an invalidation overtook the answer, it may be stale */
+        if (ret == MESSAGING_SUCCESS && route->epoch < r->epochs[server])
+            ret = MESSAGING_ERR_UNKNOWN_OBJ;
+        if (ret == MESSAGING_SUCCESS) {
+            route->refs = 1;
+            route->entry = e;
+            e->route = route;
+            route = NULL;
+            __atomic_store_n(&e->state, ROUTE_READY, __ATOMIC_RELEASE);
+        } else {
+            e->state = ROUTE_COUNTING;
+            e->publishes = 0;
+        }
+    }
+    ABT_rwlock_unlock(r->lock);
+    if (route)
+        route_free(r->xport, route);
+    return ret;
+}
+
+void messaging_routes_invalidate(messaging_routes_t r, int server, const char *namesp,
+        const char *topic, uint64_t epoch)
+{
+    struct route_entry *e;
+
+    if (server < 0 || server >= r->num_servers)
+        return;
+    ABT_rwlock_wrlock(r->lock);
+    if (epoch > r->epochs[server])
+        r->epochs[server] = epoch;
+    if (topic) {
+        if ((e = find(r, wire_topic_hash(namesp, topic), server, namesp, topic)) != NULL)
+            reset(r, e);
+    } else {
+        for (size_t b = 0; b <= r->mask; b++)
+            for (e = r->buckets[b]; e; e = e->next)
+                if (e->server == server)
+                    reset(r, e);
+    }
+    ABT_rwlock_unlock(r->lock);
+}
+
+void messaging_routes_drop(messaging_routes_t r, struct messaging_route *route)
+{
+    struct route_entry *e = route->entry;
+
+    ABT_rwlock_wrlock(r->lock);
+    if (e->route == route)
+        reset(r, e);
+    ABT_rwlock_unlock(r->lock);
+}
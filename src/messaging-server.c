@@ -40,6 +40,16 @@
 #include <errno.h>
 #include <assert.h>
 #include <messaging-server.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-arena.h>
+#include <messaging-bootstrap.h>
+#include <messaging-stats.h>
+#include <messaging-trace.h>
+#include <messaging-transport.h>
+#include <messaging-capture.h>
+#include <messaging-filter.h>
+#include <messaging-route.h>
 #include <CppWrapper.h>
 #include <vector.h>
 #include <abt.h>
@@ -53,18 +63,97 @@ struct messaging_server{
     hg_id_t notify_id;
     hg_id_t finalize_id;
     WrapperMap *t;
-    //ABT_rwlock lock;
+    messaging_arena_t arena;
+    struct messaging_server_list group;
+    hg_id_t group_id;
+    hg_id_t register_id;
+    hg_addr_t *sub_addrs;    /* resolved address of each subscriber id */
+    size_t num_sub_addrs;
+    ABT_rwlock lock;         /* guards t and sub_addrs */
+    messaging_stats_t stats;
+    hg_id_t stats_id;
+    char *stats_file;        /* MESSAGING_STATS_FILE, NULL if not dumping */
+    int stats_interval_ms;
+    ABT_thread dumper;
+    int dumper_stop;
+    char instance[256];      /* our address, labels the dumped metrics */
+    int tracing;             /* holds a reference on the process tracer */
+    char *addr_str;          /* our own address */
+    struct messaging_transport xport;  /* carries notifications and responses */
+    messaging_capture_t capture;       /* MESSAGING_CAPTURE, NULL if not recording */
+    messaging_filter_t filter;         /* topics with subscribers, guarded by lock */
+    uint32_t *listeners;               /* subscriber ids of publishers following the filter */
+    size_t num_listeners;
+    size_t max_listeners;
+    hg_id_t filter_id;
+    hg_id_t filter_update_id;
+    messaging_filter_t routed;         /* topics whose subscribers were handed out */
+    uint32_t *route_watchers;          /* subscriber ids of publishers holding routes */
+    size_t num_route_watchers;
+    size_t max_route_watchers;
+    uint64_t route_epoch;              /* bumped by every route invalidation */
+    double push_timeout_ms;            /* MESSAGING_PUSH_TIMEOUT */
+    hg_id_t route_id;
+    hg_id_t route_invalidate_id;
+    uint16_t provider_id;              /* the Margo provider serving our RPCs */
+    ABT_pool pool;                     /* our own pool, ABT_POOL_NULL for margo's handler pool */
+    ABT_xstream xstream;               /* runs pool, pinned to a core */
+    messaging_server_t *providers;     /* every provider of the process, on provider 0 only */
+    int num_providers;
+    ABT_mutex fanout_lock;             /* MESSAGING_SERIAL_FANOUT, one publish fans out at a time */
+    hg_id_t pub_oneway_id;
+    hg_id_t notify_oneway_id;
+    int notify_oneway;                 /* MESSAGING_NOTIFY_ONEWAY */
+    int notify_ack_every;              /* every nth fan-out is acknowledged anyway, 0 never */
+    uint64_t fanouts;
 };
 
+#define STATS_DUMP_POLL_MS 100   /* how quickly the dumper notices server_destroy */
+#define PROVIDER_SEP       '#'   /* server list entries name providers as "address#n" */
+#define PROVIDER_SHARED    (-2)  /* a provider serving from margo's handler pool */
+#define NOTIFY_ACK_EVERY   64    /* default MESSAGING_NOTIFY_ACK_EVERY */
+#define PUSH_TIMEOUT_MS    1000  /* default MESSAGING_PUSH_TIMEOUT */
+
 DECLARE_MARGO_RPC_HANDLER(publish_rpc);
+DECLARE_MARGO_RPC_HANDLER(publish_oneway_rpc);
 DECLARE_MARGO_RPC_HANDLER(subscribe_rpc);
 DECLARE_MARGO_RPC_HANDLER(unsubscribe_rpc);
 DECLARE_MARGO_RPC_HANDLER(client_finalize_rpc);
+DECLARE_MARGO_RPC_HANDLER(register_rpc);
+DECLARE_MARGO_RPC_HANDLER(get_stats_rpc);
+DECLARE_MARGO_RPC_HANDLER(filter_rpc);
+DECLARE_MARGO_RPC_HANDLER(route_rpc);
 
 static void publish_rpc(hg_handle_t h);
+static void publish_oneway_rpc(hg_handle_t h);
 static void subscribe_rpc(hg_handle_t h);
 static void unsubscribe_rpc(hg_handle_t h);
 static void client_finalize_rpc(hg_handle_t h);
+static void register_rpc(hg_handle_t h);
+static void get_stats_rpc(hg_handle_t h);
+static void filter_rpc(hg_handle_t h);
+static void route_rpc(hg_handle_t h);
+
+/* the server list entries of all our providers, back to back */
+static char *provider_entries(messaging_server_t server, int *len)
+{
+    int total = 0, off = 0;
+    char *buf;
+
+    for(int i = 0; i < server->num_providers; i++)
+        total += (int)strlen(server->providers[i]->addr_str) + 1;
+    buf = malloc(total);
+    if(buf == NULL)
+        return NULL;
+    for(int i = 0; i < server->num_providers; i++){
+        size_t n = strlen(server->providers[i]->addr_str) + 1;
+
+        memcpy(buf + off, server->providers[i]->addr_str, n);
+        off += (int)n;
+    }
+    *len = total;
+    return buf;
+}
 
 static int write_address(messaging_server_t server, MPI_Comm comm){
 
@@ -82,6 +171,8 @@ static int write_address(messaging_server_t server, MPI_Comm comm){
     int *sizes = NULL;
     int *sizes_psum = NULL;
     char **addr_strs = NULL;
+    const char *file_name;
+    int num_addrs;
 
     hret = margo_addr_self(server->mid, &my_addr);
     if(hret != HG_SUCCESS) {
@@ -104,12 +195,22 @@ static int write_address(messaging_server_t server, MPI_Comm comm){
         ret = -1;
         goto errorfree;
     }
-    fprintf(stdout,"Server running at %s\n", my_addr_str);
+    if(server->num_providers > 1)
+        fprintf(stdout,"Server running at %s with %d providers\n", my_addr_str, server->num_providers);
+    else
+        fprintf(stdout,"Server running at %s\n", my_addr_str);
     margo_addr_free(server->mid, my_addr);
+    free(my_addr_str);
 
+    /* every rank contributes an entry per provider */
+    my_addr_str = provider_entries(server, &self_addr_str_size);
+    if(my_addr_str == NULL) {
+        ret = -1;
+        goto error;
+    }
     sizes = malloc(comm_size * sizeof(*sizes));
-    self_addr_str_size = (int)strlen(my_addr_str) + 1;
     MPI_Allgather(&self_addr_str_size, 1, MPI_INT, sizes, 1, MPI_INT, comm);
+    MPI_Allreduce(&server->num_providers, &num_addrs, 1, MPI_INT, MPI_SUM, comm);
 
     int addr_buf_size = 0;
     for (int i = 0; i < comm_size; ++i)
@@ -123,42 +224,55 @@ static int write_address(messaging_server_t server, MPI_Comm comm){
         sizes_psum[i] = sizes_psum[i-1] + sizes[i-1];
 
     addr_str_buf = malloc(addr_buf_size);
-    MPI_Gatherv(my_addr_str, self_addr_str_size, MPI_CHAR, addr_str_buf, sizes, sizes_psum, MPI_CHAR, 0, comm);
-    if(rank==0){
-        
-        for (int i = 1; i < comm_size; ++i)
+    /* every server keeps the group view so any of them can bootstrap clients */
+    MPI_Allgatherv(my_addr_str, self_addr_str_size, MPI_CHAR, addr_str_buf, sizes, sizes_psum, MPI_CHAR, comm);
+    server->group.addrs = addr_str_buf;
+    server->group.addrs_len = addr_buf_size;
+    server->group.num_addrs = num_addrs;
+
+    file_name = messaging_bootstrap_file();
+    if(rank==0 && file_name != NULL){
+        char *tmp_name = malloc(strlen(file_name) + 5);
+        char *file_buf = malloc(addr_buf_size);
+        int fd;
+
+        /* clients may be polling for the file, write it under another name
+         * and rename it so they never see it half written */
+        sprintf(tmp_name, "%s.tmp", file_name);
+        memcpy(file_buf, addr_str_buf, addr_buf_size);
+        for (int i = 0; i < addr_buf_size; ++i)
         {
-            addr_str_buf[sizes_psum[i]-1]='\n';
+            if (file_buf[i] == '\0')
+                file_buf[i] = '\n';
         }
-        addr_str_buf[addr_buf_size-1]='\n';
 
-        int fd;
-        fd = open("servids.0", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
         if (fd < 0)
         {
             fprintf(stderr, "ERROR: unable to write server_ids into file\n");
             ret = -1;
-            goto errorfree;
-
         }
-        int bytes_written = 0;
-        bytes_written = write(fd, addr_str_buf, addr_buf_size);
-        if (bytes_written != addr_buf_size)
+        else if (write(fd, file_buf, addr_buf_size) != addr_buf_size)
         {
             fprintf(stderr, "ERROR: unable to write server_ids into opened file\n");
             ret = -1;
-            free(addr_str_buf);
+        }
+        if (fd >= 0)
             close(fd);
-            goto errorfree;
-
+        if (ret == 0 && rename(tmp_name, file_name) != 0)
+        {
+            fprintf(stderr, "ERROR: unable to rename %s to %s\n", tmp_name, file_name);
+            ret = -1;
         }
-        close(fd);
+        free(tmp_name);
+        free(file_buf);
+        if (ret != 0)
+            goto error;
     }
 //    margo_addr_free(server->mid, my_addr);
     free(my_addr_str);
     free(sizes);
     free(sizes_psum);
-    free(addr_str_buf);
 
 finish:
     return ret;
@@ -170,7 +284,182 @@ error:
 }
 
 
-int server_init(margo_instance_id mid, MPI_Comm comm, messaging_server_t* sv)
+/* a snapshot of the counters plus what the subscription table holds now */
+static void server_fill_stats(messaging_server_t server, struct messaging_server_stats *s)
+{
+    size_t topics, subscribers;
+
+    messaging_stats_snapshot(server->stats, s);
+    ABT_rwlock_rdlock(server->lock);
+    map_table_sizes(server->t, &topics, &subscribers);
+    s->topics = topics;
+    s->subscribers = subscribers;
+    s->membership_bytes = map_membership_bytes(server->t);
+    for(uint32_t i = 0; i < s->num_top; i++)
+        s->top[i].subscribers = map_get_value(server->t, s->top[i].namesp, s->top[i].topic, NULL, 0);
+    ABT_rwlock_unlock(server->lock);
+}
+
+static void stats_dump(messaging_server_t server)
+{
+    struct messaging_server_stats *s;
+    size_t len = strlen(server->stats_file);
+    char *tmp;
+    FILE *f;
+
+    s = (struct messaging_server_stats*)malloc(sizeof(*s));
+    tmp = (char*)malloc(len + 5);
+    if(s == NULL || tmp == NULL)
+        goto out;
+    server_fill_stats(server, s);
+    /* write aside and rename so scrapers never see a partial file */
+    memcpy(tmp, server->stats_file, len);
+    memcpy(tmp + len, ".tmp", 5);
+    f = fopen(tmp, "w");
+    if(f == NULL){
+        fprintf(stderr, "Warning: could not write statistics to %s (%s)\n", tmp, strerror(errno));
+        goto out;
+    }
+    messaging_stats_write_prometheus(f, s, server->instance);
+    if(fclose(f) == 0)
+        rename(tmp, server->stats_file);
+out:
+    free(tmp);
+    free(s);
+}
+
+static void stats_dumper(void *arg)
+{
+    messaging_server_t server = (messaging_server_t)arg;
+    int waited = 0;
+
+    while(!__atomic_load_n(&server->dumper_stop, __ATOMIC_ACQUIRE)){
+        margo_thread_sleep(server->mid, STATS_DUMP_POLL_MS);
+        waited += STATS_DUMP_POLL_MS;
+        if(waited >= server->stats_interval_ms){
+            stats_dump(server);
+            waited = 0;
+        }
+    }
+}
+
+/* starts dumping statistics if MESSAGING_STATS_FILE is set; with several
+ * servers each rank appends .<rank> to the file name, and providers other
+ * than the first .p<provider> */
+static void stats_dump_start(messaging_server_t server, int rank, int size)
+{
+    const char *file = getenv("MESSAGING_STATS_FILE");
+    const char *s;
+    ABT_pool pool;
+
+    server->dumper = ABT_THREAD_NULL;
+    if(file == NULL || *file == '\0')
+        return;
+    server->stats_interval_ms = 10000;
+    if((s = getenv("MESSAGING_STATS_INTERVAL")) != NULL && atof(s) > 0)
+        server->stats_interval_ms = (int)(atof(s) * 1000);
+
+    server->stats_file = (char*)malloc(strlen(file) + 24);
+    if(server->stats_file == NULL)
+        return;
+    if(size > 1)
+        sprintf(server->stats_file, "%s.%d", file, rank);
+    else
+        strcpy(server->stats_file, file);
+    if(server->provider_id != MARGO_DEFAULT_PROVIDER_ID)
+        sprintf(server->stats_file + strlen(server->stats_file), ".p%u", server->provider_id);
+
+    snprintf(server->instance, sizeof(server->instance), "%s", server->addr_str);
+
+    margo_get_handler_pool(server->mid, &pool);
+    if(ABT_thread_create(pool, stats_dumper, server, ABT_THREAD_ATTR_NULL, &server->dumper) != ABT_SUCCESS){
+        fprintf(stderr, "Warning: could not start the statistics dumper\n");
+        server->dumper = ABT_THREAD_NULL;
+    }
+}
+
+static void stats_dump_stop(messaging_server_t server)
+{
+    if(server->dumper != ABT_THREAD_NULL){
+        __atomic_store_n(&server->dumper_stop, 1, __ATOMIC_RELEASE);
+        ABT_thread_join(server->dumper);
+        ABT_thread_free(&server->dumper);
+        /* one last time, so short runs leave something behind */
+        stats_dump(server);
+    }
+    free(server->stats_file);
+    server->stats_file = NULL;
+}
+
+/* our address as a string, NULL if Mercury cannot tell */
+static char *self_address(margo_instance_id mid)
+{
+    hg_addr_t self;
+    hg_size_t len;
+    char *str = NULL;
+
+    if(margo_addr_self(mid, &self) != HG_SUCCESS)
+        return NULL;
+    if(margo_addr_to_string(mid, NULL, &len, self) == HG_SUCCESS && (str = malloc(len)) != NULL &&
+            margo_addr_to_string(mid, str, &len, self) != HG_SUCCESS){
+        free(str);
+        str = NULL;
+    }
+    margo_addr_free(mid, self);
+    return str;
+}
+
+static void capture_start(messaging_server_t server, int rank, int size)
+{
+    struct messaging_capture_config cfg;
+    size_t len;
+
+    messaging_capture_config_init(&cfg);
+    if(cfg.path[0] == '\0')
+        return;
+    len = strlen(cfg.path);
+    if(size > 1)
+        snprintf(cfg.path + len, sizeof(cfg.path) - len, ".%d", rank);
+    len = strlen(cfg.path);
+    if(server->provider_id != MARGO_DEFAULT_PROVIDER_ID)
+        snprintf(cfg.path + len, sizeof(cfg.path) - len, ".p%u", server->provider_id);
+    if(messaging_capture_open(&cfg, rank, &server->capture) != MESSAGING_SUCCESS)
+        server->capture = NULL;
+}
+
+/* who published a message, for the capture: a hash of its address */
+static uint32_t capture_publisher(messaging_server_t server, hg_addr_t addr)
+{
+    char buf[256];
+    hg_size_t len = sizeof(buf);
+
+    if(margo_addr_to_string(server->mid, buf, &len, addr) != HG_SUCCESS)
+        return 0;
+    return (uint32_t)wire_topic_hash(buf, "");
+}
+
+/* a pool and an xstream of the provider's own, pinned to cpu unless it is negative */
+static int provider_xstream(messaging_server_t server, int cpu)
+{
+    if(ABT_pool_create_basic(ABT_POOL_FIFO, ABT_POOL_ACCESS_MPMC, ABT_TRUE, &server->pool) != ABT_SUCCESS){
+        server->pool = ABT_POOL_NULL;
+        return MESSAGING_ERR_ARGOBOTS;
+    }
+    if(ABT_xstream_create_basic(ABT_SCHED_DEFAULT, 1, &server->pool, ABT_SCHED_CONFIG_NULL,
+                &server->xstream) != ABT_SUCCESS){
+        server->xstream = ABT_XSTREAM_NULL;
+        return MESSAGING_ERR_ARGOBOTS;
+    }
+    if(cpu >= 0 && ABT_xstream_set_cpubind(server->xstream, cpu) != ABT_SUCCESS)
+        fprintf(stderr, "Warning: could not pin provider %u to core %d\n", server->provider_id, cpu);
+    return MESSAGING_SUCCESS;
+}
+
+/* everything but making the server known to clients; rank and size place
+ * it in its group.  The RPCs are served by provider, on margo's handler
+ * pool if cpu is PROVIDER_SHARED and on an xstream of their own otherwise */
+static int server_setup(margo_instance_id mid, int rank, int size, uint16_t provider, int cpu,
+        messaging_server_t* sv)
 {
     
     messaging_server_t server = (messaging_server_t)calloc(1, sizeof(*server));
@@ -179,43 +468,146 @@ int server_init(margo_instance_id mid, MPI_Comm comm, messaging_server_t* sv)
     int ret = 0;
 
     hg_return_t hret  = HG_SUCCESS;
+    struct messaging_trace_config tcfg;
+    const char *s;
     server->mid = mid;
+    server->provider_id = provider;
+    server->pool = ABT_POOL_NULL;
+    server->xstream = ABT_XSTREAM_NULL;
+    messaging_transport_margo(mid, &server->xport);
+    server->addr_str = self_address(mid);
+    if(server->addr_str == NULL){
+        free(server);
+        return MESSAGING_ERR_MERCURY;
+    }
+    if(provider != MARGO_DEFAULT_PROVIDER_ID){
+        char *entry = malloc(strlen(server->addr_str) + 8);
 
-    ret = write_address(server, comm);
-    if(ret!=0)
-        goto finish;
+        if(entry == NULL){
+            free(server->addr_str);
+            free(server);
+            return MESSAGING_ERR_ALLOCATION;
+        }
+        sprintf(entry, "%s%c%u", server->addr_str, PROVIDER_SEP, provider);
+        free(server->addr_str);
+        server->addr_str = entry;
+    }
+    if(cpu != PROVIDER_SHARED && (ret = provider_xstream(server, cpu)) != MESSAGING_SUCCESS){
+        if(server->xstream == ABT_XSTREAM_NULL && server->pool != ABT_POOL_NULL)
+            ABT_pool_free(&server->pool);
+        free(server->addr_str);
+        free(server);
+        return ret;
+    }
 
+    /* what clients send us goes to our provider and runs on our pool */
     hg_bool_t flag;
     hg_id_t id;
-    margo_registered_name(server->mid, "publish_rpc", &id, &flag);
+    ABT_pool pool = server->pool;
+    margo_provider_registered_name(mid, "publish_rpc", provider, &id, &flag);
 
     if(flag == HG_TRUE) { /* RPCs already registered */
-        margo_registered_name(mid, "publish_rpc",                   &server->pub_id,                   &flag);
-        margo_registered_name(mid, "subscribe_rpc",                   &server->sub_id,                   &flag);
-        margo_registered_name(mid, "unsubscribe_rpc",                   &server->unsub_id,                   &flag);
-        margo_registered_name(mid, "notify_rpc",                   &server->notify_id,                   &flag);
-        margo_registered_name(mid, "client_finalize_rpc",                   &server->finalize_id,                   &flag);
+        margo_provider_registered_name(mid, "publish_rpc",          provider, &server->pub_id,      &flag);
+        margo_provider_registered_name(mid, "subscribe_rpc",        provider, &server->sub_id,      &flag);
+        margo_provider_registered_name(mid, "unsubscribe_rpc",      provider, &server->unsub_id,    &flag);
+        margo_provider_registered_name(mid, "client_finalize_rpc",  provider, &server->finalize_id, &flag);
+        margo_provider_registered_name(mid, "register_rpc",         provider, &server->register_id, &flag);
+        margo_provider_registered_name(mid, "server_get_stats_rpc", provider, &server->stats_id,    &flag);
+        margo_provider_registered_name(mid, "filter_rpc",           provider, &server->filter_id,   &flag);
+        margo_provider_registered_name(mid, "route_rpc",            provider, &server->route_id,    &flag);
+        margo_provider_registered_name(mid, "publish_oneway_rpc",   provider, &server->pub_oneway_id, &flag);
    
     } else {
 
         server->pub_id =
-            MARGO_REGISTER(mid, "publish_rpc", bulk_data_t, response_t, publish_rpc);
+            MARGO_REGISTER_PROVIDER(mid, "publish_rpc", message_t, response_t, publish_rpc, provider, pool);
         margo_register_data(mid, server->pub_id, (void*)server, NULL);
         server->sub_id =
-            MARGO_REGISTER(mid, "subscribe_rpc", bulk_data_t, response_t, subscribe_rpc);
+            MARGO_REGISTER_PROVIDER(mid, "subscribe_rpc", bulk_data_t, response_t, subscribe_rpc, provider, pool);
         margo_register_data(mid, server->sub_id, (void*)server, NULL);
         server->unsub_id =
-            MARGO_REGISTER(mid, "unsubscribe_rpc", bulk_data_t, response_t, unsubscribe_rpc);
+            MARGO_REGISTER_PROVIDER(mid, "unsubscribe_rpc", bulk_data_t, response_t, unsubscribe_rpc, provider, pool);
         margo_register_data(mid, server->unsub_id, (void*)server, NULL);
-        server->notify_id =
-            MARGO_REGISTER(mid, "notify_rpc", bulk_data_t, response_t, NULL);
         server->finalize_id =
-            MARGO_REGISTER(mid, "client_finalize_rpc", bulk_data_t, response_t, client_finalize_rpc);
+            MARGO_REGISTER_PROVIDER(mid, "client_finalize_rpc", bulk_data_t, response_t, client_finalize_rpc,
+                    provider, pool);
         margo_register_data(mid, server->finalize_id, (void*)server, NULL);
+        server->register_id =
+            MARGO_REGISTER_PROVIDER(mid, "register_rpc", bulk_data_t, register_out_t, register_rpc, provider, pool);
+        margo_register_data(mid, server->register_id, (void*)server, NULL);
+        server->stats_id =
+            MARGO_REGISTER_PROVIDER(mid, "server_get_stats_rpc", void, stats_out_t, get_stats_rpc, provider, pool);
+        margo_register_data(mid, server->stats_id, (void*)server, NULL);
+        server->filter_id =
+            MARGO_REGISTER_PROVIDER(mid, "filter_rpc", bulk_data_t, stats_out_t, filter_rpc, provider, pool);
+        margo_register_data(mid, server->filter_id, (void*)server, NULL);
+        server->route_id =
+            MARGO_REGISTER_PROVIDER(mid, "route_rpc", bulk_data_t, stats_out_t, route_rpc, provider, pool);
+        margo_register_data(mid, server->route_id, (void*)server, NULL);
+        server->pub_oneway_id =
+            MARGO_REGISTER_PROVIDER(mid, "publish_oneway_rpc", message_t, void, publish_oneway_rpc, provider, pool);
+        margo_register_data(mid, server->pub_oneway_id, (void*)server, NULL);
+        margo_registered_disable_response(mid, server->pub_oneway_id, HG_TRUE);
 
     }
+
+    /* what we send goes to the clients' default provider, registered once
+     * for all our providers */
+    margo_registered_name(mid, "notify_rpc", &id, &flag);
+    if(flag == HG_TRUE) {
+        margo_registered_name(mid, "notify_rpc",           &server->notify_id,           &flag);
+        margo_registered_name(mid, "filter_update_rpc",    &server->filter_update_id,    &flag);
+        margo_registered_name(mid, "route_invalidate_rpc", &server->route_invalidate_id, &flag);
+        margo_registered_name(mid, "notify_oneway_rpc",    &server->notify_oneway_id,    &flag);
+    } else {
+        server->notify_id =
+            MARGO_REGISTER(mid, "notify_rpc", message_t, response_t, NULL);
+        server->filter_update_id =
+            MARGO_REGISTER(mid, "filter_update_rpc", bulk_data_t, response_t, NULL);
+        server->route_invalidate_id =
+            MARGO_REGISTER(mid, "route_invalidate_rpc", bulk_data_t, response_t, NULL);
+        server->notify_oneway_id =
+            MARGO_REGISTER(mid, "notify_oneway_rpc", message_t, void, NULL);
+        margo_registered_disable_response(mid, server->notify_oneway_id, HG_TRUE);
+    }
     server->t=map_new();
-    //ABT_rwlock_create(&server->lock);
+    /* the group view lists every provider, provider 0 serves it */
+    if(provider == MARGO_DEFAULT_PROVIDER_ID)
+        server->group_id = messaging_bootstrap_serve(mid, &server->group);
+
+    struct messaging_arena_config cfg;
+    messaging_arena_config_init(&cfg);
+    ret = messaging_arena_create(mid, &cfg, &server->arena);
+    if(ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "Warning: server running without a registered arena (error %d)\n", ret);
+        server->arena = MESSAGING_ARENA_NULL;
+    }
+    ABT_rwlock_create(&server->lock);
+    server->fanout_lock = ABT_MUTEX_NULL;
+    if((s = getenv("MESSAGING_SERIAL_FANOUT")) != NULL && atoi(s) > 0)
+        ABT_mutex_create(&server->fanout_lock);
+    server->notify_oneway = (s = getenv("MESSAGING_NOTIFY_ONEWAY")) != NULL && atoi(s) > 0;
+    server->notify_ack_every = NOTIFY_ACK_EVERY;
+    if((s = getenv("MESSAGING_NOTIFY_ACK_EVERY")) != NULL)
+        server->notify_ack_every = atoi(s) > 0 ? atoi(s) : 0;
+    server->push_timeout_ms = PUSH_TIMEOUT_MS;
+    if((s = getenv("MESSAGING_PUSH_TIMEOUT")) != NULL && atof(s) > 0)
+        server->push_timeout_ms = atof(s);
+    ret = messaging_stats_create(&server->stats);
+    if(ret != MESSAGING_SUCCESS)
+        goto finish;
+    ret = messaging_filter_create(0, &server->filter);
+    if(ret != MESSAGING_SUCCESS)
+        goto finish;
+    ret = messaging_filter_create(0, &server->routed);
+    if(ret != MESSAGING_SUCCESS)
+        goto finish;
+    stats_dump_start(server, rank, size);
+    capture_start(server, rank, size);
+    messaging_trace_config_init(&tcfg);
+    if(tcfg.rate)
+        server->tracing = messaging_trace_start(mid, &tcfg) == MESSAGING_SUCCESS;
+
     *sv = server;
 
     return MESSAGING_SUCCESS;
@@ -223,26 +615,279 @@ finish:
     return ret;
 }
 
-int server_destroy(messaging_server_t server){
+/* the core provider p is pinned to, -1 for none */
+static int provider_cpu(int first_cpu, int p)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(first_cpu < 0)
+        return -1;
+    return (int)((first_cpu + p) % (ncpus > 0 ? ncpus : 1));
+}
+
+/* the MESSAGING_PROVIDERS providers of the process, each owning its share of
+ * the topics; the first one stands for all of them */
+static int providers_setup(margo_instance_id mid, int rank, int size, messaging_server_t* sv)
+{
+    const char *s = getenv("MESSAGING_PROVIDERS");
+    int n = s ? atoi(s) : 1, first_cpu, ret;
+    messaging_server_t server;
+
+    if(n < 1)
+        n = 1;
+    if(n > MESSAGING_PROVIDERS_MAX)
+        n = MESSAGING_PROVIDERS_MAX;
+    s = getenv("MESSAGING_PROVIDER_CPU");
+    first_cpu = s ? atoi(s) : 0;
+
+    /* alone, the provider keeps to margo's handler pool as it always has */
+    ret = server_setup(mid, rank, size, MARGO_DEFAULT_PROVIDER_ID,
+            n > 1 ? provider_cpu(first_cpu, 0) : PROVIDER_SHARED, &server);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    server->providers = (messaging_server_t*)calloc(n, sizeof(*server->providers));
+    if(server->providers == NULL){
+        server_destroy(server);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    server->providers[0] = server;
+    server->num_providers = 1;
+    for(int p = 1; p < n; p++){
+        ret = server_setup(mid, rank, size, (uint16_t)p, provider_cpu(first_cpu, p), &server->providers[p]);
+        if(ret != MESSAGING_SUCCESS){
+            server_destroy(server);
+            return ret;
+        }
+        server->num_providers++;
+    }
+    *sv = server;
+    return MESSAGING_SUCCESS;
+}
+
+int server_init(margo_instance_id mid, MPI_Comm comm, messaging_server_t* sv)
+{
+    messaging_server_t server;
+    int rank, size, ret;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    ret = providers_setup(mid, rank, size, &server);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+
+    /* publish our address only once the RPCs can be served */
+    ret = write_address(server, comm);
+    if(ret!=0)
+        return ret;
+
+    *sv = server;
+    return MESSAGING_SUCCESS;
+}
+
+int server_init_standalone(margo_instance_id mid, messaging_server_t* sv)
+{
+    messaging_server_t server;
+    int ret;
+
+    ret = providers_setup(mid, 0, 1, &server);
+    if(ret != MESSAGING_SUCCESS)
+        return ret;
+    server->group.addrs = provider_entries(server, &server->group.addrs_len);
+    if(server->group.addrs == NULL){
+        server_destroy(server);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    server->group.num_addrs = server->num_providers;
+    *sv = server;
+    return MESSAGING_SUCCESS;
+}
+
+const char *server_address(messaging_server_t server)
+{
+    return server->addr_str;
+}
+
+int server_num_providers(messaging_server_t server)
+{
+    return server->num_providers;
+}
+
+const char *server_provider_address(messaging_server_t server, int provider)
+{
+    if(provider < 0 || provider >= server->num_providers)
+        return NULL;
+    return server->providers[provider]->addr_str;
+}
+
+int server_set_transport(messaging_server_t server, const struct messaging_transport *xport)
+{
+    if(xport == NULL || xport->ops == NULL)
+        return MESSAGING_ERR_INVALID_ARG;
+    for(int p = 0; p < server->num_providers; p++){
+        messaging_server_t provider = server->providers[p];
+
+        ABT_rwlock_wrlock(provider->lock);
+        if(provider->num_sub_addrs > 0){
+            ABT_rwlock_unlock(provider->lock);
+            return MESSAGING_ERR_INVALID_ARG;
+        }
+        provider->xport = *xport;
+        ABT_rwlock_unlock(provider->lock);
+    }
+    return MESSAGING_SUCCESS;
+}
+
+/* tears down one provider, its RPCs first so nothing new reaches it */
+static void provider_destroy(messaging_server_t server)
+{
     margo_instance_id mid = server->mid;
 
     margo_deregister(mid, server->pub_id);
     margo_deregister(mid, server->sub_id);
     margo_deregister(mid, server->unsub_id);
+    if(server->provider_id == MARGO_DEFAULT_PROVIDER_ID)
+        margo_deregister(mid, server->group_id);
+    margo_deregister(mid, server->register_id);
+    margo_deregister(mid, server->stats_id);
+    margo_deregister(mid, server->filter_id);
+    margo_deregister(mid, server->route_id);
+    margo_deregister(mid, server->pub_oneway_id);
+    /* let the handlers already queued finish, the pool goes with the xstream */
+    if(server->xstream != ABT_XSTREAM_NULL){
+        ABT_xstream_join(server->xstream);
+        ABT_xstream_free(&server->xstream);
+    }
+    stats_dump_stop(server);
+    messaging_capture_close(server->capture);
+    if(server->tracing)
+        messaging_trace_stop();
     /* deregister other RPC ids ... */
-    //ABT_rwlock_wrlock(server->lock);
+    ABT_rwlock_wrlock(server->lock);
     map_delete(server->t);
-    //ABT_rwlock_unlock(server->lock);
-    //ABT_rwlock_free(&server->lock);
+    for (size_t i = 0; i < server->num_sub_addrs; i++)
+        if (server->sub_addrs[i] != HG_ADDR_NULL)
+            xport_addr_free(&server->xport, server->sub_addrs[i]);
+    free(server->sub_addrs);
+    free(server->listeners);
+    free(server->route_watchers);
+    messaging_filter_destroy(server->filter);
+    messaging_filter_destroy(server->routed);
+    ABT_rwlock_unlock(server->lock);
+    ABT_rwlock_free(&server->lock);
+    if(server->fanout_lock != ABT_MUTEX_NULL)
+        ABT_mutex_free(&server->fanout_lock);
     server->t = NULL;
+    messaging_arena_destroy(server->arena);
+    free(server->group.addrs);
+    messaging_stats_destroy(server->stats);
+    free(server->addr_str);
     free(server);
 }
 
-static void publish_rpc(hg_handle_t hndl)
+int server_destroy(messaging_server_t server){
+    messaging_server_t *providers = server->providers;
+
+    for(int p = server->num_providers - 1; p > 0; p--)
+        provider_destroy(providers[p]);
+    provider_destroy(server);
+    free(providers);
+    return MESSAGING_SUCCESS;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* removes from the sorted ids the subscribers the publisher already reached
+ * through shared memory, returns how many are left; the *dropped removed
+ * ones follow them */
+static int drop_excluded(const struct wire_msg *m, uint32_t *ids, int n, int *dropped)
+{
+    const uint8_t *data;
+    uint32_t *excl;
+    size_t len, num_excl, e = 0;
+    int i, k = 0, d = 0;
+
+    *dropped = 0;
+    if(!wire_ext_find(m, WIRE_EXT_EXCLUDE, (const void **)&data, &len) || len == 0 || len % 4 != 0)
+        return n;
+    num_excl = len / 4;
+    excl = (uint32_t*)messaging_pool_alloc(len);
+    if(excl == NULL)
+        return n;
+    for(e = 0; e < num_excl; e++)
+        excl[e] = wire_get_u32(data + 4*e);
+    qsort(excl, num_excl, sizeof(*excl), cmp_u32);
+
+    for(i = 0, e = 0; i < n; i++){
+        while(e < num_excl && excl[e] < ids[i])
+            e++;
+        /* excl[e] is used up, d <= e keeps the dropped ids there */
+        if(e < num_excl && excl[e] == ids[i]){
+            excl[d++] = ids[i];
+            continue;
+        }
+        ids[k++] = ids[i];
+    }
+    memcpy(ids + k, excl, d * sizeof(*ids));
+    messaging_pool_free(excl);
+    *dropped = d;
+    return k;
+}
+
+/* tells the subscribers a publisher reached itself which number its message
+ * got, so their reorder buffers move past it instead of waiting */
+static void notify_skipped(messaging_server_t server, const struct wire_msg *pm, uint64_t seq,
+        hg_addr_t *addrs, int n)
+{
+    struct wire_msg m;
+    message_t in;
+    hg_handle_t *handles;
+    margo_request *reqs;
+    int i;
+
+    wire_msg_init(&m, pm->namesp, pm->topic);
+    m.flags = WIRE_FLAG_SKIP;
+    m.seq = seq;
+    in.evnt.size = wire_encoded_size(&m);
+    in.evnt.raw_data = messaging_pool_alloc(in.evnt.size);
+    in.bulk = HG_BULK_NULL;
+    in.offset = 0;
+    handles = (hg_handle_t*)messaging_pool_alloc(n * sizeof(*handles));
+    reqs = (margo_request*)messaging_pool_alloc(n * sizeof(*reqs));
+    if(in.evnt.raw_data != NULL && handles != NULL && reqs != NULL){
+        wire_encode(in.evnt.raw_data, in.evnt.size, &m);
+        for(i = 0; i < n; i++){
+            handles[i] = HG_HANDLE_NULL;
+            if(xport_create(&server->xport, addrs[i], server->notify_oneway_id, &handles[i]) != HG_SUCCESS)
+                continue;
+            if(xport_iforward(&server->xport, handles[i], &in, &reqs[i]) != HG_SUCCESS){
+                xport_destroy(&server->xport, handles[i]);
+                handles[i] = HG_HANDLE_NULL;
+            }
+        }
+        for(i = 0; i < n; i++){
+            if(handles[i] == HG_HANDLE_NULL)
+                continue;
+            xport_wait(&server->xport, reqs[i]);
+            xport_destroy(&server->xport, handles[i]);
+        }
+    }
+    for(i = 0; i < n; i++)
+        xport_addr_free(&server->xport, addrs[i]);
+    messaging_pool_free(reqs);
+    messaging_pool_free(handles);
+    messaging_pool_free(in.evnt.raw_data);
+}
+
+/* a publish; with oneway the publisher is not waiting for an answer */
+static void publish_handle(hg_handle_t hndl, int oneway)
 {
     hg_return_t ret;
 
-    bulk_data_t in;
+    message_t in;
     response_t out;
 
     margo_instance_id mid = margo_hg_handle_get_instance(hndl);
@@ -250,89 +895,541 @@ static void publish_rpc(hg_handle_t hndl)
     const struct hg_info* info = margo_get_info(hndl);
     messaging_server_t server = (messaging_server_t)margo_registered_data(mid, info->id);
 
+    uint64_t start = wire_now_ns(), sent, trace_id = 0;
+    struct messaging_stats_xs *xs;
+    messaging_stats_in_flight(server->stats, 1);
+
     ret = margo_get_input(hndl, &in);
     assert(ret == HG_SUCCESS);
 
     int i;
-
-    int namespace_len, topic_len, tag_len;
-    char *namesp, *topic,  *tag_msg, *raw_buf;
-        
-    raw_buf = (char*) malloc(in.evnt.size);
-    memcpy(raw_buf, in.evnt.raw_data, in.evnt.size);
-    
-    namespace_len = ((int *)raw_buf)[0];
-    topic_len = ((int *)raw_buf)[1];
-  
-    namesp = (char *)malloc(namespace_len);
-    topic = (char *)malloc(topic_len);
-    memcpy(namesp, &raw_buf[sizeof(int)*3], namespace_len);
-    memcpy(topic, &raw_buf[sizeof(int)*3+namespace_len], topic_len);
-
-    vector sub_list;
-    //ABT_rwlock_rdlock(server->lock);
-    sub_list = map_get_value(server->t,  namesp, topic);
-    //ABT_rwlock_unlock(server->lock);
-
-    free(namesp);
-    free(topic);
-
-    out.ret = MESSAGING_SUCCESS;
-    ret = margo_respond(hndl, &out);
-    assert(ret == HG_SUCCESS);
-
-    int total_subscribers = VECTOR_TOTAL(sub_list);
+    struct wire_msg m;
+    struct messaging_arena_buf pbuf = {0};
+
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    /* nothing tells a one-way publisher when its buffer may be reused */
+    if(out.ret == MESSAGING_SUCCESS && oneway && (m.flags & WIRE_FLAG_BULK))
+        out.ret = MESSAGING_ERR_PROTOCOL;
+    if(out.ret == MESSAGING_SUCCESS && (m.flags & WIRE_FLAG_BULK)){
+        /* the publisher releases its buffer once we respond, pull it first */
+        out.ret = messaging_arena_pull(server->arena, mid, info->addr, in.bulk,
+                in.offset, m.payload_len, &pbuf);
+    }
+    if(out.ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "Publish dropped (error %d)\n", out.ret);
+        if(!oneway)
+            xport_respond(&server->xport, hndl, &out);
+        margo_free_input(hndl, &in);
+        xport_destroy(&server->xport, hndl);
+        messaging_stats_local(server->stats)->publish_errors++;
+        messaging_stats_in_flight(server->stats, -1);
+        return;
+    }
+    xs = messaging_stats_local(server->stats);
+    xs->publishes++;
+    xs->publishes_oneway += oneway;
+    xs->publish_bytes += m.payload_len;
+    messaging_hist_record(&xs->msg_size, m.payload_len);
+    messaging_stats_hot(&xs->hot, m.topic_hash, m.namesp, m.topic);
+    if(server->capture)
+        messaging_capture_record(server->capture, MESSAGING_CAPTURE_PUBLISH,
+                capture_publisher(server, info->addr), m.namesp, m.topic,
+                pbuf.ptr ? pbuf.ptr : m.payload, m.payload_len);
+    if(messaging_trace_enabled() && wire_ext_u64(&m, WIRE_EXT_TRACE, &trace_id))
+        messaging_trace_record(trace_id, MESSAGING_TRACE_SERVER_RECV, 0, start);
+
+    /* copy the subscriber ids and take a reference on their addresses
+     * under the lock, the notifications go out without it */
+    uint32_t *sub_ids = NULL;
+    hg_addr_t *sub_addrs = NULL;
+    int total_subscribers, num_skipped = 0;
+    uint64_t seq = 0;
+    if(server->fanout_lock != ABT_MUTEX_NULL)
+        ABT_mutex_lock(server->fanout_lock);
+    ABT_rwlock_rdlock(server->lock);
+    total_subscribers = (int)map_get_value(server->t, m.namesp, m.topic, NULL, 0);
+    if(total_subscribers > 0){
+        sub_ids = (uint32_t*)messaging_pool_alloc(sizeof(uint32_t)*total_subscribers);
+        sub_addrs = (hg_addr_t*)messaging_pool_alloc(sizeof(hg_addr_t)*total_subscribers);
+        if(sub_ids == NULL || sub_addrs == NULL){
+            fprintf(stderr, "Publish not delivered, out of memory for %d subscribers\n", total_subscribers);
+            total_subscribers = 0;
+        }
+        /* numbered under the lock, so the sequence follows the table; the
+         * subscribers the publisher reached itself are told the number too */
+        map_get_value_seq(server->t, m.namesp, m.topic, sub_ids, total_subscribers, &seq);
+        total_subscribers = drop_excluded(&m, sub_ids, total_subscribers, &num_skipped);
+        if(seq == 0)
+            num_skipped = 0;
+        for (i = 0; i < total_subscribers + num_skipped; ++i)
+            xport_addr_dup(&server->xport, server->sub_addrs[sub_ids[i]], &sub_addrs[i]);
+    }
+    ABT_rwlock_unlock(server->lock);
+    messaging_trace_record(trace_id, MESSAGING_TRACE_ROUTE_DONE, 0, trace_id ? wire_now_ns() : 0);
+    messaging_hist_record(&messaging_stats_local(server->stats)->fanout,
+            total_subscribers > 0 ? total_subscribers : 0);
+
+    if(!oneway){
+        ret = xport_respond(&server->xport, hndl, &out);
+        assert(ret == HG_SUCCESS);
+    }
+    if(seq)
+        wire_set_seq(in.evnt.raw_data, seq);
+    if(num_skipped > 0)
+        notify_skipped(server, &m, seq, sub_addrs + total_subscribers, num_skipped);
+
+    /* one-way notifications only fail if they cannot be sent; now and then
+     * one fan-out is acknowledged to catch subscribers that stopped
+     * answering.  Subscribers pull a bulk payload before answering, so
+     * those are always acknowledged */
+    int notify_oneway = server->notify_oneway && pbuf.ptr == NULL && (server->notify_ack_every == 0 ||
+            __atomic_add_fetch(&server->fanouts, 1, __ATOMIC_RELAXED) % server->notify_ack_every != 0);
+    hg_id_t notify_id = notify_oneway ? server->notify_oneway_id : server->notify_id;
 
     //now notify to all clients
     margo_request *serv_req;
     hg_handle_t *notify_hndl;
-    notify_hndl = (hg_handle_t*)malloc(sizeof(hg_handle_t)*total_subscribers);
-    serv_req = (margo_request*)malloc(sizeof(margo_request)*total_subscribers);
+    notify_hndl = (hg_handle_t*)messaging_pool_alloc(sizeof(hg_handle_t)*total_subscribers);
+    serv_req = (margo_request*)messaging_pool_alloc(sizeof(margo_request)*total_subscribers);
      
     //notify
+    sent = wire_now_ns();
     for (int i = 0; i < total_subscribers; ++i)
     {
-        char* client_addr;    
-        client_addr = VECTOR_GET(sub_list, char*, i);
-        //fprintf(stdout, "Sending notification to client %s\n", client_addr);
-
-        hg_addr_t cl_addr;
-        margo_addr_lookup(server->mid, client_addr, &cl_addr);
-
         hg_handle_t h;
-        margo_create(server->mid, cl_addr, server->notify_id, &h);
+        notify_hndl[i] = HG_HANDLE_NULL;
+        if(xport_create(&server->xport, sub_addrs[i], notify_id, &h) != HG_SUCCESS)
+            continue;
 
-        bulk_data_t notify_in;
+        /* subscribers get the publisher's message as is, and pull a
+         * bulk payload from our copy */
+        message_t notify_in;
         notify_in.evnt.size = in.evnt.size;
-        notify_in.evnt.raw_data = raw_buf;
+        notify_in.evnt.raw_data = in.evnt.raw_data;
+        notify_in.bulk = pbuf.ptr ? pbuf.bulk : HG_BULK_NULL;
+        notify_in.offset = pbuf.offset;
         margo_request req;
         //forward notification async to all subscribers
-        margo_iforward(h, &notify_in, &req); 
+        messaging_trace_record(trace_id, MESSAGING_TRACE_NOTIFY_SENT, sub_ids[i], trace_id ? wire_now_ns() : 0);
+        if(xport_iforward(&server->xport, h, &notify_in, &req) != HG_SUCCESS){
+            xport_destroy(&server->xport, h);
+            continue;
+        }
         notify_hndl[i] = h;
         serv_req[i] = req;
-        margo_addr_free(server->mid, cl_addr);
 
     }
     for (i = 0; i < total_subscribers; ++i){
-        margo_wait(serv_req[i]);
+        int nret = MESSAGING_ERR_MERCURY;
         response_t resp;
-        margo_get_output(notify_hndl[i], &resp);
-        ret = resp.ret;
-        margo_free_output(notify_hndl[i], &resp);
-        margo_destroy(notify_hndl[i]);
-        if(ret!=MESSAGING_SUCCESS){
-            fprintf(stderr, "Could not notify client %s \n", VECTOR_GET(sub_list, char*, i));
+        if(notify_hndl[i] != HG_HANDLE_NULL && xport_wait(&server->xport, serv_req[i]) == HG_SUCCESS){
+            if(notify_oneway){
+                nret = MESSAGING_SUCCESS;
+            } else if(xport_get_output(&server->xport, notify_hndl[i], &resp) == HG_SUCCESS){
+                nret = resp.ret;
+                xport_free_output(&server->xport, notify_hndl[i], &resp);
+            }
+        }
+        messaging_trace_record(trace_id, MESSAGING_TRACE_NOTIFY_DONE, sub_ids[i], trace_id ? wire_now_ns() : 0);
+        if(notify_hndl[i] != HG_HANDLE_NULL)
+            xport_destroy(&server->xport, notify_hndl[i]);
+        xport_addr_free(&server->xport, sub_addrs[i]);
+        /* waiting yields, we may be on another stream now */
+        xs = messaging_stats_local(server->stats);
+        xs->notifies++;
+        xs->notifies_oneway += notify_oneway;
+        if(nret!=MESSAGING_SUCCESS){
+            xs->notify_failures++;
+            fprintf(stderr, "Could not notify subscriber %u\n", sub_ids[i]);
             //return ret;
+        } else if(!notify_oneway) {
+            messaging_hist_record(&xs->notify_rtt_ns, wire_now_ns() - sent);
         }
         
     }
-    free(raw_buf);
+    if(server->fanout_lock != ABT_MUTEX_NULL)
+        ABT_mutex_unlock(server->fanout_lock);
+    messaging_pool_free(sub_ids);
+    messaging_pool_free(sub_addrs);
+    messaging_pool_free(notify_hndl);
+    messaging_pool_free(serv_req);
+    messaging_arena_release(server->arena, &pbuf);
     margo_free_input(hndl, &in);
-    margo_destroy(hndl);
+    xport_destroy(&server->xport, hndl);
+    messaging_hist_record(&messaging_stats_local(server->stats)->handler_ns, wire_now_ns() - start);
+    messaging_stats_in_flight(server->stats, -1);
+
+}
 
+static void publish_rpc(hg_handle_t hndl)
+{
+    publish_handle(hndl, 0);
 }
 DEFINE_MARGO_RPC_HANDLER(publish_rpc)
 
+static void publish_oneway_rpc(hg_handle_t hndl)
+{
+    publish_handle(hndl, 1);
+}
+DEFINE_MARGO_RPC_HANDLER(publish_oneway_rpc)
+
+/* checks that a batch payload is a whole number of well formed topic records */
+static int batch_valid(const struct wire_msg *m)
+{
+    const char *p = (const char *)m->payload;
+    const char *end = p + m->payload_len;
+    const char *ns, *topic;
+    size_t n;
+
+    if(p == NULL)
+        return 0;
+    while(p < end){
+        if((n = wire_get_topic_rec(p, end, &ns, &topic)) == 0)
+            return 0;
+        p += n;
+    }
+    return 1;
+}
+
+/* returns the id of subs_addr, registering it and resolving its address if it is new */
+static int register_subscriber(messaging_server_t server, const char *subs_addr, uint32_t *id)
+{
+    hg_addr_t addr;
+    int found;
+
+    ABT_rwlock_rdlock(server->lock);
+    found = map_find_subscriber(server->t, subs_addr, id);
+    ABT_rwlock_unlock(server->lock);
+    if(found)
+        return MESSAGING_SUCCESS;
+
+    /* the lookup may block, do it outside the lock */
+    if(xport_lookup(&server->xport, subs_addr, &addr) != HG_SUCCESS)
+        return MESSAGING_ERR_MERCURY;
+
+    ABT_rwlock_wrlock(server->lock);
+    *id = map_register(server->t, subs_addr);
+    messaging_stats_local(server->stats)->registrations++;
+    if(*id >= server->num_sub_addrs){
+        size_t n = server->num_sub_addrs ? server->num_sub_addrs * 2 : 64;
+        hg_addr_t *tmp;
+        while(n <= *id)
+            n *= 2;
+        tmp = (hg_addr_t*)realloc(server->sub_addrs, n * sizeof(*tmp));
+        if(tmp == NULL){
+            map_unregister(server->t, *id);
+            ABT_rwlock_unlock(server->lock);
+            xport_addr_free(&server->xport, addr);
+            return MESSAGING_ERR_ALLOCATION;
+        }
+        for(size_t i = server->num_sub_addrs; i < n; i++)
+            tmp[i] = HG_ADDR_NULL;
+        server->sub_addrs = tmp;
+        server->num_sub_addrs = n;
+    }
+    /* someone else may have registered the same address meanwhile */
+    if(server->sub_addrs[*id] == HG_ADDR_NULL){
+        server->sub_addrs[*id] = addr;
+        addr = HG_ADDR_NULL;
+    }
+    ABT_rwlock_unlock(server->lock);
+    if(addr != HG_ADDR_NULL)
+        xport_addr_free(&server->xport, addr);
+    return MESSAGING_SUCCESS;
+}
+
+/* finds who sent m: a registered id, or an address from clients that do not register */
+static int message_subscriber(messaging_server_t server, const struct wire_msg *m, uint32_t *id)
+{
+    const char *subs_addr;
+    int known;
+
+    if(wire_ext_u32(m, WIRE_EXT_SUBID, id)){
+        ABT_rwlock_rdlock(server->lock);
+        known = map_subscriber_addr(server->t, *id) != NULL;
+        ABT_rwlock_unlock(server->lock);
+        return known ? MESSAGING_SUCCESS : MESSAGING_ERR_UNKNOWN_OBJ;
+    }
+    subs_addr = wire_ext_string(m, WIRE_EXT_ADDR);
+    if(subs_addr == NULL)
+        return MESSAGING_ERR_PROTOCOL;
+    return register_subscriber(server, subs_addr, id);
+}
+
+static void capture_subscription(messaging_server_t server, const char *namesp,
+        const char *topic, uint32_t id, int sub)
+{
+    if(server->capture)
+        messaging_capture_record(server->capture,
+                sub ? MESSAGING_CAPTURE_SUBSCRIBE : MESSAGING_CAPTURE_UNSUBSCRIBE,
+                id, namesp, topic, NULL, 0);
+}
+
+/* adds id to a list of publishers unless it is there already */
+static int id_list_add(uint32_t **list, size_t *num, size_t *max, uint32_t id)
+{
+    size_t i;
+
+    for(i = 0; i < *num; i++)
+        if((*list)[i] == id)
+            return MESSAGING_SUCCESS;
+    if(*num == *max){
+        size_t n = *max ? 2 * *max : 16;
+        uint32_t *tmp = (uint32_t*)realloc(*list, n * sizeof(*tmp));
+        if(tmp == NULL)
+            return MESSAGING_ERR_ALLOCATION;
+        *list = tmp;
+        *max = n;
+    }
+    (*list)[(*num)++] = id;
+    return MESSAGING_SUCCESS;
+}
+
+static void id_list_remove(uint32_t *list, size_t *num, uint32_t id)
+{
+    for(size_t i = 0; i < *num; i++){
+        if(list[i] == id){
+            list[i] = list[--*num];
+            return;
+        }
+    }
+}
+
+/* what a subscription change has to tell publishers */
+#define PUSH_FILTER  1   /* a topic got its first subscriber */
+#define PUSH_ROUTE   2   /* the subscribers of a topic handed out to publishers changed */
+
+/* (un)subscribes id to one topic, with the write lock held, and keeps the
+ * filter in step; returns what publishers must hear about right away */
+static int apply_subscription(messaging_server_t server, const char *namesp,
+        const char *topic, uint32_t id, int sub)
+{
+    size_t before = map_get_value(server->t, namesp, topic, NULL, 0), after;
+    uint64_t h = wire_topic_hash(namesp, topic);
+    int push = 0;
+
+    if(sub)
+        map_subscribe(server->t, namesp, topic, id);
+    else
+        map_unsubscribe(server->t, namesp, topic, id);
+    after = map_get_value(server->t, namesp, topic, NULL, 0);
+    if(before == 0 && after > 0 && messaging_filter_add(server->filter, h))
+        push |= PUSH_FILTER;
+    /* a cleared bit only saves publishers a round trip, it can wait for them to refresh */
+    if(before > 0 && after == 0)
+        messaging_filter_remove(server->filter, h);
+    if(before != after && server->num_route_watchers > 0 && messaging_filter_test(server->routed, h))
+        push |= PUSH_ROUTE;
+    return push;
+}
+
+/* prefixes an encoded filter with our address, so clients know whose it is */
+static int filter_message(messaging_server_t server, event_meta *msg)
+{
+    void *bits;
+    size_t len, alen = strlen(server->addr_str), n;
+    uint8_t *p;
+
+    if(messaging_filter_encode(server->filter, &bits, &len) != MESSAGING_SUCCESS)
+        return MESSAGING_ERR_ALLOCATION;
+    p = (uint8_t*)messaging_pool_alloc(wire_varint_size(alen) + alen + len);
+    if(p == NULL){
+        messaging_pool_free(bits);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    n = wire_put_varint(p, alen);
+    memcpy(p + n, server->addr_str, alen);
+    memcpy(p + n + alen, bits, len);
+    messaging_pool_free(bits);
+    msg->raw_data = (char*)p;
+    msg->size = n + alen + len;
+    return MESSAGING_SUCCESS;
+}
+
+/* tells route holders that the subscribers of namesp/topic changed, of every
+ * topic in the batch payload, or with both names empty of every topic; the
+ * sequence number carries the new epoch.  Called with the write lock held. */
+static int route_invalidation(messaging_server_t server, const char *namesp, const char *topic,
+        const void *batch, size_t batch_len, event_meta *msg)
+{
+    struct wire_msg m;
+    size_t alen = strlen(server->addr_str) + 1;
+    void *buf;
+
+    wire_msg_init(&m, namesp, topic);
+    m.seq = ++server->route_epoch;
+    if(batch){
+        m.flags = WIRE_FLAG_BATCH;
+        m.payload = (void*)batch;
+        m.payload_len = batch_len;
+    }
+    m.ext_len = wire_ext_size(alen);
+    msg->size = wire_encoded_size(&m);
+    if((buf = messaging_pool_alloc(msg->size)) == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    wire_encode(buf, msg->size, &m);
+    wire_ext_put((char*)buf + wire_ext_offset(&m), WIRE_EXT_ADDR, server->addr_str, alen);
+    msg->raw_data = buf;
+    return MESSAGING_SUCCESS;
+}
+
+/* a control message for some publishers, built under the lock and sent after it */
+struct push {
+    bulk_data_t in;
+    hg_id_t rpc;
+    hg_addr_t *addrs;
+    uint32_t *ids;           /* whom addrs belong to */
+    size_t n;
+    uint32_t **list;         /* the publishers it went to, less those that do not answer */
+    size_t *num;
+};
+
+/* a push that sends nothing */
+static void push_init(struct push *p)
+{
+    p->in.evnt.raw_data = NULL;
+    p->addrs = NULL;
+    p->ids = NULL;
+    p->n = 0;
+}
+
+/* takes a reference on the addresses of the publishers in *list; called with
+ * the lock held, after p->in was filled in (raw_data NULL sends nothing) */
+static void push_prepare(messaging_server_t server, struct push *p, hg_id_t rpc,
+        uint32_t **list, size_t *num)
+{
+    const uint32_t *ids = *list;
+    size_t n = *num;
+
+    p->rpc = rpc;
+    p->list = list;
+    p->num = num;
+    p->n = 0;
+    p->addrs = NULL;
+    p->ids = NULL;
+    if(p->in.evnt.raw_data == NULL || n == 0)
+        return;
+    p->addrs = (hg_addr_t*)messaging_pool_alloc(n * sizeof(*p->addrs));
+    p->ids = (uint32_t*)messaging_pool_alloc(n * sizeof(*p->ids));
+    if(p->addrs == NULL || p->ids == NULL)
+        return;
+    for(size_t i = 0; i < n; i++){
+        if(ids[i] < server->num_sub_addrs && server->sub_addrs[ids[i]] != HG_ADDR_NULL){
+            p->ids[p->n] = ids[i];
+            xport_addr_dup(&server->xport, server->sub_addrs[ids[i]], &p->addrs[p->n++]);
+        }
+    }
+}
+
+/* sends p to every publisher in it, giving each MESSAGING_PUSH_TIMEOUT to
+ * answer; those that fail or time out are dropped from the list and hear
+ * nothing more until they ask again */
+static void push_send(messaging_server_t server, struct push *p)
+{
+    hg_handle_t *handles;
+    margo_request *reqs;
+    size_t failed = 0;
+
+    handles = (hg_handle_t*)messaging_pool_alloc((p->n + 1) * sizeof(*handles));
+    reqs = (margo_request*)messaging_pool_alloc((p->n + 1) * sizeof(*reqs));
+    for(size_t i = 0; i < p->n; i++){
+        if(handles == NULL || reqs == NULL)
+            break;
+        handles[i] = HG_HANDLE_NULL;
+        if(xport_create(&server->xport, p->addrs[i], p->rpc, &handles[i]) != HG_SUCCESS)
+            continue;
+        if(xport_iforward_timed(&server->xport, handles[i], &p->in, server->push_timeout_ms,
+                    &reqs[i]) != HG_SUCCESS){
+            xport_destroy(&server->xport, handles[i]);
+            handles[i] = HG_HANDLE_NULL;
+        }
+    }
+    for(size_t i = 0; i < p->n; i++){
+        response_t resp;
+        int ok = 0;
+
+        if(handles != NULL && reqs != NULL && handles[i] != HG_HANDLE_NULL){
+            if(xport_wait(&server->xport, reqs[i]) == HG_SUCCESS &&
+                    xport_get_output(&server->xport, handles[i], &resp) == HG_SUCCESS){
+                xport_free_output(&server->xport, handles[i], &resp);
+                ok = 1;
+            }
+            xport_destroy(&server->xport, handles[i]);
+        }
+        if(!ok && handles != NULL && reqs != NULL)
+            p->ids[failed++] = p->ids[i];
+        xport_addr_free(&server->xport, p->addrs[i]);
+    }
+    if(failed > 0){
+        fprintf(stderr, "Warning: dropping %zu publishers that did not take a subscription change\n",
+                failed);
+        ABT_rwlock_wrlock(server->lock);
+        for(size_t i = 0; i < failed; i++)
+            id_list_remove(*p->list, p->num, p->ids[i]);
+        ABT_rwlock_unlock(server->lock);
+    }
+    messaging_pool_free(reqs);
+    messaging_pool_free(handles);
+    messaging_pool_free(p->ids);
+    messaging_pool_free(p->addrs);
+    messaging_pool_free(p->in.evnt.raw_data);
+}
+
+/* builds the pushes a subscription change needs; called with the write lock held */
+static void push_changes(messaging_server_t server, int push, const struct wire_msg *m,
+        struct push *filter, struct push *route)
+{
+    push_init(filter);
+    push_init(route);
+    if((push & PUSH_FILTER) && filter_message(server, &filter->in.evnt) != MESSAGING_SUCCESS)
+        filter->in.evnt.raw_data = NULL;
+    push_prepare(server, filter, server->filter_update_id, &server->listeners, &server->num_listeners);
+    if((push & PUSH_ROUTE) && route_invalidation(server, m->namesp, m->topic,
+                (m->flags & WIRE_FLAG_BATCH) ? m->payload : NULL, m->payload_len,
+                &route->in.evnt) != MESSAGING_SUCCESS)
+        route->in.evnt.raw_data = NULL;
+    push_prepare(server, route, server->route_invalidate_id, &server->route_watchers,
+            &server->num_route_watchers);
+}
+
+/* applies a (possibly batched) subscribe or unsubscribe for subscriber id;
+ * the filter update and route invalidation it needs are left in filter and
+ * route, for the caller to send once it has answered */
+static int update_subscriptions(messaging_server_t server, const struct wire_msg *m,
+        uint32_t id, int sub, struct push *filter, struct push *route)
+{
+    const char *p, *end, *ns, *topic;
+    int push = 0;
+
+    if(!(m->flags & WIRE_FLAG_BATCH)){
+        ABT_rwlock_wrlock(server->lock);
+        push = apply_subscription(server, m->namesp, m->topic, id, sub);
+        push_changes(server, push, m, filter, route);
+        ABT_rwlock_unlock(server->lock);
+        capture_subscription(server, m->namesp, m->topic, id, sub);
+        return MESSAGING_SUCCESS;
+    }
+
+    if(!batch_valid(m))
+        return MESSAGING_ERR_PROTOCOL;
+    p = (const char *)m->payload;
+    end = p + m->payload_len;
+    ABT_rwlock_wrlock(server->lock);
+    while(p < end){
+        p += wire_get_topic_rec(p, end, &ns, &topic);
+        push |= apply_subscription(server, ns, topic, id, sub);
+    }
+    push_changes(server, push, m, filter, route);
+    ABT_rwlock_unlock(server->lock);
+    if(server->capture){
+        for(p = (const char *)m->payload; p < end; ){
+            p += wire_get_topic_rec(p, end, &ns, &topic);
+            capture_subscription(server, ns, topic, id, sub);
+        }
+    }
+    return MESSAGING_SUCCESS;
+}
+
 static void subscribe_rpc(hg_handle_t hndl)
 {
     hg_return_t ret;
@@ -348,40 +1445,73 @@ static void subscribe_rpc(hg_handle_t hndl)
     ret = margo_get_input(hndl, &in);
     assert(ret == HG_SUCCESS);
 
-    char *namesp, *topic, *subs_addr, *raw_buf;
-    int namespace_len, topic_len, subs_addr_size;
+    struct wire_msg m;
+    struct push filter, route;
+    uint32_t id;
+
+    push_init(&filter);
+    push_init(&route);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = message_subscriber(server, &m, &id);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = update_subscriptions(server, &m, id, 1, &filter, &route);
+    if(out.ret == MESSAGING_SUCCESS)
+        messaging_stats_local(server->stats)->subscribes++;
+
+    ret = xport_respond(&server->xport, hndl, &out);
+    assert(ret == HG_SUCCESS);
+    /* publishers hear of the change after the subscriber, it need not wait on them */
+    push_send(server, &filter);
+    push_send(server, &route);
+
+    margo_free_input(hndl, &in);
+    xport_destroy(&server->xport, hndl);
+ 
+}
+DEFINE_MARGO_RPC_HANDLER(subscribe_rpc)
+
+static void unsubscribe_rpc(hg_handle_t hndl)
+{
+    hg_return_t ret;
 
-    raw_buf = (char*)in.evnt.raw_data;
+    bulk_data_t in;
+    response_t out;
 
-    namespace_len = ((int *)raw_buf)[0];
-    topic_len = ((int *)raw_buf)[1];
-    subs_addr_size = ((int *)raw_buf)[2];
+    margo_instance_id mid = margo_hg_handle_get_instance(hndl);
 
-    namesp = malloc(namespace_len);
-    topic = malloc(topic_len);
-    subs_addr = malloc(subs_addr_size);
+    const struct hg_info* info = margo_get_info(hndl);
+    messaging_server_t server = (messaging_server_t)margo_registered_data(mid, info->id);
 
-    
-    memcpy(namesp, &raw_buf[sizeof(int)*3], namespace_len);
-    memcpy(topic, &raw_buf[sizeof(int)*3+namespace_len], topic_len);
-    memcpy(subs_addr, &raw_buf[sizeof(int)*3+namespace_len+topic_len], subs_addr_size);
-    //ABT_rwlock_wrlock(server->lock);
-    map_subscribe(server->t, namesp, topic, subs_addr);
-    //ABT_rwlock_unlock(server->lock);
-
-    out.ret = MESSAGING_SUCCESS;
-    ret = margo_respond(hndl, &out);
+    ret = margo_get_input(hndl, &in);
     assert(ret == HG_SUCCESS);
 
-    free(namesp);
-    free(topic);
+    struct wire_msg m;
+    struct push filter, route;
+    uint32_t id;
+
+    push_init(&filter);
+    push_init(&route);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = message_subscriber(server, &m, &id);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = update_subscriptions(server, &m, id, 0, &filter, &route);
+    if(out.ret == MESSAGING_SUCCESS)
+        messaging_stats_local(server->stats)->unsubscribes++;
+
+    ret = xport_respond(&server->xport, hndl, &out);
+    assert(ret == HG_SUCCESS);
+    /* publishers hear of the change after the subscriber, it need not wait on them */
+    push_send(server, &filter);
+    push_send(server, &route);
+
     margo_free_input(hndl, &in);
-    margo_destroy(hndl);
- 
+    xport_destroy(&server->xport, hndl);
 }
-DEFINE_MARGO_RPC_HANDLER(subscribe_rpc)
+DEFINE_MARGO_RPC_HANDLER(unsubscribe_rpc)
 
-static void unsubscribe_rpc(hg_handle_t hndl)
+static void client_finalize_rpc(hg_handle_t hndl)
 {
     hg_return_t ret;
 
@@ -396,45 +1526,115 @@ static void unsubscribe_rpc(hg_handle_t hndl)
     ret = margo_get_input(hndl, &in);
     assert(ret == HG_SUCCESS);
 
-    char *namesp, *topic, *subs_addr, *raw_buf;
-    int namespace_len, topic_len, subs_addr_size;
+    struct wire_msg m;
+    struct push route;
+    uint32_t id;
+
+    push_init(&route);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = message_subscriber(server, &m, &id);
+    if(out.ret == MESSAGING_SUCCESS){
+        /* drops the subscriptions too, and the id may be handed out again;
+         * their filter bits stay set, which is only conservative, but the
+         * routes that may name it are all dropped */
+        ABT_rwlock_wrlock(server->lock);
+        id_list_remove(server->listeners, &server->num_listeners, id);
+        id_list_remove(server->route_watchers, &server->num_route_watchers, id);
+        route.in.evnt.raw_data = NULL;
+        if(server->num_route_watchers > 0 &&
+                route_invalidation(server, "", "", NULL, 0, &route.in.evnt) != MESSAGING_SUCCESS)
+            route.in.evnt.raw_data = NULL;
+        push_prepare(server, &route, server->route_invalidate_id, &server->route_watchers,
+                &server->num_route_watchers);
+        map_unregister(server->t, id);
+        if(server->sub_addrs[id] != HG_ADDR_NULL)
+            xport_addr_free(&server->xport, server->sub_addrs[id]);
+        server->sub_addrs[id] = HG_ADDR_NULL;
+        ABT_rwlock_unlock(server->lock);
+    }
+    ret = xport_respond(&server->xport, hndl, &out);
+    assert(ret == HG_SUCCESS);
+    push_send(server, &route);
+
+    margo_free_input(hndl, &in);
+    xport_destroy(&server->xport, hndl);
+}
+DEFINE_MARGO_RPC_HANDLER(client_finalize_rpc)
 
-    raw_buf = (char*)in.evnt.raw_data;
+static void register_rpc(hg_handle_t hndl)
+{
+    hg_return_t ret;
 
-    namespace_len = ((int *)raw_buf)[0];
-    topic_len = ((int *)raw_buf)[1];
-    subs_addr_size = ((int *)raw_buf)[2];
+    bulk_data_t in;
+    register_out_t out;
 
-    namesp = malloc(namespace_len);
-    topic = malloc(topic_len);
-    subs_addr = malloc(subs_addr_size);
+    margo_instance_id mid = margo_hg_handle_get_instance(hndl);
 
-    
-    memcpy(namesp, &raw_buf[sizeof(int)*3], namespace_len);
-    memcpy(topic, &raw_buf[sizeof(int)*3+namespace_len], topic_len);
-    memcpy(subs_addr, &raw_buf[sizeof(int)*3+namespace_len+topic_len], subs_addr_size);
-    //ABT_rwlock_wrlock(server->lock);
-    map_unsubscribe(server->t, namesp, topic, subs_addr);
-    //ABT_rwlock_unlock(server->lock);
-
-    out.ret = MESSAGING_SUCCESS;
-    ret = margo_respond(hndl, &out);
+    const struct hg_info* info = margo_get_info(hndl);
+    messaging_server_t server = (messaging_server_t)margo_registered_data(mid, info->id);
+
+    ret = margo_get_input(hndl, &in);
+    assert(ret == HG_SUCCESS);
+
+    struct wire_msg m;
+    const char *subs_addr = NULL;
+
+    out.id = 0;
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        subs_addr = wire_ext_string(&m, WIRE_EXT_ADDR);
+    if(subs_addr == NULL)
+        out.ret = MESSAGING_ERR_PROTOCOL;
+    else
+        out.ret = register_subscriber(server, subs_addr, &out.id);
+
+    ret = xport_respond(&server->xport, hndl, &out);
     assert(ret == HG_SUCCESS);
 
-    free(namesp);
-    free(topic);
-    free(subs_addr);
     margo_free_input(hndl, &in);
-    margo_destroy(hndl);
+    xport_destroy(&server->xport, hndl);
 }
-DEFINE_MARGO_RPC_HANDLER(unsubscribe_rpc)
+DEFINE_MARGO_RPC_HANDLER(register_rpc)
 
-static void client_finalize_rpc(hg_handle_t hndl)
+static void get_stats_rpc(hg_handle_t hndl)
+{
+    hg_return_t ret;
+
+    stats_out_t out;
+
+    margo_instance_id mid = margo_hg_handle_get_instance(hndl);
+
+    const struct hg_info* info = margo_get_info(hndl);
+    messaging_server_t server = (messaging_server_t)margo_registered_data(mid, info->id);
+
+    /* too big for a ULT stack */
+    struct messaging_server_stats *s = (struct messaging_server_stats*)malloc(sizeof(*s));
+
+    out.data.size = 0;
+    out.data.raw_data = NULL;
+    out.ret = MESSAGING_ERR_ALLOCATION;
+    if(s != NULL){
+        server_fill_stats(server, s);
+        out.ret = messaging_stats_encode(s, &out.data.raw_data, &out.data.size);
+        free(s);
+    }
+
+    ret = xport_respond(&server->xport, hndl, &out);
+    assert(ret == HG_SUCCESS);
+
+    messaging_pool_free(out.data.raw_data);
+    xport_destroy(&server->xport, hndl);
+}
+DEFINE_MARGO_RPC_HANDLER(get_stats_rpc)
+
+/* hands a publisher the filter and keeps it updated from then on */
+static void filter_rpc(hg_handle_t hndl)
 {
     hg_return_t ret;
 
     bulk_data_t in;
-    response_t out;
+    stats_out_t out;
 
     margo_instance_id mid = margo_hg_handle_get_instance(hndl);
 
@@ -444,17 +1644,87 @@ static void client_finalize_rpc(hg_handle_t hndl)
     ret = margo_get_input(hndl, &in);
     assert(ret == HG_SUCCESS);
 
-    char *raw_buf;
-    raw_buf = (char*)in.evnt.raw_data;
-    //ABT_rwlock_wrlock(server->lock);
-    map_remove(server->t, raw_buf);
-    //ABT_rwlock_unlock(server->lock);
-    out.ret = MESSAGING_SUCCESS;
-    ret = margo_respond(hndl, &out);
+    struct wire_msg m;
+    uint32_t id;
+
+    out.data.size = 0;
+    out.data.raw_data = NULL;
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = message_subscriber(server, &m, &id);
+    if(out.ret == MESSAGING_SUCCESS){
+        ABT_rwlock_wrlock(server->lock);
+        out.ret = id_list_add(&server->listeners, &server->num_listeners,
+                &server->max_listeners, id);
+        if(out.ret == MESSAGING_SUCCESS)
+            out.ret = filter_message(server, &out.data);
+        ABT_rwlock_unlock(server->lock);
+    }
+
+    ret = xport_respond(&server->xport, hndl, &out);
     assert(ret == HG_SUCCESS);
 
+    messaging_pool_free(out.data.raw_data);
     margo_free_input(hndl, &in);
-    margo_destroy(hndl);
+    xport_destroy(&server->xport, hndl);
 }
-DEFINE_MARGO_RPC_HANDLER(client_finalize_rpc)
+DEFINE_MARGO_RPC_HANDLER(filter_rpc)
 
+/* hands a publisher the subscribers of a topic, and tells it when they change */
+static void route_rpc(hg_handle_t hndl)
+{
+    hg_return_t ret;
+
+    bulk_data_t in;
+    stats_out_t out;
+
+    margo_instance_id mid = margo_hg_handle_get_instance(hndl);
+
+    const struct hg_info* info = margo_get_info(hndl);
+    messaging_server_t server = (messaging_server_t)margo_registered_data(mid, info->id);
+
+    ret = margo_get_input(hndl, &in);
+    assert(ret == HG_SUCCESS);
+
+    struct wire_msg m;
+    uint32_t id, *ids = NULL;
+    const char **addrs = NULL;
+    size_t n = 0;
+
+    out.data.size = 0;
+    out.data.raw_data = NULL;
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if(out.ret == MESSAGING_SUCCESS)
+        out.ret = message_subscriber(server, &m, &id);
+    if(out.ret == MESSAGING_SUCCESS){
+        ABT_rwlock_wrlock(server->lock);
+        out.ret = id_list_add(&server->route_watchers, &server->num_route_watchers,
+                &server->max_route_watchers, id);
+        if(out.ret == MESSAGING_SUCCESS && !messaging_filter_test(server->routed, m.topic_hash))
+            messaging_filter_add(server->routed, m.topic_hash);
+        if(out.ret == MESSAGING_SUCCESS)
+            n = map_get_value(server->t, m.namesp, m.topic, NULL, 0);
+        ids = (uint32_t*)messaging_pool_alloc((n + 1) * sizeof(*ids));
+        addrs = (const char**)messaging_pool_alloc((n + 1) * sizeof(*addrs));
+        if(ids == NULL || addrs == NULL)
+            out.ret = MESSAGING_ERR_ALLOCATION;
+        if(out.ret == MESSAGING_SUCCESS){
+            map_get_value(server->t, m.namesp, m.topic, ids, n);
+            for(size_t i = 0; i < n; i++)
+                addrs[i] = map_subscriber_addr(server->t, ids[i]);
+            out.ret = messaging_route_encode(server->route_epoch, ids, addrs, (uint32_t)n,
+                    &out.data.raw_data, &out.data.size);
+        }
+        ABT_rwlock_unlock(server->lock);
+    }
+
+    ret = xport_respond(&server->xport, hndl, &out);
+    assert(ret == HG_SUCCESS);
+
+    messaging_pool_free(ids);
+    messaging_pool_free(addrs);
+    messaging_pool_free(out.data.raw_data);
+    margo_free_input(hndl, &in);
+    xport_destroy(&server->xport, hndl);
+}
+DEFINE_MARGO_RPC_HANDLER(route_rpc)
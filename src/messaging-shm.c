@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-shm.h>
+
+#define SHM_MAGIC    0x6d73676d73686d31ULL   /* "msgmshm1" */
+#define SHM_VERSION  1
+#define SHM_LINE     64
+#define NO_CURSOR    UINT64_MAX
+#define ATTACH_WAIT_US  5000000
+
+enum { RING_FREE = 0, RING_INIT, RING_READY };
+
+struct shm_seg {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t num_rings;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    uint32_t ready;
+    uint32_t refs;
+} __attribute__((aligned(SHM_LINE)));
+
+struct shm_ring {
+    uint32_t state;
+    uint32_t name_len;
+    uint64_t topic_hash;
+    char name[MESSAGING_SHM_NAME_MAX];
+    uint64_t head __attribute__((aligned(SHM_LINE)));
+} __attribute__((aligned(SHM_LINE)));
+
+struct shm_reader {
+    uint64_t cursor;     /* next position to read, NO_CURSOR if not reading */
+    int32_t pid;         /* owner, 0 if the slot is free */
+    uint32_t sub_id;
+} __attribute__((aligned(SHM_LINE)));
+
+struct shm_slot {
+    uint64_t seq;        /* position + 1 once the slot holds that position */
+    uint64_t mask;       /* readers the message is for */
+    uint32_t len;
+} __attribute__((aligned(SHM_LINE)));
+
+struct messaging_shm {
+    char name[64];
+    struct shm_seg *seg;
+    size_t size;
+    size_t ring_size;
+};
+
+struct messaging_shm_reader {
+    messaging_shm_t shm;
+    struct shm_ring *ring;
+    int index;
+    uint64_t cursor;
+    char *namesp;
+    char *topic;
+};
+
+#define LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static uint32_t parse_size(const char *s, uint32_t def)
+{
+    char *end;
+    unsigned long long v;
+
+    if (s == NULL || *s == '\0')
+        return def;
+    v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; break;
+    case 'm': case 'M': v <<= 20; break;
+    case 'g': case 'G': v <<= 30; break;
+    default: break;
+    }
+    return (uint32_t)v;
+}
+
+void messaging_shm_config_init(struct messaging_shm_config *cfg)
+{
+    const char *s;
+
+    s = getenv("MESSAGING_SHM");
+    cfg->enabled = s ? atoi(s) : 0;
+    s = getenv("MESSAGING_SHM_NAME");
+    if (s != NULL && *s != '\0')
+        snprintf(cfg->name, sizeof(cfg->name), "%s", s);
+    else
+        snprintf(cfg->name, sizeof(cfg->name), "/messaging-%u", (unsigned)getuid());
+    cfg->num_rings = parse_size(getenv("MESSAGING_SHM_RINGS"), MESSAGING_SHM_DEFAULT_RINGS);
+    cfg->num_slots = parse_size(getenv("MESSAGING_SHM_SLOTS"), MESSAGING_SHM_DEFAULT_SLOTS);
+    cfg->slot_size = parse_size(getenv("MESSAGING_SHM_SLOT_SIZE"), MESSAGING_SHM_DEFAULT_SLOT_SIZE);
+}
+
+static size_t ring_size(uint32_t num_slots, uint32_t slot_size)
+{
+    return sizeof(struct shm_ring) + MESSAGING_SHM_MAX_READERS * sizeof(struct shm_reader)
+        + (size_t)num_slots * slot_size;
+}
+
+static struct shm_ring *ring_at(messaging_shm_t shm, uint32_t i)
+{
+    return (struct shm_ring *)((char *)shm->seg + sizeof(struct shm_seg) + i * shm->ring_size);
+}
+
+static struct shm_reader *reader_at(struct shm_ring *ring, int i)
+{
+    return (struct shm_reader *)((char *)ring + sizeof(struct shm_ring)) + i;
+}
+
+static struct shm_slot *slot_at(messaging_shm_t shm, struct shm_ring *ring, uint64_t pos)
+{
+    return (struct shm_slot *)((char *)ring + sizeof(struct shm_ring)
+            + MESSAGING_SHM_MAX_READERS * sizeof(struct shm_reader)
+            + (pos % shm->seg->num_slots) * shm->seg->slot_size);
+}
+
+/* the segment is created zero filled, which leaves every ring free */
+static int create_segment(int fd, const struct messaging_shm_config *cfg, messaging_shm_t shm)
+{
+    struct shm_seg *seg;
+    size_t size;
+
+    if (cfg->num_rings == 0 || cfg->num_slots == 0 ||
+            cfg->slot_size <= sizeof(struct shm_slot) || cfg->slot_size % SHM_LINE != 0)
+        return MESSAGING_ERR_INVALID_ARG;
+    size = sizeof(struct shm_seg) + cfg->num_rings * ring_size(cfg->num_slots, cfg->slot_size);
+    if (ftruncate(fd, size) != 0)
+        return MESSAGING_ERR_ALLOCATION;
+    seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+        return MESSAGING_ERR_ALLOCATION;
+
+    seg->magic = SHM_MAGIC;
+    seg->version = SHM_VERSION;
+    seg->num_rings = cfg->num_rings;
+    seg->num_slots = cfg->num_slots;
+    seg->slot_size = cfg->slot_size;
+    shm->seg = seg;
+    shm->size = size;
+    shm->ring_size = ring_size(cfg->num_slots, cfg->slot_size);
+    for (uint32_t i = 0; i < cfg->num_rings; i++)
+        for (int r = 0; r < MESSAGING_SHM_MAX_READERS; r++)
+            reader_at(ring_at(shm, i), r)->cursor = NO_CURSOR;
+    STORE(&seg->ready, 1);
+    return MESSAGING_SUCCESS;
+}
+
+/* maps a segment someone else created, once they are done setting it up */
+static int open_segment(int fd, messaging_shm_t shm)
+{
+    struct shm_seg *seg;
+    struct stat st;
+    size_t size;
+    int waited;
+
+    for (waited = 0; ; waited += 1000) {
+        if (fstat(fd, &st) != 0)
+            return MESSAGING_ERR_INVALID_ARG;
+        if ((size_t)st.st_size >= sizeof(struct shm_seg))
+            break;
+        if (waited >= ATTACH_WAIT_US)
+            return MESSAGING_ERR_UNKNOWN_OBJ;
+        usleep(1000);
+    }
+    seg = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+        return MESSAGING_ERR_ALLOCATION;
+    for (waited = 0; !LOAD(&seg->ready); waited += 1000) {
+        if (waited >= ATTACH_WAIT_US) {
+            munmap(seg, st.st_size);
+            return MESSAGING_ERR_UNKNOWN_OBJ;
+        }
+        usleep(1000);
+    }
+    size = sizeof(struct shm_seg) + seg->num_rings * ring_size(seg->num_slots, seg->slot_size);
+    if (seg->magic != SHM_MAGIC || seg->version != SHM_VERSION || size != (size_t)st.st_size) {
+        munmap(seg, st.st_size);
+        return MESSAGING_ERR_PROTOCOL;
+    }
+    shm->seg = seg;
+    shm->size = size;
+    shm->ring_size = ring_size(seg->num_slots, seg->slot_size);
+    return MESSAGING_SUCCESS;
+}
+
+int messaging_shm_attach(const struct messaging_shm_config *cfg, messaging_shm_t *s)
+{
+    messaging_shm_t shm;
+    int fd, ret;
+
+    *s = MESSAGING_SHM_NULL;
+    if (!cfg->enabled)
+        return MESSAGING_SUCCESS;
+
+    shm = (messaging_shm_t)calloc(1, sizeof(*shm));
+    if (!shm)
+        return MESSAGING_ERR_ALLOCATION;
+    snprintf(shm->name, sizeof(shm->name), "%s", cfg->name);
+
+    fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        ret = create_segment(fd, cfg, shm);
+        if (ret != MESSAGING_SUCCESS)
+            shm_unlink(shm->name);
+    } else if (errno == EEXIST && (fd = shm_open(shm->name, O_RDWR, 0600)) >= 0) {
+        ret = open_segment(fd, shm);
+    } else {
+        ret = MESSAGING_ERR_INVALID_ARG;
+    }
+    if (fd >= 0)
+        close(fd);
+    if (ret != MESSAGING_SUCCESS) {
+        free(shm);
+        return ret;
+    }
+    __atomic_add_fetch(&shm->seg->refs, 1, __ATOMIC_ACQ_REL);
+    *s = shm;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_shm_detach(messaging_shm_t shm)
+{
+    if (shm == MESSAGING_SHM_NULL)
+        return;
+    if (__atomic_sub_fetch(&shm->seg->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        shm_unlink(shm->name);
+    munmap(shm->seg, shm->size);
+    free(shm);
+}
+
+size_t messaging_shm_max_payload(messaging_shm_t shm)
+{
+    return shm ? shm->seg->slot_size - sizeof(struct shm_slot) : 0;
+}
+
+/* the ring of namesp/topic; rings are never given back, so a free ring ends the probe */
+static struct shm_ring *find_ring(messaging_shm_t shm, const char *namesp, const char *topic, int create)
+{
+    size_t nlen = strlen(namesp) + 1, tlen = strlen(topic) + 1;
+    uint64_t hash = wire_topic_hash(namesp, topic);
+    uint32_t num_rings = shm->seg->num_rings;
+    char name[MESSAGING_SHM_NAME_MAX];
+
+    if (nlen + tlen > sizeof(name))
+        return NULL;
+    memcpy(name, namesp, nlen);
+    memcpy(name + nlen, topic, tlen);
+
+    for (uint32_t i = 0; i < num_rings; i++) {
+        struct shm_ring *ring = ring_at(shm, (uint32_t)((hash + i) % num_rings));
+        uint32_t state = LOAD(&ring->state);
+
+        if (state == RING_FREE) {
+            if (!create)
+                return NULL;
+            if (__atomic_compare_exchange_n(&ring->state, &state, RING_INIT, 0,
+                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                ring->topic_hash = hash;
+                ring->name_len = (uint32_t)(nlen + tlen);
+                memcpy(ring->name, name, nlen + tlen);
+                STORE(&ring->state, RING_READY);
+                return ring;
+            }
+        }
+        while ((state = LOAD(&ring->state)) == RING_INIT)
+            sched_yield();
+        if (ring->topic_hash == hash && ring->name_len == nlen + tlen &&
+                memcmp(ring->name, name, nlen + tlen) == 0)
+            return ring;
+    }
+    return NULL;
+}
+
+int messaging_shm_subscribe(messaging_shm_t shm, const char *namesp, const char *topic,
+        uint32_t sub_id, messaging_shm_reader_t *r)
+{
+    struct messaging_shm_reader *reader;
+    struct shm_ring *ring;
+    struct shm_reader *slot = NULL;
+    int32_t pid = (int32_t)getpid();
+    uint64_t head;
+    int i;
+
+    ring = find_ring(shm, namesp, topic, 1);
+    if (ring == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    for (i = 0; i < MESSAGING_SHM_MAX_READERS; i++) {
+        int32_t free_pid = 0;
+        slot = reader_at(ring, i);
+        if (__atomic_compare_exchange_n(&slot->pid, &free_pid, pid, 0,
+                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+    }
+    if (i == MESSAGING_SHM_MAX_READERS)
+        return MESSAGING_ERR_ALLOCATION;
+
+    reader = (struct messaging_shm_reader *)calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        STORE(&slot->pid, 0);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    reader->shm = shm;
+    reader->ring = ring;
+    reader->index = i;
+    reader->namesp = strdup(namesp);
+    reader->topic = strdup(topic);
+
+    /* start at the head; if publishers lapped the ring before they could see
+     * our cursor, the slot it names may be reused already, so start again */
+    slot->sub_id = sub_id;
+    do {
+        head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&slot->cursor, head, __ATOMIC_SEQ_CST);
+    } while (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) - head >= shm->seg->num_slots);
+    reader->cursor = head;
+    *r = reader;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_shm_unsubscribe(messaging_shm_reader_t reader)
+{
+    struct shm_reader *slot;
+
+    if (reader == NULL)
+        return;
+    slot = reader_at(reader->ring, reader->index);
+    __atomic_store_n(&slot->cursor, NO_CURSOR, __ATOMIC_SEQ_CST);
+    STORE(&slot->pid, 0);
+    free(reader->namesp);
+    free(reader->topic);
+    free(reader);
+}
+
+const char *messaging_shm_reader_namesp(messaging_shm_reader_t reader)
+{
+    return reader->namesp;
+}
+
+const char *messaging_shm_reader_topic(messaging_shm_reader_t reader)
+{
+    return reader->topic;
+}
+
+int messaging_shm_poll(messaging_shm_reader_t reader, messaging_shm_deliver_fn fn, void *arg, int max)
+{
+    struct shm_reader *rslot = reader_at(reader->ring, reader->index);
+    uint64_t bit = (uint64_t)1 << reader->index;
+    int delivered = 0;
+
+    while (delivered < max) {
+        struct shm_slot *slot = slot_at(reader->shm, reader->ring, reader->cursor);
+        if (LOAD(&slot->seq) != reader->cursor + 1)
+            break;
+        /* messages published before we were counted in reach us through the server */
+        if (slot->mask & bit) {
+            fn(arg, reader->namesp, reader->topic, slot + 1, slot->len);
+            delivered++;
+        }
+        reader->cursor++;
+        __atomic_store_n(&rslot->cursor, reader->cursor, __ATOMIC_SEQ_CST);
+    }
+    return delivered;
+}
+
+/* frees reader slots whose owner exited without unsubscribing; returns how many */
+static int reclaim_readers(struct shm_ring *ring)
+{
+    int reclaimed = 0;
+
+    for (int i = 0; i < MESSAGING_SHM_MAX_READERS; i++) {
+        struct shm_reader *r = reader_at(ring, i);
+        int32_t pid = LOAD(&r->pid);
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            __atomic_store_n(&r->cursor, NO_CURSOR, __ATOMIC_SEQ_CST);
+            STORE(&r->pid, 0);
+            reclaimed++;
+        }
+    }
+    return reclaimed;
+}
+
+int messaging_shm_publish(messaging_shm_t shm, const char *namesp, const char *topic,
+        const void *data, size_t len, int skip_self, uint32_t *ids)
+{
+    int32_t self = skip_self ? (int32_t)getpid() : 0;
+    uint32_t num_slots = shm->seg->num_slots;
+    struct shm_ring *ring;
+    struct shm_slot *slot;
+    uint64_t head, min, mask = 0;
+    int i, n = 0, reclaimed = 0;
+
+    if (len > messaging_shm_max_payload(shm))
+        return 0;
+    ring = find_ring(shm, namesp, topic, 0);
+    if (ring == NULL)
+        return 0;
+
+    /* reserve a position, but only if every reader is done with the slot it reuses */
+    for (;;) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+        min = NO_CURSOR;
+        for (i = 0; i < MESSAGING_SHM_MAX_READERS; i++) {
+            uint64_t c = __atomic_load_n(&reader_at(ring, i)->cursor, __ATOMIC_SEQ_CST);
+            if (c < min)
+                min = c;
+        }
+        if (min == NO_CURSOR)
+            return 0;
+        if ((int64_t)(head - min) >= (int64_t)num_slots) {
+            if (reclaimed || (reclaimed = reclaim_readers(ring)) == 0)
+                return 0;
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&ring->head, &head, head + 1, 0,
+                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            break;
+    }
+
+    /* the message is for whoever will read position head */
+    for (i = 0; i < MESSAGING_SHM_MAX_READERS; i++) {
+        struct shm_reader *r = reader_at(ring, i);
+        uint64_t c = __atomic_load_n(&r->cursor, __ATOMIC_SEQ_CST);
+        if (c != NO_CURSOR && c <= head && LOAD(&r->pid) != self) {
+            mask |= (uint64_t)1 << i;
+            ids[n++] = r->sub_id;
+        }
+    }
+
+    slot = slot_at(shm, ring, head);
+    slot->mask = mask;
+    slot->len = (uint32_t)len;
+    memcpy(slot + 1, data, len);
+    STORE(&slot->seq, head + 1);
+    return n;
+}
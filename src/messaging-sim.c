@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include <messaging-sim.h>
+#include <ss_data.h>
+
+/* virtual addresses and handles carry the low bit, which the (allocated,
+ * aligned) ones of the inner transport never have */
+#define SIM_TAG         ((uintptr_t)1)
+#define IS_SIM(p)       (((uintptr_t)(p)) & SIM_TAG)
+#define SIM_HANDLE(p)   ((struct sim_handle *)((uintptr_t)(p) & ~SIM_TAG))
+#define SIM_ENDPOINT(a) ((uint32_t)((uintptr_t)(a) >> 1))
+
+struct sim_handle {
+    uint32_t endpoint;
+    int32_t ret;            /* what the endpoint answers */
+    uint64_t done_ns;       /* when the answer is in */
+    uint64_t deadline_ns;   /* when a timed forward gives up, 0 never */
+};
+
+struct messaging_sim {
+    struct messaging_transport xport;   /* ours, handed out */
+    struct messaging_transport inner;
+    struct messaging_sim_config cfg;
+    uint64_t *delivered;                /* per endpoint */
+    uint64_t link_free_ns;              /* when the sender link is next idle */
+    uint64_t rng;
+    struct messaging_sim_stats stats;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* splitmix64 over a shared counter, reproducible for a single sender */
+static uint64_t sim_random(struct messaging_sim *sim)
+{
+    uint64_t z = __atomic_add_fetch(&sim->rng, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* bytes a notification puts on the link: the message and any payload the
+ * subscriber pulls */
+static size_t notify_size(const message_t *in)
+{
+    struct wire_msg m;
+    size_t size = in->evnt.size;
+
+    if(in->bulk != HG_BULK_NULL && wire_decode(in->evnt.raw_data, in->evnt.size, &m) == MESSAGING_SUCCESS)
+        size += m.payload_len;
+    return size;
+}
+
+static void max_u64(uint64_t *p, uint64_t v)
+{
+    uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+    while(cur < v && !__atomic_compare_exchange_n(p, &cur, v, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static hg_return_t s_lookup(void *ctx, const char *name, hg_addr_t *addr)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    size_t plen = strlen(MESSAGING_SIM_PREFIX);
+    unsigned long n;
+    char *end;
+
+    if(strncmp(name, MESSAGING_SIM_PREFIX, plen) != 0)
+        return xport_lookup(&sim->inner, name, addr);
+    n = strtoul(name + plen, &end, 10);
+    if(end == name + plen || *end != '\0' || n >= sim->cfg.max_endpoints)
+        return HG_INVALID_ARG;
+    *addr = (hg_addr_t)(((uintptr_t)n << 1) | SIM_TAG);
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_addr_dup(void *ctx, hg_addr_t addr, hg_addr_t *copy)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(addr))
+        return xport_addr_dup(&sim->inner, addr, copy);
+    *copy = addr;
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_addr_free(void *ctx, hg_addr_t addr)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(addr))
+        return xport_addr_free(&sim->inner, addr);
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_create(void *ctx, hg_addr_t addr, hg_id_t id, hg_handle_t *h)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    struct sim_handle *sh;
+
+    if(!IS_SIM(addr))
+        return xport_create(&sim->inner, addr, id, h);
+    /* pool blocks are 64 byte aligned, the tag bit is free */
+    sh = (struct sim_handle *)messaging_pool_alloc(sizeof(*sh));
+    if(sh == NULL)
+        return HG_NOMEM;
+    sh->endpoint = SIM_ENDPOINT(addr);
+    sh->ret = MESSAGING_ERR_MERCURY;
+    sh->done_ns = 0;
+    sh->deadline_ns = 0;
+    *h = (hg_handle_t)((uintptr_t)sh | SIM_TAG);
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_iforward(void *ctx, hg_handle_t h, uint16_t provider, void *in, margo_request *req)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    const struct messaging_sim_config *cfg = &sim->cfg;
+    struct sim_handle *sh;
+    uint64_t now, start, tx, free_ns, jitter = 0;
+    size_t size;
+
+    if(!IS_SIM(h))
+        return xport_provider_iforward(&sim->inner, h, provider, in, req);
+    sh = SIM_HANDLE(h);
+    size = notify_size((const message_t *)in);
+    tx = cfg->bandwidth > 0 ? (uint64_t)(size * 1e9 / cfg->bandwidth) : 0;
+
+    /* the link sends one message at a time: queue behind whatever it is sending */
+    now = now_ns();
+    free_ns = __atomic_load_n(&sim->link_free_ns, __ATOMIC_RELAXED);
+    do{
+        start = free_ns > now ? free_ns : now;
+    }while(!__atomic_compare_exchange_n(&sim->link_free_ns, &free_ns, start + tx, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if(cfg->jitter_ns)
+        jitter = sim_random(sim) % (cfg->jitter_ns + 1);
+    sh->done_ns = start + tx + 2 * cfg->latency_ns + jitter + cfg->handler_ns;
+    sh->deadline_ns = 0;
+    sh->ret = MESSAGING_SUCCESS;
+    if(cfg->failure_rate > 0 && (sim_random(sim) >> 11) * 0x1.0p-53 < cfg->failure_rate)
+        sh->ret = MESSAGING_ERR_MERCURY;
+
+    __atomic_add_fetch(&sim->stats.notifications, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sim->stats.bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sim->stats.link_busy_ns, tx, __ATOMIC_RELAXED);
+    max_u64(&sim->stats.max_completion_ns, sh->done_ns - now);
+    if(sh->ret == MESSAGING_SUCCESS)
+        __atomic_add_fetch(&sim->delivered[sh->endpoint], 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&sim->stats.failures, 1, __ATOMIC_RELAXED);
+
+    *req = (margo_request)h;
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_iforward_timed(void *ctx, hg_handle_t h, uint16_t provider, void *in,
+        double timeout_ms, margo_request *req)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    hg_return_t ret;
+
+    if(!IS_SIM(h))
+        return xport_provider_iforward_timed(&sim->inner, h, provider, in, timeout_ms, req);
+    ret = s_iforward(ctx, h, provider, in, req);
+    if(ret == HG_SUCCESS && timeout_ms > 0)
+        SIM_HANDLE(h)->deadline_ns = now_ns() + (uint64_t)(timeout_ms * 1e6);
+    return ret;
+}
+
+/* when the answer to sh is in, or the forward gives up on it */
+static uint64_t sim_finish_ns(const struct sim_handle *sh)
+{
+    if(sh->deadline_ns && sh->deadline_ns < sh->done_ns)
+        return sh->deadline_ns;
+    return sh->done_ns;
+}
+
+static hg_return_t s_wait(void *ctx, margo_request req)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    struct sim_handle *sh;
+
+    if(!IS_SIM(req))
+        return xport_wait(&sim->inner, req);
+    sh = SIM_HANDLE(req);
+    while(now_ns() < sim_finish_ns(sh))
+        ABT_thread_yield();
+    return sim_finish_ns(sh) < sh->done_ns ? HG_TIMEOUT : HG_SUCCESS;
+}
+
+static hg_return_t s_test(void *ctx, margo_request req, int *flag)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(req))
+        return xport_test(&sim->inner, req, flag);
+    *flag = now_ns() >= sim_finish_ns(SIM_HANDLE(req));
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_forward(void *ctx, hg_handle_t h, uint16_t provider, void *in)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+    margo_request req;
+    hg_return_t ret;
+
+    if(!IS_SIM(h))
+        return xport_provider_forward(&sim->inner, h, provider, in);
+    ret = s_iforward(ctx, h, provider, in, &req);
+    if(ret == HG_SUCCESS)
+        ret = s_wait(ctx, req);
+    return ret;
+}
+
+static hg_return_t s_get_output(void *ctx, hg_handle_t h, void *out)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(h))
+        return xport_get_output(&sim->inner, h, out);
+    ((response_t *)out)->ret = SIM_HANDLE(h)->ret;
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_free_output(void *ctx, hg_handle_t h, void *out)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(h))
+        return xport_free_output(&sim->inner, h, out);
+    return HG_SUCCESS;
+}
+
+static hg_return_t s_respond(void *ctx, hg_handle_t h, void *out)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    /* virtual endpoints never call us */
+    if(IS_SIM(h))
+        return HG_INVALID_ARG;
+    return xport_respond(&sim->inner, h, out);
+}
+
+static hg_return_t s_destroy(void *ctx, hg_handle_t h)
+{
+    struct messaging_sim *sim = (struct messaging_sim *)ctx;
+
+    if(!IS_SIM(h))
+        return xport_destroy(&sim->inner, h);
+    messaging_pool_free(SIM_HANDLE(h));
+    return HG_SUCCESS;
+}
+
+static const struct messaging_transport_ops sim_ops = {
+    "sim",
+    s_lookup,
+    s_addr_dup,
+    s_addr_free,
+    s_create,
+    s_forward,
+    s_iforward,
+    s_iforward_timed,
+    s_wait,
+    s_test,
+    s_get_output,
+    s_free_output,
+    s_respond,
+    s_destroy,
+};
+
+void messaging_sim_config_init(struct messaging_sim_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->latency_ns = 1000;
+    cfg->max_endpoints = 100000;
+    cfg->seed = 1;
+}
+
+int messaging_sim_create(const struct messaging_transport *inner,
+        const struct messaging_sim_config *cfg, messaging_sim_t *simp)
+{
+    struct messaging_sim *sim;
+
+    if(inner == NULL || inner->ops == NULL || cfg == NULL || cfg->max_endpoints == 0 ||
+            cfg->bandwidth < 0 || cfg->failure_rate < 0)
+        return MESSAGING_ERR_INVALID_ARG;
+    sim = (struct messaging_sim *)calloc(1, sizeof(*sim));
+    if(sim == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    sim->delivered = (uint64_t *)calloc(cfg->max_endpoints, sizeof(*sim->delivered));
+    if(sim->delivered == NULL){
+        free(sim);
+        return MESSAGING_ERR_ALLOCATION;
+    }
+    sim->inner = *inner;
+    sim->cfg = *cfg;
+    sim->rng = cfg->seed;
+    sim->xport.ops = &sim_ops;
+    sim->xport.ctx = sim;
+    *simp = sim;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_sim_destroy(messaging_sim_t sim)
+{
+    if(sim == NULL)
+        return;
+    free(sim->delivered);
+    free(sim);
+}
+
+const struct messaging_transport *messaging_sim_transport(messaging_sim_t sim)
+{
+    return &sim->xport;
+}
+
+uint64_t messaging_sim_delivered(messaging_sim_t sim, uint32_t n)
+{
+    if(n >= sim->cfg.max_endpoints)
+        return 0;
+    return __atomic_load_n(&sim->delivered[n], __ATOMIC_RELAXED);
+}
+
+void messaging_sim_get_stats(messaging_sim_t sim, struct messaging_sim_stats *stats)
+{
+    stats->notifications = __atomic_load_n(&sim->stats.notifications, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&sim->stats.bytes, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&sim->stats.failures, __ATOMIC_RELAXED);
+    stats->link_busy_ns = __atomic_load_n(&sim->stats.link_busy_ns, __ATOMIC_RELAXED);
+    stats->max_completion_ns = __atomic_load_n(&sim->stats.max_completion_ns, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,969 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-pool.h>
+#include <messaging-wire.h>
+#include <messaging-stats.h>
+
+struct messaging_stats {
+    uint64_t start_ns;
+    int64_t in_flight;
+    struct messaging_stats_xs *xs[MESSAGING_STATS_MAX_XSTREAMS];
+};
+
+int messaging_stats_create(messaging_stats_t *stats)
+{
+    struct messaging_stats *s = calloc(1, sizeof(*s));
+
+    if (!s)
+        return MESSAGING_ERR_ALLOCATION;
+    s->start_ns = wire_now_ns();
+    *stats = s;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_stats_destroy(messaging_stats_t stats)
+{
+    if (!stats)
+        return;
+    for (int i = 0; i < MESSAGING_STATS_MAX_XSTREAMS; i++)
+        free(stats->xs[i]);
+    free(stats);
+}
+
+static struct messaging_stats_xs *xs_create(void)
+{
+    struct messaging_stats_xs *xs = calloc(1, sizeof(*xs));
+
+    if (!xs)
+        return NULL;
+    messaging_hist_init(&xs->msg_size);
+    messaging_hist_init(&xs->fanout);
+    messaging_hist_init(&xs->handler_ns);
+    messaging_hist_init(&xs->notify_rtt_ns);
+    return xs;
+}
+
+struct messaging_stats_xs *messaging_stats_local(messaging_stats_t stats)
+{
+    /* used when allocating a stream's slot fails, so callers never check */
+    static struct messaging_stats_xs dummy;
+    struct messaging_stats_xs *xs, *expected = NULL;
+    int rank = 0;
+
+    ABT_xstream_self_rank(&rank);
+    rank = (rank < 0 ? 0 : rank) % MESSAGING_STATS_MAX_XSTREAMS;
+    xs = __atomic_load_n(&stats->xs[rank], __ATOMIC_ACQUIRE);
+    if (xs)
+        return xs;
+    if (!(xs = xs_create()))
+        return &dummy;
+    if (!__atomic_compare_exchange_n(&stats->xs[rank], &expected, xs, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(xs);
+        xs = expected;
+    }
+    return xs;
+}
+
+static void copy_name(char *dst, const char *src)
+{
+    strncpy(dst, src, MESSAGING_STATS_NAME_MAX - 1);
+    dst[MESSAGING_STATS_NAME_MAX - 1] = '\0';
+}
+
+void messaging_stats_hot(struct messaging_hot_topics *hot, uint64_t topic_hash,
+        const char *namesp, const char *topic)
+{
+    int min = 0;
+
+    for (int i = 0; i < MESSAGING_STATS_HOT_SLOTS; i++) {
+        if (hot->count[i] && hot->hash[i] == topic_hash) {
+            hot->count[i]++;
+            return;
+        }
+        if (hot->count[i] < hot->count[min])
+            min = i;
+    }
+    /* space-saving: the newcomer inherits the evicted count */
+    hot->hash[min] = topic_hash;
+    hot->count[min]++;
+    copy_name(hot->namesp[min], namesp);
+    copy_name(hot->topic[min], topic);
+}
+
+void messaging_stats_in_flight(messaging_stats_t stats, int delta)
+{
+    __atomic_add_fetch(&stats->in_flight, delta, __ATOMIC_RELAXED);
+}
+
+struct hot_entry {
+    uint64_t hash;
+    uint64_t count;
+    const struct messaging_hot_topics *hot;
+    int slot;
+};
+
+static int cmp_hash(const void *a, const void *b)
+{
+    const struct hot_entry *x = a, *y = b;
+
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+static int cmp_count(const void *a, const void *b)
+{
+    const struct hot_entry *x = a, *y = b;
+
+    return x->count > y->count ? -1 : x->count < y->count;
+}
+
+/* merges the hot topics of n writers into top, returns how many it filled */
+static uint32_t collect_top(const struct messaging_hot_topics *const *hot, int n,
+        struct messaging_topic_stats *top)
+{
+    struct hot_entry *e;
+    int k = 0, m = 0;
+
+    e = malloc(sizeof(*e) * MESSAGING_STATS_HOT_SLOTS * (n ? n : 1));
+    if (!e)
+        return 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < MESSAGING_STATS_HOT_SLOTS; j++) {
+            if (!hot[i]->count[j])
+                continue;
+            e[k].hash = hot[i]->hash[j];
+            e[k].count = hot[i]->count[j];
+            e[k].hot = hot[i];
+            e[k].slot = j;
+            k++;
+        }
+    }
+    /* the same topic can be hot for several writers */
+    qsort(e, k, sizeof(*e), cmp_hash);
+    for (int i = 0; i < k; i++) {
+        if (m && e[m - 1].hash == e[i].hash)
+            e[m - 1].count += e[i].count;
+        else
+            e[m++] = e[i];
+    }
+    qsort(e, m, sizeof(*e), cmp_count);
+    if (m > MESSAGING_STATS_TOP_N)
+        m = MESSAGING_STATS_TOP_N;
+    for (int i = 0; i < m; i++) {
+        /* names are read racily; a slot being replaced may show a mix */
+        memcpy(top[i].namesp, e[i].hot->namesp[e[i].slot], MESSAGING_STATS_NAME_MAX);
+        memcpy(top[i].topic, e[i].hot->topic[e[i].slot], MESSAGING_STATS_NAME_MAX);
+        top[i].namesp[MESSAGING_STATS_NAME_MAX - 1] = '\0';
+        top[i].topic[MESSAGING_STATS_NAME_MAX - 1] = '\0';
+        top[i].publishes = e[i].count;
+        top[i].subscribers = 0;
+    }
+    free(e);
+    return m;
+}
+
+void messaging_stats_snapshot(messaging_stats_t stats, struct messaging_server_stats *out)
+{
+    const struct messaging_hot_topics *hot[MESSAGING_STATS_MAX_XSTREAMS];
+    int64_t in_flight;
+    int n = 0;
+
+    memset(out, 0, sizeof(*out));
+    messaging_hist_init(&out->msg_size);
+    messaging_hist_init(&out->fanout);
+    messaging_hist_init(&out->handler_ns);
+    messaging_hist_init(&out->notify_rtt_ns);
+    out->uptime_ns = wire_now_ns() - stats->start_ns;
+    in_flight = __atomic_load_n(&stats->in_flight, __ATOMIC_RELAXED);
+    out->in_flight = in_flight > 0 ? (uint64_t)in_flight : 0;
+    for (int i = 0; i < MESSAGING_STATS_MAX_XSTREAMS; i++) {
+        const struct messaging_stats_xs *xs = __atomic_load_n(&stats->xs[i], __ATOMIC_ACQUIRE);
+
+        if (!xs)
+            continue;
+        out->publishes += xs->publishes;
+        out->publish_bytes += xs->publish_bytes;
+        out->publish_errors += xs->publish_errors;
+        out->notifies += xs->notifies;
+        out->notify_failures += xs->notify_failures;
+        out->notifies_oneway += xs->notifies_oneway;
+        out->publishes_oneway += xs->publishes_oneway;
+        out->subscribes += xs->subscribes;
+        out->unsubscribes += xs->unsubscribes;
+        out->registrations += xs->registrations;
+        messaging_hist_merge(&out->msg_size, &xs->msg_size);
+        messaging_hist_merge(&out->fanout, &xs->fanout);
+        messaging_hist_merge(&out->handler_ns, &xs->handler_ns);
+        messaging_hist_merge(&out->notify_rtt_ns, &xs->notify_rtt_ns);
+        hot[n++] = &xs->hot;
+    }
+    out->num_top = collect_top(hot, n, out->top);
+}
+
+/*
+ * Encoding: a version byte, the scalar fields as varints, the top topics as
+ * (namespace, topic, publishes, subscribers) and each histogram as count,
+ * sum, min, max, the number of non-empty buckets and (index delta, count)
+ * pairs.  put() with a NULL buffer only measures.
+ */
+
+#define STATS_VERSION 2
+
+struct stats_writer {
+    uint8_t *p;
+    size_t n;
+};
+
+static void put(struct stats_writer *w, uint64_t v)
+{
+    if (w->p)
+        w->n += wire_put_varint(w->p + w->n, v);
+    else
+        w->n += wire_varint_size(v);
+}
+
+static void put_name(struct stats_writer *w, const char *s)
+{
+    size_t len = strnlen(s, MESSAGING_STATS_NAME_MAX - 1);
+
+    put(w, len);
+    if (w->p)
+        memcpy(w->p + w->n, s, len);
+    w->n += len;
+}
+
+static void put_hist(struct stats_writer *w, const struct messaging_hist *h)
+{
+    uint64_t nnz = 0;
+    int last = 0;
+
+    for (int i = 0; i < MESSAGING_HIST_BUCKETS; i++)
+        nnz += h->counts[i] != 0;
+    put(w, h->count);
+    put(w, h->sum);
+    put(w, h->min);
+    put(w, h->max);
+    put(w, nnz);
+    for (int i = 0; i < MESSAGING_HIST_BUCKETS; i++) {
+        if (!h->counts[i])
+            continue;
+        put(w, i - last);
+        put(w, h->counts[i]);
+        last = i;
+    }
+}
+
+static void put_stats(struct stats_writer *w, const struct messaging_server_stats *s)
+{
+    if (w->p)
+        w->p[w->n] = STATS_VERSION;
+    w->n++;
+    put(w, s->uptime_ns);
+    put(w, s->publishes);
+    put(w, s->publish_bytes);
+    put(w, s->publish_errors);
+    put(w, s->notifies);
+    put(w, s->notify_failures);
+    put(w, s->notifies_oneway);
+    put(w, s->publishes_oneway);
+    put(w, s->subscribes);
+    put(w, s->unsubscribes);
+    put(w, s->registrations);
+    put(w, s->in_flight);
+    put(w, s->topics);
+    put(w, s->subscribers);
+    put(w, s->membership_bytes);
+    put(w, s->num_top);
+    for (uint32_t i = 0; i < s->num_top; i++) {
+        put_name(w, s->top[i].namesp);
+        put_name(w, s->top[i].topic);
+        put(w, s->top[i].publishes);
+        put(w, s->top[i].subscribers);
+    }
+    put_hist(w, &s->msg_size);
+    put_hist(w, &s->fanout);
+    put_hist(w, &s->handler_ns);
+    put_hist(w, &s->notify_rtt_ns);
+}
+
+int messaging_stats_encode(const struct messaging_server_stats *stats, void **buf, size_t *len)
+{
+    struct stats_writer w = { NULL, 0 };
+
+    put_stats(&w, stats);
+    if (!(w.p = messaging_pool_alloc(w.n)))
+        return MESSAGING_ERR_ALLOCATION;
+    *len = w.n;
+    w.n = 0;
+    put_stats(&w, stats);
+    *buf = w.p;
+    return MESSAGING_SUCCESS;
+}
+
+struct stats_reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    int err;
+};
+
+static uint64_t get(struct stats_reader *r)
+{
+    uint64_t v = 0;
+    size_t n;
+
+    if (r->err)
+        return 0;
+    if ((n = wire_get_varint(r->p, r->end, &v)) == 0) {
+        r->err = 1;
+        return 0;
+    }
+    r->p += n;
+    return v;
+}
+
+static void get_name(struct stats_reader *r, char *s)
+{
+    uint64_t len = get(r);
+
+    if (r->err || len >= MESSAGING_STATS_NAME_MAX || len > (uint64_t)(r->end - r->p)) {
+        r->err = 1;
+        s[0] = '\0';
+        return;
+    }
+    memcpy(s, r->p, len);
+    s[len] = '\0';
+    r->p += len;
+}
+
+static void get_hist(struct stats_reader *r, struct messaging_hist *h)
+{
+    uint64_t nnz, idx = 0;
+
+    messaging_hist_init(h);
+    h->count = get(r);
+    h->sum = get(r);
+    h->min = get(r);
+    h->max = get(r);
+    nnz = get(r);
+    if (nnz > MESSAGING_HIST_BUCKETS) {
+        r->err = 1;
+        return;
+    }
+    for (uint64_t i = 0; i < nnz && !r->err; i++) {
+        idx += get(r);
+        if (idx >= MESSAGING_HIST_BUCKETS) {
+            r->err = 1;
+            return;
+        }
+        h->counts[idx] = get(r);
+    }
+}
+
+int messaging_stats_decode(const void *buf, size_t len, struct messaging_server_stats *s)
+{
+    struct stats_reader r = { buf, (const uint8_t*)buf + len, 0 };
+
+    memset(s, 0, sizeof(*s));
+    if (len < 1 || r.p[0] != STATS_VERSION)
+        return MESSAGING_ERR_PROTOCOL;
+    r.p++;
+    s->uptime_ns = get(&r);
+    s->publishes = get(&r);
+    s->publish_bytes = get(&r);
+    s->publish_errors = get(&r);
+    s->notifies = get(&r);
+    s->notify_failures = get(&r);
+    s->notifies_oneway = get(&r);
+    s->publishes_oneway = get(&r);
+    s->subscribes = get(&r);
+    s->unsubscribes = get(&r);
+    s->registrations = get(&r);
+    s->in_flight = get(&r);
+    s->topics = get(&r);
+    s->subscribers = get(&r);
+    s->membership_bytes = get(&r);
+    s->num_top = (uint32_t)get(&r);
+    if (s->num_top > MESSAGING_STATS_TOP_N)
+        return MESSAGING_ERR_PROTOCOL;
+    for (uint32_t i = 0; i < s->num_top; i++) {
+        get_name(&r, s->top[i].namesp);
+        get_name(&r, s->top[i].topic);
+        s->top[i].publishes = get(&r);
+        s->top[i].subscribers = get(&r);
+    }
+    get_hist(&r, &s->msg_size);
+    get_hist(&r, &s->fanout);
+    get_hist(&r, &s->handler_ns);
+    get_hist(&r, &s->notify_rtt_ns);
+    return r.err ? MESSAGING_ERR_PROTOCOL : MESSAGING_SUCCESS;
+}
+
+static void write_label(FILE *f, const char *s)
+{
+    for (; *s; s++) {
+        if (*s == '\\' || *s == '"')
+            fprintf(f, "\\%c", *s);
+        else if (*s == '\n')
+            fputs("\\n", f);
+        else
+            fputc(*s, f);
+    }
+}
+
+static void write_metric(FILE *f, const char *name, const char *type, const char *help,
+        const char *instance, uint64_t v)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s{instance=\"", name, help, name, type, name);
+    write_label(f, instance);
+    fprintf(f, "\"} %llu\n", (unsigned long long)v);
+}
+
+static void write_summary(FILE *f, const char *name, const char *help,
+        const char *instance, const struct messaging_hist *h)
+{
+    static const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    fprintf(f, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+    for (size_t i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+        fprintf(f, "%s{instance=\"", name);
+        write_label(f, instance);
+        fprintf(f, "\",quantile=\"%g\"} %llu\n", q[i],
+                (unsigned long long)messaging_hist_quantile(h, q[i]));
+    }
+    fprintf(f, "%s_sum{instance=\"", name);
+    write_label(f, instance);
+    fprintf(f, "\"} %llu\n%s_count{instance=\"", (unsigned long long)h->sum, name);
+    write_label(f, instance);
+    fprintf(f, "\"} %llu\n", (unsigned long long)h->count);
+}
+
+void messaging_stats_write_prometheus(FILE *f, const struct messaging_server_stats *s,
+        const char *instance)
+{
+    write_metric(f, "messaging_uptime_seconds", "gauge", "Time since the server started.",
+            instance, s->uptime_ns / 1000000000ull);
+    write_metric(f, "messaging_publishes_total", "counter", "Publish requests handled.",
+            instance, s->publishes);
+    write_metric(f, "messaging_publish_bytes_total", "counter", "Payload bytes published.",
+            instance, s->publish_bytes);
+    write_metric(f, "messaging_publish_errors_total", "counter", "Publish requests that failed.",
+            instance, s->publish_errors);
+    write_metric(f, "messaging_notifies_total", "counter", "Notifications sent to subscribers.",
+            instance, s->notifies);
+    write_metric(f, "messaging_notify_failures_total", "counter", "Notifications that failed.",
+            instance, s->notify_failures);
+    write_metric(f, "messaging_notifies_oneway_total", "counter",
+            "Notifications sent without waiting for the subscriber.", instance, s->notifies_oneway);
+    write_metric(f, "messaging_publishes_oneway_total", "counter",
+            "Publishes the publisher did not wait for.", instance, s->publishes_oneway);
+    write_metric(f, "messaging_subscribes_total", "counter", "Subscribe requests handled.",
+            instance, s->subscribes);
+    write_metric(f, "messaging_unsubscribes_total", "counter", "Unsubscribe requests handled.",
+            instance, s->unsubscribes);
+    write_metric(f, "messaging_registrations_total", "counter", "Subscribers registered.",
+            instance, s->registrations);
+    write_metric(f, "messaging_publishes_in_flight", "gauge", "Publish requests being handled.",
+            instance, s->in_flight);
+    write_metric(f, "messaging_topics", "gauge", "Topics with subscribers.",
+            instance, s->topics);
+    write_metric(f, "messaging_subscribers", "gauge", "Registered subscribers.",
+            instance, s->subscribers);
+    write_metric(f, "messaging_membership_bytes", "gauge", "Memory used by subscriber sets.",
+            instance, s->membership_bytes);
+    write_summary(f, "messaging_message_bytes", "Payload size of published messages.",
+            instance, &s->msg_size);
+    write_summary(f, "messaging_fanout", "Subscribers notified per publish.",
+            instance, &s->fanout);
+    write_summary(f, "messaging_publish_handler_nanoseconds", "Time to handle a publish.",
+            instance, &s->handler_ns);
+    write_summary(f, "messaging_notify_rtt_nanoseconds", "Round trip of a notification.",
+            instance, &s->notify_rtt_ns);
+    fprintf(f, "# HELP messaging_topic_publishes_total Publishes to the hottest topics.\n"
+            "# TYPE messaging_topic_publishes_total counter\n");
+    for (uint32_t i = 0; i < s->num_top; i++) {
+        fprintf(f, "messaging_topic_publishes_total{instance=\"");
+        write_label(f, instance);
+        fprintf(f, "\",namesp=\"");
+        write_label(f, s->top[i].namesp);
+        fprintf(f, "\",topic=\"");
+        write_label(f, s->top[i].topic);
+        fprintf(f, "\"} %llu\n", (unsigned long long)s->top[i].publishes);
+    }
+}
+
+/* client statistics */
+
+struct cstats_thread {
+    uint64_t publishes;
+    uint64_t publish_errors;
+    uint64_t publishes_filtered;
+    uint64_t publishes_direct;
+    uint64_t direct_failures;
+    uint64_t publishes_oneway;
+    uint64_t bytes_out;
+    uint64_t subscribes;
+    uint64_t unsubscribes;
+    uint64_t notifications;
+    uint64_t bytes_in;
+    uint64_t slow_callbacks;
+    struct messaging_hist publish_rtt_ns;
+    struct messaging_hist subscribe_rtt_ns;
+    struct messaging_hist callback_ns;
+    struct messaging_hist dispatch_ns;
+    struct messaging_hot_topics hot;
+};
+
+/* start_ns is 0 while the slot is free and 1 while it is being claimed */
+struct cstats_watch {
+    uint64_t start_ns;
+    int reported;
+    char namesp[MESSAGING_STATS_NAME_MAX];
+    char topic[MESSAGING_STATS_NAME_MAX];
+};
+
+struct messaging_cstats {
+    uint64_t start_ns;
+    uint64_t warn_ns;
+    int num_servers;
+    int64_t pending;
+    int64_t max_pending;
+    uint64_t last_warn_ns;
+    unsigned watch_hint;
+    struct messaging_client_server_stats servers[MESSAGING_CSTATS_MAX_SERVERS];
+    struct cstats_thread *threads[MESSAGING_CSTATS_MAX_THREADS];
+    struct messaging_hist handler_queue;    /* written by the watchdog only */
+    struct cstats_watch watch[MESSAGING_CSTATS_WATCH_SLOTS];
+};
+
+#define CSTATS_WARN_GAP_NS 1000000000ull   /* at most one slow callback report a second */
+
+static __thread int cstats_thread_id = -1;
+static int cstats_next_thread;
+
+int messaging_cstats_create(int num_servers, uint64_t warn_ns, messaging_cstats_t *stats)
+{
+    struct messaging_cstats *s = calloc(1, sizeof(*s));
+
+    if (!s)
+        return MESSAGING_ERR_ALLOCATION;
+    s->start_ns = wire_now_ns();
+    s->warn_ns = warn_ns;
+    s->num_servers = num_servers;
+    messaging_hist_init(&s->handler_queue);
+    *stats = s;
+    return MESSAGING_SUCCESS;
+}
+
+void messaging_cstats_destroy(messaging_cstats_t stats)
+{
+    if (!stats)
+        return;
+    for (int i = 0; i < MESSAGING_CSTATS_MAX_THREADS; i++)
+        free(stats->threads[i]);
+    free(stats);
+}
+
+static struct cstats_thread *cstats_local(messaging_cstats_t stats)
+{
+    static struct cstats_thread dummy;
+    struct cstats_thread *t, *expected = NULL;
+    int id = cstats_thread_id;
+
+    if (id < 0)
+        id = cstats_thread_id = __atomic_fetch_add(&cstats_next_thread, 1, __ATOMIC_RELAXED)
+            % MESSAGING_CSTATS_MAX_THREADS;
+    t = __atomic_load_n(&stats->threads[id], __ATOMIC_ACQUIRE);
+    if (t)
+        return t;
+    if (!(t = calloc(1, sizeof(*t))))
+        return &dummy;
+    messaging_hist_init(&t->publish_rtt_ns);
+    messaging_hist_init(&t->subscribe_rtt_ns);
+    messaging_hist_init(&t->callback_ns);
+    messaging_hist_init(&t->dispatch_ns);
+    if (!__atomic_compare_exchange_n(&stats->threads[id], &expected, t, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(t);
+        t = expected;
+    }
+    return t;
+}
+
+static void server_rtt(messaging_cstats_t stats, int server, int publish,
+        uint64_t rtt_ns, int ok)
+{
+    struct messaging_client_server_stats *s;
+    uint64_t max;
+
+    if (server < 0)
+        return;
+    s = &stats->servers[server % MESSAGING_CSTATS_MAX_SERVERS];
+    __atomic_add_fetch(publish ? &s->publishes : &s->updates, 1, __ATOMIC_RELAXED);
+    if (!ok)
+        __atomic_add_fetch(&s->errors, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->rtt_sum_ns, rtt_ns, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&s->rtt_max_ns, __ATOMIC_RELAXED);
+    while (rtt_ns > max && !__atomic_compare_exchange_n(&s->rtt_max_ns, &max, rtt_ns, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void messaging_cstats_publish(messaging_cstats_t stats, int server, size_t len,
+        uint64_t rtt_ns, int ok)
+{
+    struct cstats_thread *t = cstats_local(stats);
+
+    t->publishes++;
+    t->bytes_out += len;
+    if (!ok)
+        t->publish_errors++;
+    messaging_hist_record(&t->publish_rtt_ns, rtt_ns);
+    server_rtt(stats, server, 1, rtt_ns, ok);
+}
+
+void messaging_cstats_filtered(messaging_cstats_t stats, size_t len)
+{
+    struct cstats_thread *t = cstats_local(stats);
+
+    t->publishes++;
+    t->publishes_filtered++;
+    t->bytes_out += len;
+}
+
+void messaging_cstats_direct(messaging_cstats_t stats, int failed)
+{
+    struct cstats_thread *t = cstats_local(stats);
+
+    t->publishes_direct++;
+    t->direct_failures += failed;
+}
+
+void messaging_cstats_oneway(messaging_cstats_t stats, int server, size_t len, int ok)
+{
+    struct cstats_thread *t = cstats_local(stats);
+    struct messaging_client_server_stats *s;
+
+    t->publishes++;
+    t->publishes_oneway++;
+    t->bytes_out += len;
+    if (!ok)
+        t->publish_errors++;
+    /* no round trip to account for */
+    s = &stats->servers[server % MESSAGING_CSTATS_MAX_SERVERS];
+    __atomic_add_fetch(&s->publishes, 1, __ATOMIC_RELAXED);
+    if (!ok)
+        __atomic_add_fetch(&s->errors, 1, __ATOMIC_RELAXED);
+}
+
+void messaging_cstats_updates(messaging_cstats_t stats, int subscribe, size_t count)
+{
+    struct cstats_thread *t = cstats_local(stats);
+
+    if (subscribe)
+        t->subscribes += count;
+    else
+        t->unsubscribes += count;
+}
+
+void messaging_cstats_update_rtt(messaging_cstats_t stats, int server, uint64_t rtt_ns, int ok)
+{
+    messaging_hist_record(&cstats_local(stats)->subscribe_rtt_ns, rtt_ns);
+    server_rtt(stats, server, 0, rtt_ns, ok);
+}
+
+/* FNV-1a over namesp and topic, only to tell hot topics apart */
+static uint64_t topic_hash(const char *namesp, const char *topic)
+{
+    uint64_t h = 14695981039346656037ull;
+
+    for (const char *p = namesp; *p; p++)
+        h = (h ^ (uint8_t)*p) * 1099511628211ull;
+    h = (h ^ 0xff) * 1099511628211ull;
+    for (const char *p = topic; *p; p++)
+        h = (h ^ (uint8_t)*p) * 1099511628211ull;
+    return h;
+}
+
+void messaging_cstats_received(messaging_cstats_t stats, const char *namesp, const char *topic,
+        size_t len)
+{
+    struct cstats_thread *t = cstats_local(stats);
+
+    t->notifications++;
+    t->bytes_in += len;
+    messaging_stats_hot(&t->hot, topic_hash(namesp, topic), namesp, topic);
+}
+
+void messaging_cstats_pending(messaging_cstats_t stats, int delta)
+{
+    int64_t n = __atomic_add_fetch(&stats->pending, delta, __ATOMIC_RELAXED);
+    int64_t max = __atomic_load_n(&stats->max_pending, __ATOMIC_RELAXED);
+
+    while (n > max && !__atomic_compare_exchange_n(&stats->max_pending, &max, n, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static int watch_claim(messaging_cstats_t stats, const char *namesp, const char *topic)
+{
+    unsigned start = __atomic_fetch_add(&stats->watch_hint, 1, __ATOMIC_RELAXED);
+
+    for (unsigned i = 0; i < MESSAGING_CSTATS_WATCH_SLOTS; i++) {
+        int k = (start + i) % MESSAGING_CSTATS_WATCH_SLOTS;
+        struct cstats_watch *w = &stats->watch[k];
+        uint64_t expected = 0;
+
+        if (__atomic_load_n(&w->start_ns, __ATOMIC_RELAXED) != 0 ||
+                !__atomic_compare_exchange_n(&w->start_ns, &expected, 1, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+        copy_name(w->namesp, namesp);
+        copy_name(w->topic, topic);
+        w->reported = 0;
+        return k;
+    }
+    return -1;
+}
+
+void messaging_cstats_callback_begin(messaging_cstats_t stats, struct messaging_cstats_cb *cb,
+        const char *namesp, const char *topic, uint64_t recv_ns)
+{
+    cb->namesp = namesp;
+    cb->topic = topic;
+    cb->slot = stats->warn_ns ? watch_claim(stats, namesp, topic) : -1;
+    cb->start_ns = wire_now_ns();
+    if (recv_ns && cb->start_ns >= recv_ns)
+        messaging_hist_record(&cstats_local(stats)->dispatch_ns, cb->start_ns - recv_ns);
+    if (cb->slot >= 0)
+        __atomic_store_n(&stats->watch[cb->slot].start_ns, cb->start_ns, __ATOMIC_RELEASE);
+}
+
+void messaging_cstats_callback_end(messaging_cstats_t stats, struct messaging_cstats_cb *cb)
+{
+    /* the callback may have yielded, take the slot of the thread we are on now */
+    struct cstats_thread *t = cstats_local(stats);
+    uint64_t now = wire_now_ns(), ns = now - cb->start_ns, last;
+    int reported = 0;
+
+    messaging_hist_record(&t->callback_ns, ns);
+    if (cb->slot >= 0) {
+        reported = __atomic_load_n(&stats->watch[cb->slot].reported, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&stats->watch[cb->slot].start_ns, 0, __ATOMIC_RELEASE);
+    }
+    if (!stats->warn_ns || ns <= stats->warn_ns)
+        return;
+    t->slow_callbacks++;
+    last = __atomic_load_n(&stats->last_warn_ns, __ATOMIC_RELAXED);
+    if (reported || now - last < CSTATS_WARN_GAP_NS ||
+            !__atomic_compare_exchange_n(&stats->last_warn_ns, &last, now, 0,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+    fprintf(stderr, "Warning: callback for %s/%s took %.3f s\n", cb->namesp, cb->topic, ns / 1e9);
+}
+
+void messaging_cstats_watch(messaging_cstats_t stats, long queue_size)
+{
+    uint64_t now = wire_now_ns();
+
+    if (queue_size >= 0)
+        messaging_hist_record(&stats->handler_queue, (uint64_t)queue_size);
+    if (!stats->warn_ns)
+        return;
+    for (int i = 0; i < MESSAGING_CSTATS_WATCH_SLOTS; i++) {
+        struct cstats_watch *w = &stats->watch[i];
+        uint64_t start = __atomic_load_n(&w->start_ns, __ATOMIC_ACQUIRE);
+        char namesp[MESSAGING_STATS_NAME_MAX], topic[MESSAGING_STATS_NAME_MAX];
+
+        if (start <= 1 || now < start || now - start <= stats->warn_ns ||
+                __atomic_load_n(&w->reported, __ATOMIC_RELAXED))
+            continue;
+        memcpy(namesp, w->namesp, sizeof(namesp));
+        memcpy(topic, w->topic, sizeof(topic));
+        /* the names are only ours if the callback is still the same one */
+        if (__atomic_load_n(&w->start_ns, __ATOMIC_ACQUIRE) != start)
+            continue;
+        __atomic_store_n(&w->reported, 1, __ATOMIC_RELEASE);
+        namesp[sizeof(namesp) - 1] = '\0';
+        topic[sizeof(topic) - 1] = '\0';
+        fprintf(stderr, "Warning: callback for %s/%s has been running for %.3f s\n",
+                namesp, topic, (now - start) / 1e9);
+    }
+}
+
+void messaging_cstats_snapshot(messaging_cstats_t stats, struct messaging_client_stats *out)
+{
+    const struct messaging_hot_topics *hot[MESSAGING_CSTATS_MAX_THREADS];
+    int64_t pending;
+    int n = 0;
+
+    memset(out, 0, sizeof(*out));
+    messaging_hist_init(&out->publish_rtt_ns);
+    messaging_hist_init(&out->subscribe_rtt_ns);
+    messaging_hist_init(&out->callback_ns);
+    messaging_hist_init(&out->dispatch_ns);
+    out->uptime_ns = wire_now_ns() - stats->start_ns;
+    pending = __atomic_load_n(&stats->pending, __ATOMIC_RELAXED);
+    out->pending = pending > 0 ? (uint64_t)pending : 0;
+    out->max_pending = (uint64_t)__atomic_load_n(&stats->max_pending, __ATOMIC_RELAXED);
+    out->num_servers = stats->num_servers < MESSAGING_CSTATS_MAX_SERVERS ?
+        stats->num_servers : MESSAGING_CSTATS_MAX_SERVERS;
+    for (uint32_t i = 0; i < out->num_servers; i++) {
+        const struct messaging_client_server_stats *s = &stats->servers[i];
+
+        out->servers[i].publishes = __atomic_load_n(&s->publishes, __ATOMIC_RELAXED);
+        out->servers[i].updates = __atomic_load_n(&s->updates, __ATOMIC_RELAXED);
+        out->servers[i].errors = __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+        out->servers[i].rtt_sum_ns = __atomic_load_n(&s->rtt_sum_ns, __ATOMIC_RELAXED);
+        out->servers[i].rtt_max_ns = __atomic_load_n(&s->rtt_max_ns, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < MESSAGING_CSTATS_MAX_THREADS; i++) {
+        const struct cstats_thread *t = __atomic_load_n(&stats->threads[i], __ATOMIC_ACQUIRE);
+
+        if (!t)
+            continue;
+        out->publishes += t->publishes;
+        out->publish_errors += t->publish_errors;
+        out->publishes_filtered += t->publishes_filtered;
+        out->publishes_direct += t->publishes_direct;
+        out->direct_failures += t->direct_failures;
+        out->publishes_oneway += t->publishes_oneway;
+        out->bytes_out += t->bytes_out;
+        out->subscribes += t->subscribes;
+        out->unsubscribes += t->unsubscribes;
+        out->notifications += t->notifications;
+        out->bytes_in += t->bytes_in;
+        out->slow_callbacks += t->slow_callbacks;
+        messaging_hist_merge(&out->publish_rtt_ns, &t->publish_rtt_ns);
+        messaging_hist_merge(&out->subscribe_rtt_ns, &t->subscribe_rtt_ns);
+        messaging_hist_merge(&out->callback_ns, &t->callback_ns);
+        messaging_hist_merge(&out->dispatch_ns, &t->dispatch_ns);
+        hot[n++] = &t->hot;
+    }
+    out->handler_queue = stats->handler_queue;
+    out->num_top = collect_top(hot, n, out->top);
+}
+
+static void write_server_metric(FILE *f, const char *name, const char *type, const char *help,
+        const char *instance, const struct messaging_client_stats *s, size_t field)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    for (uint32_t i = 0; i < s->num_servers; i++) {
+        fprintf(f, "%s{instance=\"", name);
+        write_label(f, instance);
+        fprintf(f, "\",server=\"%u\"} %llu\n", i,
+                (unsigned long long)*(const uint64_t*)((const char*)&s->servers[i] + field));
+    }
+}
+
+void messaging_client_stats_write_prometheus(FILE *f, const struct messaging_client_stats *s,
+        const char *instance)
+{
+    write_metric(f, "messaging_client_uptime_seconds", "gauge", "Time since the client started.",
+            instance, s->uptime_ns / 1000000000ull);
+    write_metric(f, "messaging_client_publishes_total", "counter", "Messages published.",
+            instance, s->publishes);
+    write_metric(f, "messaging_client_publish_errors_total", "counter", "Publishes that failed.",
+            instance, s->publish_errors);
+    write_metric(f, "messaging_client_publishes_filtered_total", "counter",
+            "Publishes not sent because the topic had no subscribers.", instance,
+            s->publishes_filtered);
+    write_metric(f, "messaging_client_publishes_direct_total", "counter",
+            "Publishes sent straight to the subscribers.", instance, s->publishes_direct);
+    write_metric(f, "messaging_client_direct_failures_total", "counter",
+            "Subscribers direct publishes could not reach.", instance, s->direct_failures);
+    write_metric(f, "messaging_client_publishes_oneway_total", "counter",
+            "Publishes sent without waiting for the server.", instance, s->publishes_oneway);
+    write_metric(f, "messaging_client_bytes_out_total", "counter", "Payload bytes published.",
+            instance, s->bytes_out);
+    write_metric(f, "messaging_client_subscribes_total", "counter", "Topics subscribed to.",
+            instance, s->subscribes);
+    write_metric(f, "messaging_client_unsubscribes_total", "counter", "Topics unsubscribed from.",
+            instance, s->unsubscribes);
+    write_metric(f, "messaging_client_notifications_total", "counter", "Messages received.",
+            instance, s->notifications);
+    write_metric(f, "messaging_client_bytes_in_total", "counter", "Payload bytes received.",
+            instance, s->bytes_in);
+    write_metric(f, "messaging_client_slow_callbacks_total", "counter",
+            "Callbacks that ran past the watchdog limit.", instance, s->slow_callbacks);
+    write_metric(f, "messaging_client_pending", "gauge",
+            "Notifications received whose callback has not returned.", instance, s->pending);
+    write_metric(f, "messaging_client_pending_max", "gauge",
+            "Most notifications pending at once.", instance, s->max_pending);
+    write_metric(f, "messaging_client_reorder_held_total", "counter",
+            "Notifications held until the ones before them were delivered.", instance, s->reorder_held);
+    write_metric(f, "messaging_client_reorder_gaps_total", "counter",
+            "Sequence numbers given up on by the reorder buffers.", instance, s->reorder_gaps);
+    write_metric(f, "messaging_client_reorder_duplicates_total", "counter",
+            "Notifications dropped because their turn had passed.", instance, s->reorder_duplicates);
+    write_server_metric(f, "messaging_client_server_publishes_total", "counter",
+            "Publishes sent to each server.", instance, s,
+            offsetof(struct messaging_client_server_stats, publishes));
+    write_server_metric(f, "messaging_client_server_updates_total", "counter",
+            "Subscription round trips to each server.", instance, s,
+            offsetof(struct messaging_client_server_stats, updates));
+    write_server_metric(f, "messaging_client_server_errors_total", "counter",
+            "Failed requests to each server.", instance, s,
+            offsetof(struct messaging_client_server_stats, errors));
+    write_server_metric(f, "messaging_client_server_rtt_nanoseconds_sum", "counter",
+            "Round trips to each server, summed.", instance, s,
+            offsetof(struct messaging_client_server_stats, rtt_sum_ns));
+    write_server_metric(f, "messaging_client_server_rtt_nanoseconds_max", "gauge",
+            "Longest round trip to each server.", instance, s,
+            offsetof(struct messaging_client_server_stats, rtt_max_ns));
+    write_summary(f, "messaging_client_publish_rtt_nanoseconds", "Round trip of a publish.",
+            instance, &s->publish_rtt_ns);
+    write_summary(f, "messaging_client_subscribe_rtt_nanoseconds",
+            "Round trip of a subscribe or unsubscribe.", instance, &s->subscribe_rtt_ns);
+    write_summary(f, "messaging_client_callback_nanoseconds", "Time spent in callbacks.",
+            instance, &s->callback_ns);
+    write_summary(f, "messaging_client_dispatch_nanoseconds",
+            "Time from receiving a notification to starting its callback.",
+            instance, &s->dispatch_ns);
+    write_summary(f, "messaging_client_handler_queue", "Handler pool size, sampled.",
+            instance, &s->handler_queue);
+    fprintf(f, "# HELP messaging_client_topic_notifications_total Messages received on the hottest topics.\n"
+            "# TYPE messaging_client_topic_notifications_total counter\n");
+    for (uint32_t i = 0; i < s->num_top; i++) {
+        fprintf(f, "messaging_client_topic_notifications_total{instance=\"");
+        write_label(f, instance);
+        fprintf(f, "\",namesp=\"");
+        write_label(f, s->top[i].namesp);
+        fprintf(f, "\",topic=\"");
+        write_label(f, s->top[i].topic);
+        fprintf(f, "\"} %llu\n", (unsigned long long)s->top[i].publishes);
+    }
+}
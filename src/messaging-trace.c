@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <abt.h>
+#include <messaging-common.h>
+#include <messaging-wire.h>
+#include <messaging-trace.h>
+
+#define TRACE_FLUSH_MS     100     /* how often the ring is drained */
+#define TRACE_WRITE_BATCH  256     /* spans per fwrite, the buffer is on a ULT stack */
+
+/* a ring slot is free for position p when seq == p and holds the span
+ * recorded at p once seq == p + 1 */
+struct trace_slot {
+    uint64_t seq;
+    struct messaging_trace_span span;
+};
+
+static struct {
+    pthread_mutex_t lock;       /* start, stop and draining */
+    int users;
+    int enabled;
+    uint32_t rate;
+    uint64_t salt;              /* upper half of our trace ids */
+    uint64_t sampled;
+    uint64_t dropped;
+    struct trace_slot *slots;
+    uint64_t mask;
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+    FILE *file;
+    margo_instance_id mid;
+    ABT_thread flusher;
+    int stop;
+} tracer = { PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t parse_count(const char *s, uint32_t def)
+{
+    char *end;
+    unsigned long long v;
+
+    if (s == NULL || *s == '\0')
+        return def;
+    v = strtoull(s, &end, 10);
+    if (*end == 'k' || *end == 'K')
+        v <<= 10;
+    else if (*end == 'm' || *end == 'M')
+        v <<= 20;
+    return (uint32_t)v;
+}
+
+void messaging_trace_config_init(struct messaging_trace_config *cfg)
+{
+    const char *s;
+
+    cfg->rate = parse_count(getenv("MESSAGING_TRACE"), 0);
+    s = getenv("MESSAGING_TRACE_DIR");
+    snprintf(cfg->dir, sizeof(cfg->dir), "%s", (s != NULL && *s != '\0') ? s : ".");
+    cfg->num_spans = parse_count(getenv("MESSAGING_TRACE_SPANS"), MESSAGING_TRACE_DEFAULT_SPANS);
+}
+
+/* moves the recorded spans to the file; callers hold tracer.lock */
+static void trace_drain(void)
+{
+    struct messaging_trace_span buf[TRACE_WRITE_BATCH];
+    struct trace_slot *slot;
+    size_t n = 0;
+
+    for (;;) {
+        slot = &tracer.slots[tracer.tail & tracer.mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tracer.tail + 1)
+            break;
+        buf[n++] = slot->span;
+        __atomic_store_n(&slot->seq, tracer.tail + tracer.mask + 1, __ATOMIC_RELEASE);
+        tracer.tail++;
+        if (n == TRACE_WRITE_BATCH) {
+            fwrite(buf, sizeof(buf[0]), n, tracer.file);
+            n = 0;
+        }
+    }
+    if (n)
+        fwrite(buf, sizeof(buf[0]), n, tracer.file);
+    fflush(tracer.file);
+}
+
+static void trace_flusher(void *arg)
+{
+    (void)arg;
+    while (!__atomic_load_n(&tracer.stop, __ATOMIC_ACQUIRE)) {
+        margo_thread_sleep(tracer.mid, TRACE_FLUSH_MS);
+        pthread_mutex_lock(&tracer.lock);
+        trace_drain();
+        pthread_mutex_unlock(&tracer.lock);
+    }
+}
+
+static FILE *trace_open(margo_instance_id mid, const char *dir)
+{
+    struct messaging_trace_header hdr;
+    char path[512];
+    hg_addr_t self;
+    hg_size_t len = sizeof(hdr.addr);
+    FILE *f;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MESSAGING_TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = MESSAGING_TRACE_VERSION;
+    hdr.pid = (uint32_t)getpid();
+    gethostname(hdr.host, sizeof(hdr.host) - 1);
+    if (margo_addr_self(mid, &self) == HG_SUCCESS) {
+        if (margo_addr_to_string(mid, hdr.addr, &len, self) != HG_SUCCESS)
+            hdr.addr[0] = '\0';
+        margo_addr_free(mid, self);
+    }
+
+    snprintf(path, sizeof(path), "%s/messaging-trace.%s.%u.bin", dir, hdr.host, hdr.pid);
+    f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Warning: could not open trace file %s (%s)\n", path, strerror(errno));
+        return NULL;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+int messaging_trace_start(margo_instance_id mid, const struct messaging_trace_config *cfg)
+{
+    uint64_t n = 1;
+    ABT_pool pool;
+    int ret = MESSAGING_SUCCESS;
+
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.users > 0) {
+        tracer.users++;
+        goto out;
+    }
+    if (cfg->rate == 0) {
+        ret = MESSAGING_ERR_INVALID_ARG;
+        goto out;
+    }
+    while (n < cfg->num_spans)
+        n <<= 1;
+    tracer.slots = malloc(n * sizeof(*tracer.slots));
+    if (tracer.slots == NULL) {
+        ret = MESSAGING_ERR_ALLOCATION;
+        goto out;
+    }
+    for (uint64_t i = 0; i < n; i++)
+        tracer.slots[i].seq = i;
+    tracer.mask = n - 1;
+    tracer.head = tracer.tail = 0;
+    tracer.file = trace_open(mid, cfg->dir);
+    if (tracer.file == NULL) {
+        free(tracer.slots);
+        ret = MESSAGING_ERR_INVALID_ARG;
+        goto out;
+    }
+    tracer.rate = cfg->rate;
+    /* ids only have to be unique within a run */
+    tracer.salt = ((wire_now_ns() ^ ((uint64_t)getpid() << 20)) << 32) | (1ULL << 32);
+    tracer.mid = mid;
+    tracer.stop = 0;
+    margo_get_handler_pool(mid, &pool);
+    if (ABT_thread_create(pool, trace_flusher, NULL, ABT_THREAD_ATTR_NULL, &tracer.flusher) != ABT_SUCCESS) {
+        fclose(tracer.file);
+        free(tracer.slots);
+        ret = MESSAGING_ERR_ARGOBOTS;
+        goto out;
+    }
+    __atomic_store_n(&tracer.enabled, 1, __ATOMIC_RELEASE);
+    tracer.users = 1;
+out:
+    pthread_mutex_unlock(&tracer.lock);
+    return ret;
+}
+
+void messaging_trace_stop(void)
+{
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.users == 0 || --tracer.users > 0) {
+        pthread_mutex_unlock(&tracer.lock);
+        return;
+    }
+    __atomic_store_n(&tracer.enabled, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&tracer.stop, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tracer.lock);
+
+    ABT_thread_join(tracer.flusher);
+    ABT_thread_free(&tracer.flusher);
+
+    pthread_mutex_lock(&tracer.lock);
+    trace_drain();
+    fclose(tracer.file);
+    tracer.file = NULL;
+    free(tracer.slots);
+    tracer.slots = NULL;
+    if (tracer.dropped)
+        fprintf(stderr, "Warning: %llu trace spans dropped, raise MESSAGING_TRACE_SPANS\n",
+                (unsigned long long)tracer.dropped);
+    pthread_mutex_unlock(&tracer.lock);
+}
+
+int messaging_trace_enabled(void)
+{
+    return __atomic_load_n(&tracer.enabled, __ATOMIC_ACQUIRE);
+}
+
+uint64_t messaging_trace_sample(void)
+{
+    uint64_t n;
+
+    if (!messaging_trace_enabled())
+        return 0;
+    n = __atomic_fetch_add(&tracer.sampled, 1, __ATOMIC_RELAXED);
+    if (n % tracer.rate != 0)
+        return 0;
+    return tracer.salt | ((n / tracer.rate) & 0xffffffffULL);
+}
+
+void messaging_trace_record(uint64_t trace_id, uint32_t event, uint32_t arg, uint64_t ts)
+{
+    struct trace_slot *slot;
+    uint64_t pos, seq;
+
+    if (trace_id == 0 || !messaging_trace_enabled())
+        return;
+    pos = __atomic_load_n(&tracer.head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &tracer.slots[pos & tracer.mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&tracer.head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((int64_t)(seq - pos) < 0) {
+            /* the flusher has not freed this slot yet */
+            __atomic_add_fetch(&tracer.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&tracer.head, __ATOMIC_RELAXED);
+        }
+    }
+    slot->span.trace_id = trace_id;
+    slot->span.ts = ts;
+    slot->span.event = event;
+    slot->span.arg = arg;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t messaging_trace_dropped(void)
+{
+    return __atomic_load_n(&tracer.dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <messaging-transport.h>
+
+static hg_return_t m_lookup(void *ctx, const char *name, hg_addr_t *addr)
+{
+    return margo_addr_lookup((margo_instance_id)ctx, name, addr);
+}
+
+static hg_return_t m_addr_dup(void *ctx, hg_addr_t addr, hg_addr_t *copy)
+{
+    return margo_addr_dup((margo_instance_id)ctx, addr, copy);
+}
+
+static hg_return_t m_addr_free(void *ctx, hg_addr_t addr)
+{
+    return margo_addr_free((margo_instance_id)ctx, addr);
+}
+
+static hg_return_t m_create(void *ctx, hg_addr_t addr, hg_id_t id, hg_handle_t *h)
+{
+    return margo_create((margo_instance_id)ctx, addr, id, h);
+}
+
+static hg_return_t m_forward(void *ctx, hg_handle_t h, uint16_t provider, void *in)
+{
+    (void)ctx;
+    return margo_provider_forward(provider, h, in);
+}
+
+static hg_return_t m_iforward(void *ctx, hg_handle_t h, uint16_t provider, void *in, margo_request *req)
+{
+    (void)ctx;
+    return margo_provider_iforward(provider, h, in, req);
+}
+
+static hg_return_t m_iforward_timed(void *ctx, hg_handle_t h, uint16_t provider, void *in,
+        double timeout_ms, margo_request *req)
+{
+    (void)ctx;
+    return margo_provider_iforward_timed(provider, h, in, timeout_ms, req);
+}
+
+static hg_return_t m_wait(void *ctx, margo_request req)
+{
+    (void)ctx;
+    return margo_wait(req);
+}
+
+static hg_return_t m_test(void *ctx, margo_request req, int *flag)
+{
+    (void)ctx;
+    return (hg_return_t)margo_test(req, flag);
+}
+
+static hg_return_t m_get_output(void *ctx, hg_handle_t h, void *out)
+{
+    (void)ctx;
+    return margo_get_output(h, out);
+}
+
+static hg_return_t m_free_output(void *ctx, hg_handle_t h, void *out)
+{
+    (void)ctx;
+    return margo_free_output(h, out);
+}
+
+static hg_return_t m_respond(void *ctx, hg_handle_t h, void *out)
+{
+    (void)ctx;
+    return margo_respond(h, out);
+}
+
+static hg_return_t m_destroy(void *ctx, hg_handle_t h)
+{
+    (void)ctx;
+    return margo_destroy(h);
+}
+
+static const struct messaging_transport_ops margo_ops = {
+    "margo",
+    m_lookup,
+    m_addr_dup,
+    m_addr_free,
+    m_create,
+    m_forward,
+    m_iforward,
+    m_iforward_timed,
+    m_wait,
+    m_test,
+    m_get_output,
+    m_free_output,
+    m_respond,
+    m_destroy,
+};
+
+void messaging_transport_margo(margo_instance_id mid, struct messaging_transport *t)
+{
+    t->ops = &margo_ops;
+    t->ctx = (void *)mid;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Server fan-out and delivery latency as the number of subscribing ranks per
+ * node grows.  Run it with MESSAGING_SHM=1 and MESSAGING_AGGREGATE=1 to have
+ * one rank per node subscribe for the others, and with MESSAGING_AGGREGATE=0
+ * to compare.
+ *
+ * Servers must already be running (see test_script.sh).  Rank 0 publishes
+ * through the servers only; the other ranks subscribe, 1, 2, 4, ... of them
+ * per node.  Latency uses CLOCK_REALTIME, so across nodes it is only as good
+ * as their clock synchronization.
+ *
+ * Usage: mpirun -n num_ranks ./aggregate_bench [transport] [count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+#include <margo.h>
+#include <mpi.h>
+#include <messaging-client.h>
+
+#define WAIT_SECONDS 30
+
+static volatile long received;
+static double lat_sum;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void handler(void *args, void *msg)
+{
+    uint64_t sent;
+
+    memcpy(&sent, msg, sizeof(sent));
+    lat_sum += (now_ns() - sent) * 1e-3;
+    received++;
+}
+
+int main(int argc, char **argv)
+{
+    char *transport = argc > 1 ? argv[1] : "verbs";
+    long count = argc > 2 ? atol(argv[2]) : 1000;
+    const char *agg = getenv("MESSAGING_AGGREGATE");
+    MPI_Comm sub_comm, node_comm;
+    messaging_client_t c;
+    margo_instance_id mid;
+    int rank, node_rank = 0, node_size = 0, max_node = 0, ret;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* the publisher stays out of the subscribers' node groups and rings */
+    MPI_Comm_split(MPI_COMM_WORLD, rank == 0, rank, &sub_comm);
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, -1);
+    assert(mid);
+    if(rank == 0){
+        setenv("MESSAGING_SHM", "0", 1);
+        ret = client_init(mid, &c);
+    }else{
+        ret = client_init_with_mpi(mid, sub_comm, &c);
+        MPI_Comm_split_type(sub_comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+        MPI_Comm_rank(node_comm, &node_rank);
+        MPI_Comm_size(node_comm, &node_size);
+    }
+    if(ret != MESSAGING_SUCCESS || c == MESSAGING_CLIENT_NULL){
+        fprintf(stderr, "Rank %d: client init failed (%d)\n", rank, ret);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Allreduce(&node_size, &max_node, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    if(rank == 0)
+        printf("aggregate=%s messages=%ld\n%10s %14s %16s %14s\n", agg ? agg : "0", count,
+                "per_node", "subscribers", "notify_rpcs/msg", "latency(us)");
+    for(int k = 1; k <= max_node; k *= 2){
+        int subscribed = rank != 0 && node_rank < k, nsubs;
+        uint64_t before = messaging_notify_count(c), rpcs, rpcs_all;
+        long got, got_all;
+        double lat, lat_all;
+
+        received = 0;
+        lat_sum = 0;
+        if(subscribed)
+            subscribe(c, "aggregate_bench", "fanout", handler, NULL);
+        MPI_Allreduce(&subscribed, &nsubs, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+        if(rank == 0){
+            for(long i = 0; i < count; i++){
+                uint64_t stamp = now_ns();
+                publish(c, "aggregate_bench", "fanout", &stamp, sizeof(stamp));
+            }
+        }else if(subscribed){
+            double start = MPI_Wtime();
+            while(received < count && MPI_Wtime() - start < WAIT_SECONDS)
+                margo_thread_sleep(mid, 1);
+            if(received < count)
+                fprintf(stderr, "Rank %d: got %ld of %ld messages\n", rank, (long)received, count);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        rpcs = messaging_notify_count(c) - before;
+        got = received;
+        lat = lat_sum;
+        MPI_Reduce(&rpcs, &rpcs_all, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&got, &got_all, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&lat, &lat_all, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        if(rank == 0)
+            printf("%10d %14d %16.2f %14.2f\n", k, nsubs, (double)rpcs_all / count,
+                    got_all ? lat_all / got_all : 0.0);
+
+        if(subscribed)
+            unsubscribe(c, "aggregate_bench", "fanout");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    client_finalize(c);
+    if(rank != 0)
+        MPI_Comm_free(&node_comm);
+    MPI_Comm_free(&sub_comm);
+    margo_finalize(mid);
+    MPI_Finalize();
+    return 0;
+}
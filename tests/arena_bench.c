@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Bulk transfer latency with per-message registration against the
+ * pre-registered arena.
+ *
+ * Rank 0 serves an RPC that pulls the payload named by the request; rank 1
+ * sends requests for a range of message sizes, once registering a fresh
+ * buffer for every message (what Mercury does for large inline payloads)
+ * and once sub-allocating from the arena.  Both sides use the same mode.
+ *
+ * Usage: mpirun -n 2 ./arena_bench [transport] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <margo.h>
+#include <mpi.h>
+#include <messaging-common.h>
+#include <messaging-pool.h>
+#include <messaging-arena.h>
+#include <ss_data.h>
+
+static const size_t sizes[] = { 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static void bench_rpc(hg_handle_t h);
+DECLARE_MARGO_RPC_HANDLER(bench_rpc)
+
+static void bench_rpc(hg_handle_t h)
+{
+    message_t in;
+    response_t out;
+    struct messaging_arena_buf buf = {0};
+    margo_instance_id mid = margo_hg_handle_get_instance(h);
+    const struct hg_info *info = margo_get_info(h);
+    messaging_arena_t arena = (messaging_arena_t)margo_registered_data(mid, info->id);
+
+    struct wire_msg m;
+
+    margo_get_input(h, &in);
+    out.ret = wire_decode(in.evnt.raw_data, in.evnt.size, &m);
+    if (out.ret == MESSAGING_SUCCESS)
+        out.ret = messaging_arena_pull(arena, mid, info->addr, in.bulk, in.offset,
+                m.payload_len, &buf);
+    messaging_arena_release(arena, &buf);
+    margo_respond(h, &out);
+    margo_free_input(h, &in);
+    margo_destroy(h);
+}
+DEFINE_MARGO_RPC_HANDLER(bench_rpc)
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* sends 'iters' requests of 'len' bytes, returns the median latency in seconds */
+static double run(margo_instance_id mid, hg_addr_t target, hg_id_t id,
+        messaging_arena_t arena, size_t len, int iters, double *avg)
+{
+    double *lat = malloc(sizeof(double) * iters);
+    struct wire_msg m;
+    char hdr[WIRE_ALIGN * 2];
+    double med;
+
+    /* a header-only message announcing 'len' bytes of bulk payload */
+    wire_msg_init(&m, "bench", "bench");
+    m.flags = WIRE_FLAG_BULK;
+    m.payload_len = len;
+
+    *avg = 0;
+    for (int i = 0; i < iters; i++) {
+        struct messaging_arena_buf buf = {0};
+        message_t in;
+        response_t out;
+        hg_handle_t h;
+        uint64_t st = wire_now_ns();
+
+        /* arena is NULL in per-message mode, so this registers a buffer */
+        if (messaging_arena_get(arena, mid, len, HG_BULK_READ_ONLY, &buf) != MESSAGING_SUCCESS) {
+            fprintf(stderr, "arena_bench: no buffer for %zu bytes\n", len);
+            exit(1);
+        }
+        memset(buf.ptr, 'a', len);
+        in.evnt.size = wire_encode(hdr, sizeof(hdr), &m);
+        in.evnt.raw_data = hdr;
+        in.bulk = buf.bulk;
+        in.offset = buf.offset;
+        margo_create(mid, target, id, &h);
+        margo_forward(h, &in);
+        margo_get_output(h, &out);
+        assert(out.ret == MESSAGING_SUCCESS);
+        margo_free_output(h, &out);
+        margo_destroy(h);
+        messaging_arena_release(arena, &buf);
+        lat[i] = (wire_now_ns() - st) * 1e-9;
+        *avg += lat[i];
+    }
+    *avg /= iters;
+    qsort(lat, iters, sizeof(double), cmp_double);
+    med = lat[iters / 2];
+    free(lat);
+    return med;
+}
+
+int main(int argc, char **argv)
+{
+    const char *transport = argc > 1 ? argv[1] : "na+sm";
+    int iters = argc > 2 ? atoi(argv[2]) : 1000;
+    struct messaging_arena_config cfg;
+    messaging_arena_t arena;
+    margo_instance_id mid;
+    hg_id_t reg_id, arena_id;
+    int rank, size;
+    char addr_str[256];
+    hg_size_t addr_len = sizeof(addr_str);
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (size != 2) {
+        if (rank == 0)
+            fprintf(stderr, "Usage: mpirun -n 2 ./arena_bench [transport] [iterations]\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, 1);
+    assert(mid);
+
+    messaging_arena_config_init(&cfg);
+    if (cfg.size < (4UL << 20))
+        cfg.size = 4UL << 20;
+    if (messaging_arena_create(mid, &cfg, &arena) != MESSAGING_SUCCESS) {
+        fprintf(stderr, "arena_bench: could not create the arena\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    /* the "arena" RPC pulls into the arena, the "reg" one registers per message */
+    reg_id = MARGO_REGISTER(mid, "arena_bench_reg_rpc", message_t, response_t, bench_rpc);
+    margo_register_data(mid, reg_id, NULL, NULL);
+    arena_id = MARGO_REGISTER(mid, "arena_bench_arena_rpc", message_t, response_t, bench_rpc);
+    margo_register_data(mid, arena_id, arena, NULL);
+
+    if (rank == 0) {
+        hg_addr_t self;
+        margo_addr_self(mid, &self);
+        margo_addr_to_string(mid, addr_str, &addr_len, self);
+        margo_addr_free(mid, self);
+    }
+    MPI_Bcast(addr_str, sizeof(addr_str), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    if (rank == 1) {
+        hg_addr_t target;
+        margo_addr_lookup(mid, addr_str, &target);
+        fprintf(stdout, "%10s %16s %16s %16s %16s\n", "bytes",
+                "reg median us", "reg avg us", "arena median us", "arena avg us");
+        for (size_t i = 0; i < NUM_SIZES; i++) {
+            double reg_avg, arena_avg, reg_med, arena_med;
+            /* one untimed round each to warm up connections and caches */
+            run(mid, target, reg_id, MESSAGING_ARENA_NULL, sizes[i], 10, &reg_avg);
+            reg_med = run(mid, target, reg_id, MESSAGING_ARENA_NULL, sizes[i], iters, &reg_avg);
+            run(mid, target, arena_id, arena, sizes[i], 10, &arena_avg);
+            arena_med = run(mid, target, arena_id, arena, sizes[i], iters, &arena_avg);
+            fprintf(stdout, "%10zu %16.2f %16.2f %16.2f %16.2f\n", sizes[i],
+                    reg_med * 1e6, reg_avg * 1e6, arena_med * 1e6, arena_avg * 1e6);
+        }
+        margo_addr_free(mid, target);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    messaging_arena_destroy(arena);
+    margo_finalize(mid);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Exercises the asynchronous C++ layer over the loopback harness: one
+ * client keeps many publishes in flight at once and joins them with
+ * when_all(), the subscriber has to receive every one of them, and with
+ * C++20 the same flow runs again as coroutines.
+ *
+ * Usage: ./async_test [-x transport] [-s servers] [-n messages] [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#include <messaging-async.hpp>
+#include "harness.h"
+
+struct sample {
+    uint64_t seq;
+    uint64_t check;
+};
+
+static constexpr messaging::Topic<sample> samples("harness", "samples");
+
+static uint64_t received, corrupt;
+
+static void on_sample(void *arg, void *msg)
+{
+    const sample *s = static_cast<const sample*>(msg);
+
+    (void)arg;
+    if(s->check != ~s->seq)
+        __atomic_fetch_add(&corrupt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+}
+
+static messaging::future publish_all(messaging::async_client &ac, uint64_t first, int n)
+{
+    std::vector<messaging::future> ops;
+
+    ops.reserve(n);
+    for(int i = 0; i < n; i++){
+        sample s = { first + i, ~(first + i) };
+        ops.push_back(ac.publish(samples, s));
+    }
+    return messaging::when_all(std::move(ops));
+}
+
+#ifdef MESSAGING_HAVE_COROUTINES
+/* one message at a time, each awaited before the next goes out */
+static messaging::future publish_chain(messaging::async_client &ac, uint64_t first, int n)
+{
+    for(int i = 0; i < n; i++){
+        sample s = { first + i, ~(first + i) };
+        int ret = co_await ac.publish(samples, s);
+
+        if(ret != MESSAGING_SUCCESS)
+            co_return ret;
+    }
+    co_return MESSAGING_SUCCESS;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    struct harness *h;
+    int n = 1000, timeout = 10000, opt, failed = 0, ret;
+    uint64_t expected = 0;
+
+    harness_config_init(&cfg);
+    cfg.num_clients = 2;
+    cfg.client_rpc_xstreams = 2;
+    while((opt = getopt(argc, argv, "x:s:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 's': cfg.num_servers = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-s servers] [-n messages] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    h = harness_start(&cfg);
+    if(h == NULL){
+        fprintf(stderr, "async_test: could not start the harness\n");
+        return 1;
+    }
+
+    {
+        messaging::async_client pub(harness_client(h, 0));
+        messaging::async_client sub(harness_client(h, 1));
+
+        ret = sub.subscribe(samples.namesp(), samples.name(), on_sample, NULL).get();
+        if(ret != MESSAGING_SUCCESS){
+            fprintf(stderr, "async_test: subscribe failed (%d)\n", ret);
+            failed = 1;
+        }
+        if(!failed && (ret = publish_all(pub, 0, n).get()) != MESSAGING_SUCCESS){
+            fprintf(stderr, "async_test: publishing failed (%d)\n", ret);
+            failed = 1;
+        }
+        expected += n;
+#ifdef MESSAGING_HAVE_COROUTINES
+        if(!failed){
+            std::vector<messaging::future> chains;
+
+            for(int c = 0; c < 8; c++)
+                chains.push_back(publish_chain(pub, n + (uint64_t)c * n, n / 8));
+            if((ret = messaging::when_all(std::move(chains)).get()) != MESSAGING_SUCCESS){
+                fprintf(stderr, "async_test: coroutine publishing failed (%d)\n", ret);
+                failed = 1;
+            }
+            expected += 8 * (n / 8);
+        }
+#endif
+        if(!failed && harness_wait_for(&received, expected, timeout) != 0){
+            fprintf(stderr, "async_test: received %lu of %lu messages\n",
+                    (unsigned long)received, (unsigned long)expected);
+            failed = 1;
+        }
+        if(sub.unsubscribe(samples.namesp(), samples.name()).get() != MESSAGING_SUCCESS){
+            fprintf(stderr, "async_test: unsubscribe failed\n");
+            failed = 1;
+        }
+    }
+    if(corrupt){
+        fprintf(stderr, "async_test: %lu corrupt messages\n", (unsigned long)corrupt);
+        failed = 1;
+    }
+
+    harness_stop(h);
+    printf("async_test: %s (%lu messages)\n", failed ? "FAILED" : "passed", (unsigned long)expected);
+    return failed;
+}
@@ -0,0 +1,16 @@
+#!/bin/bash
+# runs perf_bench against one server over shared memory, then fetches its statistics
+rm -f servids.0
+mpirun -n 1 server na+sm &
+server=$!
+for i in $(seq 100); do
+  [ -f servids.0 ] && break
+  sleep 0.1
+done
+./perf_bench -x na+sm -n 1000 -p 2 -S 2 -t 4 -f 2 -w 4 -j perf_bench.json
+ret=$?
+if [ $ret -eq 0 ]; then
+  ./server_stats na+sm > perf_bench.prom || ret=$?
+fi
+kill $server
+exit $ret
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Client start-up time as the number of clients grows.
+ *
+ * Servers must already be running.  Every rank creates a client, through
+ * client_init_with_mpi() (one lookup broadcast to the communicator) and then
+ * through client_init() (every rank bootstraps on its own), and the slowest
+ * and average rank are reported.  The bootstrap provider is chosen with
+ * MESSAGING_BOOTSTRAP as usual, so run it once per provider and client count.
+ *
+ * Usage: mpirun -n num_clients ./bootstrap_bench [transport]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <margo.h>
+#include <mpi.h>
+#include <messaging-client.h>
+
+static void report(const char *what, double t, int rank, int size)
+{
+    double t_max, t_sum;
+
+    MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&t, &t_sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(rank == 0)
+        printf("%-22s %8d %12.3f %12.3f\n", what, size, t_max * 1e3, t_sum / size * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    char *transport = argc > 1 ? argv[1] : "verbs";
+    const char *spec;
+    messaging_client_t c;
+    margo_instance_id mid;
+    int rank, size, ret;
+    double t;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, -1);
+    assert(mid);
+
+    spec = getenv("MESSAGING_BOOTSTRAP");
+    if(rank == 0)
+        printf("bootstrap: %s\n%-22s %8s %12s %12s\n", spec ? spec : "file",
+                "init", "clients", "max(ms)", "avg(ms)");
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t = MPI_Wtime();
+    ret = client_init_with_mpi(mid, MPI_COMM_WORLD, &c);
+    t = MPI_Wtime() - t;
+    if(ret != MESSAGING_SUCCESS)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    report("client_init_with_mpi", t, rank, size);
+    client_finalize(c);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t = MPI_Wtime();
+    ret = client_init(mid, &c);
+    t = MPI_Wtime() - t;
+    if(ret != MESSAGING_SUCCESS)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    report("client_init", t, rank, size);
+    client_finalize(c);
+
+    margo_finalize(mid);
+    MPI_Finalize();
+    return 0;
+}
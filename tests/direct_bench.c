@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Brokered against direct delivery: one client publishes to a topic with
+ * several subscribers, first through the server, then with MESSAGING_DIRECT
+ * so it notifies the subscribers itself.  Reports the delivery latency the
+ * subscribers saw and what the servers spent on publishes (handler time and
+ * notifications sent).  A subscriber that joins once the publisher has gone
+ * direct must get everything published after its subscribe() returned.
+ *
+ * Usage: ./direct_bench [-x transport] [-s servers] [-S subscribers]
+ *                       [-n messages] [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <messaging-hist.h>
+#include <messaging-stats.h>
+#include <messaging-wire.h>
+#include "harness.h"
+
+#define MAX_SUBS  64
+
+struct sub_state {
+    uint64_t received;
+    struct messaging_hist latency_ns;   /* callbacks of one client never overlap */
+};
+
+static struct sub_state subs[MAX_SUBS + 1];
+
+static void on_message(void *arg, void *msg)
+{
+    struct sub_state *s = arg;
+    uint64_t sent;
+
+    memcpy(&sent, msg, sizeof(sent));
+    messaging_hist_record(&s->latency_ns, wire_now_ns() - sent);
+    __atomic_fetch_add(&s->received, 1, __ATOMIC_RELEASE);
+}
+
+static int publish_n(messaging_client_t c, int n)
+{
+    uint64_t now;
+
+    for(int i = 0; i < n; i++){
+        now = wire_now_ns();
+        if(publish(c, "direct", "feed", &now, sizeof(now)) != MESSAGING_SUCCESS)
+            return -1;
+    }
+    return 0;
+}
+
+/* one run; returns nonzero if a subscriber missed messages */
+static int run(const struct harness_config *cfg, int direct, int nsubs, int n, int timeout)
+{
+    struct messaging_server_stats *before = malloc(sizeof(*before));
+    struct messaging_server_stats *after = malloc(sizeof(*after));
+    struct messaging_client_stats *cst = malloc(sizeof(*cst));
+    struct messaging_hist all;
+    struct harness *h;
+    messaging_client_t pub;
+    uint64_t handler_ns = 0, notifies = 0, publishes = 0;
+    int failed = 0, late = nsubs;
+
+    setenv("MESSAGING_DIRECT", direct ? "1" : "0", 1);
+    memset(subs, 0, sizeof(subs));
+    for(int s = 0; s <= nsubs; s++)
+        messaging_hist_init(&subs[s].latency_ns);
+    h = harness_start(cfg);
+    if(h == NULL || before == NULL || after == NULL || cst == NULL){
+        fprintf(stderr, "direct_bench: could not start the harness\n");
+        free(before);
+        free(after);
+        free(cst);
+        return 1;
+    }
+    pub = harness_client(h, 0);
+    for(int s = 0; s < nsubs; s++)
+        if(subscribe(harness_client(h, s + 1), "direct", "feed", on_message, &subs[s]) != MESSAGING_SUCCESS)
+            failed = 1;
+
+    /* enough to settle on a route before measuring */
+    if(!failed && publish_n(pub, 100) != 0)
+        failed = 1;
+    for(int s = 0; !failed && s < nsubs; s++)
+        failed = harness_wait_for(&subs[s].received, 100, timeout) != 0;
+    for(int s = 0; s < nsubs; s++)
+        messaging_hist_init(&subs[s].latency_ns);
+
+    for(int i = 0; !failed && i < messaging_num_servers(pub); i++){
+        if(messaging_get_server_stats(pub, i, before) != MESSAGING_SUCCESS)
+            continue;
+        handler_ns -= before->handler_ns.sum;
+        notifies -= before->notifies;
+        publishes -= before->publishes;
+    }
+    if(!failed && publish_n(pub, n) != 0)
+        failed = 1;
+    for(int s = 0; !failed && s < nsubs; s++){
+        if(harness_wait_for(&subs[s].received, 100 + n, timeout) != 0){
+            fprintf(stderr, "direct_bench: subscriber %d received %lu of %d messages\n",
+                    s, (unsigned long)subs[s].received, 100 + n);
+            failed = 1;
+        }
+    }
+    for(int i = 0; !failed && i < messaging_num_servers(pub); i++){
+        if(messaging_get_server_stats(pub, i, after) != MESSAGING_SUCCESS)
+            continue;
+        handler_ns += after->handler_ns.sum;
+        notifies += after->notifies;
+        publishes += after->publishes;
+    }
+
+    /* the publisher must hear about a new subscriber before it is acknowledged */
+    if(!failed && subscribe(harness_client(h, late + 1), "direct", "feed", on_message,
+                &subs[late]) != MESSAGING_SUCCESS)
+        failed = 1;
+    if(!failed && (publish_n(pub, 10) != 0 || harness_wait_for(&subs[late].received, 10, timeout) != 0)){
+        fprintf(stderr, "direct_bench: the late subscriber received %lu of 10 messages\n",
+                (unsigned long)subs[late].received);
+        failed = 1;
+    }
+
+    if(!failed){
+        messaging_hist_init(&all);
+        for(int s = 0; s < nsubs; s++)
+            messaging_hist_merge(&all, &subs[s].latency_ns);
+        client_get_stats(pub, cst);
+        printf("%9s %10.2f %10.2f %10.2f %12lu %12lu %14.2f %10lu\n",
+                direct ? "direct" : "brokered", messaging_hist_mean(&all) / 1e3,
+                messaging_hist_quantile(&all, 0.5) / 1e3,
+                messaging_hist_quantile(&all, 0.99) / 1e3, (unsigned long)publishes,
+                (unsigned long)notifies, handler_ns / 1e6, (unsigned long)cst->publishes_direct);
+    }
+    harness_stop(h);
+    free(before);
+    free(after);
+    free(cst);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    int nsubs = 4, n = 10000, timeout = 30000, opt, failed;
+
+    harness_config_init(&cfg);
+    while((opt = getopt(argc, argv, "x:s:S:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 's': cfg.num_servers = atoi(optarg); break;
+        case 'S': nsubs = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-s servers] [-S subscribers] [-n messages]"
+                    " [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(nsubs < 1 || nsubs > MAX_SUBS){
+        fprintf(stderr, "direct_bench: between 1 and %d subscribers\n", MAX_SUBS);
+        return 2;
+    }
+    /* the publisher, the subscribers and one that joins late */
+    cfg.num_clients = nsubs + 2;
+
+    printf("%9s %10s %10s %10s %12s %12s %14s %10s\n", "mode", "mean(us)", "p50(us)",
+            "p99(us)", "srv publish", "srv notify", "srv busy(ms)", "direct");
+    failed = run(&cfg, 0, nsubs, n, timeout);
+    failed |= run(&cfg, 1, nsubs, n, timeout);
+    printf("direct_bench: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
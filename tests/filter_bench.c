@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Publishes saved by the subscription filter on a sparse workload: one
+ * client publishes round robin over many topics of which only a few have a
+ * subscriber.  The run is repeated with MESSAGING_PUBLISH_FILTER off and on,
+ * and reports the publishes that reached the servers and the time taken.
+ * Every message to a subscribed topic must still arrive, including those to
+ * a topic subscribed to between two publishes.
+ *
+ * Usage: ./filter_bench [-x transport] [-s servers] [-t topics] [-f subscribed]
+ *                       [-n rounds] [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "harness.h"
+
+#define MSG_SIZE 64
+
+static uint64_t received;
+
+static void on_message(void *arg, void *msg)
+{
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static uint64_t server_publishes(messaging_client_t c)
+{
+    struct messaging_server_stats st;
+    uint64_t n = 0;
+
+    for(int s = 0; s < messaging_num_servers(c); s++)
+        if(messaging_get_server_stats(c, s, &st) == MESSAGING_SUCCESS)
+            n += st.publishes;
+    return n;
+}
+
+/* one run; returns nonzero if a message to a subscribed topic went missing */
+static int run(const struct harness_config *cfg, int filter, int topics, int subscribed,
+        int rounds, int timeout)
+{
+    struct harness *h;
+    struct messaging_client_stats *st = malloc(sizeof(*st));
+    messaging_client_t pub, sub;
+    char topic[32], msg[MSG_SIZE] = {0};
+    uint64_t expected = 0;
+    int failed = 0;
+    double t;
+
+    received = 0;
+    setenv("MESSAGING_PUBLISH_FILTER", filter ? "1" : "0", 1);
+    h = harness_start(cfg);
+    if(h == NULL || st == NULL){
+        fprintf(stderr, "filter_bench: could not start the harness\n");
+        free(st);
+        return 1;
+    }
+    pub = harness_client(h, 0);
+    sub = harness_client(h, 1);
+
+    for(int i = 0; i < subscribed; i++){
+        snprintf(topic, sizeof(topic), "t%d", i * (topics / subscribed));
+        if(subscribe(sub, "filter", topic, on_message, NULL) != MESSAGING_SUCCESS)
+            failed = 1;
+    }
+
+    t = now();
+    for(int r = 0; !failed && r < rounds; r++){
+        for(int i = 0; i < topics; i++){
+            snprintf(topic, sizeof(topic), "t%d", i);
+            if(publish(pub, "filter", topic, msg, sizeof(msg)) != MESSAGING_SUCCESS)
+                failed = 1;
+        }
+        expected += subscribed;
+    }
+    t = now() - t;
+
+    /* a topic the publisher has already seen empty: once subscribe()
+     * returns, its next publish must get through */
+    snprintf(topic, sizeof(topic), "t%d", topics - 1);
+    if(!failed && topics - 1 != (subscribed - 1) * (topics / subscribed)){
+        if(subscribe(sub, "filter", topic, on_message, NULL) != MESSAGING_SUCCESS ||
+                publish(pub, "filter", topic, msg, sizeof(msg)) != MESSAGING_SUCCESS)
+            failed = 1;
+        expected++;
+    }
+    if(!failed && harness_wait_for(&received, expected, timeout) != 0){
+        fprintf(stderr, "filter_bench: received %lu of %lu messages with the filter %s\n",
+                (unsigned long)received, (unsigned long)expected, filter ? "on" : "off");
+        failed = 1;
+    }
+
+    if(client_get_stats(pub, st) == MESSAGING_SUCCESS)
+        printf("%6s %12lu %12lu %12lu %12.3f\n", filter ? "on" : "off",
+                (unsigned long)st->publishes, (unsigned long)server_publishes(pub),
+                (unsigned long)st->publishes_filtered, t * 1e3);
+    harness_stop(h);
+    free(st);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    int topics = 1000, subscribed = 10, rounds = 10, timeout = 10000, opt, failed;
+
+    harness_config_init(&cfg);
+    cfg.num_clients = 2;
+    while((opt = getopt(argc, argv, "x:s:t:f:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 's': cfg.num_servers = atoi(optarg); break;
+        case 't': topics = atoi(optarg); break;
+        case 'f': subscribed = atoi(optarg); break;
+        case 'n': rounds = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-s servers] [-t topics] [-f subscribed]"
+                    " [-n rounds] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(subscribed < 1 || subscribed > topics){
+        fprintf(stderr, "filter_bench: need 1 <= subscribed <= topics\n");
+        return 2;
+    }
+
+    printf("%6s %12s %12s %12s %12s\n", "filter", "publishes", "at servers", "filtered", "time(ms)");
+    failed = run(&cfg, 0, topics, subscribed, rounds, timeout);
+    failed |= run(&cfg, 1, topics, subscribed, rounds, timeout);
+    printf("filter_bench: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <abt.h>
+#include "harness.h"
+
+struct harness_node {
+    margo_instance_id mid;
+    messaging_server_t server;
+    messaging_client_t client;
+};
+
+struct harness {
+    struct harness_config cfg;
+    struct harness_node *servers;
+    struct harness_node *clients;
+    int abt_owned;
+};
+
+void harness_config_init(struct harness_config *cfg)
+{
+    cfg->transport = "na+sm";
+    cfg->num_servers = 1;
+    cfg->num_clients = 1;
+    cfg->server_rpc_xstreams = 1;
+    cfg->client_rpc_xstreams = 0;
+}
+
+/* "env:" followed by the comma separated server addresses, one per provider */
+static char *bootstrap_spec(struct harness *h)
+{
+    size_t len = strlen("env:") + 1;
+    char *spec;
+
+    for(int i = 0; i < h->cfg.num_servers; i++)
+        for(int p = 0; p < server_num_providers(h->servers[i].server); p++)
+            len += strlen(server_provider_address(h->servers[i].server, p)) + 1;
+    spec = malloc(len);
+    if(spec == NULL)
+        return NULL;
+    strcpy(spec, "env:");
+    for(int i = 0; i < h->cfg.num_servers; i++){
+        for(int p = 0; p < server_num_providers(h->servers[i].server); p++){
+            if(i > 0 || p > 0)
+                strcat(spec, ",");
+            strcat(spec, server_provider_address(h->servers[i].server, p));
+        }
+    }
+    return spec;
+}
+
+struct harness *harness_start(const struct harness_config *cfg)
+{
+    struct harness *h;
+    char *spec = NULL;
+
+    if(cfg->num_servers < 0 || cfg->num_clients < 0)
+        return NULL;
+    h = calloc(1, sizeof(*h));
+    if(h == NULL)
+        return NULL;
+    h->cfg = *cfg;
+    h->servers = calloc(cfg->num_servers ? cfg->num_servers : 1, sizeof(*h->servers));
+    h->clients = calloc(cfg->num_clients ? cfg->num_clients : 1, sizeof(*h->clients));
+    if(h->servers == NULL || h->clients == NULL)
+        goto err;
+
+    /* with several instances in the process none of them may own Argobots,
+     * or the first margo_finalize() would pull it from under the others */
+    if(ABT_initialized() != ABT_SUCCESS){
+        if(ABT_init(0, NULL) != ABT_SUCCESS)
+            goto err;
+        h->abt_owned = 1;
+    }
+
+    for(int i = 0; i < cfg->num_servers; i++){
+        struct harness_node *n = &h->servers[i];
+
+        n->mid = margo_init(cfg->transport, MARGO_SERVER_MODE, 1, cfg->server_rpc_xstreams);
+        if(n->mid == MARGO_INSTANCE_NULL){
+            fprintf(stderr, "harness: margo_init failed for server %d\n", i);
+            goto err;
+        }
+        if(server_init_standalone(n->mid, &n->server) != MESSAGING_SUCCESS){
+            fprintf(stderr, "harness: server_init_standalone failed for server %d\n", i);
+            goto err;
+        }
+    }
+
+    if(cfg->num_servers > 0 && (spec = bootstrap_spec(h)) == NULL)
+        goto err;
+    for(int i = 0; i < cfg->num_clients; i++){
+        struct harness_node *n = &h->clients[i];
+
+        /* clients receive notifications, so they listen as well */
+        n->mid = margo_init(cfg->transport, MARGO_SERVER_MODE, 1, cfg->client_rpc_xstreams);
+        if(n->mid == MARGO_INSTANCE_NULL){
+            fprintf(stderr, "harness: margo_init failed for client %d\n", i);
+            free(spec);
+            goto err;
+        }
+        if(client_init_with_bootstrap(n->mid, spec, &n->client) != MESSAGING_SUCCESS){
+            fprintf(stderr, "harness: client_init_with_bootstrap failed for client %d\n", i);
+            free(spec);
+            goto err;
+        }
+    }
+    free(spec);
+    return h;
+
+err:
+    harness_stop(h);
+    return NULL;
+}
+
+void harness_stop(struct harness *h)
+{
+    if(h == NULL)
+        return;
+    for(int i = 0; h->clients && i < h->cfg.num_clients; i++){
+        if(h->clients[i].client)
+            client_finalize(h->clients[i].client);
+        if(h->clients[i].mid != MARGO_INSTANCE_NULL)
+            margo_finalize(h->clients[i].mid);
+    }
+    for(int i = 0; h->servers && i < h->cfg.num_servers; i++){
+        if(h->servers[i].server)
+            server_destroy(h->servers[i].server);
+        if(h->servers[i].mid != MARGO_INSTANCE_NULL)
+            margo_finalize(h->servers[i].mid);
+    }
+    if(h->abt_owned)
+        ABT_finalize();
+    free(h->clients);
+    free(h->servers);
+    free(h);
+}
+
+messaging_client_t harness_client(struct harness *h, int i)
+{
+    return h->clients[i].client;
+}
+
+margo_instance_id harness_client_mid(struct harness *h, int i)
+{
+    return h->clients[i].mid;
+}
+
+messaging_server_t harness_server(struct harness *h, int i)
+{
+    return h->servers[i].server;
+}
+
+margo_instance_id harness_server_mid(struct harness *h, int i)
+{
+    return h->servers[i].mid;
+}
+
+int harness_wait_for(const uint64_t *counter, uint64_t target, int timeout_ms)
+{
+    for(int waited = 0; __atomic_load_n(counter, __ATOMIC_ACQUIRE) < target; waited++){
+        if(waited >= timeout_ms)
+            return -1;
+        usleep(1000);
+    }
+    return 0;
+}
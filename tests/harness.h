@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Runs servers and clients inside one process for tests.
+ *
+ * Every server and client gets its own Margo instance on the same
+ * transport (na+sm by default), so messages take the real RPC path, but
+ * nothing needs MPI, a launcher or an address file: servers are started
+ * with server_init_standalone() and the clients are handed their
+ * addresses through an "env:" bootstrap spec.
+ */
+
+#ifndef __HARNESS_H_
+#define __HARNESS_H_
+
+#include <stdint.h>
+#include <margo.h>
+#include <messaging-client.h>
+#include <messaging-server.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct harness_config {
+    const char *transport;      /* Mercury transport, "na+sm" */
+    int num_servers;            /* 1; 0 connects the clients to running servers (MESSAGING_BOOTSTRAP) */
+    int num_clients;            /* 1 */
+    int server_rpc_xstreams;    /* handler xstreams per server, 1 */
+    int client_rpc_xstreams;    /* handler xstreams per client, 0 runs callbacks on the progress thread */
+};
+
+struct harness;
+
+/* fills cfg with the defaults above */
+void harness_config_init(struct harness_config *cfg);
+
+/* starts the servers, then the clients; NULL if any of them fails */
+struct harness *harness_start(const struct harness_config *cfg);
+
+/* finalizes the clients, then the servers, and frees h */
+void harness_stop(struct harness *h);
+
+messaging_client_t harness_client(struct harness *h, int i);
+margo_instance_id harness_client_mid(struct harness *h, int i);
+messaging_server_t harness_server(struct harness *h, int i);
+margo_instance_id harness_server_mid(struct harness *h, int i);
+
+/* polls until *counter reaches target; 0 on success, -1 after timeout_ms */
+int harness_wait_for(const uint64_t *counter, uint64_t target, int timeout_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
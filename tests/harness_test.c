@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * End to end regression test over the loopback harness: one or more servers
+ * and three clients in this process.  Two clients subscribe, the third
+ * publishes small and larger-than-eager messages to several topics, and
+ * every delivery is checked for content; after one subscriber leaves it
+ * must not receive anything more.  The clients' own statistics have to
+ * agree with what was sent and received.
+ *
+ * Usage: ./harness_test [-x transport] [-s servers] [-n messages per topic]
+ *                       [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "harness.h"
+
+#define NUM_TOPICS   4
+#define SMALL_SIZE   64
+#define LARGE_SIZE   (64 * 1024)
+#define NUM_SUBS     2
+
+struct sub_state {
+    uint64_t received;
+    uint64_t corrupt;
+};
+
+static struct sub_state subs[NUM_SUBS];
+
+/* every payload starts with its size, the remaining bytes are derived from it */
+static void fill(unsigned char *buf, uint32_t size)
+{
+    memcpy(buf, &size, sizeof(size));
+    for(uint32_t i = sizeof(size); i < size; i++)
+        buf[i] = (unsigned char)(i * 31 + size);
+}
+
+static int intact(const unsigned char *buf)
+{
+    uint32_t size;
+
+    memcpy(&size, buf, sizeof(size));
+    if(size != SMALL_SIZE && size != LARGE_SIZE)
+        return 0;
+    for(uint32_t i = sizeof(size); i < size; i++)
+        if(buf[i] != (unsigned char)(i * 31 + size))
+            return 0;
+    return 1;
+}
+
+static void on_message(void *arg, void *msg)
+{
+    struct sub_state *s = arg;
+
+    if(!intact(msg))
+        __atomic_fetch_add(&s->corrupt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->received, 1, __ATOMIC_RELEASE);
+}
+
+static void topic_name(char *buf, size_t len, int t)
+{
+    snprintf(buf, len, "t%d", t);
+}
+
+/* publishes n small and n / 10 large messages to every topic */
+static int publish_round(messaging_client_t c, int n, unsigned char *small, unsigned char *large)
+{
+    char topic[16];
+
+    for(int t = 0; t < NUM_TOPICS; t++){
+        topic_name(topic, sizeof(topic), t);
+        for(int i = 0; i < n; i++){
+            if(publish(c, "harness", topic, small, SMALL_SIZE) != MESSAGING_SUCCESS)
+                return -1;
+            if(i % 10 == 0 && publish(c, "harness", topic, large, LARGE_SIZE) != MESSAGING_SUCCESS)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t round_size(int n)
+{
+    return (uint64_t)NUM_TOPICS * (n + (n + 9) / 10);
+}
+
+/* the publisher counted every publish and each subscriber every callback */
+static int check_client_stats(struct harness *h, uint64_t expected)
+{
+    struct messaging_client_stats *st = malloc(sizeof(*st));
+    const uint64_t want[NUM_SUBS + 1] = { 2 * expected, 2 * expected, expected };
+    int failed = 0;
+
+    if(st == NULL)
+        return 1;
+    for(int c = 0; c <= NUM_SUBS; c++){
+        uint64_t got;
+
+        if(client_get_stats(harness_client(h, c), st) != MESSAGING_SUCCESS){
+            fprintf(stderr, "harness_test: no statistics from client %d\n", c);
+            failed = 1;
+            continue;
+        }
+        got = c == 0 ? st->publishes : st->callback_ns.count;
+        if(got != want[c] || (c == 0 && st->publish_rtt_ns.count != want[c])){
+            fprintf(stderr, "harness_test: client %d counted %lu %s, expected %lu\n", c,
+                    (unsigned long)got, c == 0 ? "publishes" : "callbacks", (unsigned long)want[c]);
+            failed = 1;
+        }
+    }
+    free(st);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    struct harness *h;
+    unsigned char *small, *large;
+    char topic[16];
+    int n = 100, timeout = 10000, opt, failed = 0;
+    uint64_t expected;
+
+    harness_config_init(&cfg);
+    cfg.num_clients = NUM_SUBS + 1;
+    while((opt = getopt(argc, argv, "x:s:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 's': cfg.num_servers = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-s servers] [-n messages] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    small = malloc(SMALL_SIZE);
+    large = malloc(LARGE_SIZE);
+    if(small == NULL || large == NULL)
+        return 1;
+    fill(small, SMALL_SIZE);
+    fill(large, LARGE_SIZE);
+
+    h = harness_start(&cfg);
+    if(h == NULL){
+        fprintf(stderr, "harness_test: could not start the harness\n");
+        return 1;
+    }
+
+    for(int s = 0; s < NUM_SUBS; s++){
+        for(int t = 0; t < NUM_TOPICS; t++){
+            topic_name(topic, sizeof(topic), t);
+            if(subscribe(harness_client(h, s + 1), "harness", topic, on_message, &subs[s]) != MESSAGING_SUCCESS){
+                fprintf(stderr, "harness_test: subscriber %d could not subscribe to %s\n", s, topic);
+                failed = 1;
+            }
+        }
+    }
+
+    if(!failed && publish_round(harness_client(h, 0), n, small, large) != 0){
+        fprintf(stderr, "harness_test: publish failed\n");
+        failed = 1;
+    }
+    expected = round_size(n);
+    for(int s = 0; !failed && s < NUM_SUBS; s++){
+        if(harness_wait_for(&subs[s].received, expected, timeout) != 0){
+            fprintf(stderr, "harness_test: subscriber %d received %lu of %lu messages\n",
+                    s, (unsigned long)subs[s].received, (unsigned long)expected);
+            failed = 1;
+        }
+    }
+
+    /* the second subscriber leaves; only the first one hears the next round */
+    for(int t = 0; !failed && t < NUM_TOPICS; t++){
+        topic_name(topic, sizeof(topic), t);
+        if(unsubscribe(harness_client(h, 2), "harness", topic) != MESSAGING_SUCCESS){
+            fprintf(stderr, "harness_test: unsubscribe from %s failed\n", topic);
+            failed = 1;
+        }
+    }
+    if(!failed && publish_round(harness_client(h, 0), n, small, large) != 0){
+        fprintf(stderr, "harness_test: publish failed\n");
+        failed = 1;
+    }
+    if(!failed && harness_wait_for(&subs[0].received, 2 * expected, timeout) != 0){
+        fprintf(stderr, "harness_test: subscriber 0 received %lu of %lu messages\n",
+                (unsigned long)subs[0].received, (unsigned long)(2 * expected));
+        failed = 1;
+    }
+    /* give anything misrouted to the departed subscriber time to show up */
+    usleep(100000);
+    if(!failed && __atomic_load_n(&subs[1].received, __ATOMIC_ACQUIRE) != expected){
+        fprintf(stderr, "harness_test: subscriber 1 received %lu messages after unsubscribing\n",
+                (unsigned long)(subs[1].received - expected));
+        failed = 1;
+    }
+    if(!failed && check_client_stats(h, expected) != 0)
+        failed = 1;
+    for(int s = 0; s < NUM_SUBS; s++){
+        if(subs[s].corrupt){
+            fprintf(stderr, "harness_test: subscriber %d got %lu corrupt messages\n",
+                    s, (unsigned long)subs[s].corrupt);
+            failed = 1;
+        }
+    }
+
+    harness_stop(h);
+    free(small);
+    free(large);
+    printf("harness_test: %s (%d server%s, %lu messages per subscriber)\n",
+            failed ? "FAILED" : "passed", cfg.num_servers, cfg.num_servers > 1 ? "s" : "",
+            (unsigned long)expected);
+    return failed;
+}
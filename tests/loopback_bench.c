@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Round trip from publish() to the callback of a subscriber in the same
+ * client.  Run it with MESSAGING_LOCAL_DISPATCH=0 to go through the server
+ * and with the default of 1 to dispatch in place.
+ *
+ * Servers must already be running (see test_script.sh).
+ *
+ * Usage: ./loopback_bench [transport] [count] [size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <margo.h>
+#include <messaging-client.h>
+#include "timer.h"
+
+#define WAIT_SECONDS 30
+
+static volatile long received;
+
+static void handler(void *args, void *msg)
+{
+    received++;
+}
+
+int main(int argc, char **argv)
+{
+    char *transport = argc > 1 ? argv[1] : "verbs";
+    long count = argc > 2 ? atol(argv[2]) : 10000;
+    int size = argc > 3 ? atoi(argv[3]) : 64;
+    const char *local = getenv("MESSAGING_LOCAL_DISPATCH");
+    messaging_client_t c;
+    margo_instance_id mid;
+    mtimer_t timer;
+    double t;
+    char *buf;
+    long i;
+    int ret;
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, -1);
+    assert(mid);
+    ret = client_init(mid, &c);
+    if(ret != MESSAGING_SUCCESS || c == MESSAGING_CLIENT_NULL){
+        fprintf(stderr, "client_init failed (%d)\n", ret);
+        return 1;
+    }
+    subscribe(c, "loopback_bench", "echo", handler, NULL);
+    buf = calloc(1, size > 0 ? size : 1);
+
+    timer_init(&timer, 0);
+    timer_start(&timer);
+    for(i = 0; i < count; i++){
+        publish(c, "loopback_bench", "echo", buf, size);
+        while(received <= i && timer_read(&timer) < WAIT_SECONDS)
+            margo_thread_sleep(mid, 0);
+        if(received <= i)
+            break;
+    }
+    t = timer_read(&timer);
+
+    printf("local_dispatch=%s messages=%ld size=%d\n", local ? local : "1", i, size);
+    printf("round trip avg %12.2f us\n", i ? t / i * 1e6 : 0.0);
+    printf("rate           %12.0f msg/s\n", t > 0 ? i / t : 0.0);
+    if(i < count)
+        fprintf(stderr, "timed out after %ld of %ld messages\n", i, count);
+
+    free(buf);
+    unsubscribe(c, "loopback_bench", "echo");
+    client_finalize(c);
+    margo_finalize(mid);
+    return i < count;
+}
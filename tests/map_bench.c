@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Routing table microbenchmark.
+ *
+ * Drives the subscription table through CppWrapper.h without any network:
+ * topic popularity follows a Zipf law, and the most popular topic has
+ * 'subs' subscribers, the k-th subs / k^zipf (at least one).  It reports
+ *   populate   map_subscribe of every subscription, and bytes per subscription
+ *              (membership sets alone, and resident memory growth overall)
+ *   lookup     map_get_value on Zipf-chosen topics, as the publish path does
+ *   update     map_subscribe then map_unsubscribe of extra subscribers
+ *   mixed      'read' fraction lookups, the rest updates, from 1 up to
+ *              'threads' threads sharing a rwlock like the server's
+ *   remove     map_remove of subscribers on 'fanin' topics each
+ *   handlers   get_handler and map_get_topics on the client handler table
+ * all in ns per operation.  Other tables can be compared by adding them
+ * to 'tables' and picking them with -m.
+ *
+ * Usage: map_bench [-m table] [-t topics] [-s subs] [-z zipf] [-o ops]
+ *                  [-r read fraction] [-T threads] [-f fanin]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <CppWrapper.h>
+#include "timer.h"
+
+#define NAMESP "bench"
+
+struct table_ops {
+    const char *name;
+    void *(*create)(void);
+    void (*destroy)(void *t);
+    uint32_t (*reg)(void *t, const char *addr);
+    void (*subscribe)(void *t, const char *ns, const char *topic, uint32_t id);
+    void (*unsubscribe)(void *t, const char *ns, const char *topic, uint32_t id);
+    size_t (*get_value)(void *t, const char *ns, const char *topic, uint32_t *ids, size_t max);
+    void (*remove)(void *t, uint32_t id);
+    size_t (*membership_bytes)(void *t);
+};
+
+static void *wrap_create(void) { return map_new(); }
+static void wrap_destroy(void *t) { map_delete(t); }
+static uint32_t wrap_reg(void *t, const char *addr) { return map_register(t, addr); }
+static void wrap_subscribe(void *t, const char *ns, const char *topic, uint32_t id)
+{
+    map_subscribe(t, ns, topic, id);
+}
+static void wrap_unsubscribe(void *t, const char *ns, const char *topic, uint32_t id)
+{
+    map_unsubscribe(t, ns, topic, id);
+}
+static size_t wrap_get_value(void *t, const char *ns, const char *topic, uint32_t *ids, size_t max)
+{
+    return map_get_value(t, ns, topic, ids, max);
+}
+static void wrap_remove(void *t, uint32_t id) { map_remove(t, id); }
+static size_t wrap_membership_bytes(void *t) { return map_membership_bytes(t); }
+
+static const struct table_ops tables[] = {
+    { "mapwrap", wrap_create, wrap_destroy, wrap_reg, wrap_subscribe, wrap_unsubscribe,
+      wrap_get_value, wrap_remove, wrap_membership_bytes },
+};
+
+struct params {
+    const struct table_ops *ops;
+    long topics;
+    long subs;
+    double zipf;
+    long ops_count;
+    double read;
+    int threads;
+    int fanin;
+};
+
+static struct params prm = { &tables[0], 10000, 1000, 0.99, 1000000, 0.9, 4, 10 };
+static char (*names)[32];
+static double *cdf;
+static long *subs_of;
+static void *table;
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static inline uint64_t rnd(uint64_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/* a topic index, popular ones first */
+static long zipf_topic(uint64_t *s)
+{
+    double u = (rnd(s) >> 11) * (1.0 / 9007199254740992.0);
+    long lo = 0, hi = prm.topics - 1;
+
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static long resident_bytes(void)
+{
+    long pages = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+        rss = 0;
+    fclose(f);
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+static void setup(void)
+{
+    double sum = 0;
+
+    names = malloc(prm.topics * sizeof(*names));
+    cdf = malloc(prm.topics * sizeof(*cdf));
+    subs_of = malloc(prm.topics * sizeof(*subs_of));
+    for (long k = 0; k < prm.topics; k++) {
+        double w = 1.0 / pow(k + 1, prm.zipf);
+        snprintf(names[k], sizeof(names[k]), "topic_%ld", k);
+        sum += w;
+        cdf[k] = sum;
+        subs_of[k] = (long)(prm.subs * w + 0.5);
+        if (subs_of[k] < 1)
+            subs_of[k] = 1;
+    }
+    for (long k = 0; k < prm.topics; k++)
+        cdf[k] /= sum;
+}
+
+static double now(mtimer_t *t)
+{
+    return timer_read(t);
+}
+
+static void report(const char *what, long ops, double secs, const char *extra)
+{
+    printf("%-30s %12ld %10.1f %s\n", what, ops, ops ? secs / ops * 1e9 : 0.0, extra ? extra : "");
+}
+
+/* subscribers of topic k are k*7919 + j modulo subs, distinct for j < subs */
+static uint32_t member(long k, long j)
+{
+    return (uint32_t)((k * 7919 + j) % prm.subs);
+}
+
+static long populate(mtimer_t *timer)
+{
+    char extra[96];
+    long total = 0, rss;
+    double t0;
+
+    rss = resident_bytes();
+    t0 = now(timer);
+    for (long k = 0; k < prm.topics; k++)
+        for (long j = 0; j < subs_of[k]; j++)
+            prm.ops->subscribe(table, NAMESP, names[k], member(k, j));
+    for (long k = 0; k < prm.topics; k++)
+        total += subs_of[k];
+    snprintf(extra, sizeof(extra), "%.1f B/sub in sets, %.1f B/sub resident",
+            (double)prm.ops->membership_bytes(table) / total,
+            (double)(resident_bytes() - rss) / total);
+    report("populate (subscribe)", total, now(timer) - t0, extra);
+    return total;
+}
+
+static void lookup(mtimer_t *timer)
+{
+    uint32_t *ids = malloc(prm.subs * sizeof(*ids));
+    uint64_t s = 88172645463325252ULL;
+    size_t fanout = 0;
+    char extra[64];
+    double t0;
+
+    t0 = now(timer);
+    for (long i = 0; i < prm.ops_count; i++)
+        fanout += prm.ops->get_value(table, NAMESP, names[zipf_topic(&s)], ids, prm.subs);
+    snprintf(extra, sizeof(extra), "mean fan-out %.1f", (double)fanout / prm.ops_count);
+    report("lookup (get_value)", prm.ops_count, now(timer) - t0, extra);
+    free(ids);
+}
+
+/* extra subscribers come after the populated ones, one range per thread */
+static uint32_t extra_sub(int thread, uint64_t *s)
+{
+    return (uint32_t)(prm.subs + thread * 1024 + rnd(s) % 1024);
+}
+
+static void update(mtimer_t *timer)
+{
+    uint64_t s = 0x9E3779B97F4A7C15ULL;
+    double t0;
+
+    t0 = now(timer);
+    for (long i = 0; i < prm.ops_count / 2; i++) {
+        long k = zipf_topic(&s);
+        uint32_t id = extra_sub(0, &s);
+        prm.ops->subscribe(table, NAMESP, names[k], id);
+        prm.ops->unsubscribe(table, NAMESP, names[k], id);
+    }
+    report("update (sub + unsub)", prm.ops_count / 2 * 2, now(timer) - t0, NULL);
+}
+
+struct worker {
+    pthread_t th;
+    int id;
+    long ops;
+    uint64_t seed;
+};
+
+static void *mixed_worker(void *arg)
+{
+    struct worker *w = arg;
+    uint32_t *ids = malloc(prm.subs * sizeof(*ids));
+    uint64_t threshold = (uint64_t)(prm.read * 1000000);
+    long pending = -1;
+    uint32_t pending_id = 0;
+
+    for (long i = 0; i < w->ops; i++) {
+        long k = zipf_topic(&w->seed);
+        if (rnd(&w->seed) % 1000000 < threshold) {
+            pthread_rwlock_rdlock(&lock);
+            prm.ops->get_value(table, NAMESP, names[k], ids, prm.subs);
+            pthread_rwlock_unlock(&lock);
+        } else if (pending < 0) {
+            pending = k;
+            pending_id = extra_sub(w->id, &w->seed);
+            pthread_rwlock_wrlock(&lock);
+            prm.ops->subscribe(table, NAMESP, names[pending], pending_id);
+            pthread_rwlock_unlock(&lock);
+        } else {
+            pthread_rwlock_wrlock(&lock);
+            prm.ops->unsubscribe(table, NAMESP, names[pending], pending_id);
+            pthread_rwlock_unlock(&lock);
+            pending = -1;
+        }
+    }
+    if (pending >= 0) {
+        pthread_rwlock_wrlock(&lock);
+        prm.ops->unsubscribe(table, NAMESP, names[pending], pending_id);
+        pthread_rwlock_unlock(&lock);
+    }
+    free(ids);
+    return NULL;
+}
+
+/* ns/op is wall time over all threads' operations */
+static void mixed(mtimer_t *timer, int n)
+{
+    struct worker *w = calloc(n, sizeof(*w));
+    char what[64], extra[64];
+    long ops = prm.ops_count / n * n;
+    double t0, dt;
+
+    t0 = now(timer);
+    for (int i = 0; i < n; i++) {
+        w[i].id = i;
+        w[i].ops = prm.ops_count / n;
+        w[i].seed = 0x2545F4914F6CDD1DULL * (i + 1);
+        pthread_create(&w[i].th, NULL, mixed_worker, &w[i]);
+    }
+    for (int i = 0; i < n; i++)
+        pthread_join(w[i].th, NULL);
+    dt = now(timer) - t0;
+    snprintf(what, sizeof(what), "mixed %.0f%% read, %d thr", prm.read * 100, n);
+    snprintf(extra, sizeof(extra), "%.2f Mops/s", ops / dt / 1e6);
+    report(what, ops, dt, extra);
+    free(w);
+}
+
+/* everything but the populated subscriptions must be gone again */
+static int check(long total)
+{
+    uint32_t *ids = malloc(prm.subs * sizeof(*ids));
+    long found = 0;
+
+    for (long k = 0; k < prm.topics; k++)
+        found += prm.ops->get_value(table, NAMESP, names[k], ids, prm.subs);
+    free(ids);
+    if (found != total) {
+        fprintf(stderr, "map_bench: %ld subscriptions left, expected %ld\n", found, total);
+        return -1;
+    }
+    return 0;
+}
+
+static void remove_subs(mtimer_t *timer)
+{
+    uint64_t s = 0xD1B54A32D192ED03ULL;
+    long n = prm.subs < 1024 ? prm.subs : 1024;
+    char extra[64];
+    double t0;
+
+    for (long i = 0; i < n; i++)
+        for (int j = 0; j < prm.fanin; j++)
+            prm.ops->subscribe(table, NAMESP, names[zipf_topic(&s)], (uint32_t)(prm.subs + i));
+    t0 = now(timer);
+    for (long i = 0; i < n; i++)
+        prm.ops->remove(table, (uint32_t)(prm.subs + i));
+    snprintf(extra, sizeof(extra), "on up to %d topics each", prm.fanin);
+    report("remove (map_remove)", n, now(timer) - t0, extra);
+}
+
+/* the client side: a handler per topic, looked up on every notification */
+static void handlers(mtimer_t *timer)
+{
+    WrapperMap *t = map_new();
+    uint64_t s = 0xA0761D6478BD642FULL;
+    void *fp, *args;
+    vector v;
+    long found = 0;
+    double t0;
+
+    for (long k = 0; k < prm.topics; k++)
+        insert_handler(t, NAMESP, names[k], (void *)handlers, NULL);
+    t0 = now(timer);
+    for (long i = 0; i < prm.ops_count; i++)
+        found += get_handler(t, NAMESP, names[zipf_topic(&s)], &fp, &args);
+    report("handler lookup (get_handler)", prm.ops_count, now(timer) - t0, NULL);
+    if (found != prm.ops_count)
+        fprintf(stderr, "map_bench: handlers missing\n");
+
+    t0 = now(timer);
+    v = map_get_topics(t);
+    report("map_get_topics, per topic", prm.topics, now(timer) - t0, NULL);
+    for (int i = 0; i < VECTOR_TOTAL(v); i++)
+        free(VECTOR_GET(v, char *, i));
+    VECTOR_FREE(v);
+    map_delete(t);
+}
+
+int main(int argc, char **argv)
+{
+    mtimer_t timer;
+    char addr[64];
+    long total;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:s:z:o:r:T:f:")) != -1) {
+        switch (opt) {
+        case 'm':
+            prm.ops = NULL;
+            for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++)
+                if (strcmp(optarg, tables[i].name) == 0)
+                    prm.ops = &tables[i];
+            if (prm.ops == NULL) {
+                fprintf(stderr, "map_bench: unknown table %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 't': prm.topics = atol(optarg); break;
+        case 's': prm.subs = atol(optarg); break;
+        case 'z': prm.zipf = atof(optarg); break;
+        case 'o': prm.ops_count = atol(optarg); break;
+        case 'r': prm.read = atof(optarg); break;
+        case 'T': prm.threads = atoi(optarg); break;
+        case 'f': prm.fanin = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-m table] [-t topics] [-s subs] [-z zipf] [-o ops]\n"
+                    "       [-r read fraction] [-T threads] [-f fanin]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (prm.topics < 1 || prm.subs < 1 || prm.ops_count < 2 || prm.threads < 1 ||
+            prm.read < 0 || prm.read > 1) {
+        fprintf(stderr, "map_bench: bad parameters\n");
+        return 1;
+    }
+
+    setup();
+    timer_init(&timer, 0);
+    timer_start(&timer);
+    table = prm.ops->create();
+    /* populated subscribers, then 1024 extra per thread for updates and removals */
+    for (long i = 0; i < prm.subs + 1024L * (prm.threads > 1 ? prm.threads : 1); i++) {
+        snprintf(addr, sizeof(addr), "ofi+verbs;ofi_rxm://10.1.%ld.%ld:%ld",
+                i / 65536, (i / 256) % 256, i % 256);
+        prm.ops->reg(table, addr);
+    }
+
+    printf("table %s, %ld topics, up to %ld subscribers, zipf %.2f\n",
+            prm.ops->name, prm.topics, prm.subs, prm.zipf);
+    printf("%-30s %12s %10s\n", "operation", "ops", "ns/op");
+    total = populate(&timer);
+    lookup(&timer);
+    update(&timer);
+    for (int n = 1; n < prm.threads; n *= 2)
+        mixed(&timer, n);
+    mixed(&timer, prm.threads);
+    remove_subs(&timer);
+    if (check(total) != 0)
+        return 1;
+    handlers(&timer);
+
+    prm.ops->destroy(table);
+    free(names);
+    free(cdf);
+    free(subs_of);
+    return 0;
+}
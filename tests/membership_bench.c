@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Cost of topic membership on the server.
+ *
+ * Registers num_subs subscribers and subscribes all of them to one topic,
+ * reporting the subscribe latency and the bytes of membership state per
+ * subscription, then does the same with every subscriber on its own topic
+ * (the sparse case).  The address strings that used to be stored for each
+ * subscription are shown for comparison.
+ *
+ * Usage: membership_bench [num_subs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CppWrapper.h>
+#include "timer.h"
+
+/* a typical ofi+verbs address */
+#define ADDR_FMT "ofi+verbs;ofi_rxm://10.1.%ld.%ld:%ld"
+
+static void shuffle(uint32_t *a, long n)
+{
+    for(long i = n - 1; i > 0; i--){
+        long j = rand() % (i + 1);
+        uint32_t tmp = a[i];
+        a[i] = a[j];
+        a[j] = tmp;
+    }
+}
+
+static int run(WrapperMap *t, const uint32_t *ids, long num_subs, int one_topic, const char *what)
+{
+    char topic[64];
+    mtimer_t timer;
+    double t0, dt, t_max = 0, t_total;
+    uint32_t *out;
+    long i;
+
+    timer_init(&timer, 0);
+    timer_start(&timer);
+    for(i = 0; i < num_subs; i++){
+        snprintf(topic, sizeof(topic), "topic_%ld", one_topic ? 0 : i);
+        t0 = timer_read(&timer);
+        map_subscribe(t, "bench", topic, ids[i]);
+        dt = timer_read(&timer) - t0;
+        if(dt > t_max)
+            t_max = dt;
+    }
+    t_total = timer_read(&timer);
+    printf("%-22s %10ld %12.3f %12.3f %12.2f\n", what, num_subs,
+            t_total / num_subs * 1e6, t_max * 1e6,
+            (double)map_membership_bytes(t) / num_subs);
+
+    if(one_topic){
+        /* fan-out reads the ids back in order */
+        out = malloc(num_subs * sizeof(*out));
+        if(map_get_value(t, "bench", "topic_0", out, num_subs) != (size_t)num_subs){
+            fprintf(stderr, "membership_bench: lost subscribers\n");
+            return -1;
+        }
+        for(i = 1; i < num_subs; i++)
+            if(out[i] <= out[i-1]){
+                fprintf(stderr, "membership_bench: ids out of order\n");
+                return -1;
+            }
+        free(out);
+    }
+    for(i = 0; i < num_subs; i++){
+        snprintf(topic, sizeof(topic), "topic_%ld", one_topic ? 0 : i);
+        map_unsubscribe(t, "bench", topic, ids[i]);
+    }
+    if(map_membership_bytes(t) != 0){
+        fprintf(stderr, "membership_bench: subscriptions left after unsubscribe\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long num_subs = argc > 1 ? atol(argv[1]) : 100000;
+    char addr[64];
+    size_t addr_bytes = 0;
+    uint32_t *ids;
+    WrapperMap *t;
+    long i;
+
+    if(num_subs <= 0){
+        fprintf(stderr, "Usage: %s [num_subs]\n", argv[0]);
+        return 1;
+    }
+
+    t = map_new();
+    ids = malloc(num_subs * sizeof(*ids));
+    for(i = 0; i < num_subs; i++){
+        snprintf(addr, sizeof(addr), ADDR_FMT, i / 256, i % 256, 30000 + i % 1000);
+        addr_bytes += strlen(addr) + 1 + sizeof(char*);
+        ids[i] = map_register(t, addr);
+    }
+
+    printf("%-22s %10s %12s %12s %12s\n", "case", "subs", "avg(us)", "max(us)", "bytes/sub");
+    if(run(t, ids, num_subs, 1, "one topic, in order") != 0)
+        return 1;
+    shuffle(ids, num_subs);
+    if(run(t, ids, num_subs, 1, "one topic, shuffled") != 0)
+        return 1;
+    if(run(t, ids, num_subs, 0, "topic per subscriber") != 0)
+        return 1;
+    printf("address strings used to take %.2f bytes/sub\n", (double)addr_bytes / num_subs);
+
+    free(ids);
+    map_delete(t);
+    return 0;
+}
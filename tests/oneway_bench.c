@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Acknowledged against one-way delivery.  One client publishes to a topic
+ * with several subscribers, with every publish and notification answered,
+ * then with one-way notifications (MESSAGING_NOTIFY_ONEWAY), one-way
+ * publishes (publish_set_oneway()) and both.  Reports the messages
+ * delivered per second and what the server spent on them: handler time,
+ * notifications sent and how many of those went one-way.  Every message
+ * must arrive, no notification may fail and the server must have seen the
+ * one-way publishes and sent the one-way notifications each run asks for.
+ *
+ * Usage: ./oneway_bench [-x transport] [-S subscribers] [-n messages]
+ *                       [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "harness.h"
+
+#define MAX_SUBS  64
+#define MSG_SIZE  64
+
+#define NOTIFY_ONEWAY   1
+#define PUBLISH_ONEWAY  2
+
+static const char *mode_names[] = { "acked", "notify", "publish", "both" };
+
+static uint64_t received;
+
+static void on_message(void *arg, void *msg)
+{
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* one run; returns nonzero if messages were lost or notifications failed */
+static int run(const struct harness_config *cfg, int mode, int nsubs, int n, int timeout)
+{
+    struct messaging_server_stats *st = malloc(sizeof(*st));
+    struct harness *h;
+    messaging_client_t pub;
+    char msg[MSG_SIZE] = {0};
+    uint64_t expected = (uint64_t)nsubs * n;
+    int failed = 0;
+    double t;
+
+    setenv("MESSAGING_NOTIFY_ONEWAY", (mode & NOTIFY_ONEWAY) ? "1" : "0", 1);
+    received = 0;
+    h = harness_start(cfg);
+    if(h == NULL || st == NULL){
+        fprintf(stderr, "oneway_bench: could not start the harness\n");
+        harness_stop(h);
+        free(st);
+        return 1;
+    }
+    pub = harness_client(h, 0);
+    for(int s = 0; s < nsubs; s++)
+        if(subscribe(harness_client(h, s + 1), "oneway", "feed", on_message, NULL) != MESSAGING_SUCCESS)
+            failed = 1;
+    if(!failed && (mode & PUBLISH_ONEWAY))
+        failed = publish_set_oneway(pub, "oneway", "feed", 1) != MESSAGING_SUCCESS;
+
+    t = now();
+    for(int i = 0; !failed && i < n; i++){
+        memcpy(msg, &i, sizeof(i));
+        if(publish(pub, "oneway", "feed", msg, sizeof(msg)) != MESSAGING_SUCCESS)
+            failed = 1;
+    }
+    if(!failed && harness_wait_for(&received, expected, timeout) != 0){
+        fprintf(stderr, "oneway_bench: %s run received %lu of %lu messages\n", mode_names[mode],
+                (unsigned long)received, (unsigned long)expected);
+        failed = 1;
+    }
+    t = now() - t;
+
+    if(messaging_get_server_stats(pub, 0, st) != MESSAGING_SUCCESS){
+        fprintf(stderr, "oneway_bench: could not get the server statistics\n");
+        failed = 1;
+    } else {
+        if(st->notify_failures){
+            fprintf(stderr, "oneway_bench: %lu notifications failed\n", (unsigned long)st->notify_failures);
+            failed = 1;
+        }
+        if((mode & PUBLISH_ONEWAY) && st->publishes_oneway == 0){
+            fprintf(stderr, "oneway_bench: %s run made no one-way publishes\n", mode_names[mode]);
+            failed = 1;
+        }
+        if((mode & NOTIFY_ONEWAY) && st->notifies_oneway == 0){
+            fprintf(stderr, "oneway_bench: %s run sent no one-way notifications\n", mode_names[mode]);
+            failed = 1;
+        }
+        printf("%8s %12.0f %12lu %12lu %12lu %14.2f %12.2f\n", mode_names[mode], received / t,
+                (unsigned long)st->publishes, (unsigned long)st->notifies,
+                (unsigned long)st->notifies_oneway, st->handler_ns.sum / 1e6,
+                st->publishes ? st->handler_ns.sum / 1e3 / st->publishes : 0.0);
+    }
+    harness_stop(h);
+    free(st);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    int nsubs = 4, n = 10000, timeout = 30000, opt, failed = 0;
+
+    harness_config_init(&cfg);
+    while((opt = getopt(argc, argv, "x:S:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 'S': nsubs = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-S subscribers] [-n messages] [-T timeout ms]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if(nsubs < 1 || nsubs > MAX_SUBS || n < 1){
+        fprintf(stderr, "oneway_bench: between 1 and %d subscribers and at least one message\n", MAX_SUBS);
+        return 2;
+    }
+    /* the publisher and the subscribers, all on the one server */
+    cfg.num_clients = nsubs + 1;
+
+    printf("%8s %12s %12s %12s %12s %14s %12s\n", "one-way", "delivered/s", "srv publish",
+            "srv notify", "srv one-way", "srv busy(ms)", "us/publish");
+    for(int mode = 0; mode <= (NOTIFY_ONEWAY | PUBLISH_ONEWAY); mode++)
+        failed |= run(&cfg, mode, nsubs, n, timeout);
+    printf("oneway_bench: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
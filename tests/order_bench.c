@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Ordering against fan-out throughput.  Several publishers each publish to
+ * a topic of their own, one message after the other, while the server fans
+ * out from several handler streams; every subscriber follows all of the
+ * topics and counts the messages it got behind a later one of the same
+ * topic.  Runs with MESSAGING_SERIAL_FANOUT (one publish fanned out at a
+ * time), with parallel fan-out, and with parallel fan-out plus the
+ * subscribers' reorder buffers (MESSAGING_REORDER), and reports the
+ * deliveries per second of each.  The reorder run must deliver everything
+ * in order without gaps or duplicates.
+ *
+ * Usage: ./order_bench [-x transport] [-r server handler xstreams]
+ *                      [-p publishers] [-S subscribers]
+ *                      [-n messages per publisher] [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "harness.h"
+
+#define MAX_PUBS  16
+#define MAX_SUBS  16
+#define MSG_SIZE  64
+
+enum { MODE_SERIAL, MODE_PARALLEL, MODE_REORDER };
+static const char *mode_names[] = { "serial", "parallel", "reorder" };
+
+struct sub_state {
+    uint64_t last[MAX_PUBS];     /* highest number seen from each publisher */
+    uint64_t inversions;
+};
+
+static struct sub_state subs[MAX_SUBS];
+static uint64_t received;
+
+static void on_message(void *arg, void *msg)
+{
+    struct sub_state *s = arg;
+    uint32_t pub;
+    uint64_t num;
+
+    /* deliveries of one topic never overlap, publishers have a topic each */
+    memcpy(&pub, msg, sizeof(pub));
+    memcpy(&num, (char *)msg + sizeof(pub), sizeof(num));
+    if(num < s->last[pub])
+        __atomic_fetch_add(&s->inversions, 1, __ATOMIC_RELAXED);
+    else
+        s->last[pub] = num;
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* one run; returns nonzero if messages were lost, or misordered with the reorder buffers */
+static int run(const struct harness_config *cfg, int mode, int npubs, int nsubs, int n, int timeout)
+{
+    struct messaging_client_stats *cst = malloc(sizeof(*cst));
+    messaging_request_t reqs[MAX_PUBS] = {0};
+    struct harness *h;
+    char topic[32], msg[MSG_SIZE] = {0};
+    uint64_t inversions = 0, held = 0, gaps = 0, dups = 0, expected = (uint64_t)npubs * nsubs * n;
+    int failed = 0;
+    double t;
+
+    setenv("MESSAGING_SERIAL_FANOUT", mode == MODE_SERIAL ? "1" : "0", 1);
+    setenv("MESSAGING_REORDER", mode == MODE_REORDER ? "1" : "0", 1);
+    memset(subs, 0, sizeof(subs));
+    received = 0;
+    h = harness_start(cfg);
+    if(h == NULL || cst == NULL){
+        fprintf(stderr, "order_bench: could not start the harness\n");
+        harness_stop(h);
+        free(cst);
+        return 1;
+    }
+    for(int s = 0; s < nsubs; s++){
+        for(int p = 0; p < npubs; p++){
+            snprintf(topic, sizeof(topic), "p%d", p);
+            if(subscribe(harness_client(h, npubs + s), "order", topic, on_message, &subs[s]) != MESSAGING_SUCCESS)
+                failed = 1;
+        }
+    }
+
+    /* each publisher has one publish in flight, so its topic is numbered in publish order */
+    t = now();
+    for(uint64_t i = 1; !failed && i <= (uint64_t)n; i++){
+        for(uint32_t p = 0; !failed && p < (uint32_t)npubs; p++){
+            if(reqs[p] != NULL && messaging_wait(reqs[p]) != MESSAGING_SUCCESS)
+                failed = 1;
+            memcpy(msg, &p, sizeof(p));
+            memcpy(msg + sizeof(p), &i, sizeof(i));
+            snprintf(topic, sizeof(topic), "p%u", p);
+            if(publish_async(harness_client(h, p), "order", topic, msg, sizeof(msg), &reqs[p]) != MESSAGING_SUCCESS){
+                reqs[p] = NULL;
+                failed = 1;
+            }
+        }
+    }
+    for(int p = 0; p < npubs; p++)
+        if(reqs[p] != NULL && messaging_wait(reqs[p]) != MESSAGING_SUCCESS)
+            failed = 1;
+    if(!failed && harness_wait_for(&received, expected, timeout) != 0){
+        fprintf(stderr, "order_bench: %s run received %lu of %lu messages\n", mode_names[mode],
+                (unsigned long)received, (unsigned long)expected);
+        failed = 1;
+    }
+    t = now() - t;
+
+    for(int s = 0; s < nsubs; s++){
+        inversions += subs[s].inversions;
+        if(client_get_stats(harness_client(h, npubs + s), cst) != MESSAGING_SUCCESS)
+            continue;
+        held += cst->reorder_held;
+        gaps += cst->reorder_gaps;
+        dups += cst->reorder_duplicates;
+    }
+    if(mode == MODE_REORDER && (inversions || gaps || dups)){
+        fprintf(stderr, "order_bench: reorder run delivered %lu out of order, %lu gaps, %lu duplicates\n",
+                (unsigned long)inversions, (unsigned long)gaps, (unsigned long)dups);
+        failed = 1;
+    }
+    printf("%9s %14.0f %12lu %10lu %8lu %8lu\n", mode_names[mode], received / t,
+            (unsigned long)inversions, (unsigned long)held, (unsigned long)gaps, (unsigned long)dups);
+    harness_stop(h);
+    free(cst);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    int npubs = 4, nsubs = 4, n = 5000, timeout = 30000, opt, failed = 0;
+
+    harness_config_init(&cfg);
+    cfg.server_rpc_xstreams = 4;
+    while((opt = getopt(argc, argv, "x:r:p:S:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 'r': cfg.server_rpc_xstreams = atoi(optarg); break;
+        case 'p': npubs = atoi(optarg); break;
+        case 'S': nsubs = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-r server handler xstreams] [-p publishers]"
+                    " [-S subscribers] [-n messages per publisher] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(npubs < 1 || npubs > MAX_PUBS || nsubs < 1 || nsubs > MAX_SUBS || n < 1 ||
+            cfg.server_rpc_xstreams < 1){
+        fprintf(stderr, "order_bench: need 1 to %d publishers, 1 to %d subscribers and a handler xstream\n",
+                MAX_PUBS, MAX_SUBS);
+        return 2;
+    }
+    cfg.num_clients = npubs + nsubs;
+
+    printf("%9s %14s %12s %10s %8s %8s\n", "fan-out", "deliveries/s", "out of order", "held", "gaps",
+            "dups");
+    for(int mode = MODE_SERIAL; mode <= MODE_REORDER; mode++)
+        failed |= run(&cfg, mode, npubs, nsubs, n, timeout);
+    printf("order_bench: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Latency and throughput benchmark on a single host.
+ *
+ * Forks the subscribers and publishers as separate processes, each with its
+ * own Margo instance, so it needs neither MPI nor a particular network:
+ * start the servers with the same transport (e.g. "mpirun -n 1 ./server
+ * na+sm") and run this in the same directory.  Topic t is subscribed by
+ * 'fanout' consecutive subscribers starting at t, and publishers go round
+ * robin over the topics with 'window' publishes in flight each.
+ *
+ * Every payload carries its CLOCK_MONOTONIC send time; subscribers record
+ * the one-way latency in a histogram, and the merged result is printed and
+ * optionally written as JSON so runs can be compared over time.
+ *
+ * Usage: ./perf_bench [-x transport] [-s size] [-n messages per publisher]
+ *                     [-p publishers] [-S subscribers] [-t topics] [-f fanout]
+ *                     [-w window] [-T idle timeout s] [-j results.json|-]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <margo.h>
+#include <messaging-client.h>
+#include <messaging-hist.h>
+
+struct params {
+    const char *transport;
+    int size;
+    long count;
+    int publishers;
+    int subscribers;
+    int topics;
+    int fanout;
+    int window;
+    int timeout;
+    const char *json;
+};
+
+struct sub_result {
+    uint64_t expected;
+    uint64_t received;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    struct messaging_hist latency;
+};
+
+struct pub_result {
+    uint64_t sent;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+static struct params prm = { "na+sm", 1024, 10000, 1, 1, 1, 1, 1, 10, NULL };
+
+static struct sub_result sres;
+
+struct pub_ult {
+    messaging_client_t client;
+    int publisher;
+    int lane;
+    uint64_t sent;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void topic_name(char *buf, size_t len, int t)
+{
+    snprintf(buf, len, "t%d", t);
+}
+
+/* messages all publishers send to topic t, publisher p sends message i to (p + i) % topics */
+static uint64_t messages_for_topic(int t)
+{
+    uint64_t n = 0;
+
+    for(int p = 0; p < prm.publishers; p++){
+        long first = ((t - p) % prm.topics + prm.topics) % prm.topics;
+        if(first < prm.count)
+            n += (prm.count - 1 - first) / prm.topics + 1;
+    }
+    return n;
+}
+
+static int subscribes_to(int sub, int t)
+{
+    return ((sub - t) % prm.subscribers + prm.subscribers) % prm.subscribers < prm.fanout;
+}
+
+static void write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            _exit(2);
+        p += n;
+        len -= n;
+    }
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while(len > 0){
+        ssize_t n = read(fd, p, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void handler(void *args, void *msg)
+{
+    uint64_t sent, now = now_ns();
+
+    memcpy(&sent, msg, sizeof(sent));
+    messaging_hist_record(&sres.latency, now - sent);
+    if(sres.received++ == 0)
+        sres.first_ns = now;
+    sres.last_ns = now;
+}
+
+static margo_instance_id child_init(messaging_client_t *c)
+{
+    margo_instance_id mid;
+
+    /* one execution stream: callbacks and publishes never run concurrently */
+    mid = margo_init(prm.transport, MARGO_SERVER_MODE, 0, -1);
+    if(mid == MARGO_INSTANCE_NULL || client_init(mid, c) != MESSAGING_SUCCESS){
+        fprintf(stderr, "perf_bench: could not start a client on %s\n", prm.transport);
+        _exit(1);
+    }
+    return mid;
+}
+
+static void subscriber(int idx, int ready_fd, int result_fd)
+{
+    struct messaging_subscription *subs;
+    messaging_client_t c;
+    margo_instance_id mid;
+    size_t n = 0;
+    uint64_t seen = 0, idle_since;
+
+    messaging_hist_init(&sres.latency);
+    mid = child_init(&c);
+
+    subs = calloc(prm.topics, sizeof(*subs));
+    for(int t = 0; t < prm.topics; t++){
+        if(!subscribes_to(idx, t))
+            continue;
+        subs[n].namesp = "perf_bench";
+        subs[n].topic = malloc(16);
+        topic_name(subs[n].topic, 16, t);
+        subs[n].callback = handler;
+        sres.expected += messages_for_topic(t);
+        n++;
+    }
+    if(subscribe_many(c, subs, n) != MESSAGING_SUCCESS)
+        fprintf(stderr, "perf_bench: subscriber %d could not subscribe\n", idx);
+    write_all(ready_fd, "s", 1);
+
+    /* wait for everything, or until nothing arrived for a while */
+    idle_since = now_ns();
+    while(sres.received < sres.expected){
+        margo_thread_sleep(mid, 1);
+        if(sres.received != seen){
+            seen = sres.received;
+            idle_since = now_ns();
+        }else if(now_ns() - idle_since > (uint64_t)prm.timeout * 1000000000ULL){
+            break;
+        }
+    }
+    write_all(result_fd, &sres, sizeof(sres));
+
+    unsubscribe_many(c, subs, n);
+    for(size_t i = 0; i < n; i++)
+        free(subs[i].topic);
+    free(subs);
+    client_finalize(c);
+    margo_finalize(mid);
+    _exit(0);
+}
+
+/* one of the 'window' publishes a publisher keeps in flight */
+static void publish_lane(void *arg)
+{
+    struct pub_ult *u = arg;
+    char *buf = calloc(1, prm.size);
+    char topic[16];
+
+    for(long i = u->lane; i < prm.count; i += prm.window){
+        uint64_t stamp;
+        topic_name(topic, sizeof(topic), (int)((u->publisher + i) % prm.topics));
+        stamp = now_ns();
+        memcpy(buf, &stamp, sizeof(stamp));
+        if(publish(u->client, "perf_bench", topic, buf, prm.size) == MESSAGING_SUCCESS)
+            u->sent++;
+    }
+    free(buf);
+}
+
+static void publisher(int idx, int ready_fd, int go_fd, int result_fd)
+{
+    struct pub_result res = {0};
+    struct pub_ult *lanes;
+    ABT_thread *ults;
+    ABT_pool pool;
+    messaging_client_t c;
+    margo_instance_id mid;
+    char go;
+
+    mid = child_init(&c);
+    lanes = calloc(prm.window, sizeof(*lanes));
+    ults = calloc(prm.window, sizeof(*ults));
+    margo_get_handler_pool(mid, &pool);
+
+    write_all(ready_fd, "p", 1);
+    if(read_all(go_fd, &go, 1) != 0)
+        _exit(1);
+
+    res.start_ns = now_ns();
+    for(int w = 0; w < prm.window; w++){
+        lanes[w].client = c;
+        lanes[w].publisher = idx;
+        lanes[w].lane = w;
+        ABT_thread_create(pool, publish_lane, &lanes[w], ABT_THREAD_ATTR_NULL, &ults[w]);
+    }
+    for(int w = 0; w < prm.window; w++){
+        ABT_thread_join(ults[w]);
+        ABT_thread_free(&ults[w]);
+        res.sent += lanes[w].sent;
+    }
+    res.end_ns = now_ns();
+    write_all(result_fd, &res, sizeof(res));
+
+    free(ults);
+    free(lanes);
+    client_finalize(c);
+    margo_finalize(mid);
+    _exit(0);
+}
+
+static void write_json(FILE *f, const struct pub_result *pub, const struct sub_result *sub,
+        double pub_s, double del_s)
+{
+    const struct messaging_hist *h = &sub->latency;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"params\": {\"transport\": \"%s\", \"size\": %d, \"messages\": %ld, "
+            "\"publishers\": %d, \"subscribers\": %d, \"topics\": %d, \"fanout\": %d, \"window\": %d},\n",
+            prm.transport, prm.size, prm.count, prm.publishers, prm.subscribers, prm.topics,
+            prm.fanout, prm.window);
+    fprintf(f, "  \"publish\": {\"messages\": %lu, \"seconds\": %.6f, \"msgs_per_s\": %.1f},\n",
+            (unsigned long)pub->sent, pub_s, pub_s > 0 ? pub->sent / pub_s : 0.0);
+    fprintf(f, "  \"delivery\": {\"expected\": %lu, \"messages\": %lu, \"seconds\": %.6f, "
+            "\"msgs_per_s\": %.1f, \"mb_per_s\": %.3f},\n",
+            (unsigned long)sub->expected, (unsigned long)sub->received, del_s,
+            del_s > 0 ? sub->received / del_s : 0.0,
+            del_s > 0 ? (double)sub->received * prm.size / del_s / 1e6 : 0.0);
+    fprintf(f, "  \"latency_us\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, "
+            "\"p99_9\": %.3f, \"max\": %.3f}\n",
+            messaging_hist_mean(h) / 1e3, messaging_hist_quantile(h, 0.5) / 1e3,
+            messaging_hist_quantile(h, 0.99) / 1e3, messaging_hist_quantile(h, 0.999) / 1e3,
+            h->count ? h->max / 1e3 : 0.0);
+    fprintf(f, "}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-x transport] [-s size] [-n messages per publisher] "
+            "[-p publishers] [-S subscribers] [-t topics] [-f fanout] [-w window] "
+            "[-T idle timeout s] [-j results.json|-]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    static struct sub_result sub_all, one;
+    struct pub_result pub_all = { 0, UINT64_MAX, 0 }, pres;
+    int ready[2], go[2], *results, nchildren, opt, failed = 0, status;
+    double pub_s, del_s;
+    char c;
+
+    while((opt = getopt(argc, argv, "x:s:n:p:S:t:f:w:T:j:h")) != -1){
+        switch(opt){
+        case 'x': prm.transport = optarg; break;
+        case 's': prm.size = atoi(optarg); break;
+        case 'n': prm.count = atol(optarg); break;
+        case 'p': prm.publishers = atoi(optarg); break;
+        case 'S': prm.subscribers = atoi(optarg); break;
+        case 't': prm.topics = atoi(optarg); break;
+        case 'f': prm.fanout = atoi(optarg); break;
+        case 'w': prm.window = atoi(optarg); break;
+        case 'T': prm.timeout = atoi(optarg); break;
+        case 'j': prm.json = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(prm.size < (int)sizeof(uint64_t))
+        prm.size = sizeof(uint64_t);
+    if(prm.publishers < 1 || prm.subscribers < 1 || prm.topics < 1 || prm.window < 1 ||
+            prm.fanout < 1 || prm.fanout > prm.subscribers || prm.count < 1)
+        usage(argv[0]);
+
+    nchildren = prm.subscribers + prm.publishers;
+    results = calloc(nchildren, sizeof(*results));
+    if(pipe(ready) != 0 || pipe(go) != 0){
+        perror("pipe");
+        return 1;
+    }
+    fflush(NULL);
+
+    /* subscribers first, publishers only start once everyone is subscribed */
+    for(int i = 0; i < nchildren; i++){
+        int res[2];
+        pid_t pid;
+
+        if(pipe(res) != 0){
+            perror("pipe");
+            return 1;
+        }
+        pid = fork();
+        if(pid == 0){
+            close(res[0]);
+            if(i < prm.subscribers)
+                subscriber(i, ready[1], res[1]);
+            else
+                publisher(i - prm.subscribers, ready[1], go[0], res[1]);
+        }
+        close(res[1]);
+        results[i] = res[0];
+        if(pid < 0){
+            perror("fork");
+            return 1;
+        }
+    }
+    close(ready[1]);
+    for(int i = 0; i < nchildren; i++){
+        if(read_all(ready[0], &c, 1) != 0){
+            fprintf(stderr, "perf_bench: a child exited before it was ready\n");
+            return 1;
+        }
+    }
+    for(int i = 0; i < prm.publishers; i++)
+        write_all(go[1], "g", 1);
+
+    messaging_hist_init(&sub_all.latency);
+    for(int i = 0; i < nchildren; i++){
+        if(i < prm.subscribers){
+            if(read_all(results[i], &one, sizeof(one)) != 0){
+                failed = 1;
+                continue;
+            }
+            sub_all.expected += one.expected;
+            sub_all.received += one.received;
+            if(one.received && one.last_ns > sub_all.last_ns)
+                sub_all.last_ns = one.last_ns;
+            messaging_hist_merge(&sub_all.latency, &one.latency);
+        }else{
+            if(read_all(results[i], &pres, sizeof(pres)) != 0){
+                failed = 1;
+                continue;
+            }
+            pub_all.sent += pres.sent;
+            if(pres.start_ns < pub_all.start_ns)
+                pub_all.start_ns = pres.start_ns;
+            if(pres.end_ns > pub_all.end_ns)
+                pub_all.end_ns = pres.end_ns;
+        }
+        close(results[i]);
+    }
+    while(wait(&status) > 0)
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+
+    pub_s = pub_all.end_ns > pub_all.start_ns ? (pub_all.end_ns - pub_all.start_ns) / 1e9 : 0;
+    del_s = sub_all.last_ns > pub_all.start_ns ? (sub_all.last_ns - pub_all.start_ns) / 1e9 : 0;
+
+    printf("%-12s %s, %d B, %ld msgs x %d publishers, %d subscribers, %d topics, fan-out %d, window %d\n",
+            "config", prm.transport, prm.size, prm.count, prm.publishers, prm.subscribers,
+            prm.topics, prm.fanout, prm.window);
+    printf("%-12s %12.0f msg/s\n", "publish", pub_s > 0 ? pub_all.sent / pub_s : 0.0);
+    printf("%-12s %12.0f msg/s %10.2f MB/s (%lu of %lu)\n", "delivery",
+            del_s > 0 ? sub_all.received / del_s : 0.0,
+            del_s > 0 ? (double)sub_all.received * prm.size / del_s / 1e6 : 0.0,
+            (unsigned long)sub_all.received, (unsigned long)sub_all.expected);
+    printf("%-12s p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f us\n", "latency",
+            messaging_hist_quantile(&sub_all.latency, 0.5) / 1e3,
+            messaging_hist_quantile(&sub_all.latency, 0.99) / 1e3,
+            messaging_hist_quantile(&sub_all.latency, 0.999) / 1e3,
+            sub_all.latency.count ? sub_all.latency.max / 1e3 : 0.0);
+
+    if(prm.json){
+        FILE *f = strcmp(prm.json, "-") == 0 ? stdout : fopen(prm.json, "w");
+        if(f == NULL){
+            perror(prm.json);
+            return 1;
+        }
+        write_json(f, &pub_all, &sub_all, pub_s, del_s);
+        if(f != stdout)
+            fclose(f);
+    }
+    free(results);
+    return failed || sub_all.received != sub_all.expected;
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Steady-state allocation benchmark for the message buffer pool.
+ *
+ * Runs the buffer handling of the publish path (client encode, server
+ * decode, fan-out arrays, subscriber decode) without a network, once on a
+ * single thread and once with buffers allocated on one thread and freed on
+ * another, as happens between Margo xstreams.  After a warm-up phase the
+ * pool must not go to the heap at all; the benchmark fails otherwise.
+ *
+ * Usage: pool_bench [num_msgs] [msg_size] [fanout]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <messaging-wire.h>
+#include <messaging-pool.h>
+#include "timer.h"
+
+#define RING_SIZE 64
+
+static long num_msgs = 1000000;
+static size_t msg_size = 1024;
+static int fanout = 8;
+static char *payload;
+
+typedef void *(*alloc_fn)(size_t);
+typedef void (*free_fn)(void *);
+
+static void *aligned_malloc(size_t size)
+{
+    void *p;
+    return posix_memalign(&p, WIRE_ALIGN, size) == 0 ? p : NULL;
+}
+
+/* client side: encode into a fresh buffer */
+static void *encode(alloc_fn do_alloc, size_t *size)
+{
+    struct wire_msg m;
+    void *buf;
+
+    wire_msg_init(&m, "bench_namespace", "bench_topic");
+    m.payload = payload;
+    m.payload_len = msg_size;
+    *size = wire_encoded_size(&m);
+    buf = do_alloc(*size);
+    wire_encode(buf, *size, &m);
+    return buf;
+}
+
+/* server and subscriber side: receive into a buffer, decode in place, fan out */
+static int receive(alloc_fn do_alloc, free_fn do_free, void *sent, size_t size)
+{
+    struct wire_msg m;
+    void *rbuf = do_alloc(size);
+    void **handles = (void **)do_alloc(sizeof(void *) * fanout);
+    int ret;
+
+    memcpy(rbuf, sent, size);
+    ret = wire_decode(rbuf, size, &m);
+    for (int i = 0; ret == MESSAGING_SUCCESS && i < fanout; i++)
+        handles[i] = m.payload;
+    do_free(handles);
+    do_free(rbuf);
+    return ret;
+}
+
+static double run_single(alloc_fn do_alloc, free_fn do_free, long n)
+{
+    struct timer t;
+    timer_init(&t, 0);
+    timer_start(&t);
+    for (long i = 0; i < n; i++) {
+        size_t size;
+        void *buf = encode(do_alloc, &size);
+        if (receive(do_alloc, do_free, buf, size) != MESSAGING_SUCCESS) {
+            fprintf(stderr, "pool_bench: decode failed\n");
+            exit(1);
+        }
+        do_free(buf);
+    }
+    return timer_read(&t);
+}
+
+/* single producer, single consumer ring handing buffers across threads */
+static struct {
+    void *bufs[RING_SIZE];
+    size_t sizes[RING_SIZE];
+    volatile long head, tail;
+    long n;
+    alloc_fn do_alloc;
+    free_fn do_free;
+} ring;
+
+static void *consumer(void *arg)
+{
+    (void)arg;
+    for (long i = 0; i < ring.n; i++) {
+        while (__atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == i)
+            sched_yield();
+        void *buf = ring.bufs[i % RING_SIZE];
+        receive(ring.do_alloc, ring.do_free, buf, ring.sizes[i % RING_SIZE]);
+        ring.do_free(buf);
+        __atomic_store_n(&ring.head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static double run_cross(alloc_fn do_alloc, free_fn do_free, long n)
+{
+    struct timer t;
+    pthread_t th;
+
+    ring.head = ring.tail = 0;
+    ring.n = n;
+    ring.do_alloc = do_alloc;
+    ring.do_free = do_free;
+    timer_init(&t, 0);
+    timer_start(&t);
+    pthread_create(&th, NULL, consumer, NULL);
+    for (long i = 0; i < n; i++) {
+        while (i - __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) >= RING_SIZE)
+            sched_yield();
+        ring.bufs[i % RING_SIZE] = encode(do_alloc, &ring.sizes[i % RING_SIZE]);
+        __atomic_store_n(&ring.tail, i + 1, __ATOMIC_RELEASE);
+    }
+    pthread_join(th, NULL);
+    return timer_read(&t);
+}
+
+static int report(const char *name, double (*run)(alloc_fn, free_fn, long))
+{
+    struct messaging_pool_stats before, after;
+    double t_pool, t_malloc;
+
+    /* warm up until a pass runs entirely from the caches, then measure */
+    for (int i = 0; i < 10; i++) {
+        messaging_pool_get_stats(&before);
+        run(messaging_pool_alloc, messaging_pool_free, num_msgs / 10 + RING_SIZE);
+        messaging_pool_get_stats(&after);
+        if (after.heap_allocs == before.heap_allocs)
+            break;
+    }
+    messaging_pool_get_stats(&before);
+    t_pool = run(messaging_pool_alloc, messaging_pool_free, num_msgs);
+    messaging_pool_get_stats(&after);
+    t_malloc = run(aligned_malloc, free, num_msgs);
+
+    fprintf(stdout, "%-12s pool %8.1f ns/msg   malloc %8.1f ns/msg   heap allocs/msg %.6f   cached %lu bytes\n",
+            name, t_pool * 1e9 / num_msgs, t_malloc * 1e9 / num_msgs,
+            (double)(after.heap_allocs - before.heap_allocs) / num_msgs,
+            (unsigned long)after.cached_bytes);
+    if (after.heap_allocs != before.heap_allocs) {
+        fprintf(stderr, "pool_bench: %s made %lu heap allocations in steady state\n",
+                name, (unsigned long)(after.heap_allocs - before.heap_allocs));
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    if (argc > 1)
+        num_msgs = atol(argv[1]);
+    if (argc > 2)
+        msg_size = (size_t)atol(argv[2]);
+    if (argc > 3)
+        fanout = atoi(argv[3]);
+
+    payload = malloc(msg_size);
+    memset(payload, 'a', msg_size);
+
+    fprintf(stdout, "pool_bench: %ld messages of %zu bytes, fan-out %d\n", num_msgs, msg_size, fanout);
+    ret |= report("single", run_single);
+    ret |= report("cross-thread", run_cross);
+    free(payload);
+    return ret;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+
+/*
+ * Publish throughput of one server process as it runs more providers.
+ * Several clients publish round robin over many topics, each keeping a
+ * window of publish_async() requests in flight; the run is repeated with
+ * MESSAGING_PROVIDERS at 1, 2, 4, ... up to the maximum, and reports the
+ * publishes per second, the speedup over a single provider and how evenly
+ * the topics spread over the providers.  Every message to the few topics
+ * with a subscriber must arrive.
+ *
+ * Usage: ./provider_bench [-x transport] [-p max providers] [-c publishers]
+ *                         [-t topics] [-n publishes per client] [-w window]
+ *                         [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "harness.h"
+
+#define MSG_SIZE   64
+#define SUBSCRIBED 8
+#define MAX_WINDOW 256
+
+static uint64_t received;
+
+static void on_message(void *arg, void *msg)
+{
+    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/* the fewest and most publishes any provider served */
+static void provider_spread(messaging_client_t c, uint64_t *min, uint64_t *max)
+{
+    struct messaging_server_stats *st = malloc(sizeof(*st));
+
+    *min = UINT64_MAX;
+    *max = 0;
+    for(int s = 0; st && s < messaging_num_servers(c); s++){
+        if(messaging_get_server_stats(c, s, st) != MESSAGING_SUCCESS)
+            continue;
+        if(st->publishes < *min)
+            *min = st->publishes;
+        if(st->publishes > *max)
+            *max = st->publishes;
+    }
+    if(*min == UINT64_MAX)
+        *min = 0;
+    free(st);
+}
+
+/* one run; returns the publishes per second, or a negative value on failure */
+static double run(const struct harness_config *cfg, int providers, int topics, int count,
+        int window, int timeout, double base)
+{
+    struct harness *h;
+    messaging_request_t (*reqs)[MAX_WINDOW];
+    messaging_client_t sub;
+    char topic[32], msg[MSG_SIZE] = {0}, num[16];
+    uint64_t expected = 0, min, max;
+    int pubs = cfg->num_clients - 1, failed = 0, next = 0;
+    double t, rate;
+
+    received = 0;
+    snprintf(num, sizeof(num), "%d", providers);
+    setenv("MESSAGING_PROVIDERS", num, 1);
+    h = harness_start(cfg);
+    reqs = calloc(pubs, sizeof(*reqs));
+    if(h == NULL || reqs == NULL){
+        fprintf(stderr, "provider_bench: could not start the harness with %d providers\n", providers);
+        harness_stop(h);
+        free(reqs);
+        return -1;
+    }
+    sub = harness_client(h, pubs);
+    for(int i = 0; i < SUBSCRIBED; i++){
+        snprintf(topic, sizeof(topic), "t%d", i * (topics / SUBSCRIBED));
+        if(subscribe(sub, "providers", topic, on_message, NULL) != MESSAGING_SUCCESS)
+            failed = 1;
+    }
+
+    /* every client keeps its window full, publishing to the next topic */
+    t = now();
+    for(int i = 0; !failed && i < count; i++){
+        for(int c = 0; !failed && c < pubs; c++){
+            messaging_request_t *r = &reqs[c][i % window];
+            int k = next++ % topics;
+
+            if(*r != NULL && messaging_wait(*r) != MESSAGING_SUCCESS)
+                failed = 1;
+            snprintf(topic, sizeof(topic), "t%d", k);
+            if(publish_async(harness_client(h, c), "providers", topic, msg, sizeof(msg), r) != MESSAGING_SUCCESS){
+                *r = NULL;
+                failed = 1;
+            }
+            if(k % (topics / SUBSCRIBED) == 0 && k / (topics / SUBSCRIBED) < SUBSCRIBED)
+                expected++;
+        }
+    }
+    for(int c = 0; c < pubs; c++)
+        for(int k = 0; k < window; k++)
+            if(reqs[c][k] != NULL && messaging_wait(reqs[c][k]) != MESSAGING_SUCCESS)
+                failed = 1;
+    t = now() - t;
+
+    if(!failed && harness_wait_for(&received, expected, timeout) != 0){
+        fprintf(stderr, "provider_bench: received %lu of %lu messages with %d providers\n",
+                (unsigned long)received, (unsigned long)expected, providers);
+        failed = 1;
+    }
+    rate = (double)count * pubs / t;
+    provider_spread(harness_client(h, 0), &min, &max);
+    printf("%9d %14.0f %9.2f %12lu %12lu\n", providers, rate, base > 0 ? rate / base : 1.0,
+            (unsigned long)min, (unsigned long)max);
+    harness_stop(h);
+    free(reqs);
+    return failed ? -1 : rate;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    int max_providers = 32, topics = 1024, count = 2000, window = 16, timeout = 10000, opt, failed = 0;
+    double base = 0, rate;
+
+    harness_config_init(&cfg);
+    cfg.num_clients = 4 + 1;
+    while((opt = getopt(argc, argv, "x:p:c:t:n:w:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 'p': max_providers = atoi(optarg); break;
+        case 'c': cfg.num_clients = atoi(optarg) + 1; break;
+        case 't': topics = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-p max providers] [-c publishers] [-t topics]"
+                    " [-n publishes per client] [-w window] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(max_providers < 1 || max_providers > MESSAGING_PROVIDERS_MAX || cfg.num_clients < 2 ||
+            topics < SUBSCRIBED || count < 1 || window < 1 || window > MAX_WINDOW){
+        fprintf(stderr, "provider_bench: need 1 <= providers <= %d, publishers >= 1, topics >= %d"
+                " and 1 <= window <= %d\n", MESSAGING_PROVIDERS_MAX, SUBSCRIBED, MAX_WINDOW);
+        return 2;
+    }
+
+    printf("%9s %14s %9s %12s %12s\n", "providers", "publishes/s", "speedup", "min/provider", "max/provider");
+    for(int p = 1; p <= max_providers; p *= 2){
+        rate = run(&cfg, p, topics, count, window, timeout, base);
+        if(rate < 0)
+            failed = 1;
+        else if(p == 1)
+            base = rate;
+    }
+    printf("provider_bench: %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
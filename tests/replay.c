@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Replays traffic recorded with MESSAGING_CAPTURE (see messaging-capture.h).
+ *
+ * The capture files of all servers are merged by time.  Subscriptions are
+ * replayed by 'subs' subscriber clients, the original subscribers spread
+ * over them, and publishes by 'lanes' publisher clients, each original
+ * publisher always on the same lane.  Every event is sent at its captured
+ * time divided by the speed (0 sends as fast as possible), and a publish
+ * never overtakes a subscription recorded before it.  Payloads are the
+ * recorded ones if the capture has them, zeros otherwise, with the send
+ * time in the first 8 bytes (shorter payloads are padded) so subscribers
+ * can measure the delivery latency.
+ *
+ * It connects to running servers (MESSAGING_BOOTSTRAP), or with -L starts
+ * one in this process over the loopback harness.
+ *
+ * Usage: ./replay [-x transport] [-L] [-S subscriber clients] [-P publisher lanes]
+ *                 [-r speed] [-T idle timeout s] [-j results.json|-] capture...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <messaging-capture.h>
+#include <messaging-hist.h>
+#include "harness.h"
+
+struct params {
+    const char *transport;
+    int loopback;
+    int subs;
+    int lanes;
+    double speed;
+    int timeout;
+    const char *json;
+};
+
+static struct params prm = { "na+sm", 0, 4, 4, 1.0, 2, NULL };
+
+struct event {
+    uint64_t ts;
+    uint32_t op;
+    uint32_t who;
+    uint32_t rank;
+    uint32_t seq;           /* keeps the order of records with the same time */
+    uint64_t size;
+    const char *namesp;
+    const char *topic;
+    const void *payload;
+};
+
+struct subscriber {
+    messaging_client_t client;
+    uint64_t received;
+    struct messaging_hist latency;
+};
+
+struct lane {
+    int idx;
+    pthread_t thread;
+    messaging_client_t client;
+    uint64_t sent;
+    uint64_t bytes;
+    uint64_t errors;
+    struct messaging_hist lag;  /* how late publishes went out */
+};
+
+/* subscriptions a subscriber client holds, so several original
+ * subscribers sharing it subscribe once */
+struct sub_ref {
+    struct sub_ref *next;
+    int client;
+    long count;
+    const char *namesp;
+    const char *topic;
+};
+
+#define REF_BUCKETS 4096
+
+static struct event *events;
+static size_t num_events;
+static struct subscriber *subscribers;
+static struct sub_ref *refs[REF_BUCKETS];
+static size_t sub_progress;     /* events before this index that are (un)subscribes are done */
+static uint64_t t0_ns, first_ts;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* sleeps until event ev is due, returns how late it is */
+static uint64_t wait_until_due(const struct event *ev)
+{
+    struct timespec ts;
+    uint64_t due, now;
+
+    if(prm.speed <= 0)
+        return 0;
+    due = t0_ns + (uint64_t)((ev->ts - first_ts) / prm.speed);
+    now = now_ns();
+    if(now >= due)
+        return now - due;
+    ts.tv_sec = due / 1000000000ULL;
+    ts.tv_nsec = due % 1000000000ULL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+    return 0;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+    const struct event *x = a, *y = b;
+
+    if(x->ts != y->ts)
+        return (x->ts > y->ts) - (x->ts < y->ts);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* appends the records of one capture file, which stays in memory */
+static int load(const char *path)
+{
+    struct messaging_capture_reader r;
+    struct messaging_capture_event ev;
+    static size_t cap;
+    FILE *f = fopen(path, "rb");
+    char *buf;
+    long len;
+    int ret;
+
+    if(f == NULL || fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0){
+        perror(path);
+        return -1;
+    }
+    rewind(f);
+    buf = malloc(len ? len : 1);
+    if(buf == NULL || fread(buf, 1, len, f) != (size_t)len){
+        fprintf(stderr, "replay: could not read %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    if(messaging_capture_reader_init(&r, buf, len) != MESSAGING_SUCCESS){
+        fprintf(stderr, "replay: %s is not a capture\n", path);
+        return -1;
+    }
+    while((ret = messaging_capture_next(&r, &ev)) == 1){
+        if(num_events == cap){
+            cap = cap ? cap * 2 : 4096;
+            events = realloc(events, cap * sizeof(*events));
+            if(events == NULL)
+                return -1;
+        }
+        events[num_events].ts = ev.ts;
+        events[num_events].op = ev.op;
+        events[num_events].who = ev.who;
+        events[num_events].rank = r.header.rank;
+        events[num_events].seq = (uint32_t)num_events;
+        events[num_events].size = ev.size;
+        events[num_events].namesp = ev.namesp;
+        events[num_events].topic = ev.topic;
+        events[num_events].payload = ev.payload;
+        num_events++;
+    }
+    if(ret < 0)
+        fprintf(stderr, "replay: %s is damaged after %zu records, using those\n", path, num_events);
+    return 0;
+}
+
+static void on_message(void *arg, void *msg)
+{
+    struct subscriber *s = arg;
+    uint64_t sent, now = now_ns();
+
+    memcpy(&sent, msg, sizeof(sent));
+    if(now >= sent)
+        messaging_hist_record(&s->latency, now - sent);
+    __atomic_add_fetch(&s->received, 1, __ATOMIC_RELAXED);
+}
+
+static struct sub_ref *find_ref(int client, const char *namesp, const char *topic)
+{
+    uint64_t hash = wire_topic_hash(namesp, topic) ^ (uint64_t)client * 0x9e3779b97f4a7c15ULL;
+    struct sub_ref **head = &refs[hash % REF_BUCKETS], *ref;
+
+    for(ref = *head; ref != NULL; ref = ref->next)
+        if(ref->client == client && strcmp(ref->namesp, namesp) == 0 && strcmp(ref->topic, topic) == 0)
+            return ref;
+    ref = calloc(1, sizeof(*ref));
+    if(ref == NULL)
+        return NULL;
+    ref->client = client;
+    ref->namesp = namesp;
+    ref->topic = topic;
+    ref->next = *head;
+    *head = ref;
+    return ref;
+}
+
+/* replays the (un)subscribes and lets the publishes behind them go */
+static void *subscription_thread(void *arg)
+{
+    for(size_t i = 0; i < num_events; i++){
+        const struct event *ev = &events[i];
+        struct sub_ref *ref;
+        int c;
+
+        if(ev->op == MESSAGING_CAPTURE_SUBSCRIBE || ev->op == MESSAGING_CAPTURE_UNSUBSCRIBE){
+            wait_until_due(ev);
+            /* ids are per server */
+            c = (int)((ev->who * 31u + ev->rank) % (uint32_t)prm.subs);
+            ref = find_ref(c, ev->namesp, ev->topic);
+            if(ref != NULL && ev->op == MESSAGING_CAPTURE_SUBSCRIBE && ref->count++ == 0)
+                subscribe(subscribers[c].client, (char*)ev->namesp, (char*)ev->topic,
+                        on_message, &subscribers[c]);
+            else if(ref != NULL && ev->op == MESSAGING_CAPTURE_UNSUBSCRIBE && ref->count > 0 &&
+                    --ref->count == 0)
+                unsubscribe(subscribers[c].client, (char*)ev->namesp, (char*)ev->topic);
+        }
+        __atomic_store_n(&sub_progress, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void *publish_thread(void *arg)
+{
+    struct lane *l = arg;
+    uint64_t max_size = sizeof(uint64_t), stamp;
+    char *buf;
+
+    for(size_t i = 0; i < num_events; i++)
+        if(events[i].op == MESSAGING_CAPTURE_PUBLISH && events[i].who % prm.lanes == (uint32_t)l->idx &&
+                events[i].size > max_size)
+            max_size = events[i].size;
+    buf = calloc(1, max_size);
+    if(buf == NULL)
+        return NULL;
+
+    for(size_t i = 0; i < num_events; i++){
+        const struct event *ev = &events[i];
+        size_t size;
+
+        if(ev->op != MESSAGING_CAPTURE_PUBLISH || ev->who % prm.lanes != (uint32_t)l->idx)
+            continue;
+        while(__atomic_load_n(&sub_progress, __ATOMIC_ACQUIRE) < i)
+            usleep(10);
+        messaging_hist_record(&l->lag, wait_until_due(ev));
+        size = ev->size > sizeof(uint64_t) ? ev->size : sizeof(uint64_t);
+        if(ev->payload)
+            memcpy(buf, ev->payload, ev->size);
+        stamp = now_ns();
+        memcpy(buf, &stamp, sizeof(stamp));
+        if(publish(l->client, (char*)ev->namesp, (char*)ev->topic, buf, (int)size) == MESSAGING_SUCCESS){
+            l->sent++;
+            l->bytes += size;
+        }else{
+            l->errors++;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static uint64_t total_received(void)
+{
+    uint64_t n = 0;
+
+    for(int i = 0; i < prm.subs; i++)
+        n += __atomic_load_n(&subscribers[i].received, __ATOMIC_RELAXED);
+    return n;
+}
+
+static void write_json(FILE *f, uint64_t pubs, uint64_t subs, uint64_t unsubs, double span_s,
+        uint64_t sent, uint64_t bytes, uint64_t errors, double replay_s, uint64_t received,
+        const struct messaging_hist *lag, const struct messaging_hist *lat)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"params\": {\"transport\": \"%s\", \"speed\": %g, \"subscribers\": %d, \"lanes\": %d},\n",
+            prm.transport, prm.speed, prm.subs, prm.lanes);
+    fprintf(f, "  \"capture\": {\"publishes\": %lu, \"subscribes\": %lu, \"unsubscribes\": %lu, "
+            "\"seconds\": %.6f},\n", (unsigned long)pubs, (unsigned long)subs,
+            (unsigned long)unsubs, span_s);
+    fprintf(f, "  \"publish\": {\"messages\": %lu, \"errors\": %lu, \"seconds\": %.6f, "
+            "\"msgs_per_s\": %.1f, \"mb_per_s\": %.3f},\n",
+            (unsigned long)sent, (unsigned long)errors, replay_s,
+            replay_s > 0 ? sent / replay_s : 0.0, replay_s > 0 ? bytes / replay_s / 1e6 : 0.0);
+    fprintf(f, "  \"lag_us\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            messaging_hist_quantile(lag, 0.5) / 1e3, messaging_hist_quantile(lag, 0.99) / 1e3,
+            lag->count ? lag->max / 1e3 : 0.0);
+    fprintf(f, "  \"delivery\": {\"messages\": %lu},\n", (unsigned long)received);
+    fprintf(f, "  \"latency_us\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, "
+            "\"p99_9\": %.3f, \"max\": %.3f}\n",
+            messaging_hist_mean(lat) / 1e3, messaging_hist_quantile(lat, 0.5) / 1e3,
+            messaging_hist_quantile(lat, 0.99) / 1e3, messaging_hist_quantile(lat, 0.999) / 1e3,
+            lat->count ? lat->max / 1e3 : 0.0);
+    fprintf(f, "}\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-x transport] [-L] [-S subscriber clients] [-P publisher lanes] "
+            "[-r speed, 0 for max] [-T idle timeout s] [-j results.json|-] capture...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    static struct messaging_hist lag, latency;
+    struct harness_config cfg;
+    struct harness *h;
+    struct lane *lanes;
+    pthread_t sub_thread;
+    uint64_t pubs = 0, subs = 0, unsubs = 0, sent = 0, bytes = 0, errors = 0, seen, idle_since, end_ns;
+    double span_s, replay_s;
+    int opt;
+
+    while((opt = getopt(argc, argv, "x:LS:P:r:T:j:h")) != -1){
+        switch(opt){
+        case 'x': prm.transport = optarg; break;
+        case 'L': prm.loopback = 1; break;
+        case 'S': prm.subs = atoi(optarg); break;
+        case 'P': prm.lanes = atoi(optarg); break;
+        case 'r': prm.speed = atof(optarg); break;
+        case 'T': prm.timeout = atoi(optarg); break;
+        case 'j': prm.json = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(optind >= argc || prm.subs < 1 || prm.lanes < 1 || prm.speed < 0)
+        usage(argv[0]);
+    for(int i = optind; i < argc; i++)
+        if(load(argv[i]) != 0)
+            return 1;
+    if(num_events == 0){
+        fprintf(stderr, "replay: nothing to replay\n");
+        return 1;
+    }
+    qsort(events, num_events, sizeof(*events), cmp_event);
+    first_ts = events[0].ts;
+    span_s = (events[num_events - 1].ts - first_ts) / 1e9;
+    for(size_t i = 0; i < num_events; i++){
+        pubs += events[i].op == MESSAGING_CAPTURE_PUBLISH;
+        subs += events[i].op == MESSAGING_CAPTURE_SUBSCRIBE;
+        unsubs += events[i].op == MESSAGING_CAPTURE_UNSUBSCRIBE;
+    }
+    printf("capture     %lu publishes, %lu subscribes, %lu unsubscribes over %.3f s in %d file%s\n",
+            (unsigned long)pubs, (unsigned long)subs, (unsigned long)unsubs, span_s,
+            argc - optind, argc - optind > 1 ? "s" : "");
+
+    harness_config_init(&cfg);
+    cfg.transport = prm.transport;
+    cfg.num_servers = prm.loopback ? 1 : 0;
+    cfg.num_clients = prm.subs + prm.lanes;
+    h = harness_start(&cfg);
+    if(h == NULL){
+        fprintf(stderr, "replay: could not start the clients\n");
+        return 1;
+    }
+    subscribers = calloc(prm.subs, sizeof(*subscribers));
+    lanes = calloc(prm.lanes, sizeof(*lanes));
+    if(subscribers == NULL || lanes == NULL)
+        return 1;
+    for(int i = 0; i < prm.subs; i++){
+        subscribers[i].client = harness_client(h, i);
+        messaging_hist_init(&subscribers[i].latency);
+    }
+
+    t0_ns = now_ns();
+    pthread_create(&sub_thread, NULL, subscription_thread, NULL);
+    for(int i = 0; i < prm.lanes; i++){
+        lanes[i].idx = i;
+        lanes[i].client = harness_client(h, prm.subs + i);
+        messaging_hist_init(&lanes[i].lag);
+        pthread_create(&lanes[i].thread, NULL, publish_thread, &lanes[i]);
+    }
+    pthread_join(sub_thread, NULL);
+    messaging_hist_init(&lag);
+    for(int i = 0; i < prm.lanes; i++){
+        pthread_join(lanes[i].thread, NULL);
+        sent += lanes[i].sent;
+        bytes += lanes[i].bytes;
+        errors += lanes[i].errors;
+        messaging_hist_merge(&lag, &lanes[i].lag);
+    }
+    end_ns = now_ns();
+    replay_s = (end_ns - t0_ns) / 1e9;
+
+    /* notifications trail the publishes, wait until they stop coming */
+    seen = total_received();
+    idle_since = now_ns();
+    while(now_ns() - idle_since < (uint64_t)prm.timeout * 1000000000ULL){
+        usleep(10000);
+        if(total_received() != seen){
+            seen = total_received();
+            idle_since = now_ns();
+        }
+    }
+    messaging_hist_init(&latency);
+    for(int i = 0; i < prm.subs; i++)
+        messaging_hist_merge(&latency, &subscribers[i].latency);
+
+    printf("replay      %gx: %lu publishes (%lu failed) in %.3f s, %.0f msgs/s, %.3f MB/s "
+            "(captured %.0f msgs/s)\n", prm.speed, (unsigned long)sent, (unsigned long)errors,
+            replay_s, sent / replay_s, bytes / replay_s / 1e6, span_s > 0 ? pubs / span_s : 0.0);
+    printf("schedule    lag p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            messaging_hist_quantile(&lag, 0.5) / 1e3, messaging_hist_quantile(&lag, 0.99) / 1e3,
+            lag.count ? lag.max / 1e3 : 0.0);
+    printf("delivery    %lu notifications, latency mean %.1f us, p50 %.1f us, p99 %.1f us, "
+            "p99.9 %.1f us, max %.1f us\n", (unsigned long)seen,
+            messaging_hist_mean(&latency) / 1e3, messaging_hist_quantile(&latency, 0.5) / 1e3,
+            messaging_hist_quantile(&latency, 0.99) / 1e3,
+            messaging_hist_quantile(&latency, 0.999) / 1e3, latency.count ? latency.max / 1e3 : 0.0);
+    if(prm.json){
+        FILE *f = strcmp(prm.json, "-") == 0 ? stdout : fopen(prm.json, "w");
+        if(f == NULL){
+            perror(prm.json);
+        }else{
+            write_json(f, pubs, subs, unsubs, span_s, sent, bytes, errors, replay_s, seen, &lag, &latency);
+            if(f != stdout)
+                fclose(f);
+        }
+    }
+
+    harness_stop(h);
+    return errors != 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Runs a real server against tens of thousands of simulated subscribers.
+ *
+ * The server and a publishing client run over the loopback harness; the
+ * server's notifications go through messaging-sim.h, where 'subs' virtual
+ * subscribers (sim://0 ...) cost a counter each and answer after a modelled
+ * network and handler delay.  Virtual subscriber s subscribes to 'fanin'
+ * topics starting at s % topics, with one batched subscribe RPC sent on its
+ * behalf, and the publisher goes round robin over the topics.  It reports
+ * subscribe rate and resident memory per subscription, delivery rate, the
+ * server's fan-out and notify round trip histograms, and checks that every
+ * virtual subscriber got what it subscribed to.
+ *
+ * Usage: ./scale_sim [-x transport] [-S subs] [-t topics] [-f fanin]
+ *                    [-n messages] [-s size] [-l latency ns] [-j jitter ns]
+ *                    [-b bandwidth MB/s] [-H handler ns] [-e failure rate]
+ *                    [-r server handler xstreams] [-T timeout s]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <messaging-sim.h>
+#include <ss_data.h>
+#include "harness.h"
+
+#define SUB_WINDOW  64      /* subscribe RPCs in flight */
+#define NAMESPACE   "sim"
+
+struct params {
+    const char *transport;
+    long subs;
+    int topics;
+    int fanin;
+    long count;
+    int size;
+    int rpc_xstreams;
+    int timeout;
+};
+
+static struct params prm = { "na+sm", 100000, 1000, 1, 1000, 1024, 4, 60 };
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long resident_bytes(void)
+{
+    long pages = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%ld %ld", &pages, &rss) != 2)
+        rss = 0;
+    fclose(f);
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+static void topic_name(char *buf, size_t len, int t)
+{
+    snprintf(buf, len, "t%d", t);
+}
+
+/* a batched subscribe from sim://s to its 'fanin' topics, as a client would send it */
+static int encode_subscribe(long s, event_meta *evnt)
+{
+    char addr[32], topic[16];
+    uint8_t recs[4096];
+    size_t len = 0, ext_off;
+    struct wire_msg m;
+    int alen;
+
+    for(int k = 0; k < prm.fanin; k++){
+        topic_name(topic, sizeof(topic), (int)((s + k) % prm.topics));
+        if(len + wire_topic_rec_size(sizeof(NAMESPACE), strlen(topic) + 1) > sizeof(recs))
+            return MESSAGING_ERR_SIZE;
+        len += wire_put_topic_rec(recs + len, NAMESPACE, sizeof(NAMESPACE), topic, strlen(topic) + 1);
+    }
+    alen = snprintf(addr, sizeof(addr), MESSAGING_SIM_PREFIX "%ld", s) + 1;
+
+    wire_msg_init(&m, "", "");
+    m.flags = WIRE_FLAG_BATCH;
+    m.payload = recs;
+    m.payload_len = len;
+    m.ext_len = wire_ext_size(alen);
+    evnt->size = wire_encoded_size(&m);
+    evnt->raw_data = messaging_pool_alloc(evnt->size);
+    if(evnt->raw_data == NULL)
+        return MESSAGING_ERR_ALLOCATION;
+    wire_encode(evnt->raw_data, evnt->size, &m);
+    ext_off = wire_ext_offset(&m);
+    wire_ext_put((char*)evnt->raw_data + ext_off, WIRE_EXT_ADDR, addr, alen);
+    return MESSAGING_SUCCESS;
+}
+
+static int finish_subscribe(hg_handle_t h, margo_request req, bulk_data_t *in)
+{
+    response_t out;
+    int ret = MESSAGING_ERR_MERCURY;
+
+    if(margo_wait(req) == HG_SUCCESS && margo_get_output(h, &out) == HG_SUCCESS){
+        ret = out.ret;
+        margo_free_output(h, &out);
+    }
+    margo_destroy(h);
+    messaging_pool_free(in->evnt.raw_data);
+    return ret;
+}
+
+/* subscribes every virtual subscriber, SUB_WINDOW RPCs at a time */
+static int subscribe_all(margo_instance_id mid, const char *server)
+{
+    hg_handle_t hs[SUB_WINDOW];
+    margo_request reqs[SUB_WINDOW];
+    bulk_data_t in[SUB_WINDOW];
+    hg_addr_t addr;
+    hg_bool_t flag;
+    hg_id_t id;
+    int ret = MESSAGING_SUCCESS, r;
+    long next = 0, done = 0;
+
+    /* the publisher's client registered the RPC on its instance */
+    margo_registered_name(mid, "subscribe_rpc", &id, &flag);
+    if(flag != HG_TRUE || margo_addr_lookup(mid, server, &addr) != HG_SUCCESS)
+        return MESSAGING_ERR_MERCURY;
+    while(done < next || (next < prm.subs && ret == MESSAGING_SUCCESS)){
+        if(next < prm.subs && ret == MESSAGING_SUCCESS && next - done < SUB_WINDOW){
+            int w = (int)(next % SUB_WINDOW);
+            ret = encode_subscribe(next, &in[w].evnt);
+            if(ret != MESSAGING_SUCCESS)
+                continue;
+            if(margo_create(mid, addr, id, &hs[w]) != HG_SUCCESS){
+                messaging_pool_free(in[w].evnt.raw_data);
+                ret = MESSAGING_ERR_MERCURY;
+                continue;
+            }
+            if(margo_iforward(hs[w], &in[w], &reqs[w]) != HG_SUCCESS){
+                margo_destroy(hs[w]);
+                messaging_pool_free(in[w].evnt.raw_data);
+                ret = MESSAGING_ERR_MERCURY;
+                continue;
+            }
+            next++;
+            continue;
+        }
+        r = finish_subscribe(hs[done % SUB_WINDOW], reqs[done % SUB_WINDOW], &in[done % SUB_WINDOW]);
+        if(r != MESSAGING_SUCCESS && ret == MESSAGING_SUCCESS){
+            fprintf(stderr, "Could not subscribe " MESSAGING_SIM_PREFIX "%ld (%d)\n", done, r);
+            ret = r;
+        }
+        done++;
+    }
+    margo_addr_free(mid, addr);
+    return ret;
+}
+
+/* messages the publisher sends to topic t, it sends message i to i % topics */
+static uint64_t messages_for_topic(int t)
+{
+    return t < prm.count ? (uint64_t)((prm.count - 1 - t) / prm.topics + 1) : 0;
+}
+
+static uint64_t expected_for(long s)
+{
+    uint64_t n = 0;
+
+    for(int k = 0; k < prm.fanin; k++)
+        n += messages_for_topic((int)((s + k) % prm.topics));
+    return n;
+}
+
+static void print_hist(const char *name, const struct messaging_hist *h, double scale, const char *unit)
+{
+    printf("  %-14s mean %10.1f  p50 %10.1f  p99 %10.1f  p99.9 %10.1f %s\n", name,
+            messaging_hist_mean(h) / scale,
+            messaging_hist_quantile(h, 0.5) / scale,
+            messaging_hist_quantile(h, 0.99) / scale,
+            messaging_hist_quantile(h, 0.999) / scale, unit);
+}
+
+int main(int argc, char **argv)
+{
+    struct messaging_sim_config scfg;
+    struct messaging_sim_stats sst;
+    struct harness_config hcfg;
+    struct messaging_server_stats *stats;
+    struct messaging_transport inner;
+    struct harness *h;
+    messaging_sim_t sim;
+    messaging_client_t pub;
+    char topic[16];
+    unsigned char *payload;
+    uint64_t expected = 0, bad = 0;
+    double t0, t1;
+    long rss0;
+    int opt, ret, failed = 0;
+
+    messaging_sim_config_init(&scfg);
+    while((opt = getopt(argc, argv, "x:S:t:f:n:s:l:j:b:H:e:r:T:")) != -1){
+        switch(opt){
+        case 'x': prm.transport = optarg; break;
+        case 'S': prm.subs = atol(optarg); break;
+        case 't': prm.topics = atoi(optarg); break;
+        case 'f': prm.fanin = atoi(optarg); break;
+        case 'n': prm.count = atol(optarg); break;
+        case 's': prm.size = atoi(optarg); break;
+        case 'l': scfg.latency_ns = strtoull(optarg, NULL, 10); break;
+        case 'j': scfg.jitter_ns = strtoull(optarg, NULL, 10); break;
+        case 'b': scfg.bandwidth = atof(optarg) * 1e6; break;
+        case 'H': scfg.handler_ns = strtoull(optarg, NULL, 10); break;
+        case 'e': scfg.failure_rate = atof(optarg); break;
+        case 'r': prm.rpc_xstreams = atoi(optarg); break;
+        case 'T': prm.timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-S subs] [-t topics] [-f fanin] [-n messages]\n"
+                    "    [-s size] [-l latency ns] [-j jitter ns] [-b bandwidth MB/s] [-H handler ns]\n"
+                    "    [-e failure rate] [-r server handler xstreams] [-T timeout s]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(prm.subs < 1 || prm.topics < 1 || prm.fanin < 1 || prm.fanin > prm.topics || prm.size < 1){
+        fprintf(stderr, "scale_sim: bad parameters\n");
+        return 2;
+    }
+    scfg.max_endpoints = (uint32_t)prm.subs;
+
+    harness_config_init(&hcfg);
+    hcfg.transport = prm.transport;
+    hcfg.server_rpc_xstreams = prm.rpc_xstreams;
+    h = harness_start(&hcfg);
+    if(h == NULL){
+        fprintf(stderr, "scale_sim: could not start the harness\n");
+        return 1;
+    }
+    pub = harness_client(h, 0);
+    messaging_transport_margo(harness_server_mid(h, 0), &inner);
+    if(messaging_sim_create(&inner, &scfg, &sim) != MESSAGING_SUCCESS ||
+            server_set_transport(harness_server(h, 0), messaging_sim_transport(sim)) != MESSAGING_SUCCESS){
+        fprintf(stderr, "scale_sim: could not set up the simulation\n");
+        harness_stop(h);
+        return 1;
+    }
+
+    /* subscribe */
+    rss0 = resident_bytes();
+    t0 = now_s();
+    ret = subscribe_all(harness_client_mid(h, 0), server_address(harness_server(h, 0)));
+    t1 = now_s();
+    if(ret != MESSAGING_SUCCESS){
+        fprintf(stderr, "scale_sim: subscribing failed (%d)\n", ret);
+        failed = 1;
+        goto fini;
+    }
+    printf("subscribe   %ld subscribers x %d topics: %.0f subscriptions/s, %.1f resident bytes/subscription\n",
+            prm.subs, prm.fanin, prm.subs * prm.fanin / (t1 - t0),
+            (double)(resident_bytes() - rss0) / (prm.subs * prm.fanin));
+
+    /* publish, each message fans out to subs * fanin / topics virtual subscribers */
+    payload = malloc(prm.size);
+    if(payload == NULL){
+        failed = 1;
+        goto fini;
+    }
+    memset(payload, 0x5a, prm.size);
+    for(long s = 0; s < prm.subs; s++)
+        expected += expected_for(s);
+    t0 = now_s();
+    for(long i = 0; i < prm.count; i++){
+        topic_name(topic, sizeof(topic), (int)(i % prm.topics));
+        if(publish(pub, NAMESPACE, topic, payload, prm.size) != MESSAGING_SUCCESS){
+            fprintf(stderr, "scale_sim: publish %ld failed\n", i);
+            failed = 1;
+            break;
+        }
+    }
+    free(payload);
+    /* the server answers before it fans out; wait for the notifications */
+    do{
+        messaging_sim_get_stats(sim, &sst);
+        if(sst.notifications >= expected)
+            break;
+        usleep(1000);
+    }while(now_s() - t0 < prm.timeout);
+    t1 = now_s();
+    printf("publish     %ld messages of %d bytes: %.0f messages/s, %.0f notifications/s\n",
+            prm.count, prm.size, prm.count / (t1 - t0), sst.notifications / (t1 - t0));
+    printf("network     %lu notifications, %lu failed, %.1f MB sent, link busy %.1f%%, "
+            "slowest reply %.1f us\n",
+            (unsigned long)sst.notifications, (unsigned long)sst.failures, sst.bytes / 1e6,
+            100.0 * sst.link_busy_ns / ((t1 - t0) * 1e9), sst.max_completion_ns / 1e3);
+    if(sst.notifications < expected){
+        fprintf(stderr, "scale_sim: %lu of %lu notifications sent before the timeout\n",
+                (unsigned long)sst.notifications, (unsigned long)expected);
+        failed = 1;
+    }
+
+    stats = (struct messaging_server_stats*)malloc(sizeof(*stats));
+    if(stats && messaging_get_server_stats(pub, 0, stats) == MESSAGING_SUCCESS){
+        printf("server      %lu topics, %lu subscribers, %.1f membership bytes/subscription\n",
+                (unsigned long)stats->topics, (unsigned long)stats->subscribers,
+                (double)stats->membership_bytes / (prm.subs * prm.fanin));
+        print_hist("fanout", &stats->fanout, 1, "");
+        print_hist("handler", &stats->handler_ns, 1e3, "us");
+        print_hist("notify rtt", &stats->notify_rtt_ns, 1e3, "us");
+    }
+    free(stats);
+
+    /* without failures every virtual subscriber got exactly its share */
+    if(!failed && scfg.failure_rate == 0){
+        for(long s = 0; s < prm.subs; s++)
+            if(messaging_sim_delivered(sim, (uint32_t)s) != expected_for(s))
+                bad++;
+        if(bad){
+            fprintf(stderr, "scale_sim: %lu virtual subscribers got the wrong number of messages\n",
+                    (unsigned long)bad);
+            failed = 1;
+        }
+    }
+
+fini:
+    harness_stop(h);
+    messaging_sim_destroy(sim);
+    return failed;
+}
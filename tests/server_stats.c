@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Prints the statistics of every server in the Prometheus text format.
+ *
+ * Connects as an ordinary client, so it finds the servers the same way
+ * (MESSAGING_BOOTSTRAP) and must use their transport.
+ *
+ * Usage: ./server_stats [transport]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <margo.h>
+#include <messaging-client.h>
+
+int main(int argc, char **argv)
+{
+    const char *transport = argc > 1 ? argv[1] : "na+sm";
+    struct messaging_server_stats *stats;
+    margo_instance_id mid;
+    messaging_client_t c;
+    char instance[16];
+    int ret = 0;
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 0, -1);
+    if(mid == MARGO_INSTANCE_NULL || client_init(mid, &c) != MESSAGING_SUCCESS){
+        fprintf(stderr, "Could not connect to the servers over %s\n", transport);
+        return 1;
+    }
+    stats = (struct messaging_server_stats*)malloc(sizeof(*stats));
+    for(int i = 0; stats && i < messaging_num_servers(c); i++){
+        ret = messaging_get_server_stats(c, i, stats);
+        if(ret != MESSAGING_SUCCESS){
+            fprintf(stderr, "Server %d: error %d\n", i, ret);
+            break;
+        }
+        snprintf(instance, sizeof(instance), "%d", i);
+        messaging_stats_write_prometheus(stdout, stats, instance);
+    }
+    free(stats);
+    client_finalize(c);
+    margo_finalize(mid);
+    return ret != MESSAGING_SUCCESS;
+}
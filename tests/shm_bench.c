@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * One-way latency and delivery rate from a publisher to subscribers on the
+ * same node.  Run it once with MESSAGING_SHM=0 and once with MESSAGING_SHM=1
+ * to compare the Margo path with shared memory delivery.
+ *
+ * Servers must already be running (see test_script.sh).  Rank 0 publishes,
+ * every other rank subscribes; all ranks are expected on one node, since the
+ * payload carries a CLOCK_MONOTONIC timestamp.
+ *
+ * Usage: MESSAGING_SHM=1 mpirun -n num_ranks ./shm_bench [transport] [count] [size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+#include <margo.h>
+#include <mpi.h>
+#include <messaging-client.h>
+
+#define WAIT_SECONDS 30
+
+static volatile long received;
+static double lat_sum, lat_max;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void handler(void *args, void *msg)
+{
+    uint64_t sent;
+    double lat;
+
+    memcpy(&sent, msg, sizeof(sent));
+    lat = (now_ns() - sent) * 1e-3;
+    lat_sum += lat;
+    if(lat > lat_max)
+        lat_max = lat;
+    received++;
+}
+
+int main(int argc, char **argv)
+{
+    char *transport = argc > 1 ? argv[1] : "verbs";
+    long count = argc > 2 ? atol(argv[2]) : 10000;
+    int size = argc > 3 ? atoi(argv[3]) : 64;
+    const char *shm = getenv("MESSAGING_SHM");
+    messaging_client_t c;
+    margo_instance_id mid;
+    int rank, nranks, ret;
+    double t = 0, t_max, lat[2], lat_all[2];
+    long got, got_all;
+    char *buf;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    if(nranks < 2){
+        fprintf(stderr, "shm_bench needs a publisher and at least one subscriber\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if(size < (int)sizeof(uint64_t))
+        size = sizeof(uint64_t);
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, -1);
+    assert(mid);
+    ret = client_init_with_mpi(mid, MPI_COMM_WORLD, &c);
+    if(ret != MESSAGING_SUCCESS || c == MESSAGING_CLIENT_NULL){
+        fprintf(stderr, "client_init_with_mpi failed (%d)\n", ret);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if(rank != 0)
+        subscribe(c, "shm_bench", "latency", handler, NULL);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(rank == 0){
+        buf = calloc(1, size);
+        t = MPI_Wtime();
+        for(long i = 0; i < count; i++){
+            uint64_t stamp = now_ns();
+            memcpy(buf, &stamp, sizeof(stamp));
+            publish(c, "shm_bench", "latency", buf, size);
+        }
+        t = MPI_Wtime() - t;
+        free(buf);
+    }else{
+        double start = MPI_Wtime();
+        while(received < count && MPI_Wtime() - start < WAIT_SECONDS)
+            margo_thread_sleep(mid, 1);
+        t = MPI_Wtime() - start;
+        if(received < count)
+            fprintf(stderr, "Rank %d: got %ld of %ld messages\n", rank, (long)received, count);
+    }
+
+    got = rank ? received : 0;
+    lat[0] = rank ? lat_sum : 0;
+    lat[1] = rank ? lat_max : 0;
+    MPI_Reduce(&got, &got_all, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&lat[0], &lat_all[0], 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&lat[1], &lat_all[1], 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if(rank == 0){
+        printf("shm=%s subscribers=%d messages=%ld size=%d\n", shm ? shm : "0", nranks - 1, count, size);
+        printf("publish rate   %12.0f msg/s\n", count / t);
+        printf("delivery rate  %12.0f msg/s\n", got_all / t_max);
+        printf("latency avg    %12.2f us\n", got_all ? lat_all[0] / got_all : 0.0);
+        printf("latency max    %12.2f us\n", lat_all[1]);
+    }
+
+    unsubscribe(c, "shm_bench", "latency");
+    client_finalize(c);
+    margo_finalize(mid);
+    MPI_Finalize();
+    return 0;
+}
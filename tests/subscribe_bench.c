@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Time to register many subscriptions, one subscribe() per topic against a
+ * single subscribe_many() call.
+ *
+ * Servers must already be running (see test_script.sh).  Every rank
+ * subscribes to its own set of topics and the slowest rank is reported.
+ *
+ * Usage: mpirun -n num_clients ./subscribe_bench [transport]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <margo.h>
+#include <mpi.h>
+#include <messaging-client.h>
+
+static const int counts[] = { 1, 10, 100, 1000 };
+#define NUM_COUNTS (sizeof(counts) / sizeof(counts[0]))
+
+static void handler(void *args, void *msg)
+{
+}
+
+int main(int argc, char **argv)
+{
+    char *transport = argc > 1 ? argv[1] : "verbs";
+    struct messaging_subscription *subs;
+    messaging_client_t c;
+    margo_instance_id mid;
+    int rank, ret, max = counts[NUM_COUNTS - 1];
+    double t, t_single, t_many;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    mid = margo_init(transport, MARGO_SERVER_MODE, 1, -1);
+    assert(mid);
+    ret = client_init_with_mpi(mid, MPI_COMM_WORLD, &c);
+    if(ret != MESSAGING_SUCCESS || c == MESSAGING_CLIENT_NULL){
+        fprintf(stderr, "client_init_with_mpi failed (%d)\n", ret);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    subs = calloc(max, sizeof(*subs));
+    for(int i = 0; i < max; i++){
+        subs[i].namesp = "subscribe_bench";
+        subs[i].topic = malloc(32);
+        snprintf(subs[i].topic, 32, "r%d_t%d", rank, i);
+        subs[i].callback = handler;
+    }
+
+    if(rank == 0)
+        printf("%8s %14s %14s\n", "topics", "single(ms)", "batched(ms)");
+    for(size_t k = 0; k < NUM_COUNTS; k++){
+        int n = counts[k];
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        t = MPI_Wtime();
+        for(int i = 0; i < n; i++)
+            subscribe(c, subs[i].namesp, subs[i].topic, handler, NULL);
+        t = MPI_Wtime() - t;
+        MPI_Reduce(&t, &t_single, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        unsubscribe_many(c, subs, n);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        t = MPI_Wtime();
+        ret = subscribe_many(c, subs, n);
+        t = MPI_Wtime() - t;
+        if(ret != MESSAGING_SUCCESS)
+            fprintf(stderr, "Rank %d: subscribe_many failed (%d)\n", rank, ret);
+        MPI_Reduce(&t, &t_many, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        unsubscribe_many(c, subs, n);
+
+        if(rank == 0)
+            printf("%8d %14.3f %14.3f\n", n, t_single * 1e3, t_many * 1e3);
+    }
+
+    for(int i = 0; i < max; i++)
+        free(subs[i].topic);
+    free(subs);
+    client_finalize(c);
+    margo_finalize(mid);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Server-side cost of client teardown.
+ *
+ * Fills a subscription table with num_topics topics spread over num_clients
+ * subscribers (every topic has one subscriber, some have more) and times
+ * map_unregister() for every client, which is what client_finalize_rpc does.
+ * Fails if anything is left in the table afterwards.
+ *
+ * Usage: teardown_bench [num_clients] [num_topics]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CppWrapper.h>
+#include "timer.h"
+
+#define EXTRA_SUBSCRIBERS 4
+
+int main(int argc, char **argv)
+{
+    long num_clients = argc > 1 ? atol(argv[1]) : 10000;
+    long num_topics = argc > 2 ? atol(argv[2]) : 1000000;
+    char addr[64], topic[64];
+    uint32_t *ids;
+    mtimer_t timer;
+    double t_fill, t_remove, t_max = 0;
+    WrapperMap *t;
+    size_t left;
+    long i, c;
+
+    if(num_clients <= 0 || num_topics <= 0){
+        fprintf(stderr, "Usage: %s [num_clients] [num_topics]\n", argv[0]);
+        return 1;
+    }
+
+    t = map_new();
+    ids = malloc(num_clients * sizeof(*ids));
+    timer_init(&timer, 0);
+    timer_start(&timer);
+    for(c = 0; c < num_clients; c++){
+        snprintf(addr, sizeof(addr), "client_%ld", c);
+        ids[c] = map_register(t, addr);
+    }
+    for(i = 0; i < num_topics; i++){
+        snprintf(topic, sizeof(topic), "topic_%ld", i);
+        map_subscribe(t, "bench", topic, ids[i % num_clients]);
+        /* a few popular topics everybody follows */
+        if(i < EXTRA_SUBSCRIBERS)
+            for(c = 0; c < num_clients; c++)
+                map_subscribe(t, "bench", topic, ids[c]);
+    }
+    t_fill = timer_read(&timer);
+
+    for(c = 0; c < num_clients; c++){
+        double t0 = timer_read(&timer), dt;
+        map_unregister(t, ids[c]);
+        dt = timer_read(&timer) - t0;
+        if(dt > t_max)
+            t_max = dt;
+    }
+    t_remove = timer_read(&timer) - t_fill;
+
+    printf("%ld clients, %ld topics: fill %.3f s, teardown %.3f s total, "
+            "%.2f us/client avg, %.2f us/client max\n", num_clients, num_topics,
+            t_fill, t_remove, t_remove / num_clients * 1e6, t_max * 1e6);
+
+    left = map_membership_bytes(t);
+    if(left != 0){
+        fprintf(stderr, "teardown_bench: %zu bytes of subscriptions left after teardown\n", left);
+        return 1;
+    }
+    free(ids);
+    map_delete(t);
+    return 0;
+}
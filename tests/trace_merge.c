@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Merges the per-process trace files written with MESSAGING_TRACE set into
+ * a per-hop latency breakdown.
+ *
+ * Processes on one host share a clock.  Across hosts, the offset between a
+ * publisher and its server comes from the publish round trip (publish call
+ * and answer on one side, handler start and route done on the other) and
+ * between a server and a subscriber from the notify round trip, NTP style,
+ * keeping for each pair the round trip with the least network time.  Every
+ * timestamp is then moved to the clock of the first server file.
+ *
+ * Usage: ./trace_merge messaging-trace.*.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <messaging-hist.h>
+#include <messaging-trace.h>
+
+struct span {
+    struct messaging_trace_span s;
+    int file;
+};
+
+struct clock_edge {
+    int64_t delay;     /* round trip minus the remote side's time, -1 if none */
+    int64_t offset;    /* clock of b minus clock of a */
+};
+
+enum { HOP_PUBLISH, HOP_SEND, HOP_LOOKUP, HOP_FANOUT, HOP_NETWORK, HOP_QUEUE,
+       HOP_CALLBACK, HOP_TOTAL, NUM_HOPS };
+
+static const char *hop_names[NUM_HOPS] = {
+    "publish call (publisher)",
+    "publisher -> server",
+    "server lookup",
+    "server fan-out issue",
+    "server -> subscriber",
+    "subscriber queue",
+    "callback",
+    "end to end",
+};
+
+static struct messaging_trace_header *hdrs;
+static struct span *spans;
+static size_t num_spans;
+static int num_files;
+static struct clock_edge *edges;   /* num_files x num_files */
+static int64_t *offset;            /* clock of file minus the reference clock */
+
+static int cmp_span(const void *a, const void *b)
+{
+    const struct messaging_trace_span *x = &((const struct span *)a)->s;
+    const struct messaging_trace_span *y = &((const struct span *)b)->s;
+
+    if (x->trace_id != y->trace_id)
+        return x->trace_id < y->trace_id ? -1 : 1;
+    if (x->event != y->event)
+        return x->event < y->event ? -1 : 1;
+    return (x->arg > y->arg) - (x->arg < y->arg);
+}
+
+static const struct span *find(uint64_t trace_id, uint32_t event, uint32_t arg)
+{
+    struct span key;
+
+    key.s.trace_id = trace_id;
+    key.s.event = event;
+    key.s.arg = arg;
+    return bsearch(&key, spans, num_spans, sizeof(*spans), cmp_span);
+}
+
+static int read_file(const char *path, int file)
+{
+    struct messaging_trace_span s;
+    FILE *f = fopen(path, "r");
+    size_t cap = num_spans;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&hdrs[file], sizeof(hdrs[file]), 1, f) != 1 ||
+            memcmp(hdrs[file].magic, MESSAGING_TRACE_MAGIC, 8) != 0 ||
+            hdrs[file].version != MESSAGING_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(f);
+        return -1;
+    }
+    hdrs[file].host[sizeof(hdrs[file].host) - 1] = '\0';
+    hdrs[file].addr[sizeof(hdrs[file].addr) - 1] = '\0';
+    while (fread(&s, sizeof(s), 1, f) == 1) {
+        if (num_spans == cap) {
+            cap = cap ? cap * 2 : 4096;
+            spans = realloc(spans, cap * sizeof(*spans));
+            if (spans == NULL) {
+                fclose(f);
+                return -1;
+            }
+        }
+        spans[num_spans].s = s;
+        spans[num_spans].file = file;
+        num_spans++;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* one round trip: a sends at t0 and hears back at t3, b receives at t1 and answers at t2 */
+static void clock_sample(int a, int b, uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+{
+    struct clock_edge *e = &edges[a * num_files + b];
+    int64_t delay = (int64_t)(t3 - t0) - (int64_t)(t2 - t1);
+    int64_t off = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2;
+
+    if (a == b || delay < 0)
+        return;
+    if (e->delay < 0 || delay < e->delay) {
+        e->delay = delay;
+        e->offset = off;
+    }
+}
+
+static void estimate_clocks(void)
+{
+    const struct span *p, *q, *r;
+    int *queue, head = 0, tail = 0, ref = -1;
+    int *done;
+
+    edges = malloc(sizeof(*edges) * num_files * num_files);
+    offset = calloc(num_files, sizeof(*offset));
+    queue = malloc(sizeof(*queue) * num_files);
+    done = calloc(num_files, sizeof(*done));
+    for (int i = 0; i < num_files * num_files; i++)
+        edges[i].delay = -1;
+
+    for (size_t i = 0; i < num_spans; i++) {
+        const struct span *sp = &spans[i];
+
+        if (sp->s.event == MESSAGING_TRACE_SERVER_RECV) {
+            if (ref < 0)
+                ref = sp->file;
+            p = find(sp->s.trace_id, MESSAGING_TRACE_PUBLISH, 0);
+            q = find(sp->s.trace_id, MESSAGING_TRACE_PUBLISH_DONE, 0);
+            r = find(sp->s.trace_id, MESSAGING_TRACE_ROUTE_DONE, 0);
+            if (p && q && r && p->file == q->file)
+                clock_sample(p->file, sp->file, p->s.ts, sp->s.ts, r->s.ts, q->s.ts);
+        } else if (sp->s.event == MESSAGING_TRACE_NOTIFY_SENT) {
+            p = find(sp->s.trace_id, MESSAGING_TRACE_NOTIFY_DONE, sp->s.arg);
+            q = find(sp->s.trace_id, MESSAGING_TRACE_SUB_RECV, sp->s.arg);
+            r = find(sp->s.trace_id, MESSAGING_TRACE_SUB_RESPOND, sp->s.arg);
+            if (p && q && r && q->file == r->file)
+                clock_sample(sp->file, q->file, sp->s.ts, q->s.ts, r->s.ts, p->s.ts);
+        }
+    }
+    /* a shared clock beats any estimate */
+    for (int a = 0; a < num_files; a++)
+        for (int b = 0; b < num_files; b++)
+            if (a != b && strcmp(hdrs[a].host, hdrs[b].host) == 0) {
+                edges[a * num_files + b].delay = 0;
+                edges[a * num_files + b].offset = 0;
+            }
+
+    if (ref < 0)
+        ref = 0;
+    queue[tail++] = ref;
+    done[ref] = 1;
+    while (head < tail) {
+        int a = queue[head++];
+        for (int b = 0; b < num_files; b++) {
+            if (done[b])
+                continue;
+            if (edges[a * num_files + b].delay >= 0)
+                offset[b] = offset[a] + edges[a * num_files + b].offset;
+            else if (edges[b * num_files + a].delay >= 0)
+                offset[b] = offset[a] - edges[b * num_files + a].offset;
+            else
+                continue;
+            done[b] = 1;
+            queue[tail++] = b;
+        }
+    }
+    printf("%-4s %-24s %-8s %14s  %s\n", "file", "host", "pid", "offset (us)", "address");
+    for (int i = 0; i < num_files; i++) {
+        if (done[i])
+            printf("%-4d %-24s %-8u %14.1f  %s\n", i, hdrs[i].host, hdrs[i].pid,
+                    offset[i] / 1000.0, hdrs[i].addr);
+        else
+            printf("%-4d %-24s %-8u %14s  %s\n", i, hdrs[i].host, hdrs[i].pid,
+                    "unknown", hdrs[i].addr);
+    }
+    printf("\n");
+    free(queue);
+    free(done);
+}
+
+static uint64_t at(const struct span *sp)
+{
+    return sp->s.ts - offset[sp->file];
+}
+
+static void hop(struct messaging_hist *h, uint64_t *negative, const struct span *from,
+        const struct span *to)
+{
+    int64_t d;
+
+    if (from == NULL || to == NULL)
+        return;
+    d = (int64_t)(at(to) - at(from));
+    if (d < 0) {
+        (*negative)++;
+        d = 0;
+    }
+    messaging_hist_record(h, (uint64_t)d);
+}
+
+int main(int argc, char **argv)
+{
+    static struct messaging_hist hops[NUM_HOPS];
+    uint64_t negative[NUM_HOPS] = {0};
+    size_t traces = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace_file...\n", argv[0]);
+        return 1;
+    }
+    num_files = argc - 1;
+    hdrs = calloc(num_files, sizeof(*hdrs));
+    for (int i = 0; i < num_files; i++)
+        if (read_file(argv[i + 1], i) != 0)
+            return 1;
+    qsort(spans, num_spans, sizeof(*spans), cmp_span);
+    estimate_clocks();
+
+    for (int i = 0; i < NUM_HOPS; i++)
+        messaging_hist_init(&hops[i]);
+    for (size_t i = 0; i < num_spans; i++) {
+        const struct span *sp = &spans[i], *pub, *recv, *route;
+        uint64_t id = sp->s.trace_id;
+
+        if (sp->s.event == MESSAGING_TRACE_PUBLISH) {
+            traces++;
+            hop(&hops[HOP_PUBLISH], &negative[HOP_PUBLISH], sp,
+                    find(id, MESSAGING_TRACE_PUBLISH_DONE, 0));
+            hop(&hops[HOP_SEND], &negative[HOP_SEND], sp,
+                    find(id, MESSAGING_TRACE_SERVER_RECV, 0));
+        } else if (sp->s.event == MESSAGING_TRACE_SERVER_RECV) {
+            hop(&hops[HOP_LOOKUP], &negative[HOP_LOOKUP], sp,
+                    find(id, MESSAGING_TRACE_ROUTE_DONE, 0));
+        } else if (sp->s.event == MESSAGING_TRACE_NOTIFY_SENT) {
+            route = find(id, MESSAGING_TRACE_ROUTE_DONE, 0);
+            recv = find(id, MESSAGING_TRACE_SUB_RECV, sp->s.arg);
+            hop(&hops[HOP_FANOUT], &negative[HOP_FANOUT], route, sp);
+            hop(&hops[HOP_NETWORK], &negative[HOP_NETWORK], sp, recv);
+        } else if (sp->s.event == MESSAGING_TRACE_CALLBACK_START) {
+            hop(&hops[HOP_QUEUE], &negative[HOP_QUEUE],
+                    find(id, MESSAGING_TRACE_SUB_RECV, sp->s.arg), sp);
+            hop(&hops[HOP_CALLBACK], &negative[HOP_CALLBACK], sp,
+                    find(id, MESSAGING_TRACE_CALLBACK_END, sp->s.arg));
+        } else if (sp->s.event == MESSAGING_TRACE_CALLBACK_END) {
+            pub = find(id, MESSAGING_TRACE_PUBLISH, 0);
+            hop(&hops[HOP_TOTAL], &negative[HOP_TOTAL], pub, sp);
+        }
+    }
+
+    printf("%zu spans, %zu traced publishes, times in us\n", num_spans, traces);
+    printf("%-28s %10s %10s %10s %10s %10s %10s %8s\n",
+            "hop", "count", "mean", "p50", "p90", "p99", "max", "clamped");
+    for (int i = 0; i < NUM_HOPS; i++) {
+        const struct messaging_hist *h = &hops[i];
+        printf("%-28s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %8llu\n", hop_names[i],
+                (unsigned long long)h->count, messaging_hist_mean(h) / 1000.0,
+                messaging_hist_quantile(h, 0.5) / 1000.0,
+                messaging_hist_quantile(h, 0.9) / 1000.0,
+                messaging_hist_quantile(h, 0.99) / 1000.0,
+                h->count ? h->max / 1000.0 : 0.0, (unsigned long long)negative[i]);
+    }
+    free(spans);
+    free(hdrs);
+    free(edges);
+    free(offset);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+
+/*
+ * Round trip through the typed C++ layer over the loopback harness: one
+ * client publishes a struct to a Topic<T>, another receives it as a const
+ * reference, and every field has to arrive intact.  After the subscription
+ * is released nothing more may be delivered.
+ *
+ * Usage: ./typed_test [-x transport] [-s servers] [-n messages] [-T timeout ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <messaging.hpp>
+#include "harness.h"
+
+struct particle {
+    double pos[3];
+    double vel[3];
+    uint32_t id;
+    uint32_t step;
+};
+
+static constexpr messaging::Topic<particle> particles("harness", "particles");
+
+static particle make(uint32_t i)
+{
+    particle p;
+
+    for(int k = 0; k < 3; k++){
+        p.pos[k] = i * 0.5 + k;
+        p.vel[k] = -(double)i - k;
+    }
+    p.id = i;
+    p.step = i * 7;
+    return p;
+}
+
+static bool same(const particle &a, const particle &b)
+{
+    for(int k = 0; k < 3; k++)
+        if(a.pos[k] != b.pos[k] || a.vel[k] != b.vel[k])
+            return false;
+    return a.id == b.id && a.step == b.step;
+}
+
+int main(int argc, char **argv)
+{
+    struct harness_config cfg;
+    struct harness *h;
+    uint64_t received = 0, corrupt = 0;
+    int n = 1000, timeout = 10000, opt, failed = 0;
+
+    harness_config_init(&cfg);
+    cfg.num_clients = 2;
+    while((opt = getopt(argc, argv, "x:s:n:T:")) != -1){
+        switch(opt){
+        case 'x': cfg.transport = optarg; break;
+        case 's': cfg.num_servers = atoi(optarg); break;
+        case 'n': n = atoi(optarg); break;
+        case 'T': timeout = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-x transport] [-s servers] [-n messages] [-T timeout ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    h = harness_start(&cfg);
+    if(h == NULL){
+        fprintf(stderr, "typed_test: could not start the harness\n");
+        return 1;
+    }
+
+    {
+        messaging::subscription sub;
+        messaging::publisher<particle> pub(harness_client(h, 0), particles);
+
+        if(messaging::subscribe(harness_client(h, 1), particles, [&](const particle &p){
+                    if(!same(p, make(p.id)))
+                        __atomic_fetch_add(&corrupt, 1, __ATOMIC_RELAXED);
+                    __atomic_fetch_add(&received, 1, __ATOMIC_RELEASE);
+                }, sub) != MESSAGING_SUCCESS){
+            fprintf(stderr, "typed_test: subscribe failed\n");
+            failed = 1;
+        }
+        for(int i = 0; !failed && i < n; i++){
+            if(pub.publish(make(i)) != MESSAGING_SUCCESS){
+                fprintf(stderr, "typed_test: publish %d failed\n", i);
+                failed = 1;
+            }
+        }
+        if(!failed && harness_wait_for(&received, n, timeout) != 0){
+            fprintf(stderr, "typed_test: received %lu of %d messages\n", (unsigned long)received, n);
+            failed = 1;
+        }
+        if(sub.reset() != MESSAGING_SUCCESS){
+            fprintf(stderr, "typed_test: unsubscribe failed\n");
+            failed = 1;
+        }
+        for(int i = 0; !failed && i < 10; i++)
+            pub.publish(make(i));
+    }
+    /* give anything delivered after the unsubscribe time to show up */
+    usleep(100000);
+    if(!failed && __atomic_load_n(&received, __ATOMIC_ACQUIRE) != (uint64_t)n){
+        fprintf(stderr, "typed_test: %lu messages after unsubscribing\n",
+                (unsigned long)(received - n));
+        failed = 1;
+    }
+    if(corrupt){
+        fprintf(stderr, "typed_test: %lu corrupt messages\n", (unsigned long)corrupt);
+        failed = 1;
+    }
+
+    harness_stop(h);
+    printf("typed_test: %s (%d messages of %zu bytes)\n", failed ? "FAILED" : "passed",
+            n, sizeof(particle));
+    return failed;
+}
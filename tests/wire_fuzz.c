@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2020, Rutgers Discovery Informatics Institute, Rutgers University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice, this list of conditions and
+ * the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ * the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * - Neither the name of the NSF Cloud and Autonomic Computing Center, Rutgers University, nor the names of its
+ * contributors may be used to endorse or promote products derived from this software without specific prior
+ * written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ *  Pradeep Subedi (2020)  RDI2 Rutgers University
+ *  pradeep.subedi@rutgers.edu
+ */
+
+/*
+ * Fuzz test for the wire format parser.
+ *
+ * Encodes random well formed messages and checks that they round trip, then
+ * feeds wire_decode() truncated, bit flipped and random buffers and checks
+ * that every accepted message describes memory inside the buffer.
+ *
+ * Built with -DMESSAGING_LIBFUZZER this file instead provides a libFuzzer
+ * entry point.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <messaging-wire.h>
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void rnd_string(char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        s[i] = 'a' + rnd() % 26;
+    s[len] = '\0';
+}
+
+/* checks that an accepted message lies within buf and walks its extensions */
+static int check_view(const uint8_t *buf, size_t size, const struct wire_msg *m)
+{
+    const uint8_t *end = buf + size;
+    const void *data;
+    size_t len;
+    uint32_t id;
+
+    if ((const uint8_t *)m->namesp < buf || (const uint8_t *)m->namesp + m->namesp_len > end)
+        return -1;
+    if ((const uint8_t *)m->topic < buf || (const uint8_t *)m->topic + m->topic_len > end)
+        return -1;
+    if ((const uint8_t *)m->ext < buf || (const uint8_t *)m->ext + m->ext_len > end)
+        return -1;
+    if (m->flags & WIRE_FLAG_BULK) {
+        if (m->payload != NULL)
+            return -1;
+    } else {
+        if ((const uint8_t *)m->payload < buf || (const uint8_t *)m->payload + m->payload_len > end)
+            return -1;
+        if (((const uint8_t *)m->payload - buf) % WIRE_ALIGN != 0)
+            return -1;
+    }
+    if (strlen(m->namesp) + 1 != m->namesp_len || strlen(m->topic) + 1 != m->topic_len)
+        return -1;
+    for (int t = 0; t < 256; t++) {
+        if (wire_ext_find(m, (uint8_t)t, &data, &len) &&
+            ((const uint8_t *)data < buf || (const uint8_t *)data + len > end))
+            return -1;
+    }
+    wire_ext_string(m, WIRE_EXT_ADDR);
+    if (wire_ext_u32(m, WIRE_EXT_SUBID, &id) && !wire_ext_find(m, WIRE_EXT_SUBID, &data, &len))
+        return -1;
+    if (m->payload != NULL) {
+        const uint8_t *p = (const uint8_t *)m->payload;
+        const uint8_t *pend = p + m->payload_len;
+        const char *ns, *topic;
+        size_t n;
+        while (p < pend && (n = wire_get_topic_rec(p, pend, &ns, &topic)) != 0) {
+            if ((const uint8_t *)ns < p || (const uint8_t *)topic + strlen(topic) >= pend)
+                return -1;
+            p += n;
+        }
+    }
+    return 0;
+}
+
+static int decode_and_check(const uint8_t *data, size_t size)
+{
+    struct wire_msg m;
+    uint8_t *buf = malloc(size ? size : 1);
+    int ret = 0;
+
+    memcpy(buf, data, size);
+    if (wire_decode(buf, size, &m) == MESSAGING_SUCCESS)
+        ret = check_view(buf, size, &m);
+    free(buf);
+    return ret;
+}
+
+#ifdef MESSAGING_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (decode_and_check(data, size) != 0)
+        abort();
+    return 0;
+}
+
+#else
+
+static uint8_t *random_message(size_t *size, struct wire_msg *m,
+        char *namesp, char *topic, uint8_t *ext, uint8_t *payload)
+{
+    uint8_t *buf;
+    size_t ext_len = 0;
+
+    rnd_string(namesp, rnd() % 40);
+    rnd_string(topic, rnd() % 200);
+    wire_msg_init(m, namesp, topic);
+    m->flags = (uint8_t)rnd();
+    m->seq = rnd();
+
+    /* a few extension records, one of them the address */
+    int nrec = rnd() % 4;
+    for (int i = 0; i < nrec; i++) {
+        uint8_t val[300];
+        size_t len = rnd() % sizeof(val);
+        for (size_t j = 0; j < len; j++)
+            val[j] = (uint8_t)rnd();
+        if (i == 0) {
+            rnd_string((char *)val, len ? len - 1 : 0);
+            len = strlen((char *)val) + 1;
+        }
+        ext_len += wire_ext_put(ext + ext_len, i == 0 ? WIRE_EXT_ADDR : (uint8_t)(2 + rnd() % 200), val, len);
+    }
+    m->ext = ext;
+    m->ext_len = ext_len;
+
+    m->payload_len = rnd() % 3 == 0 ? 0 : rnd() % 5000;
+    for (size_t j = 0; j < m->payload_len; j++)
+        payload[j] = (uint8_t)rnd();
+    m->payload = payload;
+
+    *size = wire_encoded_size(m);
+    if (posix_memalign((void **)&buf, WIRE_ALIGN, *size ? *size : 1) != 0)
+        return NULL;
+    if (wire_encode(buf, *size, m) != *size) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static int roundtrip(void)
+{
+    char namesp[64], topic[256];
+    uint8_t ext[2048], payload[5000];
+    struct wire_msg m, d;
+    size_t size;
+    uint8_t *buf = random_message(&size, &m, namesp, topic, ext, payload);
+
+    if (buf == NULL)
+        return -1;
+    if (wire_decode(buf, size, &d) != MESSAGING_SUCCESS ||
+        strcmp(d.namesp, namesp) != 0 || strcmp(d.topic, topic) != 0 ||
+        d.flags != m.flags || d.seq != m.seq || d.timestamp != m.timestamp ||
+        d.topic_hash != wire_topic_hash(namesp, topic) ||
+        d.ext_len != m.ext_len || memcmp(d.ext, ext, m.ext_len) != 0 ||
+        d.payload_len != m.payload_len ||
+        (!(m.flags & WIRE_FLAG_BULK) && (memcmp(d.payload, payload, m.payload_len) != 0 ||
+                                        ((uintptr_t)d.payload % WIRE_ALIGN) != 0)) ||
+        check_view(buf, size, &d) != 0) {
+        free(buf);
+        return -1;
+    }
+
+    /* a valid message must not be accepted once truncated or extended */
+    if (size > 0 && wire_decode(buf, size - 1 - rnd() % size, &d) == MESSAGING_SUCCESS &&
+        check_view(buf, size, &d) != 0) {
+        free(buf);
+        return -1;
+    }
+
+    /* mutate a few bytes anywhere in the message */
+    int nflip = 1 + rnd() % 4;
+    for (int i = 0; i < nflip; i++)
+        buf[rnd() % size] ^= (uint8_t)(1 + rnd() % 255);
+    if (decode_and_check(buf, size - rnd() % (size + 1)) != 0) {
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return 0;
+}
+
+static int batch_roundtrip(void)
+{
+    uint8_t buf[8192];
+    char names[32][64], topics[32][64];
+    int nrec = rnd() % 32;
+    size_t len = 0;
+    const uint8_t *p = buf;
+
+    for (int i = 0; i < nrec; i++) {
+        rnd_string(names[i], rnd() % 60);
+        rnd_string(topics[i], rnd() % 60);
+        len += wire_put_topic_rec(buf + len, names[i], strlen(names[i]) + 1,
+                topics[i], strlen(topics[i]) + 1);
+    }
+    for (int i = 0; i < nrec; i++) {
+        const char *ns, *topic;
+        size_t n = wire_get_topic_rec(p, buf + len, &ns, &topic);
+        if (n == 0 || strcmp(ns, names[i]) != 0 || strcmp(topic, topics[i]) != 0)
+            return -1;
+        p += n;
+    }
+    return p == buf + len ? 0 : -1;
+}
+
+static int garbage(void)
+{
+    uint8_t buf[512];
+    size_t size = rnd() % sizeof(buf);
+
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (uint8_t)rnd();
+    /* make it past the magic check half of the time */
+    if (size >= WIRE_FIXED_SIZE && rnd() % 2) {
+        wire_put_u16(buf, WIRE_MAGIC);
+        buf[2] = WIRE_VERSION;
+        for (size_t i = WIRE_FIXED_SIZE; i < size && i < WIRE_FIXED_SIZE + 4; i++)
+            buf[i] = (uint8_t)(rnd() % 64);
+    }
+    return decode_and_check(buf, size);
+}
+
+int main(int argc, char **argv)
+{
+    long iters = 100000;
+    if (argc > 1)
+        iters = atol(argv[1]);
+    if (argc > 2)
+        rng_state = strtoull(argv[2], NULL, 10) | 1;
+
+    for (long i = 0; i < iters; i++) {
+        if (roundtrip() != 0) {
+            fprintf(stderr, "wire_fuzz: round trip failed at iteration %ld\n", i);
+            return 1;
+        }
+        if (batch_roundtrip() != 0) {
+            fprintf(stderr, "wire_fuzz: batch round trip failed at iteration %ld\n", i);
+            return 1;
+        }
+        if (garbage() != 0) {
+            fprintf(stderr, "wire_fuzz: bad view accepted at iteration %ld\n", i);
+            return 1;
+        }
+    }
+    fprintf(stdout, "wire_fuzz: %ld iterations passed\n", iters);
+    return 0;
+}
+
+#endif